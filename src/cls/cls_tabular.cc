@@ -17,6 +17,13 @@
 #include <sstream>
 #include <boost/lexical_cast.hpp>
 #include <time.h>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 #include "re2/re2.h"
 #include "include/types.h"
 #include "objclass/objclass.h"
@@ -33,7 +40,10 @@ cls_method_handle_t h_wasm_query_op;
 cls_method_handle_t h_exec_runstats_op;
 cls_method_handle_t h_build_index;
 cls_method_handle_t h_exec_build_sky_index_op;
+cls_method_handle_t h_exec_append_op;
 cls_method_handle_t h_transform_db_op;
+cls_method_handle_t h_exec_compact_op;
+cls_method_handle_t h_exec_compact_index_op;
 cls_method_handle_t h_freelockobj_query_op;
 cls_method_handle_t h_inittable_group_obj_query_op;
 cls_method_handle_t h_getlockobj_query_op;
@@ -61,6 +71,34 @@ static inline uint64_t getns()
   return __getns(CLOCK_MONOTONIC);
 }
 
+// omap entries read by the query op running on this thread, reported in
+// its cls_info.  The index and zone map lookups of a query read the omap
+// via the sky_map_get_* wrappers below, which count the entries read.
+static thread_local uint64_t omap_keys_read = 0;
+
+static int sky_map_get_val(cls_method_context_t hctx, const std::string& key,
+                           bufferlist *bl)
+{
+  int ret = cls_cxx_map_get_val(hctx, key, bl);
+  if (ret >= 0)
+    omap_keys_read++;
+  return ret;
+}
+
+static int sky_map_get_vals(cls_method_context_t hctx,
+                            const std::string& start_after,
+                            const std::string& filter_prefix,
+                            uint64_t max_to_get,
+                            std::map<std::string, bufferlist> *vals,
+                            bool *more)
+{
+  int ret = cls_cxx_map_get_vals(hctx, start_after, filter_prefix,
+                                 max_to_get, vals, more);
+  if (ret >= 0)
+    omap_keys_read += vals->size();
+  return ret;
+}
+
 // extract bytes as string for regex matching
 static std::string string_ncopy(const char* buffer, std::size_t buffer_size) {
   const char* copyupto = std::find(buffer, buffer + buffer_size, 0);
@@ -108,279 +146,590 @@ int set_fb_seq_num(cls_method_context_t hctx, unsigned int fb_seq_num) {
     return 0;
 }
 
-/*
- * Build a skyhook index, insert to omap.
- * Index types are
- * 1. fb_index: points (physically within the object) to the fb
- *    <string fb_num, struct idx_fb_entry>
- *    where fb_num is a sequence number of flatbufs within an obj
- *
- * 2. rec_index: points (logically within the fb) to the relevant row
- *    <string rec-val, struct idx_rec_entry>
- *    where rec-val is the col data value(s) or RID
- *
- */
+// xattr name of the progress of an index, from its type name and cols
 static
-int exec_build_sky_index_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+std::string
+idx_progress_xattr(std::string idx_name,
+                   const Tables::schema_vec& idx_schema = Tables::schema_vec())
 {
-    // iterate over all fbs within an obj and create 2 indexes:
-    // 1. for each fb, create idx_fb_entry (physical fb offset)
-    // 2. for each row of an fb, create idx_rec_entry (logical row offset)
+    std::string name = "idx_progress" + Tables::IDX_KEY_DELIM_OUTER + idx_name;
+    for (auto it = idx_schema.begin(); it != idx_schema.end(); ++it)
+        name += Tables::IDX_KEY_DELIM_INNER + it->name;
+    return name;
+}
 
-    // a ceph property encoding the len of each bl in front of the bl,
-    // seems to be an int32 currently.
-    const int ceph_bl_encoding_len = sizeof(int32_t);
+// Get the progress of an index from xattr, if not present the index has
+// not been built and progress is set to the start of the object.
+static
+int get_idx_progress(cls_method_context_t hctx, std::string name,
+                     struct idx_progress& progress, bool* found) {
 
-    // fb_seq_num is stored in xattrs and used as a stable counter of the
-    // current number of fbs in the object.
-    unsigned int fb_seq_num = Tables::DATASTRUCT_SEQ_NUM_MIN;
-    int ret = get_fb_seq_num(hctx, fb_seq_num);
-    if (ret < 0) {
-        CLS_ERR("ERROR: exec_build_sky_index_op: fb_seq_num entry from xattr %d", ret);
+    progress = idx_progress(0, Tables::DATASTRUCT_SEQ_NUM_MIN);
+    *found = false;
+    bufferlist bl;
+    int ret = cls_cxx_getxattr(hctx, name.c_str(), &bl);
+    if (ret == -ENOENT || ret == -ENODATA)
+        return 0;
+    if (ret < 0)
         return ret;
-    }
-
-    std::string key_fb_prefix;
-    std::string key_data_prefix;
-    std::string key_data;
-    std::string key;
-    std::map<std::string, bufferlist> fbs_index;
-    std::map<std::string, bufferlist> recs_index;
-    std::map<std::string, bufferlist> rids_index;
-    std::map<std::string, bufferlist> txt_index;
-
-    // extract the index op instructions from the input bl
-    idx_op op;
     try {
-        bufferlist::const_iterator it = in->begin();
+        bufferlist::const_iterator it = bl.begin();
         using ceph::decode;
-        decode(op, it);
+        decode(progress, it);
     } catch (const buffer::error &err) {
-        CLS_ERR("ERROR: exec_build_sky_index_op decoding idx_op");
+        CLS_ERR("ERROR: cls_tabular:get_idx_progress: decoding %s",
+                name.c_str());
         return -EINVAL;
     }
-    Tables::schema_vec idx_schema = Tables::schemaFromString(op.idx_schema_str);
+    *found = true;
+    return 0;
+}
 
-    // obj contains one bl that itself wraps a seq of encoded bls of skyhook fb
-    bufferlist wrapped_bls;
-    ret = cls_cxx_read(hctx, 0, 0, &wrapped_bls);
-    if (ret < 0) {
-        CLS_ERR("ERROR: exec_build_sky_index_op: reading obj. %d", ret);
-        return ret;
-    }
+// Insert the progress of an index to xattr
+static
+int set_idx_progress(cls_method_context_t hctx, std::string name,
+                     const struct idx_progress& progress) {
 
-    // decode and process each wrapped bl (each bl contains 1 flatbuf)
-    uint64_t off = 0;
-    ceph::bufferlist::const_iterator it = wrapped_bls.begin();
-    uint64_t obj_len = it.get_remaining();
-    while (it.get_remaining() > 0) {
-        off = obj_len - it.get_remaining();
-        ceph::bufferlist bl;
-        try {
-            using ceph::decode;
-            decode(bl, it);  // unpack the next bl
-        } catch (ceph::buffer::error&) {
-            assert(Tables::BuildSkyIndexDecodeBlsErr==0);
-        }
+    bufferlist bl;
+    using ceph::encode;
+    encode(progress, bl);
+    return cls_cxx_setxattr(hctx, name.c_str(), &bl);
+}
 
-        const char* fb = bl.c_str();   // get fb as contiguous bytes
-        int fb_len = bl.length();
-        Tables::sky_root root = Tables::getSkyRoot(fb, fb_len);
+// a data content index (IDX_RID/IDX_REC/IDX_TXT) being built over the fbs
+// of an object after progress, its entries are written to omap in batches.
+struct content_index {
+    idx_op op;
+    Tables::schema_vec idx_schema;
+    std::string progress_name;
+    struct idx_progress progress;  // fbs before progress.off already indexed
+    std::string key_data_prefix;
+    std::map<std::string, bufferlist> recs_index;
+    std::map<std::string, Tables::txt_postings_vec> txt_postings;  // per word
 
-        // DATA LOCATION INDEX (PHYSICAL data reference):
+    content_index(const idx_op& _op) :
+        op(_op),
+        idx_schema(Tables::schemaFromString(_op.idx_schema_str)) {}
+};
 
-        // IDX_FB get the key prefix and key_data (fb sequence num)
-        ++fb_seq_num;
-        key_fb_prefix = buildKeyPrefix(Tables::SIT_IDX_FB, root.db_schema_name,
-                                       root.table_name);
-        std::string str_seq_num = Tables::u64tostr(fb_seq_num); // key data
-        int len = str_seq_num.length();
-
-        // create string of len min chars per type, int32 here
-        int pos = len - 10;
-        key_data = str_seq_num.substr(pos, len);
-
-        // IDX_FB create the entry struct, encode into bufferlist
-        bufferlist fb_bl;
-        struct idx_fb_entry fb_ent(off, fb_len + ceph_bl_encoding_len);
-        using ceph::encode;
-        encode(fb_ent, fb_bl);
-        key = key_fb_prefix + key_data;
-        fbs_index[key] = fb_bl;
+/*
+ * Add the entries of each row of an fb to a data content index, only
+ * flatbuf rows are supported for data content indexes.
+ */
+static
+int
+index_fb_rows(
+    cls_method_context_t hctx,
+    content_index& ci,
+    Tables::sky_meta& meta,
+    Tables::sky_root& root,
+    uint32_t fb_seq_num)
+{
+    const idx_op& op = ci.op;
+    const Tables::schema_vec& idx_schema = ci.idx_schema;
+    std::string key_data;
+    std::string key;
+    int ret = 0;
 
-        // DATA CONTENT INDEXES (LOGICAL data reference):
-        // Build the key prefixes for each index type (IDX_RID/IDX_REC/IDX_TXT)
-        if (op.idx_type == Tables::SIT_IDX_RID) {
-            std::vector<std::string> index_cols;
-            index_cols.push_back(Tables::RID_INDEX);
-            key_data_prefix = buildKeyPrefix(Tables::SIT_IDX_RID,
-                                             root.db_schema_name,
-                                             root.table_name,
-                                             index_cols);
-        }
-        if (op.idx_type == Tables::SIT_IDX_REC or
-            op.idx_type == Tables::SIT_IDX_TXT) {
+    // Build the key prefixes for each index type (IDX_RID/IDX_REC/IDX_TXT)
+    if (op.idx_type == Tables::SIT_IDX_RID) {
+        std::vector<std::string> index_cols;
+        index_cols.push_back(Tables::RID_INDEX);
+        ci.key_data_prefix = buildKeyPrefix(Tables::SIT_IDX_RID,
+                                            root.db_schema_name,
+                                            root.table_name,
+                                            index_cols);
+    }
+    if (op.idx_type == Tables::SIT_IDX_REC or
+        op.idx_type == Tables::SIT_IDX_TXT) {
 
-            std::vector<std::string> keycols;
-            for (auto it = idx_schema.begin(); it != idx_schema.end(); ++it) {
-                keycols.push_back(it->name);
-            }
-            key_data_prefix = Tables::buildKeyPrefix(op.idx_type,
-                                                     root.db_schema_name,
-                                                     root.table_name,
-                                                     keycols);
+        std::vector<std::string> keycols;
+        for (auto it = idx_schema.begin(); it != idx_schema.end(); ++it) {
+            keycols.push_back(it->name);
         }
+        ci.key_data_prefix = Tables::buildKeyPrefix(op.idx_type,
+                                                    root.db_schema_name,
+                                                    root.table_name,
+                                                    keycols);
+    }
 
-        // IDX_REC/IDX_RID/IDX_TXT: create the key data for each row
-        for (uint32_t i = 0; i < root.nrows; i++) {
-
-            Tables::sky_rec rec = Tables::getSkyRec(static_cast<Tables::row_offs>(root.data_vec)->Get(i));
+    // IDX_REC/IDX_RID/IDX_TXT: create the key data for each row
+    uint32_t nrows_indexed = 0;
+    if (meta.blob_format == SFT_FLATBUF_FLEX_ROW)
+        nrows_indexed = root.nrows;
+    for (uint32_t i = 0; i < nrows_indexed; i++) {
 
-            switch (op.idx_type) {
+        Tables::sky_rec rec = Tables::getSkyRec(static_cast<Tables::row_offs>(root.data_vec)->Get(i));
 
-                case Tables::SIT_IDX_RID: {
+        switch (op.idx_type) {
 
-                    // key_data is just the RID val
-                    key_data = Tables::u64tostr(rec.RID);
+            case Tables::SIT_IDX_RID: {
 
-                    // create the entry, encode into bufferlist, update map
-                    bufferlist rec_bl;
-                    struct idx_rec_entry rec_ent(fb_seq_num, i, rec.RID);
-                    using ceph::encode;
-                    encode(rec_ent, rec_bl);
-                    key = key_data_prefix + key_data;
-                    recs_index[key] = rec_bl;
-                    break;
-                }
-                case Tables::SIT_IDX_REC: {
+                // key_data is just the RID val
+                key_data = Tables::u64tostr(rec.RID);
 
-                    // key data is built up from the relevant col vals
-                    key_data.clear();
+                // create the entry, encode into bufferlist, update map
+                bufferlist rec_bl;
+                struct idx_rec_entry rec_ent(fb_seq_num, i, rec.RID);
+                using ceph::encode;
+                encode(rec_ent, rec_bl);
+                key = ci.key_data_prefix + key_data;
+                ci.recs_index[key] = rec_bl;
+                break;
+            }
+            case Tables::SIT_IDX_REC: {
 
-                    auto row = rec.data.AsVector();
-                    for (unsigned i = 0; i < idx_schema.size(); i++) {
-                        if (i > 0) key_data += Tables::IDX_KEY_DELIM_INNER;
-                        key_data += Tables::buildKeyData(
-                                            idx_schema[i].type,
-                                            row[idx_schema[i].idx].AsUInt64());
-                    }
+                // key data is built up from the relevant col vals
+                key_data.clear();
 
-                    // to enforce uniqueness, append RID to key data
-                    if (!op.idx_unique) {
-                        key_data += (Tables::IDX_KEY_DELIM_OUTER +
-                                     Tables::IDX_KEY_DELIM_UNIQUE +
-                                     Tables::IDX_KEY_DELIM_INNER +
-                                     std::to_string(rec.RID));
-                    }
+                auto row = rec.data.AsVector();
+                for (unsigned i = 0; i < idx_schema.size(); i++) {
+                    if (i > 0) key_data += Tables::IDX_KEY_DELIM_INNER;
+                    key_data += Tables::buildKeyData(
+                                        idx_schema[i].type,
+                                        row[idx_schema[i].idx].AsUInt64());
+                }
 
-                    // create the entry, encode into bufferlist, update map
-                    bufferlist rec_bl;
-                    struct idx_rec_entry rec_ent(fb_seq_num, i, rec.RID);
-                    using ceph::encode;
-                    encode(rec_ent, rec_bl);
-                    key = key_data_prefix + key_data;
-                    recs_index[key] = rec_bl;
-                    break;
+                // to enforce uniqueness, append RID to key data
+                if (!op.idx_unique) {
+                    key_data += (Tables::IDX_KEY_DELIM_OUTER +
+                                 Tables::IDX_KEY_DELIM_UNIQUE +
+                                 Tables::IDX_KEY_DELIM_INNER +
+                                 std::to_string(rec.RID));
                 }
-                case Tables::SIT_IDX_TXT: {
-
-                    // add each word in the row to a words vector, store as
-                    // lower case and and preserve word sequence order.
-                    std::vector<std::pair<std::string, int>> words;
-                    std::string text_delims;
-                    if (!op.idx_text_delims.empty())
-                        text_delims = op.idx_text_delims;
-                    else
-                        text_delims = " \t\r\f\v\n"; // whitespace chars
-                    auto row = rec.data.AsVector();
-                    for (unsigned i = 0; i < idx_schema.size(); i++) {
-                        if (i > 0) key_data += Tables::IDX_KEY_DELIM_INNER;
-                        std::string line = \
-                            row[idx_schema[i].idx].AsString().str();
-                        boost::trim(line);
-                        if (line.empty())
+
+                // create the entry, encode into bufferlist, update map
+                bufferlist rec_bl;
+                struct idx_rec_entry rec_ent(fb_seq_num, i, rec.RID);
+                using ceph::encode;
+                encode(rec_ent, rec_bl);
+                key = ci.key_data_prefix + key_data;
+                ci.recs_index[key] = rec_bl;
+                break;
+            }
+            case Tables::SIT_IDX_TXT: {
+
+                // add the row to the postings of each distinct word in
+                // it, words are stored as lower case.  rows are visited
+                // in (fb, row) order so the postings stay sorted.
+                std::string text_delims;
+                if (!op.idx_text_delims.empty())
+                    text_delims = op.idx_text_delims;
+                else
+                    text_delims = " \t\r\f\v\n"; // whitespace chars
+                struct Tables::txt_posting posting = {fb_seq_num, i};
+                auto row = rec.data.AsVector();
+                for (unsigned i = 0; i < idx_schema.size(); i++) {
+                    std::string line = \
+                        root.dicts.getString(row, idx_schema[i].idx);
+                    boost::trim(line);
+                    if (line.empty())
+                        continue;
+                    vector<std::string> elems;
+                    boost::split(elems, line, boost::is_any_of(text_delims),
+                                        boost::token_compress_on);
+                    for (uint32_t i = 0; i < elems.size(); i++) {
+                        std::string word = \
+                                boost::algorithm::to_lower_copy(elems[i]);
+                        boost::trim(word);
+                        if (word.empty())
                             continue;
-                        vector<std::string> elems;
-                        boost::split(elems, line, boost::is_any_of(text_delims),
-                                            boost::token_compress_on);
-                        for (uint32_t i = 0; i < elems.size(); i++) {
-                            std::string word = \
-                                    boost::algorithm::to_lower_copy(elems[i]);
-                            boost::trim(word);
-
-                            // skip stopwords?
-                            if (op.idx_ignore_stopwords and
-                                Tables::IDX_STOPWORDS.count(word) > 0) {
-                                    continue;
 
-                            }
-                            words.push_back(std::make_pair(elems[i], i));
+                        // skip stopwords?
+                        if (op.idx_ignore_stopwords and
+                            Tables::IDX_STOPWORDS.count(word) > 0) {
+                                continue;
+
                         }
+
+                        // a word repeated within the row is posted once
+                        Tables::txt_postings_vec& postings = \
+                            ci.txt_postings[word];
+                        if (postings.empty() or
+                            !(postings.back() == posting))
+                            postings.push_back(posting);
                     }
-                    // now create a key and val (an entry struct) for each
-                    // word extracted from line
-                    for (auto it = words.begin(); it != words.end(); ++it) {
-
-                        key_data.clear();
-                        std::string word = it->first;
-                        key_data += word;
-
-                        // add the RID for uniqueness,
-                        // in case of repeated words within all rows
-                        key_data += (Tables::IDX_KEY_DELIM_OUTER +
-                                     Tables::IDX_KEY_DELIM_UNIQUE +
-                                     Tables::IDX_KEY_DELIM_INNER +
-                                     std::to_string(rec.RID));
-
-                        // add the word pos for uniqueness,
-                        // in case of repeated words within same row
-                        int word_pos = it->second;
-                        key_data += (Tables::IDX_KEY_DELIM_INNER +
-                                     std::to_string(word_pos));
-
-                        // create the entry, encode into bufferlist, update map
-                        bufferlist txt_bl;
-                        struct idx_txt_entry txt_ent(fb_seq_num, i,
-                                                     rec.RID, word_pos);
-                        using ceph::encode;
-                        encode(txt_ent, txt_bl);
-                        key = key_data_prefix + key_data;
-                        txt_index[key] = txt_bl;
-                        /*CLS_LOG(20,"kv=%s",
-                                 (key+";"+txt_ent.toString()).c_str());*/
-                    }
-                    break;
-                }
-                default: {
-                    CLS_ERR("exec_build_sky_index_op: %s", (
-                            "Index type unknown. type=" +
-                            std::to_string(op.idx_type)).c_str());
                 }
+                break;
+            }
+            default: {
+                CLS_ERR("exec_build_sky_index_op: %s", (
+                        "Index type unknown. type=" +
+                        std::to_string(op.idx_type)).c_str());
             }
+        }
+
+        // IDX_REC/IDX_RID batch insert to omap (minimize IOs)
+        if (ci.recs_index.size() > op.idx_batch_size) {
+            ret = cls_cxx_map_set_vals(hctx, &ci.recs_index);
+            if (ret < 0) {
+                CLS_ERR("exec_build_sky_index_op: error setting recs index entries %d", ret);
+                return ret;
+            }
+            ci.recs_index.clear();
+        }
+    }  // end foreach row
+    return 0;
+}
+
+/*
+ * Insert the remaining entries of a data content index to omap.  The
+ * posting list of each word of a text index is appended to its existing
+ * list by an incremental build, or else replaces it.
+ */
+static
+int
+finish_content_index(cls_method_context_t hctx, content_index& ci)
+{
+    // IDX_REC/IDX_RID insert remaining entries to omap
+    int ret = 0;
+    if (ci.recs_index.size() > 0) {
+        ret = cls_cxx_map_set_vals(hctx, &ci.recs_index);
+        if (ret < 0) {
+            CLS_ERR("exec_build_sky_index_op: error setting recs index entries %d", ret);
+            return ret;
+        }
+        ci.recs_index.clear();
+    }
+
+    // IDX_TXT insert the posting list of each word to omap, in batches
+    std::map<std::string, bufferlist> txt_index;
+    for (auto it = ci.txt_postings.begin(); it != ci.txt_postings.end(); ++it) {
+        std::string key = ci.key_data_prefix + it->first;
+        struct idx_txt_postings txt_ent;
+        bufferlist bl;
+        ret = -ENOENT;
+        if (ci.op.idx_incremental)
+            ret = cls_cxx_map_get_val(hctx, key, &bl);
+        if (ret < 0 and ret != -ENOENT) {
+            CLS_ERR("exec_build_sky_index_op: error reading txt index entry %d", ret);
+            return ret;
+        }
+        if (ret == -ENOENT) {
+            Tables::encodeTxtPostings(it->second, txt_ent);
+        }
+        else {
+            try {
+                bufferlist::const_iterator bit = bl.begin();
+                using ceph::decode;
+                decode(txt_ent, bit);
+            } catch (const buffer::error &err) {
+                CLS_ERR("ERROR: decoding idx_txt_postings for key=%s",
+                        key.c_str());
+                return -EINVAL;
+            }
+            Tables::appendTxtPostings(it->second, txt_ent);
+        }
+        using ceph::encode;
+        encode(txt_ent, txt_index[key]);
+        if (txt_index.size() > ci.op.idx_batch_size or
+            std::next(it) == ci.txt_postings.end()) {
+            ret = cls_cxx_map_set_vals(hctx, &txt_index);
+            if (ret < 0) {
+                CLS_ERR("exec_build_sky_index_op: error setting txt index entries %d", ret);
+                return ret;
+            }
+            txt_index.clear();
+        }
+    }
+    ci.txt_postings.clear();
+    return 0;
+}
+
+/*
+ * Read the whole encoded fbmeta bls of the object that start at off into
+ * extent, as many as end within max_len bytes of off, or the next bl alone
+ * if it is longer than that.
+ */
+static
+int
+read_fbmeta_extent(
+    cls_method_context_t hctx,
+    uint64_t off,
+    uint64_t obj_len,
+    uint64_t max_len,
+    bufferlist& extent)
+{
+    // a ceph property encoding the len of each bl in front of the bl,
+    // seems to be an int32 currently.
+    const uint32_t ceph_bl_encoding_len = sizeof(int32_t);
+
+    extent.clear();
+    uint64_t len = std::min(max_len, obj_len - off);
+    while (off < obj_len) {
+        bufferlist bls;
+        int ret = cls_cxx_read(hctx, off, len, &bls);
+        if (ret < 0) {
+            CLS_ERR("ERROR: read_fbmeta_extent: reading obj. %d", ret);
+            return ret;
+        }
+
+        // the len of the whole bls read, skipping over each bl
+        uint64_t whole_len = 0;
+        uint32_t bl_len = 0;
+        ceph::bufferlist::const_iterator it = bls.begin();
+        while (it.get_remaining() >= ceph_bl_encoding_len) {
+            try {
+                using ceph::decode;
+                decode(bl_len, it);
+            } catch (const buffer::error &err) {
+                CLS_ERR("ERROR: read_fbmeta_extent: decoding bl len at off=%lu",
+                        off + whole_len);
+                return -EINVAL;
+            }
+            if (it.get_remaining() < bl_len)
+                break;
+            it.advance(bl_len);
+            whole_len += ceph_bl_encoding_len + bl_len;
+        }
+        if (whole_len > 0) {
+            extent.substr_of(bls, 0, whole_len);
+            return 0;
+        }
+        if (off + len >= obj_len) {
+            CLS_ERR("ERROR: read_fbmeta_extent: truncated fbmeta at off=%lu",
+                    off);
+            return -EINVAL;
+        }
+        len = std::min(static_cast<uint64_t>(ceph_bl_encoding_len + bl_len),
+                       obj_len - off);
+    }
+    return 0;
+}
+
+/*
+ * Index the fbs of the object, each index only adding the entries of the
+ * fbs after its progress.  The fb index and zone maps and each data content
+ * index start from the start of the object, or for an incremental build
+ * from their recorded progress, and then the object is read only from the
+ * earliest of these.  An incremental build also adds the rows of its new
+ * fbs to the col_stats of the object, if runstats has been done.  Fbs are
+ * numbered in object order, so the entries of fbs indexed again are the
+ * same as before.  If obj_data is given it is the data of the object from
+ * obj_data_off to its end as written by this op, which is not yet visible
+ * to reads within the op, so it is indexed instead of reading the object.
+ * The object is read in extents of whole fbmetas.
+ */
+static
+int
+index_sky_fbs(
+    cls_method_context_t hctx,
+    std::vector<content_index>& content,
+    bool incremental,
+    uint32_t idx_batch_size,
+    bufferlist* obj_data=NULL,
+    uint64_t obj_data_off=0)
+{
+    using namespace Tables;
+
+    // a ceph property encoding the len of each bl in front of the bl,
+    // seems to be an int32 currently.
+    const int ceph_bl_encoding_len = sizeof(int32_t);
+
+    // the progress of each index, the fb index and zone maps first
+    std::string fb_progress_name = idx_progress_xattr(
+        SkyIdxTypeMap.at(SIT_IDX_FB));
+    std::string stats_progress_name = idx_progress_xattr(COL_STATS_KEY_PREFIX);
+    struct idx_progress fb_progress, stats_progress;
+    bool found = false, merge_stats = false;
+    int ret = 0;
+    if (incremental) {
+        ret = get_idx_progress(hctx, fb_progress_name, fb_progress, &found);
+        if (ret == 0)
+            ret = get_idx_progress(hctx, stats_progress_name, stats_progress,
+                                   &merge_stats);
+        for (auto it = content.begin(); ret == 0 and it != content.end(); ++it)
+            ret = get_idx_progress(hctx, it->progress_name, it->progress,
+                                   &found);
+        if (ret < 0) {
+            CLS_ERR("ERROR: exec_build_sky_index_op: idx_progress from xattr %d", ret);
+            return ret;
+        }
+    }
+    struct idx_progress start = fb_progress;
+    if (merge_stats and stats_progress.off < start.off)
+        start = stats_progress;
+    for (auto it = content.begin(); it != content.end(); ++it) {
+        if (it->progress.off < start.off)
+            start = it->progress;
+    }
 
-            // IDX_REC/IDX_RID batch insert to omap (minimize IOs)
-            if (recs_index.size() > op.idx_batch_size) {
-                ret = cls_cxx_map_set_vals(hctx, &recs_index);
+    // read only the bytes after the earliest progress, they contain a seq
+    // of encoded bls of skyhook fbs
+    // the bytes before obj_data were written by earlier ops and are read.
+    uint64_t obj_len = 0;
+    uint64_t disk_len = 0;
+    if (obj_data) {
+        obj_len = obj_data_off + obj_data->length();
+        disk_len = obj_data_off;
+    }
+    else {
+        ret = cls_cxx_stat(hctx, &obj_len, NULL);
+        disk_len = obj_len;
+    }
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_build_sky_index_op: stat obj. %d", ret);
+        return ret;
+    }
+
+    std::map<std::string, bufferlist> fbs_index;
+    std::map<std::string, bufferlist> zones_index;
+    std::string zone_prefix;  // set if any zone map was built
+
+    // the existing col_stats of each col and the summary of its new rows
+    std::map<std::string, col_stats> stats;
+    std::vector<col_summary> stats_summaries;
+    schema_vec stats_schema;
+    std::string stats_db_schema, stats_table;
+    uint64_t stats_rows = 0;
+    int stats_stride = 0;  // 0 until the existing stats are read
+
+    // decode and process each wrapped bl (each bl contains 1 flatbuf), the
+    // bls are read in extents of whole fbmetas, then taken from obj_data.
+    unsigned int fb_seq_num = start.fb_seq_num;
+    uint64_t off = start.off;
+    uint64_t extent_off = start.off;  // off of the extent in wrapped_bls
+    bufferlist wrapped_bls;
+    ceph::bufferlist::const_iterator it = wrapped_bls.begin();
+    std::vector<char> blob_buf;  // decompressed blob, reused across fbs
+    while (true) {
+        if (it.get_remaining() == 0) {
+            extent_off += wrapped_bls.length();
+            if (extent_off >= obj_len)
+                break;
+            if (extent_off < disk_len) {
+                ret = read_fbmeta_extent(hctx, extent_off, disk_len,
+                                         READ_BATCH_BYTES_MAX, wrapped_bls);
                 if (ret < 0) {
-                    CLS_ERR("exec_build_sky_index_op: error setting recs index entries %d", ret);
+                    CLS_ERR("ERROR: exec_build_sky_index_op: reading obj. %d", ret);
                     return ret;
                 }
-                recs_index.clear();
             }
+            else {
+                wrapped_bls.clear();
+                wrapped_bls.substr_of(*obj_data, extent_off - obj_data_off,
+                                      obj_len - extent_off);
+            }
+            it = wrapped_bls.begin();
+        }
+        off = extent_off + wrapped_bls.length() - it.get_remaining();
+        ceph::bufferlist bl;
+        try {
+            using ceph::decode;
+            decode(bl, it);  // unpack the next bl
+        } catch (ceph::buffer::error&) {
+            CLS_ERR("ERROR: exec_build_sky_index_op: decoding fbmeta at off=%lu",
+                    off);
+            return -EINVAL;
+        }
+
+        // each bl contains 1 fbmeta wrapping the fb
+        int fb_len = bl.length();
+        sky_meta meta = getSkyMeta(&bl);
+        ret = decompressSkyMeta(meta, blob_buf);
+        if (ret != 0) {
+            CLS_ERR("ERROR: exec_build_sky_index_op: decompressing blob TablesErrCodes::%d", ret);
+            return -EINVAL;
+        }
+        sky_root root = getSkyRoot(meta.blob_data, meta.blob_size,
+                                   meta.blob_format);
+        ++fb_seq_num;
+
+        // DATA LOCATION INDEX (PHYSICAL data reference):
+        std::string str_seq_num = u64tostr(fb_seq_num); // key data
+        std::string key_data = str_seq_num.substr(str_seq_num.length() - 10);
+        if (off >= fb_progress.off) {
+
+            // IDX_FB create the entry struct, encode into bufferlist
+            bufferlist fb_bl;
+            struct idx_fb_entry fb_ent(off, fb_len + ceph_bl_encoding_len);
+            using ceph::encode;
+            encode(fb_ent, fb_bl);
+            fbs_index[buildKeyPrefix(SIT_IDX_FB, root.db_schema_name,
+                                     root.table_name) + key_data] = fb_bl;
+
+            // IDX_ZONE the zone map of the fb, at the same key data as IDX_FB
+            schema_vec fb_schema = schemaFromString(root.data_schema);
+            std::vector<col_summary> summaries;
+            uint64_t zone_rows = 0;
+            std::string errmsg;
+            ret = summarize_cols(meta.blob_data, meta.blob_size,
+                                 meta.blob_format, fb_schema, 1,
+                                 &zone_rows, summaries, errmsg, true);
+            if (ret == 0) {
+                struct idx_zone_entry zone_ent = \
+                    build_zone_entry(fb_schema, summaries, zone_rows);
+                bufferlist zone_bl;
+                encode(zone_ent, zone_bl);
+                zone_prefix = buildKeyPrefix(SIT_IDX_ZONE,
+                                             root.db_schema_name,
+                                             root.table_name);
+                zones_index[zone_prefix + key_data] = zone_bl;
+            }
+            else {
+                CLS_LOG(20, "exec_build_sky_index_op: no zone map, %s",
+                        errmsg.c_str());
+            }
+        }
 
-            // IDX_TXT batch insert to omap (minimize IOs)
-            if (txt_index.size() > op.idx_batch_size) {
-                ret = cls_cxx_map_set_vals(hctx, &txt_index);
-                if (ret < 0) {
-                    CLS_ERR("exec_build_sky_index_op: error setting recs index entries %d", ret);
-                    return ret;
+        // COL_STATS sample the rows of the new fbs at the density of the
+        // existing stats, read once the table of the fbs is known.
+        if (merge_stats and off >= stats_progress.off) {
+            if (stats_stride == 0) {
+                stats_schema = schemaFromString(root.data_schema);
+                stats_db_schema = root.db_schema_name;
+                stats_table = root.table_name;
+                for (auto itc = stats_schema.begin();
+                          itc != stats_schema.end(); ++itc) {
+                    std::string key = buildColStatsKey(stats_db_schema,
+                                                       stats_table,
+                                                       itc->name);
+                    bufferlist stats_bl;
+                    ret = cls_cxx_map_get_val(hctx, key, &stats_bl);
+                    if (ret == -ENOENT)
+                        continue;
+                    if (ret < 0) {
+                        CLS_ERR("Cannot read col_stats entry for key=%s errorcode=%d",
+                                key.c_str(), ret);
+                        return ret;
+                    }
+                    try {
+                        bufferlist::const_iterator itb = stats_bl.begin();
+                        using ceph::decode;
+                        decode(stats[key], itb);
+                    } catch (const buffer::error &err) {
+                        CLS_ERR("ERROR: decoding col_stats for key=%s",
+                                key.c_str());
+                        return -EINVAL;
+                    }
                 }
-                txt_index.clear();
+                int level = stats.empty() ? MED
+                                          : stats.begin()->second.stats_level;
+                stats_stride = (level == LOW) ? STATS_SAMPLE_STRIDE_LOW :
+                               (level == HIGH) ? STATS_SAMPLE_STRIDE_HIGH :
+                               STATS_SAMPLE_STRIDE_MED;
+            }
+            std::string errmsg;
+            ret = summarize_cols(meta.blob_data, meta.blob_size,
+                                 meta.blob_format, stats_schema, stats_stride,
+                                 &stats_rows, stats_summaries, errmsg);
+            if (ret != 0) {
+                CLS_ERR("ERROR: exec_build_sky_index_op: %s", errmsg.c_str());
+                return -EINVAL;
             }
-        }  // end foreach row
+        }
+
+        // DATA CONTENT INDEXES (LOGICAL data reference):
+        for (auto itc = content.begin(); itc != content.end(); ++itc) {
+            if (off < itc->progress.off)
+                continue;
+            ret = index_fb_rows(hctx, *itc, meta, root, fb_seq_num);
+            if (ret < 0)
+                return ret;
+        }
 
         // IDX_FB batch insert to omap (minimize IOs)
-        if (fbs_index.size() > op.idx_batch_size) {
+        if (fbs_index.size() > idx_batch_size) {
             ret = cls_cxx_map_set_vals(hctx, &fbs_index);
             if (ret < 0) {
                 CLS_ERR("exec_build_sky_index_op: error setting fbs index entries %d", ret);
@@ -388,56 +737,212 @@ int exec_build_sky_index_op(cls_method_context_t hctx, bufferlist *in, bufferlis
             }
             fbs_index.clear();
         }
+
+        // IDX_ZONE batch insert to omap (minimize IOs)
+        if (zones_index.size() > idx_batch_size) {
+            ret = cls_cxx_map_set_vals(hctx, &zones_index);
+            if (ret < 0) {
+                CLS_ERR("exec_build_sky_index_op: error setting zone map entries %d", ret);
+                return ret;
+            }
+            zones_index.clear();
+        }
     }  // end while decode wrapped_bls
 
+    for (auto itc = content.begin(); itc != content.end(); ++itc) {
+        ret = finish_content_index(hctx, *itc);
+        if (ret < 0)
+            return ret;
+    }
 
-    // IDX_TXT insert remaining entries to omap
-    if (txt_index.size() > 0) {
-        ret = cls_cxx_map_set_vals(hctx, &txt_index);
+    // IDX_FB insert remaining entries to omap
+    if (fbs_index.size() > 0) {
+        ret = cls_cxx_map_set_vals(hctx, &fbs_index);
         if (ret < 0) {
-            CLS_ERR("exec_build_sky_index_op: error setting recs index entries %d", ret);
+            CLS_ERR("exec_build_sky_index_op: error setting fbs index entries %d", ret);
             return ret;
         }
     }
 
-    // IDX_REC/IDX_RID insert remaining entries to omap
-    if (recs_index.size() > 0) {
-        ret = cls_cxx_map_set_vals(hctx, &recs_index);
+    // IDX_ZONE insert remaining entries to omap
+    if (zones_index.size() > 0) {
+        ret = cls_cxx_map_set_vals(hctx, &zones_index);
         if (ret < 0) {
-            CLS_ERR("exec_build_sky_index_op: error setting recs index entries %d", ret);
+            CLS_ERR("exec_build_sky_index_op: error setting zone map entries %d", ret);
             return ret;
         }
     }
-    // IDX_FB insert remaining entries to omap
-    if (fbs_index.size() > 0) {
-        ret = cls_cxx_map_set_vals(hctx, &fbs_index);
+
+    // COL_STATS add the new rows to the stats of each col
+    if (stats_rows > 0) {
+        int64_t cur_time = static_cast<int64_t>(time(NULL));
+        std::map<std::string, bufferlist> stats_map;
+        for (unsigned i = 0; i < stats_summaries.size(); i++) {
+            std::string key = buildColStatsKey(stats_db_schema, stats_table,
+                                               stats_schema[i].name);
+            auto its = stats.find(key);
+            if (its == stats.end())
+                continue;
+            merge_col_stats(its->second, stats_summaries[i], stats_rows,
+                            cur_time);
+            using ceph::encode;
+            encode(its->second, stats_map[key]);
+        }
+        if (!stats_map.empty())
+            ret = cls_cxx_map_set_vals(hctx, &stats_map);
         if (ret < 0) {
-            CLS_ERR("exec_build_sky_index_op: error setting fbs index entries %d", ret);
+            CLS_ERR("exec_build_sky_index_op: error setting col_stats %d", ret);
             return ret;
         }
     }
 
-    // Update counter and Insert fb_seq_num to xattr
-    ret = set_fb_seq_num(hctx, fb_seq_num);
-    if(ret < 0) {
+    // Update the counter in xattr to the last fb, unless fbs after it were
+    // already counted when written.
+    unsigned int fb_seq_num_max = DATASTRUCT_SEQ_NUM_MIN;
+    ret = get_fb_seq_num(hctx, fb_seq_num_max);
+    if (ret == 0 and fb_seq_num > fb_seq_num_max)
+        ret = set_fb_seq_num(hctx, fb_seq_num);
+    if (ret < 0) {
         CLS_ERR("exec_build_sky_index_op: error setting fb_seq_num entry to xattr %d", ret);
         return ret;
     }
 
-    // LASTLY insert a marker key to indicate this index exists,
+    // the progress of each index is now the end of the object
+    struct idx_progress end(obj_len, fb_seq_num);
+    ret = set_idx_progress(hctx, fb_progress_name, end);
+    if (ret == 0 and merge_stats)
+        ret = set_idx_progress(hctx, stats_progress_name, end);
+    for (auto itc = content.begin(); ret == 0 and itc != content.end(); ++itc)
+        ret = set_idx_progress(hctx, itc->progress_name, end);
+    if (ret < 0) {
+        CLS_ERR("exec_build_sky_index_op: error setting idx_progress to xattr %d", ret);
+        return ret;
+    }
+
+    // LASTLY insert a marker key to indicate each index exists,
     // here we are using the key prefix with no data vals
     // TODO: make this a valid entry (not empty_bl), but with empty vals.
     bufferlist empty_bl;
     empty_bl.append("");
     std::map<std::string, bufferlist> index_exists_marker;
-    index_exists_marker[key_data_prefix] = empty_bl;
-    ret = cls_cxx_map_set_vals(hctx, &index_exists_marker);
+    for (auto itc = content.begin(); itc != content.end(); ++itc) {
+        if (!itc->key_data_prefix.empty())
+            index_exists_marker[itc->key_data_prefix] = empty_bl;
+    }
+    if (!zone_prefix.empty())
+        index_exists_marker[zone_prefix] = empty_bl;
+    if (!index_exists_marker.empty()) {
+        ret = cls_cxx_map_set_vals(hctx, &index_exists_marker);
+        if (ret < 0) {
+            CLS_ERR("exec_build_sky_index_op: error setting index_exists_marker %d", ret);
+            return ret;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Build a skyhook index, insert to omap.
+ * Index types are
+ * 1. fb_index: points (physically within the object) to the fb
+ *    <string fb_num, struct idx_fb_entry>
+ *    where fb_num is a sequence number of flatbufs within an obj
+ *
+ * 2. rec_index: points (logically within the fb) to the relevant row
+ *    <string rec-val, struct idx_rec_entry>
+ *    where rec-val is the col data value(s) or RID
+ *
+ * An incremental build only indexes the fbs appended since its last build.
+ */
+static
+int exec_build_sky_index_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+    // extract the index op instructions from the input bl
+    idx_op op;
+    try {
+        bufferlist::const_iterator it = in->begin();
+        using ceph::decode;
+        decode(op, it);
+    } catch (const buffer::error &err) {
+        CLS_ERR("ERROR: exec_build_sky_index_op decoding idx_op");
+        return -EINVAL;
+    }
+    if (op.idx_type != Tables::SIT_IDX_RID and
+        op.idx_type != Tables::SIT_IDX_REC and
+        op.idx_type != Tables::SIT_IDX_TXT) {
+        CLS_ERR("ERROR: exec_build_sky_index_op: Index type unknown. type=%d",
+                op.idx_type);
+        return -EINVAL;
+    }
+
+    std::vector<content_index> content;
+    content.push_back(content_index(op));
+    content[0].progress_name = idx_progress_xattr(
+        Tables::SkyIdxTypeMap.at(static_cast<Tables::SkyIdxType>(op.idx_type)),
+        content[0].idx_schema);
+    return index_sky_fbs(hctx, content, op.idx_incremental, op.idx_batch_size);
+}
+
+/*
+ * Append fbmetas to the object and index them as they are written, adding
+ * their fb index, zone map and col_stats entries and their entries of the
+ * requested data content indexes, as an incremental build of each.
+ */
+static
+int exec_append_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+    append_op op;
+    try {
+        bufferlist::const_iterator it = in->begin();
+        using ceph::decode;
+        decode(op, it);
+    } catch (const buffer::error &err) {
+        CLS_ERR("ERROR: exec_append_op decoding append_op");
+        return -EINVAL;
+    }
+
+    // verify the data is a seq of encoded bls before writing any of it
+    ceph::bufferlist::const_iterator it = op.data.begin();
+    while (it.get_remaining() > 0) {
+        ceph::bufferlist bl;
+        try {
+            using ceph::decode;
+            decode(bl, it);
+        } catch (ceph::buffer::error&) {
+            CLS_ERR("ERROR: exec_append_op: data is not a seq of fbmeta bls");
+            return -EINVAL;
+        }
+    }
+
+    std::vector<content_index> content;
+    for (auto itc = op.idx_ops.begin(); itc != op.idx_ops.end(); ++itc) {
+        if (itc->idx_type != Tables::SIT_IDX_RID and
+            itc->idx_type != Tables::SIT_IDX_REC and
+            itc->idx_type != Tables::SIT_IDX_TXT) {
+            CLS_ERR("ERROR: exec_append_op: Index type unknown. type=%d",
+                    itc->idx_type);
+            return -EINVAL;
+        }
+        content.push_back(content_index(*itc));
+        content.back().op.idx_incremental = true;
+        content.back().progress_name = idx_progress_xattr(
+            Tables::SkyIdxTypeMap.at(static_cast<Tables::SkyIdxType>(itc->idx_type)),
+            content.back().idx_schema);
+    }
+
+    uint64_t size = 0;
+    int ret = cls_cxx_stat(hctx, &size, NULL);
+    if (ret < 0 and ret != -ENOENT) {
+        CLS_ERR("ERROR: exec_append_op: stat obj. %d", ret);
+        return ret;
+    }
+    ret = cls_cxx_write(hctx, size, op.data.length(), &op.data);
     if (ret < 0) {
-        CLS_ERR("exec_build_sky_index_op: error setting index_exists_marker %d", ret);
+        CLS_ERR("ERROR: exec_append_op: writing obj. %d", ret);
         return ret;
     }
-
-    return 0;
+    return index_sky_fbs(hctx, content, true, op.idx_batch_size, &op.data,
+                         size);
 }
 
 /*
@@ -530,17 +1035,17 @@ static void add_extra_row_cost(uint64_t cost)
   }
 }
 
+// rows of each fb matched by index lookups, keyed by fb seq num
+typedef std::map<uint32_t, Tables::RowBitmap> fb_rows_map;
+
+/*
+ * Decode an idx_rec_entry and add its row num to the rows of its fb.
+ */
 static
 int
-update_idx_reads(
-    cls_method_context_t hctx,
-    std::map<int, struct Tables::read_info>& idx_reads,
-    bufferlist bl,
-    std::string key_fb_prefix,
-    std::string key_data_prefix) {
+add_idx_rec_rows(bufferlist& bl, fb_rows_map& fb_rows) {
 
     struct idx_rec_entry rec_ent;
-    int ret = 0;
     try {
         bufferlist::const_iterator it = bl.begin();
         using ceph::decode;
@@ -549,75 +1054,116 @@ update_idx_reads(
         CLS_ERR("ERROR: decoding query idx_rec_ent");
         return -EINVAL;
     }
+    fb_rows[rec_ent.fb_num].set(rec_ent.row_num);
+    return 0;
+}
 
-    // keep track of the specified row num for this record
-    std::vector<unsigned int> row_nums;
-    row_nums.push_back(rec_ent.row_num);
-
-    // now build the key to lookup the corresponding flatbuf entry
-    std::string key_data = Tables::buildKeyData(Tables::SDT_INT32, rec_ent.fb_num);
-    std::string key = key_fb_prefix + key_data;
-    struct idx_fb_entry fb_ent;
-    bufferlist bl1;
-    ret = cls_cxx_map_get_val(hctx, key, &bl1);
+/*
+ * Set the idx_reads info vector with the flatbuf off/len and the rows of
+ * each fb in fb_rows.  The fb entries share a key prefix
+ * and are ordered by seq num, so they are fetched in batches by scanning
+ * from the first fb needed to the last, instead of one lookup per record.
+ */
+static
+int
+read_fb_extents(
+    cls_method_context_t hctx,
+    std::string key_fb_prefix,
+    fb_rows_map& fb_rows,
+    int idx_batch_size,
+    std::map<int, struct Tables::read_info>& idx_reads) {
 
-    if (ret < 0) {
-        if (ret == -ENOENT) {
-            CLS_LOG(20,"WARN: NO FB key ENTRY FOUND!! ret=%d", ret);
-        }
-        else {
-            CLS_ERR("cant read map val index for idx_fb_key, %d", ret);
+    using namespace Tables;
+    if (fb_rows.empty())
+        return 0;
+
+    // start_after is exclusive, so start after the key preceding the first
+    uint32_t first_fb = fb_rows.begin()->first;
+    std::string start_after = key_fb_prefix;
+    if (first_fb > 0)
+        start_after += buildKeyData(SDT_INT32, first_fb - 1);
+    std::string last_key = key_fb_prefix +
+                           buildKeyData(SDT_INT32, fb_rows.rbegin()->first);
+
+    unsigned found = 0;
+    bool more = true;
+    std::map<std::string, bufferlist> fb_entries;
+    while (more and found < fb_rows.size()) {
+        fb_entries.clear();
+        int ret = sky_map_get_vals(hctx, start_after, key_fb_prefix,
+                                    idx_batch_size, &fb_entries, &more);
+        if (ret < 0 && ret != -ENOENT) {
+            CLS_ERR("cant read map vals for idx_fb keys, %d", ret);
             return ret;
         }
-    }
+        if (ret == -ENOENT or fb_entries.empty())
+            break;
 
-    if (ret >= 0) {
-        try {
-            bufferlist::const_iterator it = bl1.begin();
-            using ceph::decode;
-            decode(fb_ent, it);
-        } catch (const buffer::error &err) {
-            CLS_ERR("ERROR: decoding query idx_fb_ent");
-            return -EINVAL;
-        }
+        for (auto it = fb_entries.begin(); it != fb_entries.end(); ++it) {
+            const std::string& key = it->first;
+            start_after = key;
+            if (key > last_key) {
+                more = false;
+                break;
+            }
 
-        // our reads are indexed by fb_num
-        // either add these row nums to the existing read_info
-        // struct for the given fb_num, or create a new one
-        auto it = idx_reads.find(rec_ent.fb_num);
-        if (it != idx_reads.end()) {
-            it->second.rnums.insert(it->second.rnums.end(),
-                                    row_nums.begin(),
-                                    row_nums.end());
-        }
-        else {
-            idx_reads[rec_ent.fb_num] = \
-            Tables::read_info(rec_ent.fb_num,
-                              fb_ent.off,
-                              fb_ent.len,
-                              row_nums);
+            uint32_t fb_num = std::stoul(key.substr(key_fb_prefix.size()));
+            auto itr = fb_rows.find(fb_num);
+            if (itr == fb_rows.end())
+                continue;
+
+            struct idx_fb_entry fb_ent;
+            try {
+                bufferlist::const_iterator bit = it->second.begin();
+                using ceph::decode;
+                decode(fb_ent, bit);
+            } catch (const buffer::error &err) {
+                CLS_ERR("ERROR: decoding query idx_fb_ent");
+                return -EINVAL;
+            }
+
+            // our reads are indexed by fb_num
+            // either add these row nums to the existing read_info
+            // struct for the given fb_num, or create a new one
+            auto itr_read = idx_reads.find(fb_num);
+            if (itr_read != idx_reads.end()) {
+                itr_read->second.rows.orWith(itr->second);
+            }
+            else {
+                idx_reads[fb_num] = Tables::read_info(fb_num,
+                                                      fb_ent.off,
+                                                      fb_ent.len,
+                                                      itr->second);
+            }
+            found++;
         }
     }
+
+    if (found < fb_rows.size())
+        CLS_LOG(20,"WARN: NO FB key ENTRY FOUND for %lu fbs",
+                fb_rows.size() - found);
     return 0;
 }
 
 /*
- * Lookup matching records in omap, based on the index specified and the
- * index predicates.  Set the idx_reads info vector with the corresponding
- * flatbuf off/len and row numbers for each matching record.
+ * Lookup the off/len of each flatbuf in the object from the fb index,
+ * starting from seq_min.  Set the reads info vector with the corresponding
+ * flatbuf off/len for each fb found.  The fb entries are ordered by seq
+ * num, so they are fetched in batches of idx_batch_size keys.
  */
 static
 int
 read_fbs_index(
     cls_method_context_t hctx,
     std::string key_fb_prefix,
-    std::map<int, struct Tables::read_info>& reads)
+    int idx_batch_size,
+    std::map<int, struct Tables::read_info>& reads,
+    unsigned int seq_min=Tables::DATASTRUCT_SEQ_NUM_MIN)
 {
 
     using namespace Tables;
     int ret = 0;
 
-    unsigned int seq_min = Tables::DATASTRUCT_SEQ_NUM_MIN;
     unsigned int seq_max = Tables::DATASTRUCT_SEQ_NUM_MIN;
 
     // get the actual max fb seq number
@@ -626,51 +1172,134 @@ read_fbs_index(
         CLS_ERR("error getting fb_seq_num entry from xattr %d", ret);
         return ret;
     }
+    if (seq_min > seq_max)
+        return 0;
+    if (idx_batch_size <= 0)
+        idx_batch_size = IDX_BATCH_SIZE_DEFAULT;
+
+    // start_after is exclusive, so start after the key preceding seq_min.
+    // a seq_num may not be present due to fb deleted/compaction.
+    std::string start_after = key_fb_prefix;
+    if (seq_min > 0)
+        start_after += buildKeyData(SDT_INT32, seq_min - 1);
+    std::string last_key = key_fb_prefix + buildKeyData(SDT_INT32, seq_max);
 
-    // fb seq num grow monotically, so try to read each key
-    for (unsigned int i = seq_min; i <= seq_max; i++) {
-
-        // create key for this seq num.
-        std::string key_data = Tables::buildKeyData(Tables::SDT_INT32, i);
-        std::string key = key_fb_prefix + key_data;
+    bool more = true;
+    std::map<std::string, bufferlist> fb_entries;
+    while (more) {
+        fb_entries.clear();
+        ret = sky_map_get_vals(hctx, start_after, key_fb_prefix,
+                               idx_batch_size, &fb_entries, &more);
+        if (ret < 0 && ret != -ENOENT) {
+            CLS_ERR("cant read map vals for idx_fb keys, %d", ret);
+            return ret;
+        }
+        if (ret == -ENOENT or fb_entries.empty())
+            break;
 
-        bufferlist bl;
-        ret = cls_cxx_map_get_val(hctx, key, &bl);
+        for (auto it = fb_entries.begin(); it != fb_entries.end(); ++it) {
+            const std::string& key = it->first;
+            start_after = key;
+            if (key > last_key) {
+                more = false;
+                break;
+            }
 
-        // a seq_num may not be present due to fb deleted/compaction
-        // if key not found, just continue (this is not an error)
-        if (ret < 0) {
-            if (ret == -ENOENT) {
-                // CLS_LOG(20, "omap entry NOT found for key=%s", key.c_str());
-                continue;
+            struct idx_fb_entry fb_ent;
+            try {
+                bufferlist::const_iterator bit = it->second.begin();
+                using ceph::decode;
+                decode(fb_ent, bit);
+            } catch (const buffer::error &err) {
+                CLS_ERR("ERROR: decoding idx_fb_ent for key=%s", key.c_str());
+                return -EINVAL;
             }
-            else {
-                CLS_ERR("Cannot read omap entry for key=%s", key.c_str());
-                return ret;
+            int seq = std::stoul(key.substr(key_fb_prefix.size()));
+            reads[seq] = Tables::read_info(seq, fb_ent.off, fb_ent.len, {});
+        }
+    }
+    return 0;
+}
+
+/*
+ * Remove the reads of fbs whose zone map shows that none of their rows
+ * can pass the query preds, so they are neither read nor decoded.
+ * Zone map entries are ordered by seq num like the fb entries, so they
+ * are fetched in batches over the range of reads and pruned in memory.
+ * Fbs without a zone map entry are kept.
+ */
+static
+int
+prune_fbs_by_zone_maps(
+    cls_method_context_t hctx,
+    std::string key_zone_prefix,
+    Tables::predicate_vec& preds,
+    int idx_batch_size,
+    std::map<int, struct Tables::read_info>& reads,
+    int* npruned)
+{
+    using namespace Tables;
+    *npruned = 0;
+    if (reads.empty())
+        return 0;
+    if (idx_batch_size <= 0)
+        idx_batch_size = IDX_BATCH_SIZE_DEFAULT;
+
+    // start_after is exclusive, so start after the key preceding the first
+    int first_fb = reads.begin()->first;
+    std::string start_after = key_zone_prefix;
+    if (first_fb > 0)
+        start_after += buildKeyData(SDT_INT32, first_fb - 1);
+    std::string last_key = key_zone_prefix +
+                           buildKeyData(SDT_INT32, reads.rbegin()->first);
+
+    bool more = true;
+    std::map<std::string, bufferlist> zone_entries;
+    while (more) {
+        zone_entries.clear();
+        int ret = sky_map_get_vals(hctx, start_after, key_zone_prefix,
+                                   idx_batch_size, &zone_entries, &more);
+        if (ret < 0 && ret != -ENOENT) {
+            CLS_ERR("cant read map vals for idx_zone keys, %d", ret);
+            return ret;
+        }
+        if (ret == -ENOENT or zone_entries.empty())
+            break;
+
+        for (auto it = zone_entries.begin(); it != zone_entries.end(); ++it) {
+            const std::string& key = it->first;
+            start_after = key;
+            if (key > last_key) {
+                more = false;
+                break;
             }
-        }
 
-        // key found so decode the entry and set the read vals.
-        if (ret >= 0) {
-            // CLS_LOG(20, "omap entry found for key=%s", key.c_str());
-            struct idx_fb_entry fb_ent;
+            int fb_num = std::stoul(key.substr(key_zone_prefix.size()));
+            auto itr = reads.find(fb_num);
+            if (itr == reads.end())
+                continue;
+
+            struct idx_zone_entry zone_ent;
             try {
-                bufferlist::const_iterator it = bl.begin();
+                bufferlist::const_iterator bit = it->second.begin();
                 using ceph::decode;
-                decode(fb_ent, it);
+                decode(zone_ent, bit);
             } catch (const buffer::error &err) {
-                CLS_ERR("ERROR: decoding idx_fb_ent for key=%s", key.c_str());
+                CLS_ERR("ERROR: decoding idx_zone_entry for key=%s",
+                        key.c_str());
                 return -EINVAL;
             }
-            reads[i] = Tables::read_info(i, fb_ent.off, fb_ent.len, {});
+
+            if (!zone_may_match(preds, zone_ent)) {
+                reads.erase(itr);
+                (*npruned)++;
+            }
         }
     }
     return 0;
 }
 
 
-
-
 /*
     Check for index existence, always used before trying to perform index reads
     We check omap for the presence of the base key (prefix only), which is used
@@ -684,7 +1313,7 @@ sky_index_exists (cls_method_context_t hctx, std::string key_prefix)
 {
     std::map<std::string, bufferlist> key_val_map;
     bufferlist dummy_bl;
-    int ret = cls_cxx_map_get_val(hctx, key_prefix, &dummy_bl);
+    int ret = sky_map_get_val(hctx, key_prefix, &dummy_bl);
     if (ret < 0 && ret != -ENOENT) {
         CLS_ERR("Cannot read idx_rec entry for key, errorcode=%d", ret);
         return false;
@@ -699,48 +1328,425 @@ sky_index_exists (cls_method_context_t hctx, std::string key_prefix)
 
 
 /*
-    Decide to use index or not.
-    Check statistics and index predicates, if expected selectivity is high
-    enough then use the index (return true) else if low selectivity too many
-    index entries will match and we should not use the index (return false).
-    Returning false indicates to use a table scan instead of index.
+ * Read the col_stats entry from omap for the col of each pred.  Cols that
+ * do not have stats yet (runstats not done) are not added to the map.
+ */
+static
+int
+read_col_stats(
+        cls_method_context_t hctx,
+        std::string db_schema_name,
+        std::string table_name,
+        Tables::schema_vec& data_schema,
+        Tables::predicate_vec& preds,
+        std::map<int, col_stats>& stats)
+{
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        int col_idx = (*it)->colIdx();
+        if (stats.find(col_idx) != stats.end())
+            continue;
+
+        std::string colname;
+        for (auto itc = data_schema.begin(); itc != data_schema.end(); ++itc) {
+            if (itc->idx == col_idx)
+                colname = itc->name;
+        }
+        if (colname.empty())
+            continue;
+
+        std::string key = Tables::buildColStatsKey(db_schema_name,
+                                                   table_name,
+                                                   colname);
+        bufferlist bl;
+        int ret = sky_map_get_val(hctx, key, &bl);
+        if (ret == -ENOENT)
+            continue;
+        if (ret < 0) {
+            CLS_ERR("Cannot read col_stats entry for key=%s errorcode=%d",
+                    key.c_str(), ret);
+            return ret;
+        }
+
+        col_stats cs;
+        try {
+            bufferlist::const_iterator itb = bl.begin();
+            using ceph::decode;
+            decode(cs, itb);
+        } catch (const buffer::error &err) {
+            CLS_ERR("ERROR: decoding col_stats for key=%s", key.c_str());
+            return -EINVAL;
+        }
+        stats[col_idx] = cs;
+    }
+    return 0;
+}
+
+/*
+    Decide to use the requested indexes or not.
+    Estimate the selectivity of the index predicates from the col_stats
+    histograms, then compare the cost of fetching the matching index keys
+    and rows against a sequential read of the object.  For an intersection
+    plan, index1 alone may be used with the index2 preds applied during the
+    scan, but a union plan must use both indexes since the scan cannot
+    apply them as a disjunction.  If no stats are found the requested plan
+    is used.  Setting use_index1 to false indicates to use a table scan.
+    The plan and its estimates are described in plan_info for reporting.
 */
 static
-bool
-use_sky_index(
+void
+plan_sky_index(
         cls_method_context_t hctx,
-        std::string index_prefix,
-        Tables::predicate_vec index_preds)
+        query_op& op,
+        Tables::schema_vec& data_schema,
+        Tables::predicate_vec& index_preds,
+        Tables::predicate_vec& index2_preds,
+        bool index1_exists,
+        bool index2_exists,
+        bool& use_index1,
+        bool& use_index2,
+        std::string& plan_info)
 {
+    using namespace Tables;
+
+    bool two_idx = op.index_plan_type == SIP_IDX_INTERSECTION or
+                   op.index_plan_type == SIP_IDX_UNION;
+
     // we assume to use by default, since the planner requested it.
-    bool use_index = true;
+    use_index1 = index1_exists;
+    use_index2 = two_idx and index1_exists and index2_exists;
+
+    std::map<int, col_stats> stats;
+    int ret = read_col_stats(hctx, op.db_schema_name, op.table_name,
+                             data_schema, index_preds, stats);
+    if (ret == 0 and use_index2)
+        ret = read_col_stats(hctx, op.db_schema_name, op.table_name,
+                             data_schema, index2_preds, stats);
+
+    bool have_stats1 = false;
+    bool have_stats2 = !use_index2;
+    double sel1 = estimate_selectivity(index_preds, stats, &have_stats1);
+    double sel2 = 1.0;
+    if (use_index2)
+        sel2 = estimate_selectivity(index2_preds, stats, &have_stats2);
+
+    double nrows = 0;
+    for (auto it = stats.begin(); it != stats.end(); ++it) {
+        double n = 0;
+        for (unsigned i = 0; i < it->second.nbins; i++)
+            n += it->second.hist[i];
+        nrows = std::max(nrows, n);
+    }
 
-    bufferlist bl;
-    int ret = cls_cxx_map_get_val(hctx, index_prefix, &bl);
-    if (ret < 0 && ret != -ENOENT) {
-        CLS_ERR("Cannot read idx_rec entry for key, errorcode=%d", ret);
-        return false;
+    std::string reason;
+    double cost_scan = nrows * COST_ROW_READ;
+    double cost_idx = 0;
+    if (!index1_exists) {
+        reason = "noindex";
+    }
+    else if (op.index_type == SIT_IDX_TXT) {
+        reason = "text";  // no stats for words, and a scan is a regex match
+    }
+    else if (ret < 0 or !have_stats1 or !have_stats2 or nrows == 0) {
+        reason = "nostats";
+    }
+    else {
+        double cost_key = COST_IDX_KEY_FETCH + COST_ROW_READ;
+        double cost_idx1 = nrows * sel1 * cost_key;
+        if (!use_index2) {
+            cost_idx = cost_idx1;
+            use_index1 = cost_idx1 < cost_scan;
+        }
+        else if (op.index_plan_type == SIP_IDX_INTERSECTION) {
+            double cost_both = nrows * ((sel1 + sel2) * COST_IDX_KEY_FETCH +
+                                        sel1 * sel2 * COST_ROW_READ);
+            use_index2 = cost_both < cost_idx1;
+            cost_idx = std::min(cost_both, cost_idx1);
+            use_index1 = cost_idx < cost_scan;
+            use_index2 &= use_index1;
+        }
+        else {
+            cost_idx = nrows * ((sel1 + sel2) * COST_IDX_KEY_FETCH +
+                                (sel1 + sel2 - sel1 * sel2) * COST_ROW_READ);
+            if (cost_idx >= cost_scan)
+                reason = "union";
+        }
+        if (reason.empty())
+            reason = "cost";
+    }
+
+    std::string plan = "scan";
+    if (use_index1 and use_index2)
+        plan = op.index_plan_type == SIP_IDX_UNION ? "union" : "intersection";
+    else if (use_index1)
+        plan = "index";
+
+    plan_info = "plan=" + plan +
+                ";reason=" + reason +
+                ";sel1=" + std::to_string(sel1) +
+                ";sel2=" + std::to_string(sel2) +
+                ";est_rows=" + std::to_string(nrows) +
+                ";cost_scan=" + std::to_string(cost_scan) +
+                ";cost_index=" + std::to_string(cost_idx);
+}
+
+/*
+ * Set reads[] to each fbmeta of an object that has no fb index, from
+ * seq_min on, by walking the encoded len in front of each fbmeta bl.  Only
+ * the lens are read, and the fbmetas are numbered in object order as by
+ * the fb index.
+ */
+static
+int
+walk_fbmetas(
+    cls_method_context_t hctx,
+    std::map<int, struct Tables::read_info>& reads,
+    unsigned int seq_min)
+{
+    // a ceph property encoding the len of each bl in front of the bl,
+    // seems to be an int32 currently.
+    const unsigned ceph_bl_encoding_len = sizeof(int32_t);
+
+    uint64_t obj_len = 0;
+    int ret = cls_cxx_stat(hctx, &obj_len, NULL);
+    if (ret < 0) {
+        CLS_ERR("ERROR: walk_fbmetas: stat obj. %d", ret);
+        return ret;
+    }
+    uint64_t off = 0;
+    unsigned int fb_seq_num = Tables::DATASTRUCT_SEQ_NUM_MIN;
+    while (off < obj_len) {
+        bufferlist len_bl;
+        ret = cls_cxx_read(hctx, off, ceph_bl_encoding_len, &len_bl);
+        if (ret < 0) {
+            CLS_ERR("ERROR: walk_fbmetas: reading obj at off=%lu %d", off, ret);
+            return ret;
+        }
+        uint32_t bl_len = 0;
+        try {
+            bufferlist::const_iterator it = len_bl.begin();
+            using ceph::decode;
+            decode(bl_len, it);
+        } catch (const buffer::error &err) {
+            CLS_ERR("ERROR: walk_fbmetas: decoding fbmeta len at off=%lu", off);
+            return -EINVAL;
+        }
+        uint64_t len = ceph_bl_encoding_len + bl_len;
+        if (off + len > obj_len) {
+            CLS_ERR("ERROR: walk_fbmetas: fbmeta at off=%lu past obj end", off);
+            return -EINVAL;
+        }
+        ++fb_seq_num;
+        if (fb_seq_num >= seq_min)
+            reads[fb_seq_num] = Tables::read_info(fb_seq_num, off, len, {});
+        off += len;
+    }
+    return 0;
+}
+
+/*
+ * Combine the reads of several index lookups into the reads of an index
+ * plan.  For an intersection plan only the rows found by every index are
+ * kept, for a union plan the rows found by any index.
+ */
+static
+void
+combine_index_reads(
+    std::vector<const std::map<int, struct Tables::read_info>*> idx_reads,
+    int index_plan_type,
+    std::map<int, struct Tables::read_info>& reads)
+{
+    using namespace Tables;
+    reads.clear();
+    if (idx_reads.empty())
+        return;
+
+    if (index_plan_type == SIP_IDX_UNION) {
+        for (auto rmap : idx_reads) {
+            for (auto it = rmap->begin(); it != rmap->end(); ++it) {
+                auto itr = reads.find(it->first);
+                if (itr == reads.end())
+                    reads[it->first] = it->second;
+                else
+                    itr->second.rows.orWith(it->second.rows);
+            }
+        }
+        return;
+    }
+
+    // intersection, probe the other indexes for the fbs of the smallest
+    auto smallest = std::min_element(idx_reads.begin(), idx_reads.end(),
+        [](const std::map<int, read_info>* a,
+           const std::map<int, read_info>* b) {
+            return a->size() < b->size();
+        });
+    for (auto it = (*smallest)->begin(); it != (*smallest)->end(); ++it) {
+        read_info ri = it->second;
+        for (auto rmap : idx_reads) {
+            if (rmap == *smallest)
+                continue;
+            auto itr = rmap->find(it->first);
+            if (itr == rmap->end()) {
+                ri.rows = RowBitmap();
+                break;
+            }
+            ri.rows.andWith(itr->second.rows);
+            if (ri.rows.empty())
+                break;
+        }
+        if (!ri.rows.empty())
+            reads[it->first] = ri;
+    }
+}
+
+/*
+ * Lookup the rows matching the text index preds by merging the posting
+ * lists of their words, see textPredTerms().  The and-ed group of words
+ * with the fewest postings gives the candidate rows, which are then probed
+ * in the lists of each other group by seeking forward, so most blocks of
+ * the longer lists are never decoded.  A stopword not in the index is
+ * taken as ignored by it, so does not restrict the rows.
+ */
+static
+int
+read_sky_text_index(
+    cls_method_context_t hctx,
+    Tables::predicate_vec& index_preds,
+    std::string key_fb_prefix,
+    std::string key_data_prefix,
+    int idx_batch_size,
+    std::map<int, struct Tables::read_info>& idx_reads) {
+
+    using namespace Tables;
+
+    // the posting lists of the alternative words of each group
+    std::vector<std::vector<struct idx_txt_postings>> groups;
+    std::vector<uint64_t> group_sizes;
+    for (auto it = index_preds.begin(); it != index_preds.end(); ++it) {
+        std::vector<std::vector<std::string>> terms = textPredTerms(*it);
+        for (auto itg = terms.begin(); itg != terms.end(); ++itg) {
+            std::vector<struct idx_txt_postings> lists;
+            uint64_t size = 0;
+            bool ignored = false;
+            for (auto ita = itg->begin(); ita != itg->end(); ++ita) {
+                std::string key = key_data_prefix + *ita;
+                bufferlist bl;
+                int ret = sky_map_get_val(hctx, key, &bl);
+                if (ret == -ENOENT) {
+                    ignored |= IDX_STOPWORDS.count(*ita) > 0;
+                    continue;
+                }
+                if (ret < 0) {
+                    CLS_ERR("cant read map val for idx_txt key=%s %d",
+                            key.c_str(), ret);
+                    return ret;
+                }
+
+                struct idx_txt_postings list;
+                try {
+                    bufferlist::const_iterator bit = bl.begin();
+                    using ceph::decode;
+                    decode(list, bit);
+                } catch (const buffer::error &err) {
+                    CLS_ERR("ERROR: decoding idx_txt_postings for key=%s",
+                            key.c_str());
+                    return -EINVAL;
+                }
+                size_t nblocks = (static_cast<size_t>(list.npostings) +
+                                  TXT_POSTINGS_BLOCK - 1) / TXT_POSTINGS_BLOCK;
+                if (list.block_fbs.size() != nblocks or
+                    list.block_rows.size() != nblocks or
+                    list.block_offs.size() != nblocks) {
+                    CLS_ERR("ERROR: malformed idx_txt_postings for key=%s",
+                            key.c_str());
+                    return -EINVAL;
+                }
+                size += list.npostings;
+                lists.push_back(list);
+            }
+            if (ignored)
+                continue;
+            if (lists.empty())
+                return 0;  // no row contains any word of this group
+            groups.push_back(lists);
+            group_sizes.push_back(size);
+        }
     }
 
-    // If an entry was found for this index key, check the statistics for
-    // each predicate to see if it is expected to be highly selective.
-    if (ret != -ENOENT) {
+    // no words to match, so all rows of every fb match
+    if (groups.empty())
+        return read_fbs_index(hctx, key_fb_prefix, idx_batch_size,
+                              idx_reads);
+
+    // the candidates are the union of the smallest group's lists
+    size_t smallest = std::min_element(group_sizes.begin(),
+                                       group_sizes.end()) -
+                      group_sizes.begin();
+    txt_postings_vec candidates;
+    candidates.reserve(group_sizes[smallest]);
+    for (auto it = groups[smallest].begin();
+              it != groups[smallest].end(); ++it) {
+        for (TxtPostingsCursor c(*it); c.valid(); c.next())
+            candidates.push_back(c.value());
+    }
+    if (groups[smallest].size() > 1) {
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()),
+                         candidates.end());
+    }
 
-        // TODO: this should be based on a cost model, not a fixed value.
-        const float SELECTIVITY_HIGH_VAL = 0.10;
+    // keep the candidates in any list of each other group, the candidates
+    // ascend so each cursor only seeks forward.
+    for (size_t g = 0; g < groups.size() and !candidates.empty(); g++) {
+        if (g == smallest)
+            continue;
+        std::vector<TxtPostingsCursor> cursors;
+        for (auto it = groups[g].begin(); it != groups[g].end(); ++it)
+            cursors.emplace_back(*it);
+        size_t nkept = 0;
+        for (size_t i = 0; i < candidates.size(); i++) {
+            for (auto itc = cursors.begin(); itc != cursors.end(); ++itc) {
+                itc->seek(candidates[i]);
+                if (itc->valid() and itc->value() == candidates[i]) {
+                    candidates[nkept++] = candidates[i];
+                    break;
+                }
+            }
+        }
+        candidates.resize(nkept);
+    }
 
-        // for each pred, check the bl idx_stats struct and decide selectivity
-        for (auto it = index_preds.begin(); it != index_preds.end(); ++it) {
+    fb_rows_map fb_rows;
+    for (auto it = candidates.begin(); it != candidates.end(); ++it)
+        fb_rows[it->fb_num].set(it->row_num);
+    return read_fb_extents(hctx, key_fb_prefix, fb_rows, idx_batch_size,
+                           idx_reads);
+}
 
-            // TODO: compute this from the predicate value and stats struct
-            float expected_selectivity = 0.10;
-            if (expected_selectivity <= SELECTIVITY_HIGH_VAL)
-                use_index &= true;
-            else
-                use_index &= false;
+/*
+ * Replace each text index pred by a like pred per group of its words, to
+ * apply them during a scan when the text index is not used.  The like
+ * preds are owned by owned_preds.
+ */
+static
+void
+text_index_scan_preds(
+    Tables::predicate_vec& preds,
+    std::vector<std::unique_ptr<Tables::PredicateBase>>& owned_preds)
+{
+    using namespace Tables;
+    predicate_vec scan_preds;
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        std::vector<std::vector<std::string>> terms = textPredTerms(*it);
+        for (auto itg = terms.begin(); itg != terms.end(); ++itg) {
+            owned_preds.emplace_back(
+                new TypedPredicate<std::string>((*it)->colIdx(),
+                                                (*it)->colType(),
+                                                SOT_like,
+                                                textTermsRegex(*itg)));
+            scan_preds.push_back(owned_preds.back().get());
         }
     }
-    return use_index;
+    preds = scan_preds;
 }
 
 /*
@@ -761,8 +1767,14 @@ read_sky_index(
     std::map<int, struct Tables::read_info>& idx_reads) {
 
     using namespace Tables;
+    if (index_type == SIT_IDX_TXT)
+        return read_sky_text_index(hctx, index_preds, key_fb_prefix,
+                                   key_data_prefix, idx_batch_size,
+                                   idx_reads);
+
     int ret = 0, ret2 = 0;
     std::vector<std::string> keys;   // to contain all keys found after lookups
+    fb_rows_map fb_rows;  // matching rows of every fb, resolved at the end
 
     // for each fb_seq_num, a corresponding read_info struct to
     // indicate the relevant rows within a given fb.
@@ -834,8 +1846,8 @@ read_sky_index(
     int max_to_get = idx_batch_size;
     std::map<std::string, bufferlist> key_val_map;
     while(!stop) {
-        ret2 = cls_cxx_map_get_vals(hctx, start_after, string(),
-                                    max_to_get, &key_val_map, &more);
+        ret2 = sky_map_get_vals(hctx, start_after, string(),
+                                 max_to_get, &key_val_map, &more);
 
         if (ret2 < 0 && ret2 != -ENOENT) {
             CLS_ERR("cant read map val index rec for idx_rec key %d", ret2);
@@ -897,46 +1909,638 @@ read_sky_index(
                         continue;
                     }
 
-                    // Set the idx_reads info vector with the corresponding
-                    // flatbuf off/len and row numbers for each matching record
-                    ret2 = update_idx_reads(hctx, idx_reads, record_bl_entry,
-                                            key_fb_prefix, key_data_prefix);
-                    if(ret2 < 0)
-                        return ret2;
-                }
+                    // collect the fb and row number of each matching record
+                    ret2 = add_idx_rec_rows(record_bl_entry, fb_rows);
+                    if(ret2 < 0)
+                        return ret2;
+                }
+            } catch (const buffer::error &err) {
+                    CLS_ERR("ERROR: decoding query idx_rec_ent");
+                    return -EINVAL;
+            }
+        }
+    }
+
+
+    // lookup key in omap to get the row offset
+    if (!keys.empty()) {
+        for (unsigned i = 0; i < keys.size(); i++) {
+            bufferlist record_bl_entry;
+            ret = sky_map_get_val(hctx, keys[i], &record_bl_entry);
+            if (ret < 0 && ret != -ENOENT) {
+                CLS_ERR("cant read map val index rec for idx_rec key %d", ret);
+                return ret;
+            }
+            if (ret >= 0) {
+                ret2 = add_idx_rec_rows(record_bl_entry, fb_rows);
+                if (ret2 < 0)
+                    return ret2;
+            } else  {
+                // no rec found for key
+            }
+        }
+    }
+
+    // Set the idx_reads info vector with the corresponding
+    // flatbuf off/len and row numbers of all matching records
+    return read_fb_extents(hctx, key_fb_prefix, fb_rows, idx_batch_size,
+                           idx_reads);
+}
+
+// one fbmeta of the object and its result, processed by a query thread
+struct fbmeta_task {
+    bufferlist data;                     // the encoded fbmeta
+    int fb_seq_num;                      // or -1 if not from an fb index
+    std::vector<unsigned int> row_nums;  // rows to process, empty for all
+    bufferlist result_bl;                // its fbmeta(s) of result rows
+    std::string errmsg;
+    int ret;
+    uint64_t rows_examined;
+    uint64_t rows_passed;
+    uint64_t encode_ns;
+};
+
+// the state of one query thread, reused for all of its fbmetas
+struct query_thread {
+    Tables::PredicateEngine engine;
+    Tables::BuilderPool builders;
+    std::vector<char> blob_buf;
+
+    query_thread(Tables::predicate_vec& preds) : engine(preds) {}
+};
+
+/*
+ * The rows a query examines in fbmeta, which must not be compressed: the
+ * rows of row_nums if from an index, else all of its rows.
+ */
+static
+uint64_t
+fbmeta_rows_examined(
+    const Tables::sky_meta& fbmeta,
+    const std::vector<unsigned int>& row_nums)
+{
+    using namespace Tables;
+    if (!row_nums.empty())
+        return row_nums.size();
+    switch (fbmeta.blob_format) {
+    case SFT_FLATBUF_FLEX_ROW:
+        return GetTable(fbmeta.blob_data)->nrows();
+    case SFT_ARROW:
+        return getSkyRoot(fbmeta.blob_data, fbmeta.blob_size,
+                          SFT_ARROW).nrows;
+    default:
+        return 0;
+    }
+}
+
+// the rows of a flatbuf result blob
+static
+uint64_t
+fb_result_rows(flatbuffers::FlatBufferBuilder& result_builder)
+{
+    return Tables::GetTable(result_builder.GetBufferPointer())->nrows();
+}
+
+/*
+ * Process the rows of a single fbmeta for a query without aggs, groups,
+ * top-k or a row limit, so its result does not depend on any other fbmeta.
+ * Only the fbmeta's task and thread state are modified, so independent
+ * fbmetas may be processed concurrently.
+ */
+static
+int
+process_fbmeta_task(
+    const query_op& op,
+    Tables::schema_vec& data_schema,
+    Tables::schema_vec& query_schema,
+    Tables::predicate_vec& query_preds,
+    query_thread& qt,
+    fbmeta_task& task)
+{
+    using namespace Tables;
+    int ret = 0;
+    sky_meta fbmeta = getSkyMeta(&task.data);
+
+    bool pass_thru = op.fastpath and
+                     (fbmeta.blob_format == SFT_FLATBUF_FLEX_ROW or
+                      fbmeta.blob_format == SFT_ARROW);
+    if (pass_thru and (fbmeta.blob_format == SFT_ARROW or
+                       fbmeta.blob_compression != none)) {
+        task.result_bl.append(task.data);
+        return 0;  // rows of blobs passed thru are not counted
+    }
+    if (!pass_thru) {
+        ret = decompressSkyMeta(fbmeta, qt.blob_buf);
+        if (ret != 0) {
+            task.errmsg.append("decompressing blob");
+            return ret;
+        }
+    }
+    task.rows_examined = fbmeta_rows_examined(fbmeta, task.row_nums);
+    uint64_t encode_start = 0;
+
+    flatbuffers::FlatBufferBuilder* fbmeta_builder = NULL;
+    switch (fbmeta.blob_format) {
+
+    case SFT_JSON: {
+        // TODO: call processJSON() here, see exec_query_op.
+        fbmeta_builder = &qt.builders.metaBuilder(fbmeta.blob_size);
+        createFbMeta(fbmeta_builder,
+                     SFT_FLATBUF_FLEX_ROW,
+                     reinterpret_cast<unsigned char*>(
+                        const_cast<char*>(fbmeta.blob_data)),
+                     fbmeta.blob_size);
+        break;
+    }
+
+    case SFT_FLATBUF_FLEX_ROW: {
+        if (op.fastpath) {
+            task.rows_passed = task.rows_examined;
+            encode_start = getns();
+            fbmeta_builder = &qt.builders.metaBuilder(fbmeta.blob_size);
+            ret = createFbMeta(fbmeta_builder,
+                               SFT_FLATBUF_FLEX_ROW,
+                               reinterpret_cast<unsigned char*>(
+                                  const_cast<char*>(fbmeta.blob_data)),
+                               fbmeta.blob_size,
+                               false, 0, 0,
+                               op.result_compression);
+            if (ret != 0)
+                return ret;
+            break;
+        }
+
+        // size the result to the projected fraction of the blob
+        int bldr_size = 1024;
+        size_t result_size = fbmeta.blob_size;
+        if (!data_schema.empty() and
+            query_schema.size() < data_schema.size())
+            result_size = result_size * query_schema.size() /
+                          data_schema.size();
+        flatbuffers::FlatBufferBuilder& result_builder = \
+            qt.builders.resultBuilder(result_size + bldr_size);
+        ret = processSkyFb(result_builder,
+                           data_schema,
+                           query_schema,
+                           query_preds,
+                           qt.engine,
+                           qt.builders,
+                           fbmeta.blob_data,
+                           fbmeta.blob_size,
+                           task.errmsg,
+                           task.row_nums);
+        if (ret != 0)
+            return ret;
+        task.rows_passed = fb_result_rows(result_builder);
+        encode_start = getns();
+        fbmeta_builder = &qt.builders.metaBuilder(result_builder.GetSize());
+        ret = createFbMeta(fbmeta_builder,
+                           SFT_FLATBUF_FLEX_ROW,
+                           reinterpret_cast<unsigned char*>(
+                              result_builder.GetBufferPointer()),
+                           result_builder.GetSize(),
+                           false, 0, 0,
+                           op.result_compression);
+        if (ret != 0)
+            return ret;
+        break;
+    }
+
+    case SFT_ARROW: {
+        std::shared_ptr<arrow::Table> table;
+        ret = processArrowCol(&table,
+                              data_schema,
+                              query_schema,
+                              query_preds,
+                              qt.engine,
+                              fbmeta.blob_data,
+                              fbmeta.blob_size,
+                              task.errmsg,
+                              task.row_nums);
+        if (ret != 0)
+            return ret;
+        task.rows_passed = table->num_rows();
+        encode_start = getns();
+        ret = convert_arrow_to_fbmeta(table, task.result_bl,
+                                      op.result_compression);
+        task.encode_ns = getns() - encode_start;
+        return ret;
+    }
+
+    default:
+        return TablesErrCodes::SkyFormatTypeNotRecognized;
+    }
+
+    task.result_bl.append(reinterpret_cast<const char*>(
+                          fbmeta_builder->GetBufferPointer()),
+                          fbmeta_builder->GetSize());
+    if (encode_start > 0)
+        task.encode_ns = getns() - encode_start;
+    return 0;
+}
+
+// query threads running in the OSD besides the op threads, over all of the
+// concurrent exec_query_op calls, at most QUERY_OSD_THREADS_MAX.
+static std::atomic<int> query_osd_threads(0);
+
+/*
+ * Up to n of the OSD's query threads, held until destroyed.  Fewer or none
+ * are reserved once the OSD limit is reached.
+ */
+class query_threads_reservation {
+public:
+    explicit query_threads_reservation(int n) : count_(0) {
+        int used = query_osd_threads.load();
+        int want = 0;
+        do {
+            want = std::min(n, Tables::QUERY_OSD_THREADS_MAX - used);
+            if (want <= 0)
+                return;
+        } while (!query_osd_threads.compare_exchange_weak(used, used + want));
+        count_ = want;
+    }
+    ~query_threads_reservation() {query_osd_threads -= count_;}
+    int count() const {return count_;}
+
+private:
+    int count_;
+};
+
+/*
+ * Workers of an exec_query_fbmetas_parallel call on threads.size() query
+ * threads, started once and fed each wave of tasks in turn.  Each thread
+ * takes the next unprocessed task of the wave until none remain.  The
+ * calling thread is one of the threads.
+ */
+class fbmeta_workers {
+public:
+    fbmeta_workers(
+        const query_op& op,
+        Tables::schema_vec& data_schema,
+        Tables::schema_vec& query_schema,
+        Tables::predicate_vec& query_preds,
+        std::vector<std::unique_ptr<query_thread>>& threads) :
+        op_(op),
+        data_schema_(data_schema),
+        query_schema_(query_schema),
+        query_preds_(query_preds),
+        threads_(threads),
+        tasks_(NULL),
+        next_task_(0),
+        wave_(0),
+        pending_(0),
+        stopping_(false)
+    {
+        for (size_t t = 1; t < threads_.size(); t++)
+            workers_.emplace_back(&fbmeta_workers::work, this,
+                                  threads_[t].get());
+    }
+
+    ~fbmeta_workers() {
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            stopping_ = true;
+        }
+        wave_cond_.notify_all();
+        for (auto it = workers_.begin(); it != workers_.end(); ++it)
+            it->join();
+    }
+
+    // process a wave of tasks, returning once all of them are done
+    void run(std::vector<fbmeta_task>& tasks) {
+        {
+            std::lock_guard<std::mutex> l(lock_);
+            tasks_ = &tasks;
+            next_task_ = 0;
+            pending_ = workers_.size();
+            ++wave_;
+        }
+        wave_cond_.notify_all();
+        process(threads_[0].get());
+        std::unique_lock<std::mutex> l(lock_);
+        done_cond_.wait(l, [this] {return pending_ == 0;});
+        tasks_ = NULL;
+    }
+
+private:
+    void process(query_thread* qt) {
+        std::vector<fbmeta_task>& tasks = *tasks_;
+        for (size_t i = next_task_++; i < tasks.size(); i = next_task_++) {
+            tasks[i].ret = process_fbmeta_task(op_, data_schema_,
+                                               query_schema_, query_preds_,
+                                               *qt, tasks[i]);
+        }
+    }
+
+    // each worker processes every wave once, the next wave is only started
+    // after all workers are done with the last one.
+    void work(query_thread* qt) {
+        uint64_t seen = 0;
+        std::unique_lock<std::mutex> l(lock_);
+        while (true) {
+            wave_cond_.wait(l, [&] {return stopping_ or wave_ != seen;});
+            if (stopping_)
+                return;
+            seen = wave_;
+            l.unlock();
+            process(qt);
+            l.lock();
+            if (--pending_ == 0)
+                done_cond_.notify_one();
+        }
+    }
+
+    const query_op& op_;
+    Tables::schema_vec& data_schema_;
+    Tables::schema_vec& query_schema_;
+    Tables::predicate_vec& query_preds_;
+    std::vector<std::unique_ptr<query_thread>>& threads_;
+    std::vector<std::thread> workers_;
+    std::mutex lock_;
+    std::condition_variable wave_cond_;
+    std::condition_variable done_cond_;
+    std::vector<fbmeta_task>* tasks_;
+    std::atomic<size_t> next_task_;
+    uint64_t wave_;
+    size_t pending_;
+    bool stopping_;
+};
+
+/*
+ * Process the fbmetas of reads[] concurrently on nthreads query threads.
+ * Reads are issued by the calling thread, and their fbmetas processed in
+ * waves of a few fbmetas per thread, so only a wave at a time is held in
+ * memory.  Results are appended to result_bl in fb_seq_num order, and a
+ * result capped at op.result_max_bytes sets next_seq_num as by the serial
+ * loop of exec_query_op.  Any fbmetas of the last wave processed after the
+ * cap are dropped and processed again when the client resumes.
+ */
+static
+int
+exec_query_fbmetas_parallel(
+    cls_method_context_t hctx,
+    const query_op& op,
+    std::map<int, struct Tables::read_info>& reads,
+    bool resumable,
+    int nthreads,
+    Tables::schema_vec& data_schema,
+    Tables::schema_vec& query_schema,
+    Tables::predicate_vec& query_preds,
+    bufferlist& result_bl,
+    cls_info& info,
+    int* next_seq_num)
+{
+    using namespace Tables;
+    std::vector<std::unique_ptr<query_thread>> threads;
+    for (int t = 0; t < nthreads; t++)
+        threads.emplace_back(new query_thread(query_preds));
+    fbmeta_workers workers(op, data_schema, query_schema, query_preds,
+                           threads);
+
+    size_t wave_size = nthreads * QUERY_THREAD_FBS;
+    std::vector<fbmeta_task> tasks;
+    bufferlist b;
+    for (auto it = reads.begin(); it != reads.end(); ) {
+
+        // same coalesced reads of adjacent fbmetas as exec_query_op
+        size_t off = it->second.off;
+        size_t len = it->second.len;
+        auto fb_it = it++;
+        if (resumable) {
+            while (it != reads.end() and
+                   static_cast<size_t>(it->second.off) == off + len and
+                   len + it->second.len <= READ_BATCH_BYTES_MAX) {
+                len += it->second.len;
+                ++it;
+            }
+        }
+
+        uint64_t read_start = getns();
+        b.clear();
+        int ret = cls_cxx_read(hctx, off, len, &b);
+        if (ret < 0) {
+            CLS_ERR("ERROR: cls: exec_query_op: %d reading obj at off=%lu;len=%lu",
+                    ret, off, len);
+            return ret;
+        }
+        info.read_ns += getns() - read_start;
+        info.bytes_read += b.length();
+
+        // each fbmeta of a resumable read has its own read info, else all
+        // fbmetas of the object share the single full object read info.
+        ceph::bufferlist::const_iterator data_itr = b.begin();
+        while (data_itr.get_remaining() > 0) {
+            fbmeta_task task;
+            try {
+                using ceph::decode;
+                decode(task.data, data_itr);
             } catch (const buffer::error &err) {
-                    CLS_ERR("ERROR: decoding query idx_rec_ent");
-                    return -EINVAL;
+                CLS_ERR("ERROR: cls: exec_query_op: decoding data from data_itr (ds sequence");
+                return -EINVAL;
             }
+            task.fb_seq_num = -1;
+            task.ret = 0;
+            task.rows_examined = 0;
+            task.rows_passed = 0;
+            task.encode_ns = 0;
+            if (fb_it != reads.end()) {
+                if (resumable)
+                    task.fb_seq_num = fb_it->first;
+                fb_it->second.rows.toRowNums(task.row_nums);
+                if (resumable)
+                    ++fb_it;
+            }
+            tasks.push_back(std::move(task));
         }
-    }
 
+        if (tasks.size() < wave_size and it != reads.end())
+            continue;
 
-    // lookup key in omap to get the row offset
-    if (!keys.empty()) {
-        for (unsigned i = 0; i < keys.size(); i++) {
-            bufferlist record_bl_entry;
-            ret = cls_cxx_map_get_val(hctx, keys[i], &record_bl_entry);
-            if (ret < 0 && ret != -ENOENT) {
-                CLS_ERR("cant read map val index rec for idx_rec key %d", ret);
-                return ret;
+        uint64_t eval_start = getns();
+        workers.run(tasks);
+        info.eval_ns += getns() - eval_start;
+
+        for (auto t = tasks.begin(); t != tasks.end(); ++t) {
+            if (t->ret != 0) {
+                CLS_ERR("ERROR: exec_query_op: fbmeta %d %s", t->fb_seq_num,
+                        t->errmsg.c_str());
+                CLS_ERR("ERROR: TablesErrCodes::%d", t->ret);
+                return -1;
             }
-            if (ret >= 0) {
-                ret2 = update_idx_reads(hctx,
-                                        idx_reads,
-                                        record_bl_entry,
-                                        key_fb_prefix,
-                                        key_data_prefix);
-                if (ret2 < 0)
-                    return ret2;
-            } else  {
-                // no rec found for key
+            result_bl.claim_append(t->result_bl);
+            info.fbs_scanned++;
+            info.rows_examined += t->rows_examined;
+            info.rows_passed += t->rows_passed;
+            info.encode_ns += t->encode_ns;
+
+            // resume from the next fbmeta once the result reaches the cap
+            if (resumable and op.result_max_bytes > 0 and
+                result_bl.length() >= op.result_max_bytes) {
+                auto next_it = reads.upper_bound(t->fb_seq_num);
+                if (next_it != reads.end())
+                    *next_seq_num = next_it->first;
+                return 0;
             }
         }
+        tasks.clear();
     }
     return 0;
 }
 
+/*
+ * Parsed schemas, predicates and omap key prefixes of a query_op.  Parsing
+ * splits every schema and pred string, allocates a pred per clause and
+ * compiles its LIKE regex, so the plans are cached across exec_query_op
+ * calls.  The cached preds are shared by the ops, except agg preds which
+ * are updated in place, so each op works on its own copies of them.
+ */
+struct query_plan {
+    Tables::schema_vec data_schema;
+    Tables::schema_vec query_schema;
+    Tables::schema_vec groupby_schema;
+    Tables::schema_vec orderby_schema;
+    Tables::predicate_vec query_preds;
+    std::string key_fb_prefix;
+    std::string key_zone_prefix;
+
+    // index_read only
+    Tables::schema_vec index_schema;
+    Tables::schema_vec index2_schema;
+    Tables::predicate_vec index_preds;
+    Tables::predicate_vec index2_preds;
+    std::vector<std::string> index_cols;
+    std::vector<std::string> index2_cols;
+    std::string key_data_prefix;
+    std::string key2_data_prefix;
+
+    explicit query_plan(const query_op& op);
+    ~query_plan();
+};
+
+query_plan::query_plan(const query_op& op)
+{
+    using namespace Tables;
+
+    data_schema = schemaFromString(op.data_schema);
+    query_schema = schemaFromString(op.query_schema);
+    query_preds = predsFromString(data_schema, op.query_preds);
+    groupby_schema = schemaFromString(op.groupby_schema);
+    orderby_schema = schemaFromString(op.orderby_schema);
+    key_fb_prefix = buildKeyPrefix(SIT_IDX_FB, op.db_schema_name,
+                                   op.table_name);
+    key_zone_prefix = buildKeyPrefix(SIT_IDX_ZONE, op.db_schema_name,
+                                     op.table_name);
+    if (op.index_read) {
+        index_schema = schemaFromString(op.index_schema);
+        index_preds = predsFromString(data_schema, op.index_preds);
+        index_cols = colnamesFromSchema(index_schema);
+        key_data_prefix = buildKeyPrefix(op.index_type, op.db_schema_name,
+                                         op.table_name, index_cols);
+        index2_schema = schemaFromString(op.index2_schema);
+        index2_preds = predsFromString(data_schema, op.index2_preds);
+        index2_cols = colnamesFromSchema(index2_schema);
+        key2_data_prefix = buildKeyPrefix(op.index2_type, op.db_schema_name,
+                                          op.table_name, index2_cols);
+    }
+}
+
+query_plan::~query_plan()
+{
+    for (auto p : query_preds) delete p;
+    for (auto p : index_preds) delete p;
+    for (auto p : index2_preds) delete p;
+}
+
+// the preds of an op from the cached preds of its plan, copying only the
+// agg preds into owned_preds.
+static Tables::predicate_vec op_preds(
+    const Tables::predicate_vec& preds,
+    std::vector<std::unique_ptr<Tables::PredicateBase>>& owned_preds)
+{
+    Tables::predicate_vec op_preds;
+    op_preds.reserve(preds.size());
+    for (auto p : preds) {
+        if (p->isGlobalAgg()) {
+            owned_preds.emplace_back(p->clone());
+            op_preds.push_back(owned_preds.back().get());
+        }
+        else {
+            op_preds.push_back(p);
+        }
+    }
+    return op_preds;
+}
+
+// LRU of parsed plans shared by the op threads of this OSD, keyed by all
+// of the query_op fields a plan is built from.
+typedef std::list<std::pair<std::string,
+                            std::shared_ptr<const query_plan>>> plan_lru_t;
+static std::mutex query_plan_lock;
+static plan_lru_t query_plan_lru;
+static std::unordered_map<std::string, plan_lru_t::iterator> query_plan_map;
+
+static std::string query_plan_key(const query_op& op)
+{
+    std::string key;
+    auto append = [&key](const std::string& s) {
+        key.append(std::to_string(s.size()));
+        key.push_back(':');
+        key.append(s);
+    };
+    append(op.db_schema_name);
+    append(op.table_name);
+    append(op.data_schema);
+    append(op.query_schema);
+    append(op.query_preds);
+    append(op.groupby_schema);
+    append(op.orderby_schema);
+    key.push_back(op.index_read ? '1' : '0');
+    if (op.index_read) {
+        append(std::to_string(op.index_type));
+        append(op.index_schema);
+        append(op.index_preds);
+        append(std::to_string(op.index2_type));
+        append(op.index2_schema);
+        append(op.index2_preds);
+    }
+    return key;
+}
+
+// cached plan of this op, parsed and inserted on a miss
+static std::shared_ptr<const query_plan>
+get_query_plan(const query_op& op, bool& cache_hit)
+{
+    std::string key = query_plan_key(op);
+    {
+        std::lock_guard<std::mutex> l(query_plan_lock);
+        auto it = query_plan_map.find(key);
+        if (it != query_plan_map.end()) {
+            query_plan_lru.splice(query_plan_lru.begin(), query_plan_lru,
+                                  it->second);
+            cache_hit = true;
+            return it->second->second;
+        }
+    }
+
+    // parse outside of the lock, a concurrent miss on the same key just
+    // replaces the entry.
+    cache_hit = false;
+    auto plan = std::make_shared<const query_plan>(op);
+    std::lock_guard<std::mutex> l(query_plan_lock);
+    auto it = query_plan_map.find(key);
+    if (it != query_plan_map.end()) {
+        query_plan_lru.erase(it->second);
+        query_plan_map.erase(it);
+    }
+    query_plan_lru.emplace_front(key, plan);
+    query_plan_map[key] = query_plan_lru.begin();
+    while (query_plan_lru.size() > (size_t)Tables::QUERY_PLAN_CACHE_MAX) {
+        query_plan_map.erase(query_plan_lru.back().first);
+        query_plan_lru.pop_back();
+    }
+    return plan;
+}
+
 /*
  * Primary method to process queries
  */
@@ -945,11 +2549,12 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
     int ret = 0;
 
-    // accounting.
+    // accounting, returned to the client along with the result.
+    cls_info info;
     uint64_t read_start = 0;
-    uint64_t read_ns = 0;
     uint64_t eval_start = 0;
-    uint64_t eval_ns = 0;
+    uint64_t encode_start = 0;
+    omap_keys_read = 0;
 
     // result set to be returned to client.
     bufferlist result_bl;
@@ -966,6 +2571,11 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         CLS_ERR("ERROR: exec_query_op: decoding query op failed");
         return -EINVAL;
     }
+    if (!compression_type_valid(op.result_compression)) {
+        CLS_ERR("ERROR: exec_query_op: compression type unknown. type=%d",
+                op.result_compression);
+        return -EINVAL;
+    }
 
     // remove newlines for cls logging purpose
     std::string msg = op.toString();
@@ -986,17 +2596,34 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
     std::map<int, struct read_info> reads;
     std::map<int, struct read_info> idx1_reads;
     std::map<int, struct read_info> idx2_reads;
+    std::string plan_info;  // chosen index plan and estimates, if any
+
+    // parsed schemas, preds and key prefixes, shared with other ops
+    // running the same query.
+    bool plan_cached = false;
+    std::shared_ptr<const query_plan> plan = get_query_plan(op, plan_cached);
+    if (op.debug)
+        CLS_LOG(20, "exec_query_op: query plan cache %s",
+                plan_cached ? "hit" : "miss");
 
     // data_schema is the table's current schema
     // TODO: redundant, this is also stored in the fb, extract from fb?
-    schema_vec data_schema = schemaFromString(op.data_schema);
+    schema_vec data_schema = plan->data_schema;
 
     // query_schema is the query schema
-    schema_vec query_schema = schemaFromString(op.query_schema);
+    schema_vec query_schema = plan->query_schema;
+
+    // preds of this op not shared with the plan, freed on any return
+    std::vector<std::unique_ptr<PredicateBase>> owned_preds;
 
     // predicates to be applied, if any
-    predicate_vec query_preds = predsFromString(data_schema,
-                                                op.query_preds);
+    predicate_vec query_preds = op_preds(plan->query_preds, owned_preds);
+
+    // group key cols of the agg preds, if any
+    schema_vec groupby_schema = plan->groupby_schema;
+
+    // order by key col of a top-k query, if any
+    schema_vec orderby_schema = plan->orderby_schema;
 
     /* INDEXING LOOKUPS */
     //
@@ -1004,52 +2631,38 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
     predicate_vec index_preds;
     predicate_vec index2_preds;
 
-    std::string key_fb_prefix = buildKeyPrefix(SIT_IDX_FB,
-                                               op.db_schema_name,
-                                               op.table_name);
+    const std::string& key_fb_prefix = plan->key_fb_prefix;
 
     // lookup correct flatbuf and potentially set specific row nums
     // to be processed next in processFb()
+    uint64_t index_start = getns();
     if (op.index_read) {
 
         // get info for index1
-        schema_vec index_schema = \
-                schemaFromString(op.index_schema);
-
-        index_preds = \
-                predsFromString(data_schema, op.index_preds);
-
-        std::vector<std::string> index_cols = \
-                colnamesFromSchema(index_schema);
-
-        std::string key_data_prefix = \
-                buildKeyPrefix(op.index_type,
-                               op.db_schema_name,
-                               op.table_name,
-                               index_cols);
+        index_preds = op_preds(plan->index_preds, owned_preds);
+        const std::vector<std::string>& index_cols = plan->index_cols;
+        const std::string& key_data_prefix = plan->key_data_prefix;
 
         // get info for index2
-        schema_vec index2_schema = \
-                schemaFromString(op.index2_schema);
-        index2_preds = \
-                predsFromString(data_schema, op.index2_preds);
-
-        std::vector<std::string> index2_cols = \
-                colnamesFromSchema(index2_schema);
-
-        std::string key2_data_prefix = \
-                buildKeyPrefix(op.index2_type,
-                               op.db_schema_name,
-                               op.table_name,
-                               index2_cols);
+        index2_preds = op_preds(plan->index2_preds, owned_preds);
+        const std::string& key2_data_prefix = plan->key2_data_prefix;
 
         // verify if index1 is present in omap
         index1_exists = sky_index_exists(hctx,
                                          key_data_prefix);
 
+        // verify if index2 is present in omap, if a 2 index plan
+        if (op.index_plan_type == SIP_IDX_INTERSECTION or
+            op.index_plan_type == SIP_IDX_UNION)
+            index2_exists = sky_index_exists(hctx,
+                                             key2_data_prefix);
+
         // check local statistics, decide to use or not.
-        if (index1_exists)
-            use_index1 = use_sky_index(hctx, key_data_prefix, index_preds);
+        plan_sky_index(hctx, op, data_schema, index_preds, index2_preds,
+                       index1_exists, index2_exists, use_index1, use_index2,
+                       plan_info);
+        if (op.debug)
+            CLS_LOG(20, "exec_query_op: %s", plan_info.c_str());
 
         if (index1_exists && use_index1) {
 
@@ -1099,20 +2712,10 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                 case SIP_IDX_INTERSECTION:
                 case SIP_IDX_UNION: {
 
-                    // verify if index2 is present in omap
-                    index2_exists = sky_index_exists(hctx,
-                                                     key2_data_prefix);
-
-                    // check local statistics, decide to use or not.
-                    if (index2_exists)
-                        use_index2 = use_sky_index(hctx,
-                                                   key2_data_prefix,
-                                                   index2_preds);
-
                     if (index2_exists && use_index2) {
 
                         // check for case of multicol index but not all equality.
-                        if (index2_cols.size() > 1 and
+                        if (plan->index2_cols.size() > 1 and
                             !check_predicate_ops_all_equality(index2_preds)) {
 
                             // NOTE: same reasoning as above for index1_preds
@@ -1139,82 +2742,9 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                         CLS_LOG(20, "exec_query_op: index2 found %lu entries", idx2_reads.size());
 
                         // INDEX PLAN (INTERSECTION or UNION)
-                        // for each fbseq_num in idx1 reads, check if idx2
-                        // has any rows for same fbseq_num, perform
-                        // intersection or union of rows, store resulting
-                        // rows into our reads vector.
-                        ///reads.clear();
-
-                        // for union always "populate" the first vector
-                        // because we always iterate over that one, so it
-                        // cannot be empty
-                        if (idx1_reads.empty() and op.index_plan_type == SIP_IDX_UNION) {
-                            idx1_reads = idx2_reads;
-                        }
-
-                        // iterate over idx1 and check idx2 union/intersection
-                        for (auto it1 = idx1_reads.begin(); it1 != idx1_reads.end(); ++it1) {
-
-                            int fbnum = it1->first;
-                            auto it2 = idx2_reads.find(fbnum);
-
-                            // if not found but we need to do union, then
-                            // point the second iterator back to the first.
-                            if (it2 == idx2_reads.end() and op.index_plan_type == SIP_IDX_UNION) {
-                                it2 = it1;
-                            }
-
-                            if (it2 != idx2_reads.end()) {
-                                struct Tables::read_info ri1 = it1->second;
-                                struct Tables::read_info ri2 = it2->second;
-                                std::vector<unsigned> rnums1 = ri1.rnums;
-                                std::vector<unsigned> rnums2 = ri2.rnums;
-                                std::sort(rnums1.begin(), rnums1.end());
-                                std::sort(rnums2.begin(), rnums2.end());
-                                std::vector<unsigned> result_rnums(
-                                        rnums1.size() + rnums2.size());
-
-                                switch (op.index_plan_type) {
-
-                                    case SIP_IDX_INTERSECTION: {
-                                        auto it = std::set_intersection(
-                                                        rnums1.begin(),
-                                                        rnums1.end(),
-                                                        rnums2.begin(),
-                                                        rnums2.end(),
-                                                        result_rnums.begin());
-                                        result_rnums.resize(it -
-                                                        result_rnums.begin());
-                                        break;
-                                    }
-
-                                    case SIP_IDX_UNION: {
-                                        auto it = std::set_union(
-                                                        rnums1.begin(),
-                                                        rnums1.end(),
-                                                        rnums2.begin(),
-                                                        rnums2.end(),
-                                                        result_rnums.begin());
-                                        result_rnums.resize(it -
-                                                        result_rnums.begin());
-                                        break;
-                                    }
-
-                                    default: {
-                                        // none
-                                    }
-                                } // end switch op.index_plan_type
-
-                                if (!result_rnums.empty()) {
-
-                                    reads[fbnum] = Tables::read_info(
-                                                            ri1.fb_seq_num,
-                                                            ri1.off,
-                                                            ri1.len,
-                                                            result_rnums);
-                                }
-                            } // end if (it2 != idx2_reads.end())
-                        } // end for (auto it1 = idx1_reads.begin();
+                        // combine the rows each index found per fb.
+                        combine_index_reads({&idx1_reads, &idx2_reads},
+                                            op.index_plan_type, reads);
                     } // end if (use_index2)
 
                     break;
@@ -1226,6 +2756,7 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
             } // end switch (op.index_plan_type)
         } // end if (index1_exists && use_index1)
     } // end if (op.index_read)
+    info.index_ns += getns() - index_start;
 
 
     /*
@@ -1252,6 +2783,8 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         // those requested index predicates to our query_preds so those
         // predicates can be applied during the data scan operator
         if (!use_index1) {
+            if (op.index_type == SIT_IDX_TXT)
+                text_index_scan_preds(index_preds, owned_preds);
             if (!index_preds.empty()) {
                     query_preds.insert(
                         query_preds.end(),
@@ -1261,6 +2794,8 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         }
 
         if (!use_index2) {
+            if (op.index2_type == SIT_IDX_TXT)
+                text_index_scan_preds(index2_preds, owned_preds);
             if (!index2_preds.empty()) {
                     query_preds.insert(
                         query_preds.end(),
@@ -1270,6 +2805,36 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         }
     }
 
+    // compile the final set of query preds once, the same engine is then
+    // reused to evaluate the preds over each fb in the object.
+    PredicateEngine query_engine(query_preds);
+    if (op.debug)
+        CLS_LOG(20, "exec_query_op: %s", query_engine.toString().c_str());
+
+    // grouped aggs accumulate per group over all fbmetas, and the group rows
+    // are returned as a single result.  Once the group table reaches its
+    // memory budget the result is capped at the current fbmeta, as below.
+    std::unique_ptr<GroupTable> groups;
+    if (!groupby_schema.empty() and query_engine.hasAggs()) {
+        uint64_t max_bytes = op.groupby_max_bytes;
+        if (max_bytes == 0)
+            max_bytes = GROUPBY_MAX_BYTES_DEFAULT;
+        groups.reset(new GroupTable(groupby_schema,
+                                    groupAggsFromPreds(query_preds),
+                                    false,
+                                    max_bytes));
+    }
+
+    // order by with a limit keeps the top row_limit rows over all fbmetas,
+    // returned as a single result.  A limit alone stops the scan once
+    // row_limit rows have been returned.  Agg results are a row per group
+    // so are never limited here.
+    std::unique_ptr<TopKRows> topk;
+    uint64_t row_limit = query_engine.hasAggs() ? 0 : op.row_limit;
+    uint64_t rows_returned = 0;
+    if (row_limit > 0 and !orderby_schema.empty())
+        topk.reset(new TopKRows(orderby_schema[0], op.orderby_desc, row_limit));
+
 
     if (!op.index_read or
         (op.index_read and (!use_index1 and !use_index2))) {
@@ -1284,11 +2849,21 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 
         // default, assume we have plenty of mem avail.
         bool read_full_object = true;
+        index_start = getns();
+
+        // fbs may be skipped by their zone maps if there are preds to check
+        const std::string& key_zone_prefix = plan->key_zone_prefix;
+        bool use_zone_maps = !query_preds.empty() and
+                             sky_index_exists(hctx, key_zone_prefix);
 
-        if (op.mem_constrain) {
+        if (op.mem_constrain or use_zone_maps) {
 
-            // try to set the reads[] with the fb sequence
-            int ret = read_fbs_index(hctx, key_fb_prefix, reads);
+            // try to set the reads[] with the fb sequence, starting from
+            // the cursor of a prior capped call if any.
+            unsigned int seq_min = std::max(op.resume_seq_num,
+                                            DATASTRUCT_SEQ_NUM_MIN);
+            int ret = read_fbs_index(hctx, key_fb_prefix,
+                                     op.index_batch_size, reads, seq_min);
 
             if (reads.empty())
                 CLS_LOG(20,"exec_query_op: WARN: No FBs index entries found.");
@@ -1297,7 +2872,54 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
             // no longer need to read the full object.
             if (ret >= 0 and !reads.empty())
                 read_full_object = false;
+
+            if (use_zone_maps and !read_full_object) {
+                int nfbs = reads.size();
+                int npruned = 0;
+                std::map<int, struct read_info> all_reads = reads;
+                ret = prune_fbs_by_zone_maps(hctx, key_zone_prefix,
+                                             query_preds,
+                                             op.index_batch_size,
+                                             reads, &npruned);
+                if (ret < 0)
+                    return ret;
+
+                // global aggs still produce a result row if no fb matches
+                if (reads.empty() and query_engine.hasAggs())
+                    reads.insert(*all_reads.begin());
+
+                if (!plan_info.empty())
+                    plan_info.append(";");
+                plan_info.append("zonemap_skipped=" +
+                                 std::to_string(npruned) + "/" +
+                                 std::to_string(nfbs));
+                info.fbs_skipped = npruned;
+            }
+        }
+
+        // a capped result, or a group table that reaches its budget, is
+        // only resumable from per fbmeta reads, so these are taken from the
+        // fb index if not yet tried, else by walking the fbmetas of the
+        // object.
+        if (read_full_object and (op.result_max_bytes > 0 or groups)) {
+            unsigned int seq_min = std::max(op.resume_seq_num,
+                                            DATASTRUCT_SEQ_NUM_MIN);
+            int ret = -ENOENT;
+            if (!op.mem_constrain and !use_zone_maps)
+                ret = read_fbs_index(hctx, key_fb_prefix,
+                                     op.index_batch_size, reads, seq_min);
+            if (ret < 0 or reads.empty()) {
+                reads.clear();
+                ret = walk_fbmetas(hctx, reads, seq_min);
+                if (ret < 0) {
+                    CLS_ERR("ERROR: exec_query_op: result_max_bytes=%lu groupby_max_bytes=%lu needs per fbmeta reads %d",
+                            op.result_max_bytes, op.groupby_max_bytes, ret);
+                    return ret;
+                }
+            }
+            read_full_object = false;
         }
+        info.index_ns += getns() - index_start;
 
         // if we must read the full object, we set the reads[] to
         // contain a single read, indicating the entire object.
@@ -1311,23 +2933,88 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         }
     }
 
+    // reads[] from the fb index or a data index are per fbmeta, so a
+    // capped result can be resumed at any fb_seq_num, whereas a single
+    // full object read cannot.
+    bool resumable = !(reads.size() == 1 and reads.begin()->second.len == 0);
+    if (resumable and op.resume_seq_num > DATASTRUCT_SEQ_NUM_MIN)
+        reads.erase(reads.begin(), reads.lower_bound(op.resume_seq_num));
+
+    // set to the seq num of the next unprocessed fbmeta if result is capped
+    int next_seq_num = -1;
+
+    // fbmetas are processed concurrently if requested, unless the query has
+    // aggs, groups, top-k or a row limit, whose state carries over from one
+    // fbmeta to the next.  threads are capped per op so as to share the osd
+    // with the op threads of other requests, and over all ops by the
+    // threads reserved from the OSD limit, serially once none are left.
+    int nthreads = std::min(op.max_threads, QUERY_THREADS_MAX);
+    int ncores = std::thread::hardware_concurrency();
+    if (ncores > 0)
+        nthreads = std::min(nthreads, ncores);
+    bool parallel = nthreads > 1 and !query_engine.hasAggs() and !groups and
+                    !topk and row_limit == 0;
+    query_threads_reservation extra_threads(parallel ? nthreads - 1 : 0);
+    nthreads = 1 + extra_threads.count();
+    parallel = parallel and nthreads > 1;
+    if (parallel) {
+        if (op.debug)
+            CLS_LOG(20, "exec_query_op: processing fbmetas on %d threads",
+                    nthreads);
+        ret = exec_query_fbmetas_parallel(hctx, op, reads, resumable,
+                                          nthreads, data_schema, query_schema,
+                                          query_preds, result_bl, info,
+                                          &next_seq_num);
+        if (ret < 0)
+            return ret;
+        if (!plan_info.empty())
+            plan_info.append(";");
+        plan_info.append("query_threads=" + std::to_string(nthreads));
+    }
+
     // now we can decode and process each bl in the obj
     // loop over a list of reads() that may have come from an index lookup
     // or if no index lookup, then a single read with off=0 and len=0 to
     // read the entire object len.
-    // NOTE: 1 bl contains exactly 1 fbmeta.
+    // NOTE: 1 bl contains exactly 1 fbmeta, but reads of adjacent fbmetas
+    // are coalesced so 1 read may contain a sequence of bls.
     // weak ordering in map will iterate over fbmetas in sequence
-    for (auto it = reads.begin(); it != reads.end(); ++it) {
+    // builders are reused across all fbmetas rather than allocated per fbmeta
+    BuilderPool builders;
+    bufferlist b;
+    std::vector<char> blob_buf;  // decompressed blob, reused across fbmetas
+
+    // agg preds accumulate over all fbmetas, so only the agg row built for
+    // the last fbmeta is returned, as this object's partial aggs.  The row
+    // is copied out of the pooled builder, which the next fbmeta reuses.
+    bool aggs_only = query_engine.hasAggs() and !groups;
+    bufferlist agg_result;
+    bool have_agg_result = false;
+    bool limit_reached = false;
+    for (auto it = reads.begin(); !parallel and
+         it != reads.end() and next_seq_num < 0 and !limit_reached; ) {
 
         // get an off len to read from the object.
-        bufferlist b;
         size_t off = it->second.off;
         size_t len = it->second.len;
-        std::vector<unsigned int> row_nums = it->second.rnums;
+        auto fb_it = it++;  // read info of the next fbmeta decoded from b
+
+        // extend the read over any following adjacent fbmetas, up to the
+        // batch size.  The rows of each fbmeta are taken from its own read
+        // info when it is decoded.
+        if (resumable) {
+            while (it != reads.end() and
+                   static_cast<size_t>(it->second.off) == off + len and
+                   len + it->second.len <= READ_BATCH_BYTES_MAX) {
+                len += it->second.len;
+                ++it;
+            }
+        }
         std::string msg = "off=" + std::to_string(off) +
                           ";len=" + std::to_string(len);
 
         read_start = getns();
+        b.clear();
         ret = cls_cxx_read(hctx, off, len, &b);
         if (ret < 0) {
           std::string msg = std::to_string(ret) + "reading obj at off="
@@ -1335,12 +3022,13 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
           CLS_ERR("ERROR: cls: exec_query_op: %s", msg.c_str());
           return ret;
         }
-        read_ns += getns() - read_start;
+        info.read_ns += getns() - read_start;
+        info.bytes_read += b.length();
 
         // begin processing, so we record the evaluation time.
         eval_start = getns();
         ceph::bufferlist::const_iterator data_itr = b.begin();
-        while (data_itr.get_remaining() > 0) {
+        while (data_itr.get_remaining() > 0 and !limit_reached) {
 
             // unpack the next data stucture (ds) in sequence
             // obj contains a sequence of fbmeta's, each encoded as bl
@@ -1374,6 +3062,33 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
             // the decoded bl should contain exactly 1 fbmeta
             sky_meta fbmeta = getSkyMeta(&data);
 
+            // compressed blobs are processed decompressed, unless passed
+            // thru as is by the fastpath.
+            bool pass_thru = op.fastpath and
+                             (fbmeta.blob_format == SFT_FLATBUF_FLEX_ROW or
+                              fbmeta.blob_format == SFT_ARROW);
+            if (!pass_thru) {
+                ret = decompressSkyMeta(fbmeta, blob_buf);
+                if (ret != 0) {
+                    CLS_ERR("ERROR: cls: exec_query_op: decompressing blob TablesErrCodes::%d", ret);
+                    return -EINVAL;
+                }
+            }
+
+            // rows of this fbmeta to process in ascending order, empty for
+            // all rows
+            std::vector<unsigned int> row_nums;
+            if (fb_it != reads.end())
+                fb_it->second.rows.toRowNums(row_nums);
+
+            // rows of blobs passed thru compressed are not counted
+            info.fbs_scanned++;
+            uint64_t rows_examined = 0;
+            if (!pass_thru or fbmeta.blob_compression == none)
+                rows_examined = fbmeta_rows_examined(fbmeta, row_nums);
+            info.rows_examined += rows_examined;
+            encode_start = 0;
+
             if (op.debug) {
                 CLS_LOG(20, "cls: exec_query_op: fbmeta.blob_format=%d", fbmeta.blob_format);
                 CLS_LOG(20, "cls: exec_query_op: fbmeta.blob_data=0x%p", &fbmeta.blob_data[0]);
@@ -1389,10 +3104,12 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 
             // CREATE An FB_META, start with an empty builder first
             flatbuffers::FlatBufferBuilder *fbmeta_builder =  \
-                new flatbuffers::FlatBufferBuilder();
+                &builders.metaBuilder(0);
+
+            // set if the case below already appended its result to result_bl
+            bool result_appended = false;
 
             // call associated process method based on ds type
-            eval_start = getns();
             switch (fbmeta.blob_format) {
 
             case SFT_JSON: {
@@ -1415,6 +3132,7 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                 char* result_data = orig_data;
                 size_t result_size = orig_size;
 
+                fbmeta_builder = &builders.metaBuilder(result_size);
                 createFbMeta(fbmeta_builder,
                              SFT_FLATBUF_FLEX_ROW,
                              reinterpret_cast<unsigned char*>(
@@ -1428,8 +3146,16 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                 if (op.debug)
                     CLS_LOG(20, "cls: exec_query_op: case SFT_FLATBUF_FLEX_ROW");
 
+                // size the result to the projected fraction of the blob
+                // so it is allocated once instead of doubling while built.
                 int bldr_size = 1024;
-                flatbuffers::FlatBufferBuilder result_builder(bldr_size);
+                size_t result_size = fbmeta.blob_size;
+                if (!data_schema.empty() and
+                    query_schema.size() < data_schema.size())
+                    result_size = result_size * query_schema.size() /
+                                  data_schema.size();
+                flatbuffers::FlatBufferBuilder& result_builder = \
+                    builders.resultBuilder(result_size + bldr_size);
 
                 // temporary toggle for wasm execution testing
                 bool wasm = false;
@@ -1473,13 +3199,59 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                 else {
 
                     // short circuit processing since select * query.
-                    if (op.fastpath) {
+                    if (op.fastpath and fbmeta.blob_compression != none) {
+
+                    // pass thru the orig fbmeta still compressed.
+                    result_bl.append(data);
+                    result_appended = true;
+                    }
+                    else if (op.fastpath) {
 
                     // just create a new fbmeta from the orig data blob.
-                    createFbMeta(fbmeta_builder,
+                    info.rows_passed += rows_examined;
+                    encode_start = getns();
+                    fbmeta_builder = &builders.metaBuilder(fbmeta.blob_size);
+                    ret = createFbMeta(fbmeta_builder,
                         SFT_FLATBUF_FLEX_ROW,
                         reinterpret_cast<unsigned char*>(const_cast<char*>(fbmeta.blob_data)),
-                        fbmeta.blob_size);
+                        fbmeta.blob_size,
+                        false, 0, 0,
+                        op.result_compression);
+                    if (ret != 0) {
+                        CLS_ERR("ERROR: createFbMeta TablesErrCodes::%d", ret);
+                        return -1;
+                    }
+                    }
+                    else if (groups) {
+                        ret = processSkyFbGroups(*groups,
+                                                 query_engine,
+                                                 fbmeta.blob_data,
+                                                 fbmeta.blob_size,
+                                                 errmsg,
+                                                 row_nums);
+                        if (ret != 0) {
+                            CLS_ERR("ERROR: processSkyFbGroups %s", errmsg.c_str());
+                            CLS_ERR("ERROR: TablesErrCodes::%d", ret);
+                            return -1;
+                        }
+                        result_appended = true;  // group rows are built last
+                    }
+                    else if (topk) {
+                        ret = processSkyFbTopK(*topk,
+                                               data_schema,
+                                               query_schema,
+                                               query_engine,
+                                               builders,
+                                               fbmeta.blob_data,
+                                               fbmeta.blob_size,
+                                               errmsg,
+                                               row_nums);
+                        if (ret != 0) {
+                            CLS_ERR("ERROR: processSkyFbTopK %s", errmsg.c_str());
+                            CLS_ERR("ERROR: TablesErrCodes::%d", ret);
+                            return -1;
+                        }
+                        result_appended = true;  // top-k rows are built last
                     }
                     else {
                         // normal case, pass in cpp typed params
@@ -1487,10 +3259,13 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                                            data_schema,
                                            query_schema,
                                            query_preds,
+                                           query_engine,
+                                           builders,
                                            fbmeta.blob_data,
                                            fbmeta.blob_size,
                                            errmsg,
-                                           row_nums);
+                                           row_nums,
+                                           row_limit - rows_returned);
 
 
                         if (ret != 0) {
@@ -1499,12 +3274,29 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                             return -1;
                         }
 
-                        createFbMeta(fbmeta_builder,
-                                     SFT_FLATBUF_FLEX_ROW,
-                                     reinterpret_cast<unsigned char*>(
-                                            result_builder.GetBufferPointer()),
-                                            result_builder.GetSize()
+                        uint64_t nrows_out = fb_result_rows(result_builder);
+                        if (!aggs_only)
+                            info.rows_passed += nrows_out;
+                        if (row_limit > 0) {
+                            rows_returned += nrows_out;
+                            limit_reached = rows_returned >= row_limit;
+                        }
+
+                        encode_start = getns();
+                        fbmeta_builder = &builders.metaBuilder(
+                                            result_builder.GetSize());
+                        ret = createFbMeta(fbmeta_builder,
+                                           SFT_FLATBUF_FLEX_ROW,
+                                           reinterpret_cast<unsigned char*>(
+                                                  result_builder.GetBufferPointer()),
+                                           result_builder.GetSize(),
+                                           false, 0, 0,
+                                           op.result_compression
                         );
+                        if (ret != 0) {
+                            CLS_ERR("ERROR: createFbMeta TablesErrCodes::%d", ret);
+                            return -1;
+                        }
                     }
                 }
                 break;
@@ -1518,11 +3310,41 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                 // short circuit processing since select * query.
                 if (op.fastpath) {
 
-                // just create a new fbmeta from the orig data blob.
-                createFbMeta(fbmeta_builder,
-                    SFT_ARROW,
-                    reinterpret_cast<unsigned char*>(const_cast<char*>(fbmeta.blob_data)),
-                    fbmeta.blob_size);
+                // just pass through the orig fbmeta, sharing its memory.
+                info.rows_passed += rows_examined;
+                result_bl.append(data);
+                result_appended = true;
+                }
+                else if (groups) {
+                    ret = processArrowGroups(*groups,
+                                             data_schema,
+                                             query_engine,
+                                             fbmeta.blob_data,
+                                             fbmeta.blob_size,
+                                             errmsg,
+                                             row_nums);
+                    if (ret != 0) {
+                        CLS_ERR("ERROR: processArrowGroups %s", errmsg.c_str());
+                        CLS_ERR("ERROR: TablesErrCodes::%d", ret);
+                        return -1;
+                    }
+                    result_appended = true;  // group rows are built last
+                }
+                else if (topk) {
+                    ret = processArrowTopK(*topk,
+                                           data_schema,
+                                           query_schema,
+                                           query_engine,
+                                           fbmeta.blob_data,
+                                           fbmeta.blob_size,
+                                           errmsg,
+                                           row_nums);
+                    if (ret != 0) {
+                        CLS_ERR("ERROR: processArrowTopK %s", errmsg.c_str());
+                        CLS_ERR("ERROR: TablesErrCodes::%d", ret);
+                        return -1;
+                    }
+                    result_appended = true;  // top-k rows are built last
                 }
                 else {
                     std::shared_ptr<arrow::Table> table;
@@ -1530,10 +3352,12 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                                           data_schema,
                                           query_schema,
                                           query_preds,
+                                          query_engine,
                                           fbmeta.blob_data,
                                           fbmeta.blob_size,
                                           errmsg,
-                                          row_nums);
+                                          row_nums,
+                                          row_limit - rows_returned);
 
                     if (ret != 0) {
                         CLS_ERR("ERROR: processArrowCol %s", errmsg.c_str());
@@ -1541,12 +3365,22 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                         return -1;
                     }
 
-                    std::shared_ptr<arrow::Buffer> buffer;
-                    convert_arrow_to_buffer(table, &buffer);
-                    createFbMeta(fbmeta_builder,
-                                 SFT_ARROW,
-                                 reinterpret_cast<unsigned char*>(buffer->mutable_data()),
-                                 buffer->size());
+                    info.rows_passed += table->num_rows();
+                    if (row_limit > 0) {
+                        rows_returned += table->num_rows();
+                        limit_reached = rows_returned >= row_limit;
+                    }
+
+                    // write the ipc stream directly into a new fbmeta
+                    // that is appended to the result bl by reference.
+                    encode_start = getns();
+                    ret = convert_arrow_to_fbmeta(table, result_bl,
+                                                  op.result_compression);
+                    if (ret != 0) {
+                        CLS_ERR("ERROR: convert_arrow_to_fbmeta TablesErrCodes::%d", ret);
+                        return -1;
+                    }
+                    result_appended = true;
                 }
                 break;
             }
@@ -1562,23 +3396,124 @@ int exec_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 
             } // end switch
 
-            // add meta_builder's data into the result bufferlist as char*
-            result_bl.append(reinterpret_cast<const char*>( \
-                             fbmeta_builder->GetBufferPointer()),
-                             fbmeta_builder->GetSize()
-            );
+            if (aggs_only and fbmeta.blob_format == SFT_FLATBUF_FLEX_ROW and
+                !op.fastpath) {
+                agg_result.clear();
+                agg_result.append(reinterpret_cast<const char*>(
+                                  fbmeta_builder->GetBufferPointer()),
+                                  fbmeta_builder->GetSize());
+                have_agg_result = true;
+                result_appended = true;
+            }
 
-            delete fbmeta_builder;
+            // add meta_builder's data into the result bufferlist as char*
+            if (!result_appended) {
+                result_bl.append(reinterpret_cast<const char*>( \
+                                 fbmeta_builder->GetBufferPointer()),
+                                 fbmeta_builder->GetSize()
+                );
+            }
+            if (encode_start > 0)
+                info.encode_ns += getns() - encode_start;
+
+            // stop once the result reaches the cap, or the group table its
+            // budget, the client resumes from the next fbmeta in a
+            // subsequent call.  Once the row limit is reached there is
+            // nothing left to resume.
+            if (resumable and fb_it != reads.end() and !limit_reached) {
+                ++fb_it;
+                bool capped = (op.result_max_bytes > 0 and
+                               result_bl.length() >= op.result_max_bytes) or
+                              (groups and groups->full());
+                if (capped and fb_it != reads.end()) {
+                    next_seq_num = fb_it->first;
+                    break;
+                }
+            }
 
         } // end while itr>0
 
-        eval_ns += getns() - eval_start; // add our processing time.
+        info.eval_ns += getns() - eval_start; // add our processing time.
     }  // end for reads
 
-    if (op.debug)
+    // the group and top-k rows of all fbmetas are built last
+    encode_start = getns();
+
+    if (have_agg_result) {
+        info.rows_passed += 1;
+        result_bl.claim_append(agg_result);
+    }
+
+    // the partial aggs of each group, one row per group
+    if (groups) {
+        if (op.debug)
+            CLS_LOG(20, "exec_query_op: %s", groups->toString().c_str());
+        info.rows_passed += groups->size();
+        flatbuffers::FlatBufferBuilder& result_builder = \
+            builders.resultBuilder(1024);
+        groups->buildFb(result_builder, op.query_schema);
+        flatbuffers::FlatBufferBuilder* fbmeta_builder = \
+            &builders.metaBuilder(result_builder.GetSize());
+        ret = createFbMeta(fbmeta_builder,
+                           SFT_FLATBUF_FLEX_ROW,
+                           reinterpret_cast<unsigned char*>(
+                              result_builder.GetBufferPointer()),
+                           result_builder.GetSize(),
+                           false, 0, 0,
+                           op.result_compression);
+        if (ret != 0) {
+            CLS_ERR("ERROR: createFbMeta TablesErrCodes::%d", ret);
+            return -1;
+        }
+        result_bl.append(reinterpret_cast<const char*>( \
+                         fbmeta_builder->GetBufferPointer()),
+                         fbmeta_builder->GetSize()
+        );
+    }
+
+    // the top-k rows of this object, in order
+    if (topk) {
+        if (op.debug)
+            CLS_LOG(20, "exec_query_op: %s", topk->toString().c_str());
+        info.rows_passed += topk->size();
+        flatbuffers::FlatBufferBuilder& result_builder = \
+            builders.resultBuilder(1024);
+        topk->buildFb(result_builder, op.query_schema);
+        flatbuffers::FlatBufferBuilder* fbmeta_builder = \
+            &builders.metaBuilder(result_builder.GetSize());
+        ret = createFbMeta(fbmeta_builder,
+                           SFT_FLATBUF_FLEX_ROW,
+                           reinterpret_cast<unsigned char*>(
+                              result_builder.GetBufferPointer()),
+                           result_builder.GetSize(),
+                           false, 0, 0,
+                           op.result_compression);
+        if (ret != 0) {
+            CLS_ERR("ERROR: createFbMeta TablesErrCodes::%d", ret);
+            return -1;
+        }
+        result_bl.append(reinterpret_cast<const char*>( \
+                         fbmeta_builder->GetBufferPointer()),
+                         fbmeta_builder->GetSize()
+        );
+    }
+
+    if (op.debug) {
         CLS_LOG(20, "query_op.encoding result_bl size=%s", std::to_string(result_bl.length()).c_str());
+        CLS_LOG(20, "cls: exec_query_op: %s", builders.stats().toString().c_str());
+        if (next_seq_num >= 0)
+            CLS_LOG(20, "exec_query_op: result capped, next_seq_num=%d", next_seq_num);
+    }
 
-    cls_info info (read_ns, eval_ns, "", "");
+    if (groups or topk) {
+        uint64_t encode_ns = getns() - encode_start;
+        info.encode_ns += encode_ns;
+        info.eval_ns += encode_ns;
+    }
+    info.next_seq_num = next_seq_num;
+    info.plan_info = plan_info;
+    info.omap_keys = omap_keys_read;
+    info.result_bytes = result_bl.length();
 
     // add both our cls info struct and our result bl to the output buffer.
     using ceph::encode;
@@ -1876,41 +3811,160 @@ int test_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                     add_extra_row_cost(op.extra_row_cost);
                 }
             }
-        }
-        else { // look for matching row(s) and extract all cols.
-            RE2 re(op.comment_regex);
-            for (size_t rid = 0; rid < num_rows; rid++) {
-                const char *row = rows + rid * row_size;
-                const char *cptr = row + comment_field_offset;
-                const std::string comment_val = string_ncopy(cptr,
-                comment_field_length);
-                if (RE2::PartialMatch(comment_val, re)) {
-                    result_bl.append(row, row_size);
-                    add_extra_row_cost(op.extra_row_cost);
-                }
+        }
+        else { // look for matching row(s) and extract all cols.
+            RE2 re(op.comment_regex);
+            for (size_t rid = 0; rid < num_rows; rid++) {
+                const char *row = rows + rid * row_size;
+                const char *cptr = row + comment_field_offset;
+                const std::string comment_val = string_ncopy(cptr,
+                comment_field_length);
+                if (RE2::PartialMatch(comment_val, re)) {
+                    result_bl.append(row, row_size);
+                    add_extra_row_cost(op.extra_row_cost);
+                }
+            }
+        }
+    }
+    else if (op.query == "fastpath") { // just copy data directly out.
+        result_bl.append(bl);
+    }
+    else {
+        return -EINVAL;
+    }
+    eval_ns += getns() - start;
+
+    // record our cls information for later reporting.
+    cls_info info (
+        read_ns,
+        eval_ns,
+        "none",
+        "none");
+
+    // add both our cls info struct and our result bl to the output buffer.
+    using ceph::encode;
+    encode(info, *out);
+    encode(result_bl, *out);
+
+    return 0;
+}
+
+/*
+ * Compute the col_stats of each col of the table over all of the fbmetas of
+ * the object, read in extents of whole fbmetas, overwriting any prior
+ * stats.
+ */
+static
+int
+runstats_sky_fbs(
+    cls_method_context_t hctx,
+    const stats_op& op)
+{
+    using namespace Tables;
+    std::string dbschema = op.db_schema;
+    std::string table_name = op.table_name;
+    schema_vec data_schema = schemaFromString(op.data_schema);
+
+    int stride, nbins;
+    switch (op.stats_level) {
+        case LOW:
+            stride = STATS_SAMPLE_STRIDE_LOW;
+            nbins = STATS_NBINS_LOW;
+            break;
+        case HIGH:
+            stride = STATS_SAMPLE_STRIDE_HIGH;
+            nbins = STATS_NBINS_HIGH;
+            break;
+        case MED:
+        default:
+            stride = STATS_SAMPLE_STRIDE_MED;
+            nbins = STATS_NBINS_MED;
+    }
+
+    uint64_t obj_len = 0;
+    int ret = cls_cxx_stat(hctx, &obj_len, NULL);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_runstats_op: stat obj. %d", ret);
+        return ret;
+    }
+
+    // sample every fbmeta into one summary per col
+    uint64_t nrows = 0;
+    unsigned int nfbs = 0;
+    std::vector<col_summary> summaries;
+    std::vector<char> blob_buf;  // decompressed blob, reused across fbmetas
+    uint64_t off = 0;
+    while (off < obj_len) {
+        bufferlist extent;
+        ret = read_fbmeta_extent(hctx, off, obj_len, READ_BATCH_BYTES_MAX,
+                                 extent);
+        if (ret < 0) {
+            CLS_ERR("ERROR: exec_runstats_op: reading obj. %d", ret);
+            return ret;
+        }
+        off += extent.length();
+
+        ceph::bufferlist::const_iterator it = extent.begin();
+        while (it.get_remaining() > 0) {
+            bufferlist bl;
+            try {
+                using ceph::decode;
+                decode(bl, it);  // unpack the next bl
+            } catch (const buffer::error &err) {
+                CLS_ERR("ERROR: exec_runstats_op: decoding fbmeta from BL");
+                return -EINVAL;
+            }
+
+            sky_meta meta = getSkyMeta(&bl);
+            ret = decompressSkyMeta(meta, blob_buf);
+            if (ret != 0) {
+                CLS_ERR("ERROR: exec_runstats_op: decompressing blob TablesErrCodes::%d", ret);
+                return -EINVAL;
+            }
+            std::string errmsg;
+            ret = summarize_cols(meta.blob_data, meta.blob_size,
+                                 meta.blob_format, data_schema, stride,
+                                 &nrows, summaries, errmsg);
+            if (ret != 0) {
+                CLS_ERR("ERROR: exec_runstats_op: %s", errmsg.c_str());
+                return -EINVAL;
             }
+            nfbs++;
         }
     }
-    else if (op.query == "fastpath") { // just copy data directly out.
-        result_bl.append(bl);
-    }
-    else {
-        return -EINVAL;
-    }
-    eval_ns += getns() - start;
 
-    // record our cls information for later reporting.
-    cls_info info (
-        read_ns,
-        eval_ns,
-        "none",
-        "none");
+    // one col_stats entry per col, overwriting any prior stats
+    int64_t cur_time = static_cast<int64_t>(time(NULL));
+    std::map<std::string, bufferlist> stats_map;
+    for (unsigned i = 0; i < summaries.size(); i++) {
+        const col_info& col = data_schema[i];
+        if (col.idx < 0)
+            continue;
+        col_stats stats = build_col_stats(table_name, col, summaries[i],
+                                          nrows, op.stats_level, nbins,
+                                          cur_time);
+        CLS_LOG(20, "exec_runstats_op: %s", stats.toString().c_str());
+        bufferlist stats_bl;
+        using ceph::encode;
+        encode(stats, stats_bl);
+        stats_map[buildColStatsKey(dbschema, table_name, col.name)] = stats_bl;
+    }
 
-    // add both our cls info struct and our result bl to the output buffer.
-    using ceph::encode;
-    encode(info, *out);
-    encode(result_bl, *out);
+    ret = cls_cxx_map_set_vals(hctx, &stats_map);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_runstats_op: writing col_stats %d", ret);
+        return ret;
+    }
 
+    // the stats cover the whole object, so an incremental index build only
+    // adds the rows of fbs appended after it.
+    struct idx_progress progress(obj_len, DATASTRUCT_SEQ_NUM_MIN + nfbs);
+    ret = set_idx_progress(hctx, idx_progress_xattr(COL_STATS_KEY_PREFIX),
+                           progress);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_runstats_op: writing idx_progress %d", ret);
+        return ret;
+    }
     return 0;
 }
 
@@ -1932,18 +3986,34 @@ int exec_runstats_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
     CLS_LOG(20, "exec_runstats_op: table_name=%s", op.table_name.c_str());
     CLS_LOG(20, "exec_runstats_op: data_schema=%s", op.data_schema.c_str());
 
-    using namespace Tables;
-    std::string dbschema = op.db_schema;
-    std::string table_name = op.table_name;
-    schema_vec data_schema = schemaFromString(op.data_schema);
-
-    return 0;
+    return runstats_sky_fbs(hctx, op);
 }
 
 
+// the max rows per arrow record batch of a blob, when batch_rows < 0 it is
+// sized so that each batch is about ARROW_BATCH_BYTES_AUTO of the blob.
+static
+int
+arrow_batch_rows(int batch_rows, size_t blob_size, uint32_t nrows)
+{
+    if (batch_rows >= 0)
+        return batch_rows;
+    if (blob_size <= static_cast<size_t>(Tables::ARROW_BATCH_BYTES_AUTO))
+        return 0;
+    uint64_t rows = static_cast<uint64_t>(nrows) *
+                    Tables::ARROW_BATCH_BYTES_AUTO / blob_size;
+    return std::max(static_cast<uint64_t>(1), rows);
+}
+
 /*
  * Function: transform_db_op
- * Description: Method to convert database format.
+ * Description: Method to convert database format.  The fbmetas that start
+ *  in the extent of op.max_bytes of the object from op.src_off are each
+ *  transformed into the required format, or kept as they are if already in
+ *  that format, and returned in a transform_chunk.  The object is unchanged,
+ *  the caller writes the chunks of the object to a temp object and replaces
+ *  the object with it once all of its chunks are transformed, so that the
+ *  memory used is bounded by the extent and a transform can be resumed.
  * @param[in] hctx    : CLS method context
  * @param[out] in     : input bufferlist
  * @param[out] out    : output bufferlist
@@ -1953,7 +4023,6 @@ static
 int transform_db_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
 {
     transform_op op;
-    int offset = 0;
 
     // unpack the requested op from the inbl.
     try {
@@ -1964,29 +4033,50 @@ int transform_db_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
         CLS_ERR("ERROR: cls_tabular:transform_db_op: decoding transform_op");
         return -EINVAL;
     }
+    if (!compression_type_valid(op.compression_type)) {
+        CLS_ERR("ERROR: transform_db_op: compression type unknown. type=%d",
+                op.compression_type);
+        return -EINVAL;
+    }
 
     CLS_LOG(20, "transform_db_op: table_name=%s", op.table_name.c_str());
     CLS_LOG(20, "transform_db_op: transform_format_type=%d", op.required_type);
+    CLS_LOG(20, "transform_db_op: src_off=%lu", op.src_off);
 
     // Columns specified in the query schmea will transformed and not the whole
     // object.
     Tables::schema_vec query_schema = Tables::schemaFromString(op.query_schema);
 
-    // Object is sequence of actual data along with encoded metadata
-    bufferlist encoded_meta_bls;
+    using namespace Tables;
+    struct transform_chunk chunk;
+    int ret = cls_cxx_stat(hctx, &chunk.obj_len, NULL);
+    if (ret < 0) {
+        CLS_ERR("ERROR: transform_db_op: stat obj. %d", ret);
+        return ret;
+    }
+    if (op.src_off > chunk.obj_len) {
+        CLS_ERR("ERROR: transform_db_op: src_off=%lu beyond obj len=%lu",
+                op.src_off, chunk.obj_len);
+        return -EINVAL;
+    }
 
-    // TODO: get individual off/len of fbmeta's inside obj and read one at a time.
-    int ret = cls_cxx_read(hctx, 0, 0, &encoded_meta_bls);
+    // Object is sequence of actual data along with encoded metadata, only
+    // the extent of whole fbmetas from src_off is read
+    bufferlist encoded_meta_bls;
+    uint64_t max_bytes = op.max_bytes ? op.max_bytes : READ_BATCH_BYTES_MAX;
+    ret = read_fbmeta_extent(hctx, op.src_off, chunk.obj_len, max_bytes,
+                             encoded_meta_bls);
     if (ret < 0) {
         CLS_ERR("ERROR: transform_db_op: reading obj. %d", ret);
         return ret;
     }
+    chunk.next_off = op.src_off + encoded_meta_bls.length();
 
-    using namespace Tables;
     ceph::bufferlist::const_iterator it = encoded_meta_bls.begin();
+    BuilderPool builders;  // reused across all fbmetas in the object
+    std::vector<char> blob_buf;  // decompressed blob, reused likewise
     while (it.get_remaining() > 0) {
         bufferlist bl;
-        bufferlist transformed_encoded_meta_bl;
         try {
             using ceph::decode;
             decode(bl, it);  // unpack the next bl
@@ -1995,21 +4085,28 @@ int transform_db_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
             return -EINVAL;
         }
 
-        // default usage here assumes the fbmeta is already in the bl
+        // Check if transformation is required or not, a deleted blob is
+        // also kept as it is, for compaction to drop.
         sky_meta meta = getSkyMeta(&bl);
-        std::string errmsg;
-
-        // Check if transformation is required or not
-        if (meta.blob_format == op.required_type) {
-            // Source and destination object types are same, therefore no tranformation
-            // is required.
+        if (meta.blob_format == op.required_type or meta.blob_deleted) {
             CLS_LOG(20, "No Transforming required");
-            return 0;
+            using ceph::encode;
+            encode(bl, chunk.data);
+            continue;
+        }
+
+        // default usage here assumes the fbmeta is already in the bl
+        std::string errmsg;
+        ret = decompressSkyMeta(meta, blob_buf);
+        if (ret != 0) {
+            CLS_ERR("ERROR: transform_db_op: decompressing blob TablesErrCodes::%d", ret);
+            return -EINVAL;
         }
 
         // CREATE An FB_META, start with an empty builder first
         flatbuffers::FlatBufferBuilder *meta_builder =                  \
-            new flatbuffers::FlatBufferBuilder();
+            &builders.metaBuilder(0);
+        bufferlist meta_bl;
 
         // According to the format type transform the object
         if (op.required_type == SFT_ARROW) {
@@ -2021,53 +4118,520 @@ int transform_db_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
                 return ret;
             }
 
-            // Convert arrow to a buffer
-            std::shared_ptr<arrow::Buffer> buffer;
-            convert_arrow_to_buffer(table, &buffer);
+            // Bound the record batch size, cls processes one batch at a time
+            ret = rebatch_arrow_table(table,
+                                      arrow_batch_rows(op.arrow_batch_rows,
+                                                       meta.blob_size,
+                                                       table->num_rows()));
+            if (ret != 0) {
+                CLS_ERR("ERROR: rebatching arrow table TablesErrCodes::%d", ret);
+                return -EINVAL;
+            }
 
-            createFbMeta(meta_builder,
-                         SFT_ARROW,
-                         reinterpret_cast<unsigned char*>(buffer->mutable_data()),
-                         buffer->size());
+            // Convert arrow directly into an fbmeta in meta_bl
+            ret = convert_arrow_to_fbmeta(table, meta_bl, op.compression_type);
+            if (ret != 0) {
+                CLS_ERR("ERROR: converting arrow table to fbmeta");
+                return ret;
+            }
 
         } else if (op.required_type == SFT_FLATBUF_FLEX_ROW) {
-            flatbuffers::FlatBufferBuilder flatbldr(1024);  // pre-alloc sz
+            flatbuffers::FlatBufferBuilder& flatbldr = \
+                builders.resultBuilder(meta.blob_size);  // pre-alloc sz
 
             ret = transform_arrow_to_fb(meta.blob_data, meta.blob_size, errmsg, flatbldr);
             if (ret != 0) {
                 CLS_ERR("ERROR: transforming object from arrow to flatbuffer");
                 return ret;
             }
-            createFbMeta(meta_builder,
-                         SFT_FLATBUF_FLEX_ROW,
-                         reinterpret_cast<unsigned char*>(
-                                 flatbldr.GetBufferPointer()),
-                         flatbldr.GetSize());
+            meta_builder = &builders.metaBuilder(flatbldr.GetSize());
+            ret = createFbMeta(meta_builder,
+                               SFT_FLATBUF_FLEX_ROW,
+                               reinterpret_cast<unsigned char*>(
+                                       flatbldr.GetBufferPointer()),
+                               flatbldr.GetSize(),
+                               false, 0, 0,
+                               op.compression_type);
+            if (ret != 0) {
+                CLS_ERR("ERROR: transform_db_op: creating fbmeta TablesErrCodes::%d", ret);
+                return -EINVAL;
+            }
         }
 
         // Add meta_builder's data into a bufferlist as char*
-        bufferlist meta_bl;
-        meta_bl.append(reinterpret_cast<const char*>(
-                       meta_builder->GetBufferPointer()),
-                       meta_builder->GetSize()
-        );
+        if (meta_bl.length() == 0) {
+            meta_bl.append(reinterpret_cast<const char*>(
+                           meta_builder->GetBufferPointer()),
+                           meta_builder->GetSize()
+            );
+        }
         using ceph::encode;
-        encode(meta_bl, transformed_encoded_meta_bl);
-        delete meta_builder;
+        encode(meta_bl, chunk.data);
+        chunk.ntransformed++;
+    }
+
+    CLS_LOG(20, "transform_db_op: %s", chunk.toString().c_str());
+    using ceph::encode;
+    encode(chunk, *out);
+    return 0;
+}
+
+
+// the live rows of the fbs being merged into the next compacted fb, all of
+// the same table and data schema.
+struct compact_fb {
+    flatbuffers::FlatBufferBuilder* bldr;
+    std::vector<flatbuffers::Offset<Tables::Record>> offs;
+    int skyhook_version;
+    int data_structure_version;
+    int data_schema_version;
+    std::string data_schema;
+    std::string db_schema;
+    std::string table_name;
+    Tables::DictEncoder dicts;  // codes of the encoded cols of the rows
+    unsigned int nfbs;  // num fbmetas compacted so far
+
+    compact_fb() :
+        bldr(NULL),
+        skyhook_version(0),
+        data_structure_version(0),
+        data_schema_version(0),
+        nfbs(0) {}
+};
+
+/*
+ * Finish the rows of cfb as one fb of the table and append its fbmeta to
+ * out, in the required format of the compaction.  The builder of cfb is
+ * then cleared for the rows of the next fb.
+ */
+static
+int
+flush_compact_fb(
+    compact_fb& cfb,
+    const compact_op& op,
+    Tables::BuilderPool& builders,
+    bufferlist& out)
+{
+    using namespace Tables;
+    if (cfb.offs.empty())
+        return 0;
+
+    // the rows are all live, so the delete vector is all zeros
+    flatbuffers::FlatBufferBuilder& bldr = *cfb.bldr;
+    delete_vector dead_rows(cfb.offs.size(), 0);
+    auto data_schema = bldr.CreateString(cfb.data_schema);
+    auto db_schema = bldr.CreateString(cfb.db_schema);
+    auto table_name = bldr.CreateString(cfb.table_name);
+    auto delete_v = bldr.CreateVector(dead_rows);
+    auto rows_v = bldr.CreateVector(cfb.offs);
+    auto table = CreateTable(
+        bldr,
+        SFT_FLATBUF_FLEX_ROW,
+        cfb.skyhook_version,
+        cfb.data_structure_version,
+        cfb.data_schema_version,
+        data_schema,
+        db_schema,
+        table_name,
+        delete_v,
+        rows_v,
+        cfb.offs.size(),
+        cfb.dicts.finish(bldr));
+    bldr.Finish(table);
+
+    bufferlist meta_bl;
+    if (op.required_type == SFT_ARROW) {
+        std::string errmsg;
+        schema_vec schema = schemaFromString(cfb.data_schema);
+        std::shared_ptr<arrow::Table> arrow_table;
+        int ret = transform_fb_to_arrow(
+            reinterpret_cast<const char*>(bldr.GetBufferPointer()),
+            bldr.GetSize(), schema, errmsg, &arrow_table);
+        if (ret != 0) {
+            CLS_ERR("ERROR: exec_compact_op: transforming fb to arrow %s",
+                    errmsg.c_str());
+            return ret;
+        }
+        ret = rebatch_arrow_table(arrow_table,
+                                  arrow_batch_rows(op.arrow_batch_rows,
+                                                   bldr.GetSize(),
+                                                   cfb.offs.size()));
+        if (ret != 0) {
+            CLS_ERR("ERROR: exec_compact_op: rebatching arrow table TablesErrCodes::%d", ret);
+            return -EINVAL;
+        }
+        ret = convert_arrow_to_fbmeta(arrow_table, meta_bl,
+                                      op.compression_type);
+        if (ret != 0) {
+            CLS_ERR("ERROR: exec_compact_op: converting arrow table to fbmeta");
+            return ret;
+        }
+    }
+    else {
+        flatbuffers::FlatBufferBuilder& meta_builder = \
+            builders.metaBuilder(bldr.GetSize());
+        int ret = createFbMeta(&meta_builder,
+                               SFT_FLATBUF_FLEX_ROW,
+                               reinterpret_cast<unsigned char*>(bldr.GetBufferPointer()),
+                               bldr.GetSize(),
+                               false, 0, 0,
+                               op.compression_type);
+        if (ret != 0) {
+            CLS_ERR("ERROR: exec_compact_op: creating fbmeta TablesErrCodes::%d", ret);
+            return -EINVAL;
+        }
+        meta_bl.append(reinterpret_cast<const char*>(
+                       meta_builder.GetBufferPointer()),
+                       meta_builder.GetSize());
+    }
+    using ceph::encode;
+    encode(meta_bl, out);
+    cfb.nfbs++;
+
+    bldr.Clear();
+    cfb.offs.clear();
+    cfb.dicts.clear();
+    return 0;
+}
+
+/*
+ * Remove every skyhook index entry and index marker from omap, in batches
+ * of batch_size keys (or the default batch size if 0).  Col stats entries
+ * are kept.
+ */
+static
+int
+remove_sky_indexes(cls_method_context_t hctx, uint32_t batch_size)
+{
+    using namespace Tables;
+    if (batch_size == 0)
+        batch_size = IDX_BATCH_SIZE_DEFAULT;
+    std::vector<std::string> prefixes;
+    for (auto it = SkyIdxTypeMap.begin(); it != SkyIdxTypeMap.end(); ++it) {
+        if (it->first != SIT_IDX_UNK)
+            prefixes.push_back(it->second + IDX_KEY_DELIM_OUTER);
+    }
 
-        // Write the object back to Ceph. cls_cxx_replace truncates the original
-        // object and writes full object.
-        ret = cls_cxx_replace(hctx, offset, transformed_encoded_meta_bl.length(),
-                              &transformed_encoded_meta_bl);
+    std::string start_after;
+    bool more = true;
+    while (more) {
+        std::set<std::string> keys;
+        int ret = cls_cxx_map_get_keys(hctx, start_after, batch_size, &keys,
+                                       &more);
         if (ret < 0) {
-            CLS_ERR("ERROR: writing obj full %d", ret);
+            CLS_ERR("ERROR: exec_compact_op: reading omap keys %d", ret);
             return ret;
         }
-        offset += transformed_encoded_meta_bl.length();
+        if (keys.empty())
+            break;
+        for (auto it = keys.begin(); it != keys.end(); ++it) {
+            for (auto itp = prefixes.begin(); itp != prefixes.end(); ++itp) {
+                if (it->compare(0, itp->size(), *itp) != 0)
+                    continue;
+                ret = cls_cxx_map_remove_key(hctx, *it);
+                if (ret < 0) {
+                    CLS_ERR("ERROR: exec_compact_op: removing index entry %d", ret);
+                    return ret;
+                }
+                break;
+            }
+        }
+        start_after = *keys.rbegin();
+    }
+    return 0;
+}
+
+/*
+ * Compact the fbmetas that start in the extent of op.max_bytes of the object
+ * from op.src_off into fewer fbmetas, of about op.fb_rows live rows each,
+ * returned in a transform_chunk.  Deleted fbmetas and dead rows are
+ * dropped, and the rows of the remaining flatbuf fbmetas are merged in
+ * object order, into flatbuf or arrow fbmetas.  Arrow fbmetas are kept as
+ * they are, when arrow is the required format.  The object is unchanged,
+ * the caller writes the chunks to a temp object, indexes it with
+ * exec_compact_index_op and then replaces the object with it, as for
+ * transform_db_op, so the memory used is bounded by the extent and a
+ * compaction can be resumed.  Fbs do not span chunks.
+ */
+static
+int exec_compact_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
+{
+    compact_op op;
+    try {
+        bufferlist::const_iterator it = in->begin();
+        using ceph::decode;
+        decode(op, it);
+    } catch (const buffer::error &err) {
+        CLS_ERR("ERROR: exec_compact_op decoding compact_op");
+        return -EINVAL;
+    }
+    CLS_LOG(20, "exec_compact_op: %s", op.toString().c_str());
+
+    using namespace Tables;
+    if (op.required_type != SFT_FLATBUF_FLEX_ROW and
+        op.required_type != SFT_ARROW) {
+        CLS_ERR("ERROR: exec_compact_op: format type unsupported. type=%d",
+                op.required_type);
+        return -EINVAL;
+    }
+    if (op.fb_rows == 0) {
+        CLS_ERR("ERROR: exec_compact_op: fb_rows must be > 0");
+        return -EINVAL;
+    }
+    if (!compression_type_valid(op.compression_type)) {
+        CLS_ERR("ERROR: exec_compact_op: compression type unknown. type=%d",
+                op.compression_type);
+        return -EINVAL;
+    }
+
+    struct transform_chunk chunk;
+    int ret = cls_cxx_stat(hctx, &chunk.obj_len, NULL);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_compact_op: stat obj. %d", ret);
+        return ret;
+    }
+    if (op.src_off > chunk.obj_len) {
+        CLS_ERR("ERROR: exec_compact_op: src_off=%lu beyond obj len=%lu",
+                op.src_off, chunk.obj_len);
+        return -EINVAL;
+    }
+
+    // read only the extent of whole fbmeta bls from src_off
+    bufferlist extent;
+    uint64_t max_bytes = op.max_bytes ? op.max_bytes : READ_BATCH_BYTES_MAX;
+    ret = read_fbmeta_extent(hctx, op.src_off, chunk.obj_len, max_bytes,
+                             extent);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_compact_op: reading obj. %d", ret);
+        return ret;
+    }
+    chunk.next_off = op.src_off + extent.length();
+
+    BuilderPool builders;
+    compact_fb cfb;
+    cfb.bldr = builders.acquire();
+    std::vector<char> blob_buf;  // decompressed blob, reused across fbmetas
+    uint64_t nrows_in = 0, nfbs_in = 0;
+
+    ceph::bufferlist::const_iterator it = extent.begin();
+    while (it.get_remaining() > 0) {
+        bufferlist bl;
+        try {
+            using ceph::decode;
+            decode(bl, it);  // unpack the next bl
+        } catch (const buffer::error &err) {
+            CLS_ERR("ERROR: exec_compact_op: decoding fbmeta from BL");
+            builders.release(cfb.bldr);
+            return -EINVAL;
+        }
+        nfbs_in++;
+
+        sky_meta meta = getSkyMeta(&bl);
+        if (meta.blob_deleted)
+            continue;
+        ret = decompressSkyMeta(meta, blob_buf);
+        if (ret != 0) {
+            CLS_ERR("ERROR: exec_compact_op: decompressing blob TablesErrCodes::%d", ret);
+            builders.release(cfb.bldr);
+            return -EINVAL;
+        }
+        sky_root root = getSkyRoot(meta.blob_data, meta.blob_size,
+                                   meta.blob_format);
+        nrows_in += root.nrows;
+
+        // rows of a different table or schema start a new fb
+        if (meta.blob_format != SFT_FLATBUF_FLEX_ROW or
+            root.data_schema != cfb.data_schema or
+            root.db_schema_name != cfb.db_schema or
+            root.table_name != cfb.table_name) {
+            ret = flush_compact_fb(cfb, op, builders, chunk.data);
+            if (ret != 0) {
+                builders.release(cfb.bldr);
+                return ret;
+            }
+            cfb.skyhook_version = root.skyhook_version;
+            cfb.data_structure_version = root.data_structure_version;
+            cfb.data_schema_version = root.data_schema_version;
+            cfb.data_schema = root.data_schema;
+            cfb.db_schema = root.db_schema_name;
+            cfb.table_name = root.table_name;
+        }
+
+        // arrow fbmetas are already batches of cols, there is no
+        // transform from arrow to flatbuf rows
+        if (meta.blob_format != SFT_FLATBUF_FLEX_ROW) {
+            if (meta.blob_format != op.required_type) {
+                CLS_ERR("ERROR: exec_compact_op: cannot compact format %d into format %d",
+                        meta.blob_format, op.required_type);
+                builders.release(cfb.bldr);
+                return -EINVAL;
+            }
+            using ceph::encode;
+            encode(bl, chunk.data);
+            cfb.nfbs++;
+            continue;
+        }
+
+        // a new fb encodes the same cols as its first fbmeta.  each live
+        // row is copied as is into the next fb, unless either of them
+        // has dictionaries, then its strings are recoded for the fb.
+        if (cfb.offs.empty())
+            cfb.dicts = DictEncoder(root.dicts.positions());
+        bool recode = !root.dicts.empty() or !cfb.dicts.empty();
+        schema_vec data_schema;
+        if (recode)
+            data_schema = schemaFromString(root.data_schema);
+        flatbuffers::FlatBufferBuilder& bldr = *cfb.bldr;
+        row_offs rows = static_cast<row_offs>(root.data_vec);
+        for (uint32_t i = 0; i < root.nrows; i++) {
+            if (root.delete_vec[i] == 1)
+                continue;
+            const Tables::Record* rec = rows->Get(i);
+            flatbuffers::Offset<flatbuffers::Vector<uint8_t>> row_data;
+            if (recode) {
+                recodeFlexRow(builders.flexBuilder(),
+                              rec->data_flexbuffer_root().AsVector(),
+                              data_schema, root.dicts, cfb.dicts);
+                row_data = builders.finishFlex(bldr);
+            }
+            else {
+                row_data = bldr.CreateVector(rec->data()->Data(),
+                                             rec->data()->size());
+            }
+            auto nullbits = bldr.CreateVector(rec->nullbits()->data(),
+                                              rec->nullbits()->size());
+            cfb.offs.push_back(Tables::CreateRecord(bldr, rec->RID(),
+                                                    nullbits, row_data));
+            if (cfb.offs.size() >= op.fb_rows or
+                bldr.GetSize() >= READ_BATCH_BYTES_MAX) {
+                ret = flush_compact_fb(cfb, op, builders, chunk.data);
+                if (ret != 0) {
+                    builders.release(cfb.bldr);
+                    return ret;
+                }
+            }
+        }
     }
+    ret = flush_compact_fb(cfb, op, builders, chunk.data);
+    builders.release(cfb.bldr);
+    if (ret != 0)
+        return ret;
+    chunk.ntransformed = cfb.nfbs;
+
+    CLS_LOG(20, "exec_compact_op: compacted %lu fbs of %lu rows into %u fbs",
+            nfbs_in, nrows_in, cfb.nfbs);
+    using ceph::encode;
+    encode(chunk, *out);
     return 0;
 }
 
+/*
+ * Index the temp object of a compaction, written with the chunks of
+ * exec_compact_op, before it replaces the object.  The index entries of an
+ * earlier attempt are removed, then its fb index and zone maps and the
+ * requested data content indexes are built over its fbs, numbered from the
+ * start, and its col_stats if op.stats_level is set.
+ */
+static
+int exec_compact_index_op(cls_method_context_t hctx, bufferlist *in,
+                          bufferlist *out)
+{
+    compact_op op;
+    try {
+        bufferlist::const_iterator it = in->begin();
+        using ceph::decode;
+        decode(op, it);
+    } catch (const buffer::error &err) {
+        CLS_ERR("ERROR: exec_compact_index_op decoding compact_op");
+        return -EINVAL;
+    }
+    CLS_LOG(20, "exec_compact_index_op: %s", op.toString().c_str());
+
+    using namespace Tables;
+    std::vector<content_index> content;
+    for (auto itc = op.idx_ops.begin(); itc != op.idx_ops.end(); ++itc) {
+        if (itc->idx_type != SIT_IDX_RID and
+            itc->idx_type != SIT_IDX_REC and
+            itc->idx_type != SIT_IDX_TXT) {
+            CLS_ERR("ERROR: exec_compact_index_op: Index type unknown. type=%d",
+                    itc->idx_type);
+            return -EINVAL;
+        }
+        content.push_back(content_index(*itc));
+        content.back().op.idx_incremental = false;
+        content.back().progress_name = idx_progress_xattr(
+            SkyIdxTypeMap.at(static_cast<SkyIdxType>(itc->idx_type)),
+            content.back().idx_schema);
+    }
+
+    int ret = remove_sky_indexes(hctx, op.idx_batch_size);
+    if (ret < 0)
+        return ret;
+    std::map<std::string, bufferlist> attrs;
+    ret = cls_cxx_getxattrs(hctx, &attrs);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_compact_index_op: reading xattrs %d", ret);
+        return ret;
+    }
+    std::string progress_prefix = idx_progress_xattr("");
+    struct idx_progress no_progress(0, DATASTRUCT_SEQ_NUM_MIN);
+    for (auto it = attrs.begin(); it != attrs.end(); ++it) {
+        if (it->first.compare(0, progress_prefix.size(), progress_prefix) != 0)
+            continue;
+        ret = set_idx_progress(hctx, it->first, no_progress);
+        if (ret < 0) {
+            CLS_ERR("ERROR: exec_compact_index_op: resetting idx_progress %d", ret);
+            return ret;
+        }
+    }
+    ret = set_fb_seq_num(hctx, DATASTRUCT_SEQ_NUM_MIN);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_compact_index_op: setting fb_seq_num entry to xattr %d", ret);
+        return ret;
+    }
+
+    ret = index_sky_fbs(hctx, content, false, op.idx_batch_size);
+    if (ret < 0)
+        return ret;
+    if (op.stats_level == 0)
+        return 0;
+
+    // the col_stats are of the table of the first fb
+    uint64_t obj_len = 0;
+    ret = cls_cxx_stat(hctx, &obj_len, NULL);
+    if (ret < 0) {
+        CLS_ERR("ERROR: exec_compact_index_op: stat obj. %d", ret);
+        return ret;
+    }
+    if (obj_len == 0)
+        return 0;
+    bufferlist extent;
+    ret = read_fbmeta_extent(hctx, 0, obj_len, 1, extent);
+    if (ret < 0)
+        return ret;
+    bufferlist bl;
+    try {
+        bufferlist::const_iterator it = extent.begin();
+        using ceph::decode;
+        decode(bl, it);
+    } catch (const buffer::error &err) {
+        CLS_ERR("ERROR: exec_compact_index_op: decoding fbmeta from BL");
+        return -EINVAL;
+    }
+    sky_meta meta = getSkyMeta(&bl);
+    std::vector<char> blob_buf;
+    ret = decompressSkyMeta(meta, blob_buf);
+    if (ret != 0) {
+        CLS_ERR("ERROR: exec_compact_index_op: decompressing blob TablesErrCodes::%d", ret);
+        return -EINVAL;
+    }
+    sky_root root = getSkyRoot(meta.blob_data, meta.blob_size,
+                               meta.blob_format);
+    stats_op sop(root.db_schema_name, root.table_name, root.data_schema,
+                 op.stats_level);
+    return runstats_sky_fbs(hctx, sop);
+}
+
 
 static
 int example_query_op(cls_method_context_t hctx, bufferlist *in, bufferlist *out)
@@ -2456,8 +5020,18 @@ void __cls_init()
   cls_register_cxx_method(h_class, "exec_build_sky_index_op",
       CLS_METHOD_RD | CLS_METHOD_WR, exec_build_sky_index_op, &h_exec_build_sky_index_op);
 
+  cls_register_cxx_method(h_class, "exec_append_op",
+      CLS_METHOD_RD | CLS_METHOD_WR, exec_append_op, &h_exec_append_op);
+
   cls_register_cxx_method(h_class, "transform_db_op",
-      CLS_METHOD_RD | CLS_METHOD_WR, transform_db_op, &h_transform_db_op);
+      CLS_METHOD_RD, transform_db_op, &h_transform_db_op);
+
+  cls_register_cxx_method(h_class, "exec_compact_op",
+      CLS_METHOD_RD, exec_compact_op, &h_exec_compact_op);
+
+  cls_register_cxx_method(h_class, "exec_compact_index_op",
+      CLS_METHOD_RD | CLS_METHOD_WR, exec_compact_index_op,
+      &h_exec_compact_index_op);
 
   cls_register_cxx_method(h_class, "lock_obj_init_op",
       CLS_METHOD_PROMOTE | CLS_METHOD_WR, lock_obj_init_op, &h_inittable_group_obj_query_op);
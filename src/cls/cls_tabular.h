@@ -101,13 +101,25 @@ inline int sky_format_type_from_string (std::string type) {
     return 0;   // format unrecognized
 }
 
+// compression of an fbmeta's data blob
 enum CompressionType {
     none = 0,
-    // lzw,  TODO: placeholder, not yet supported.
-    // bz2,
-    // etc.
+    lz4,
+    zstd
 };
 
+inline int compression_type_from_string (std::string type) {
+    std::transform(type.begin(), type.end(), type.begin(), ::tolower);
+    if (type == "none")  return none;
+    if (type == "lz4")   return lz4;
+    if (type == "zstd")  return zstd;
+    return -1;  // compression unrecognized
+}
+
+inline bool compression_type_valid(int type) {
+    return type == none or type == lz4 or type == zstd;
+}
+
 struct testencode {
 
     string s;
@@ -149,6 +161,15 @@ struct query_op {
   std::string query_preds;
   std::string index_preds;
   std::string index2_preds;
+  int resume_seq_num;        // first fb_seq_num to read, from a prior cursor
+  uint64_t result_max_bytes; // cap on result size per call, 0 for no cap
+  std::string groupby_schema;  // group key cols of the agg preds, if any
+  uint64_t groupby_max_bytes;  // group table memory budget, 0 for default
+  uint64_t row_limit;          // max rows to return, 0 for no limit
+  std::string orderby_schema;  // key col of the top row_limit rows, if any
+  bool orderby_desc;           // order by the key col descending
+  int result_compression;      // CompressionType of the result blobs
+  int max_threads;             // max threads processing fbmetas, 1 for serial
 
   query_op() {}
 
@@ -174,6 +195,15 @@ struct query_op {
     encode(query_preds, bl);
     encode(index_preds, bl);
     encode(index2_preds, bl);
+    encode(resume_seq_num, bl);
+    encode(result_max_bytes, bl);
+    encode(groupby_schema, bl);
+    encode(groupby_max_bytes, bl);
+    encode(row_limit, bl);
+    encode(orderby_schema, bl);
+    encode(orderby_desc, bl);
+    encode(result_compression, bl);
+    encode(max_threads, bl);
   }
 
   // deserialize the fields from the bufferlist into this struct
@@ -198,6 +228,15 @@ struct query_op {
     decode(query_preds, bl);
     decode(index_preds, bl);
     decode(index2_preds, bl);
+    decode(resume_seq_num, bl);
+    decode(result_max_bytes, bl);
+    decode(groupby_schema, bl);
+    decode(groupby_max_bytes, bl);
+    decode(row_limit, bl);
+    decode(orderby_schema, bl);
+    decode(orderby_desc, bl);
+    decode(result_compression, bl);
+    decode(max_threads, bl);
   }
 
   std::string toString() {
@@ -220,6 +259,15 @@ struct query_op {
     s.append(" .query_preds=" + query_preds);
     s.append(" .index_preds=" + index_preds);
     s.append(" .index2_preds=" + index2_preds);
+    s.append(" .resume_seq_num=" + std::to_string(resume_seq_num));
+    s.append(" .result_max_bytes=" + std::to_string(result_max_bytes));
+    s.append(" .groupby_schema=" + groupby_schema);
+    s.append(" .groupby_max_bytes=" + std::to_string(groupby_max_bytes));
+    s.append(" .row_limit=" + std::to_string(row_limit));
+    s.append(" .orderby_schema=" + orderby_schema);
+    s.append(" .orderby_desc=" + std::to_string(orderby_desc));
+    s.append(" .result_compression=" + std::to_string(result_compression));
+    s.append(" .max_threads=" + std::to_string(max_threads));
     return s;
   }
 };
@@ -311,10 +359,13 @@ struct stats_op {
   std::string db_schema;
   std::string table_name;
   std::string data_schema;
+  int stats_level;  // StatsLevel, controls sampling rate and nbins
 
   stats_op() {}
-  stats_op(std::string dbscma, std::string tname, std::string dtscma) :
-           db_schema(dbscma), table_name(tname), data_schema(dtscma) { }
+  stats_op(std::string dbscma, std::string tname, std::string dtscma,
+           int level) :
+           db_schema(dbscma), table_name(tname), data_schema(dtscma),
+           stats_level(level) { }
 
   // serialize the fields into bufferlist to be sent over the wire
   void encode(bufferlist& bl) const {
@@ -322,6 +373,7 @@ struct stats_op {
     encode(db_schema, bl);
     encode(table_name, bl);
     encode(data_schema, bl);
+    encode(stats_level, bl);
   }
 
   // deserialize the fields from the bufferlist into this struct
@@ -330,6 +382,7 @@ struct stats_op {
     decode(db_schema, bl);
     decode(table_name, bl);
     decode(data_schema, bl);
+    decode(stats_level, bl);
   }
 
   std::string toString() {
@@ -338,20 +391,33 @@ struct stats_op {
     s.append(" .db_schema=" + db_schema);
     s.append(" .table_name=" + table_name);
     s.append(" .data_schema=" + data_schema);
+    s.append(" .stats_level=" + std::to_string(stats_level));
     return s;
   }
 };
 WRITE_CLASS_ENCODER(stats_op)
 
+// Transforms the fbmetas of an object that start in the extent of max_bytes
+// from src_off into the required format, see transform_chunk.
 struct transform_op {
 
   std::string table_name;
   std::string query_schema;
   int required_type;
+  int compression_type;  // CompressionType of the transformed blobs
+  int arrow_batch_rows;  // max rows per arrow record batch, 0 for one batch,
+                         // < 0 sized to ARROW_BATCH_BYTES_AUTO of the blob
+  uint64_t src_off;      // off of the first fbmeta to transform
+  uint64_t max_bytes;    // max len of the fbmetas to transform per call,
+                         // 0 for READ_BATCH_BYTES_MAX
 
   transform_op() {}
-  transform_op(std::string tname, std::string qrscma, int req_type) :
-    table_name(tname), query_schema(qrscma), required_type(req_type) { }
+  transform_op(std::string tname, std::string qrscma, int req_type,
+               int compress=none, int batch_rows=0, uint64_t off=0,
+               uint64_t max_len=0) :
+    table_name(tname), query_schema(qrscma), required_type(req_type),
+    compression_type(compress), arrow_batch_rows(batch_rows),
+    src_off(off), max_bytes(max_len) { }
 
   // serialize the fields into bufferlist to be sent over the wire
   void encode(bufferlist& bl) const {
@@ -359,6 +425,10 @@ struct transform_op {
     encode(table_name, bl);
     encode(query_schema, bl);
     encode(required_type, bl);
+    encode(compression_type, bl);
+    encode(arrow_batch_rows, bl);
+    encode(src_off, bl);
+    encode(max_bytes, bl);
   }
 
   // deserialize the fields from the bufferlist into this struct
@@ -367,6 +437,10 @@ struct transform_op {
     decode(table_name, bl);
     decode(query_schema, bl);
     decode(required_type, bl);
+    decode(compression_type, bl);
+    decode(arrow_batch_rows, bl);
+    decode(src_off, bl);
+    decode(max_bytes, bl);
   }
 
   std::string toString() {
@@ -375,11 +449,104 @@ struct transform_op {
     s.append(" .table_name=" + table_name);
     s.append(" .query_schema=" + query_schema);
     s.append(" .required_type=" + std::to_string(required_type));
+    s.append(" .compression_type=" + std::to_string(compression_type));
+    s.append(" .arrow_batch_rows=" + std::to_string(arrow_batch_rows));
+    s.append(" .src_off=" + std::to_string(src_off));
+    s.append(" .max_bytes=" + std::to_string(max_bytes));
     return s;
   }
 };
 WRITE_CLASS_ENCODER(transform_op)
 
+// The result of a transform_op, the transformed fbmetas of the extent of
+// the object [src_off, next_off), each fbmeta already in the required
+// format is as it was.  The object is transformed once next_off is obj_len.
+// A compact_op returns the compacted fbmetas of its extent likewise.
+struct transform_chunk {
+
+  uint64_t next_off;    // off of the first fbmeta after the extent
+  uint64_t obj_len;     // len of the object when transformed
+  uint32_t ntransformed;  // num fbmetas transformed into the required format,
+                          // or num compacted fbmetas
+  bufferlist data;      // seq of encoded fbmeta bls
+
+  transform_chunk() : next_off(0), obj_len(0), ntransformed(0) {}
+
+  void encode(bufferlist& bl) const {
+    using ceph::encode;
+    encode(next_off, bl);
+    encode(obj_len, bl);
+    encode(ntransformed, bl);
+    encode(data, bl);
+  }
+
+  void decode(bufferlist::const_iterator &bl) {
+    using ceph::decode;
+    decode(next_off, bl);
+    decode(obj_len, bl);
+    decode(ntransformed, bl);
+    decode(data, bl);
+  }
+
+  std::string toString() {
+    std::string s;
+    s.append("transform_chunk:");
+    s.append(" .next_off=" + std::to_string(next_off));
+    s.append(" .obj_len=" + std::to_string(obj_len));
+    s.append(" .ntransformed=" + std::to_string(ntransformed));
+    s.append(" .data_len=" + std::to_string(data.length()));
+    return s;
+  }
+};
+WRITE_CLASS_ENCODER(transform_chunk)
+
+// The progress of transforming (or compacting) an object into its temp
+// object, stored in xattr of the temp object with the data transformed so
+// far, so that a transform can be resumed.
+struct transform_progress {
+
+  uint64_t src_off;     // off of the next fbmeta of the object to transform
+  uint64_t src_len;     // len of the object when its transform started
+  uint64_t dst_off;     // len of the data transformed so far
+  uint64_t ntransformed;  // num fbmetas transformed so far
+  uint64_t src_ver;     // version of the object when its transform started
+
+  transform_progress() :
+    src_off(0), src_len(0), dst_off(0), ntransformed(0), src_ver(0) {}
+  transform_progress(uint64_t len, uint64_t ver) :
+    src_off(0), src_len(len), dst_off(0), ntransformed(0), src_ver(ver) {}
+
+  void encode(bufferlist& bl) const {
+    using ceph::encode;
+    encode(src_off, bl);
+    encode(src_len, bl);
+    encode(dst_off, bl);
+    encode(ntransformed, bl);
+    encode(src_ver, bl);
+  }
+
+  void decode(bufferlist::const_iterator &bl) {
+    using ceph::decode;
+    decode(src_off, bl);
+    decode(src_len, bl);
+    decode(dst_off, bl);
+    decode(ntransformed, bl);
+    decode(src_ver, bl);
+  }
+
+  std::string toString() {
+    std::string s;
+    s.append("transform_progress:");
+    s.append(" .src_off=" + std::to_string(src_off));
+    s.append(" .src_len=" + std::to_string(src_len));
+    s.append(" .dst_off=" + std::to_string(dst_off));
+    s.append(" .ntransformed=" + std::to_string(ntransformed));
+    s.append(" .src_ver=" + std::to_string(src_ver));
+    return s;
+  }
+};
+WRITE_CLASS_ENCODER(transform_progress)
+
 // holds an omap entry containing flatbuffer location
 // this entry type contains physical location info
 // idx_key = idx_prefix + fb sequence number (int)
@@ -395,6 +562,7 @@ struct idx_fb_entry {
     void encode(bufferlist& bl) const {
         using ceph::encode;
         encode(off, bl);
+        encode(len, bl);
     }
 
     void decode(bufferlist::const_iterator &bl) {
@@ -412,6 +580,65 @@ struct idx_fb_entry {
 };
 WRITE_CLASS_ENCODER(idx_fb_entry)
 
+// holds an omap entry containing the zone map of a flatbuffer
+// idx_key = idx_prefix + fb sequence number (int), same as its idx_fb_entry
+// val = this struct containing the min/max/null count of each col in the fb,
+// min/max are strings formatted as the col_stats vals, and include the
+// stored vals of null rows, since the predicate scan compares those too.
+struct idx_zone_entry {
+    uint32_t nrows;  // live rows in the fb
+    std::vector<int> col_ids;
+    std::vector<int> col_types;
+    std::vector<std::string> min_vals;
+    std::vector<std::string> max_vals;
+    std::vector<uint32_t> null_counts;
+
+    idx_zone_entry() : nrows(0) {}
+
+    void add_col(int id, int type, std::string min, std::string max,
+                 uint32_t nnulls) {
+        col_ids.push_back(id);
+        col_types.push_back(type);
+        min_vals.push_back(min);
+        max_vals.push_back(max);
+        null_counts.push_back(nnulls);
+    }
+
+    void encode(bufferlist& bl) const {
+        using ceph::encode;
+        encode(nrows, bl);
+        encode(col_ids, bl);
+        encode(col_types, bl);
+        encode(min_vals, bl);
+        encode(max_vals, bl);
+        encode(null_counts, bl);
+    }
+
+    void decode(bufferlist::const_iterator &bl) {
+        using ceph::decode;
+        decode(nrows, bl);
+        decode(col_ids, bl);
+        decode(col_types, bl);
+        decode(min_vals, bl);
+        decode(max_vals, bl);
+        decode(null_counts, bl);
+    }
+
+    std::string toString() {
+        std::string s;
+        s.append("idx_zone_entry.nrows=" + std::to_string(nrows));
+        for (unsigned i = 0; i < col_ids.size(); i++) {
+            s.append("; col=" + std::to_string(col_ids[i]));
+            s.append(",type=" + std::to_string(col_types[i]));
+            s.append(",min=" + min_vals[i]);
+            s.append(",max=" + max_vals[i]);
+            s.append(",nulls=" + std::to_string(null_counts[i]));
+        }
+        return s;
+    }
+};
+WRITE_CLASS_ENCODER(idx_zone_entry)
+
 // holds an omap entry for indexed col values
 // this index entry type contains logical location info
 // idx_key = idx_prefix + column data value(s) (ints)
@@ -495,6 +722,53 @@ struct idx_txt_entry {
 };
 WRITE_CLASS_ENCODER(idx_txt_entry)
 
+// omap entry for text index posting lists
+// this index entry type contains the logical location of every row
+// containing a word, so there is one entry per distinct word.
+// idx_key = idx_prefix + word (lower case)
+// val = this struct, the (fb_num, row_num) postings in ascending order,
+// delta encoded as varints in blocks of TXT_POSTINGS_BLOCK postings.
+// The first posting of each block is stored in the block headers, so
+// blocks can be skipped without decoding them when merging lists.
+struct idx_txt_postings {
+    uint32_t npostings;
+    std::vector<uint32_t> block_fbs;   // fb_num of the first posting
+    std::vector<uint32_t> block_rows;  // row_num of the first posting
+    std::vector<uint32_t> block_offs;  // offset of the block's deltas
+    std::string deltas;
+
+    idx_txt_postings() : npostings(0) {}
+
+    void encode(bufferlist& bl) const {
+        using ceph::encode;
+        encode(npostings, bl);
+        encode(block_fbs, bl);
+        encode(block_rows, bl);
+        encode(block_offs, bl);
+        encode(deltas, bl);
+    }
+
+    void decode(bufferlist::const_iterator &bl) {
+        using ceph::decode;
+        decode(npostings, bl);
+        decode(block_fbs, bl);
+        decode(block_rows, bl);
+        decode(block_offs, bl);
+        decode(deltas, bl);
+    }
+
+    std::string toString() {
+        std::string s;
+        s.append("idx_txt_postings.npostings=" + std::to_string(npostings));
+        s.append("; idx_txt_postings.nblocks=" +
+                 std::to_string(block_fbs.size()));
+        s.append("; idx_txt_postings.deltas_len=" +
+                 std::to_string(deltas.size()));
+        return s;
+    }
+};
+WRITE_CLASS_ENCODER(idx_txt_postings)
+
 // Stores index instructions/metadata into bl for build_sky_index()
 struct idx_op {
     bool idx_unique;   // if idx contains all primary key/unique cols
@@ -503,16 +777,19 @@ struct idx_op {
     int idx_type;
     std::string idx_schema_str;
     std::string idx_text_delims; // for text indexing
+    bool idx_incremental;  // only index the fbs appended since the last build
 
     idx_op() {}
     idx_op(bool unq, bool ign, int batsz, int index_type,
-           std::string schema_str, std::string delimiters) :
+           std::string schema_str, std::string delimiters,
+           bool incremental=false) :
         idx_unique(unq),
         idx_ignore_stopwords(ign),
         idx_batch_size(batsz),
         idx_type(index_type),
         idx_schema_str(schema_str),
-        idx_text_delims(delimiters) {}
+        idx_text_delims(delimiters),
+        idx_incremental(incremental) {}
 
     void encode(bufferlist& bl) const {
         using ceph::encode;
@@ -522,6 +799,7 @@ struct idx_op {
         encode(idx_type, bl);
         encode(idx_schema_str, bl);
         encode(idx_text_delims, bl);
+        encode(idx_incremental, bl);
     }
 
     void decode(bufferlist::const_iterator &bl) {
@@ -533,6 +811,7 @@ struct idx_op {
         decode(idx_type, bl);
         decode(idx_schema_str, bl);
         decode(idx_text_delims, bl);
+        decode(idx_incremental, bl);
     }
 
     std::string toString() {
@@ -544,13 +823,156 @@ struct idx_op {
         s.append("; idx_op.idx_type=" + std::to_string(idx_type));
         s.append("; idx_op.idx_schema_str=\n" + idx_schema_str);
         s.append("; idx_op.text_delims=\n" + idx_text_delims);
+        s.append("; idx_op.idx_incremental=" + std::to_string(idx_incremental));
         return s;
     }
 };
 WRITE_CLASS_ENCODER(idx_op)
 
+// xattr entry for the progress of an index over an object, the fbs before
+// off have been indexed and fb_seq_num is the seq num of the last of them.
+// fbs are numbered in object order, so an incremental build resumes from
+// here, reading only the fbs appended since.
+struct idx_progress {
+    uint64_t off;
+    uint32_t fb_seq_num;
+
+    idx_progress() : off(0), fb_seq_num(0) {}
+    idx_progress(uint64_t o, uint32_t fb) : off(o), fb_seq_num(fb) {}
+
+    void encode(bufferlist& bl) const {
+        using ceph::encode;
+        encode(off, bl);
+        encode(fb_seq_num, bl);
+    }
+
+    void decode(bufferlist::const_iterator &bl) {
+        using ceph::decode;
+        decode(off, bl);
+        decode(fb_seq_num, bl);
+    }
+
+    std::string toString() {
+        std::string s;
+        s.append("idx_progress.off=" + std::to_string(off));
+        s.append("; idx_progress.fb_seq_num=" + std::to_string(fb_seq_num));
+        return s;
+    }
+};
+WRITE_CLASS_ENCODER(idx_progress)
+
+// Stores the fbmetas to append to an object by exec_append_op(), which
+// also adds their fb index, zone map and col_stats entries, and their
+// entries of the data content indexes in idx_ops, if any.
+struct append_op {
+    bufferlist data;              // seq of encoded fbmeta bls
+    std::vector<idx_op> idx_ops;
+    uint32_t idx_batch_size;      // num idx entries to write into omap at once
+
+    append_op() : idx_batch_size(1000) {}
+
+    void encode(bufferlist& bl) const {
+        using ceph::encode;
+        encode(data, bl);
+        encode(idx_ops, bl);
+        encode(idx_batch_size, bl);
+    }
+
+    void decode(bufferlist::const_iterator &bl) {
+        using ceph::decode;
+        decode(data, bl);
+        decode(idx_ops, bl);
+        decode(idx_batch_size, bl);
+    }
+
+    std::string toString() {
+        std::string s;
+        s.append("append_op.data_len=" + std::to_string(data.length()));
+        s.append("; append_op.idx_ops=" + std::to_string(idx_ops.size()));
+        s.append("; append_op.idx_batch_size=" +
+                 std::to_string(idx_batch_size));
+        return s;
+    }
+};
+WRITE_CLASS_ENCODER(append_op)
+
+// Compacts the fbmetas of an object that start in the extent of max_bytes
+// from src_off into fewer fbmetas of about fb_rows live rows each, see
+// exec_compact_op, and rebuilds the indexes over the compacted fbmetas, see
+// exec_compact_index_op.
+struct compact_op {
+    int required_type;            // SkyFormatType of the compacted fbmetas
+    uint32_t fb_rows;             // target num rows per compacted fbmeta
+    int compression_type;         // CompressionType of the compacted blobs
+    int arrow_batch_rows;         // max rows per arrow record batch, 0 for one
+    std::vector<idx_op> idx_ops;  // data content indexes to rebuild
+    uint32_t idx_batch_size;      // num idx entries to write into omap at once
+    uint64_t src_off;             // off of the first fbmeta to compact
+    uint64_t max_bytes;           // max len of the fbmetas to compact per
+                                  // call, 0 for READ_BATCH_BYTES_MAX
+    int stats_level;              // StatsLevel of the col_stats to rebuild,
+                                  // 0 if runstats has not been done
+
+    compact_op() :
+        required_type(SFT_FLATBUF_FLEX_ROW),
+        fb_rows(100000),
+        compression_type(none),
+        arrow_batch_rows(0),
+        idx_batch_size(1000),
+        src_off(0),
+        max_bytes(0),
+        stats_level(0) {}
+
+    void encode(bufferlist& bl) const {
+        using ceph::encode;
+        encode(required_type, bl);
+        encode(fb_rows, bl);
+        encode(compression_type, bl);
+        encode(arrow_batch_rows, bl);
+        encode(idx_ops, bl);
+        encode(idx_batch_size, bl);
+        encode(src_off, bl);
+        encode(max_bytes, bl);
+        encode(stats_level, bl);
+    }
+
+    void decode(bufferlist::const_iterator &bl) {
+        using ceph::decode;
+        decode(required_type, bl);
+        decode(fb_rows, bl);
+        decode(compression_type, bl);
+        decode(arrow_batch_rows, bl);
+        decode(idx_ops, bl);
+        decode(idx_batch_size, bl);
+        decode(src_off, bl);
+        decode(max_bytes, bl);
+        decode(stats_level, bl);
+    }
+
+    std::string toString() {
+        std::string s;
+        s.append("compact_op.required_type=" + std::to_string(required_type));
+        s.append("; compact_op.fb_rows=" + std::to_string(fb_rows));
+        s.append("; compact_op.compression_type=" +
+                 std::to_string(compression_type));
+        s.append("; compact_op.arrow_batch_rows=" +
+                 std::to_string(arrow_batch_rows));
+        s.append("; compact_op.idx_ops=" + std::to_string(idx_ops.size()));
+        s.append("; compact_op.idx_batch_size=" +
+                 std::to_string(idx_batch_size));
+        s.append("; compact_op.src_off=" + std::to_string(src_off));
+        s.append("; compact_op.max_bytes=" + std::to_string(max_bytes));
+        s.append("; compact_op.stats_level=" + std::to_string(stats_level));
+        return s;
+    }
+};
+WRITE_CLASS_ENCODER(compact_op)
+
 
 // Stores column level statstics
+// hist is an equi-depth histogram, bin i holds hist[i] rows with values in
+// [bounds[i], bounds[i+1]].  If bounds is empty the bins are equi-width over
+// [min_val, max_val].  Counts are scaled up to the object when sampled.
 struct col_stats {
     int col_id;     // fixed, refers to col in original schema
     int col_type;
@@ -563,8 +985,12 @@ struct col_stats {
     std::string max_val;
     unsigned int nbins;
     std::vector<int> hist;  // TODO: should support uint type also
+    std::vector<std::string> bounds;  // nbins+1 bin boundaries, or empty
+    uint64_t nrows;           // all rows in the object, incl nulls
+    uint64_t null_count;
+    uint64_t distinct_count;  // estimated from a sketch
 
-    col_stats() {}
+    col_stats() : nbins(0), nrows(0), null_count(0), distinct_count(0) {}
     col_stats(int cid, int type, int tid, int level, int64_t cur_time,
               std::string tname, std::string cinfo, std::string min,
               std::string max, unsigned num_bins, std::vector<int> h) :
@@ -577,7 +1003,10 @@ struct col_stats {
         col_info_str(cinfo),
         min_val(min),
         max_val(max),
-        nbins(num_bins) {
+        nbins(num_bins),
+        nrows(0),
+        null_count(0),
+        distinct_count(0) {
             assert (nbins <= h.size());
             for (unsigned int i=0; i<nbins; i++) {
                 hist.push_back(h[i]);
@@ -603,6 +1032,10 @@ struct col_stats {
         for (unsigned int i=0; i<nbins; i++) {
             encode(hist[i], bl);
         }
+        encode(bounds, bl);
+        encode(nrows, bl);
+        encode(null_count, bl);
+        encode(distinct_count, bl);
     }
 
     void decode(bufferlist::const_iterator &bl) {
@@ -623,6 +1056,10 @@ struct col_stats {
             decode(tmp, bl);
             hist.push_back(tmp);
         }
+        decode(bounds, bl);
+        decode(nrows, bl);
+        decode(null_count, bl);
+        decode(distinct_count, bl);
     }
 
     std::string toString() {
@@ -642,6 +1079,14 @@ struct col_stats {
             s.append(std::to_string(hist[i]) + ",");
         }
         s.append(">");
+        s.append("col_stats.bounds<");
+        for (unsigned int i=0; i<bounds.size(); i++) {
+            s.append(bounds[i] + ",");
+        }
+        s.append(">");
+        s.append("col_stats.nrows=" + std::to_string(nrows));
+        s.append("col_stats.null_count=" + std::to_string(null_count));
+        s.append("col_stats.distinct_count=" + std::to_string(distinct_count));
         return s;
     }
 };
@@ -906,18 +1351,46 @@ struct cls_info {
   uint64_t eval_ns;
   std::string push_back_predicates;
   std::string push_back_reason;
-
-  cls_info() {}
+  int next_seq_num;  // fb_seq_num to resume from if result was capped, or -1
+  std::string plan_info;  // index plan chosen and its estimates
+  uint64_t index_ns;       // index and zone map lookups, and planning
+  uint64_t encode_ns;      // of eval_ns, building the result fbmetas
+  uint64_t omap_keys;      // omap entries read
+  uint64_t bytes_read;     // object data bytes read
+  uint64_t fbs_scanned;    // fbmetas processed
+  uint64_t fbs_skipped;    // fbmetas skipped by their zone maps
+  uint64_t rows_examined;  // rows of the fbmetas processed, or index rows
+  uint64_t rows_passed;    // rows in the result
+  uint64_t result_bytes;   // size of the result bl
+
+  cls_info() :
+    rows_processed(0),
+    read_ns(0),
+    eval_ns(0),
+    next_seq_num(-1),
+    index_ns(0),
+    encode_ns(0),
+    omap_keys(0),
+    bytes_read(0),
+    fbs_scanned(0),
+    fbs_skipped(0),
+    rows_examined(0),
+    rows_passed(0),
+    result_bytes(0) {}
   cls_info(
     uint64_t _read_ns,
     uint64_t _eval_ns,
     std::string _push_back_predicates,
-    std::string _push_back_reason)
+    std::string _push_back_reason,
+    int _next_seq_num=-1)
     :
-    read_ns(_read_ns),
-    eval_ns(_eval_ns),
-    push_back_predicates(_push_back_predicates),
-    push_back_reason(_push_back_reason) { }
+    cls_info() {
+      read_ns = _read_ns;
+      eval_ns = _eval_ns;
+      push_back_predicates = _push_back_predicates;
+      push_back_reason = _push_back_reason;
+      next_seq_num = _next_seq_num;
+    }
 
   // serialize the fields into bufferlist to be sent over the wire
   void encode(bufferlist& bl) const {
@@ -926,6 +1399,17 @@ struct cls_info {
     encode(eval_ns, bl);
     encode(push_back_predicates, bl);
     encode(push_back_reason, bl);
+    encode(next_seq_num, bl);
+    encode(plan_info, bl);
+    encode(index_ns, bl);
+    encode(encode_ns, bl);
+    encode(omap_keys, bl);
+    encode(bytes_read, bl);
+    encode(fbs_scanned, bl);
+    encode(fbs_skipped, bl);
+    encode(rows_examined, bl);
+    encode(rows_passed, bl);
+    encode(result_bytes, bl);
   }
 
   // deserialize the fields from the bufferlist into this struct
@@ -935,6 +1419,17 @@ struct cls_info {
     decode(eval_ns, bl);
     decode(push_back_predicates, bl);
     decode(push_back_reason, bl);
+    decode(next_seq_num, bl);
+    decode(plan_info, bl);
+    decode(index_ns, bl);
+    decode(encode_ns, bl);
+    decode(omap_keys, bl);
+    decode(bytes_read, bl);
+    decode(fbs_scanned, bl);
+    decode(fbs_skipped, bl);
+    decode(rows_examined, bl);
+    decode(rows_passed, bl);
+    decode(result_bytes, bl);
   }
 
   std::string toString() {
@@ -944,6 +1439,17 @@ struct cls_info {
     s.append(" .eval_ns=" + std::to_string(eval_ns));
     s.append(" .push_back_predicates=" + push_back_predicates);
     s.append(" .push_back_reason=" + push_back_reason);
+    s.append(" .next_seq_num=" + std::to_string(next_seq_num));
+    s.append(" .plan_info=" + plan_info);
+    s.append(" .index_ns=" + std::to_string(index_ns));
+    s.append(" .encode_ns=" + std::to_string(encode_ns));
+    s.append(" .omap_keys=" + std::to_string(omap_keys));
+    s.append(" .bytes_read=" + std::to_string(bytes_read));
+    s.append(" .fbs_scanned=" + std::to_string(fbs_scanned));
+    s.append(" .fbs_skipped=" + std::to_string(fbs_skipped));
+    s.append(" .rows_examined=" + std::to_string(rows_examined));
+    s.append(" .rows_passed=" + std::to_string(rows_passed));
+    s.append(" .result_bytes=" + std::to_string(result_bytes));
     return s;
   }
 };
@@ -0,0 +1,495 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+#include "cls_tabular_groupby.h"
+
+
+namespace Tables {
+
+// slots start small and double, keeping the load factor at or below 1/2
+static const uint32_t GROUP_SLOTS_MIN = 64;
+static const uint32_t GROUP_SLOT_EMPTY = UINT32_MAX;
+
+int aggStateField(int col_type) {
+    switch (col_type) {
+        case SDT_BOOL:
+        case SDT_CHAR:
+        case SDT_INT8:
+        case SDT_INT16:
+        case SDT_INT32:
+        case SDT_INT64:
+            return ASF_INT;
+        case SDT_UCHAR:
+        case SDT_UINT8:
+        case SDT_UINT16:
+        case SDT_UINT32:
+        case SDT_UINT64:
+            return ASF_UINT;
+        case SDT_FLOAT:
+        case SDT_DOUBLE:
+            return ASF_DOUBLE;
+        case SDT_DATE:
+        case SDT_STRING:
+            return ASF_STRING;
+        default:
+            assert (UnsupportedSkyDataType==0);
+    }
+    return ASF_INT;  // should be unreachable
+}
+
+static uint64_t hashKey(const std::string& key) {
+    const uint64_t m = 0xff51afd7ed558ccdULL;
+    const char* p = key.data();
+    size_t n = key.size();
+    uint64_t h = 0x9e3779b97f4a7c15ULL ^ n;
+    while (n >= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        h = (h ^ w) * m;
+        h ^= h >> 32;
+        p += 8;
+        n -= 8;
+    }
+    if (n) {
+        uint64_t w = 0;
+        memcpy(&w, p, n);
+        h = (h ^ w) * m;
+        h ^= h >> 32;
+    }
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+template <typename T>
+static void appendFixed(std::string& key, T v) {
+    key.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void appendStr(std::string& key, const char* s, uint32_t len) {
+    appendFixed(key, len);
+    key.append(s, len);
+}
+
+// keys are encoded as 8 byte values, or length prefixed for strings.
+// the key of a dictionary encoded col is its value, as codes differ per fb.
+static void appendFlexKey(std::string& key, const flexbuffers::Vector& row,
+                          int pos, int col_type, const FbDicts& dicts) {
+    switch (aggStateField(col_type)) {
+        case ASF_INT: appendFixed(key, row[pos].AsInt64()); break;
+        case ASF_UINT: appendFixed(key, row[pos].AsUInt64()); break;
+        case ASF_DOUBLE: appendFixed(key, row[pos].AsDouble()); break;
+        case ASF_STRING: {
+            size_t len = 0;
+            const char* s = dicts.getChars(row, pos, &len);
+            appendStr(key, s, len);
+            break;
+        }
+    }
+}
+
+agg_state flexAggState(const flexbuffers::Reference& ref, int col_type) {
+    agg_state v;
+    switch (aggStateField(col_type)) {
+        case ASF_INT: v.i = ref.AsInt64(); break;
+        case ASF_UINT: v.u = ref.AsUInt64(); break;
+        case ASF_DOUBLE: v.d = ref.AsDouble(); break;
+        default: assert (UnsupportedAggDataType==0);
+    }
+    return v;
+}
+
+template <typename A>
+static auto arrowValue(const std::shared_ptr<arrow::Array>& a, uint32_t rnum)
+    -> decltype(std::declval<A>().Value(rnum)) {
+    return std::static_pointer_cast<A>(a)->Value(rnum);
+}
+
+agg_state arrowAggState(const std::shared_ptr<arrow::Array>& a,
+                        int col_type, uint32_t rnum) {
+    agg_state v;
+    switch (col_type) {
+        case SDT_BOOL: v.i = arrowValue<arrow::BooleanArray>(a, rnum); break;
+        case SDT_CHAR:
+        case SDT_INT8: v.i = arrowValue<arrow::Int8Array>(a, rnum); break;
+        case SDT_INT16: v.i = arrowValue<arrow::Int16Array>(a, rnum); break;
+        case SDT_INT32: v.i = arrowValue<arrow::Int32Array>(a, rnum); break;
+        case SDT_INT64: v.i = arrowValue<arrow::Int64Array>(a, rnum); break;
+        case SDT_UCHAR:
+        case SDT_UINT8: v.u = arrowValue<arrow::UInt8Array>(a, rnum); break;
+        case SDT_UINT16: v.u = arrowValue<arrow::UInt16Array>(a, rnum); break;
+        case SDT_UINT32: v.u = arrowValue<arrow::UInt32Array>(a, rnum); break;
+        case SDT_UINT64: v.u = arrowValue<arrow::UInt64Array>(a, rnum); break;
+        case SDT_FLOAT: v.d = arrowValue<arrow::FloatArray>(a, rnum); break;
+        case SDT_DOUBLE: v.d = arrowValue<arrow::DoubleArray>(a, rnum); break;
+        default: assert (UnsupportedAggDataType==0);
+    }
+    return v;
+}
+
+static void appendArrowKey(std::string& key,
+                           const std::shared_ptr<arrow::Array>& a,
+                           int col_type, uint32_t rnum) {
+    if (aggStateField(col_type) == ASF_STRING) {
+        auto s = std::static_pointer_cast<arrow::StringArray>(a);
+        int32_t len = 0;
+        const uint8_t* p = s->GetValue(rnum, &len);
+        appendStr(key, reinterpret_cast<const char*>(p), len);
+        return;
+    }
+    agg_state v = arrowAggState(a, col_type, rnum);
+    appendFixed(key, v.u);  // same 8 bytes as the typed value
+}
+
+void addAggState(flexbuffers::Builder& flexbldr, const agg_state& v,
+                 int col_type) {
+    switch (col_type) {
+        case SDT_BOOL: flexbldr.Add(static_cast<bool>(v.i)); break;
+        case SDT_CHAR:
+        case SDT_INT8: flexbldr.Add(static_cast<int8_t>(v.i)); break;
+        case SDT_INT16: flexbldr.Add(static_cast<int16_t>(v.i)); break;
+        case SDT_INT32: flexbldr.Add(static_cast<int32_t>(v.i)); break;
+        case SDT_INT64: flexbldr.Add(v.i); break;
+        case SDT_UCHAR:
+        case SDT_UINT8: flexbldr.Add(static_cast<uint8_t>(v.u)); break;
+        case SDT_UINT16: flexbldr.Add(static_cast<uint16_t>(v.u)); break;
+        case SDT_UINT32: flexbldr.Add(static_cast<uint32_t>(v.u)); break;
+        case SDT_UINT64: flexbldr.Add(v.u); break;
+        case SDT_FLOAT: flexbldr.Add(static_cast<float>(v.d)); break;
+        case SDT_DOUBLE: flexbldr.Add(v.d); break;
+        default: assert (UnsupportedSkyDataType==0);
+    }
+}
+
+template <typename T>
+static T mergeVal(T acc, T v, int op_type) {
+    switch (op_type) {
+        case SOT_min: return (v < acc) ? v : acc;
+        case SOT_max: return (v > acc) ? v : acc;
+        default: return acc + v;  // sum and cnt
+    }
+}
+
+std::vector<group_agg> groupAggsFromPreds(const predicate_vec& preds) {
+    std::vector<group_agg> aggs;
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        if (!(*it)->isGlobalAgg())
+            continue;
+        group_agg ga;
+        ga.col_idx = (*it)->colIdx();
+        ga.col_type = (*it)->colType();
+        ga.op_type = (*it)->opType();
+        aggs.push_back(ga);
+    }
+    return aggs;
+}
+
+/*
+ * GroupTable
+ */
+
+GroupTable::GroupTable(const schema_vec& _keys,
+                       const std::vector<group_agg>& _aggs,
+                       bool _merge_mode,
+                       uint64_t _max_bytes) :
+    keys(_keys),
+    aggs(_aggs),
+    merge_mode(_merge_mode),
+    max_bytes(_max_bytes),
+    skyhook_version(0),
+    data_structure_version(0),
+    data_schema_version(0)
+{
+    for (auto it = aggs.begin(); it != aggs.end(); ++it)
+        assert (aggStateField(it->col_type) != ASF_STRING);
+    clear();
+}
+
+void GroupTable::clear() {
+    key_arena.clear();
+    key_offs.assign(1, 0);
+    hashes.clear();
+    states.clear();
+    slots.assign(GROUP_SLOTS_MIN, GROUP_SLOT_EMPTY);
+    slot_mask = GROUP_SLOTS_MIN - 1;
+}
+
+uint64_t GroupTable::memBytes() const {
+    return key_arena.capacity() +
+           key_offs.capacity() * sizeof(uint32_t) +
+           hashes.capacity() * sizeof(uint64_t) +
+           states.capacity() * sizeof(agg_state) +
+           slots.capacity() * sizeof(uint32_t);
+}
+
+void GroupTable::grow() {
+    slots.assign(slots.size() * 2, GROUP_SLOT_EMPTY);
+    slot_mask = slots.size() - 1;
+    for (uint32_t g = 0; g < size(); g++) {
+        uint64_t idx = hashes[g] & slot_mask;
+        while (slots[idx] != GROUP_SLOT_EMPTY)
+            idx = (idx + 1) & slot_mask;
+        slots[idx] = g;
+    }
+}
+
+uint32_t GroupTable::findOrInsert(const std::string& key, bool* inserted) {
+    const uint64_t h = hashKey(key);
+    uint64_t idx = h & slot_mask;
+    while (slots[idx] != GROUP_SLOT_EMPTY) {
+        uint32_t g = slots[idx];
+        uint32_t off = key_offs[g];
+        uint32_t len = key_offs[g + 1] - off;
+        if (hashes[g] == h and len == key.size() and
+            memcmp(key_arena.data() + off, key.data(), len) == 0) {
+            *inserted = false;
+            return g;
+        }
+        idx = (idx + 1) & slot_mask;
+    }
+
+    uint32_t g = size();
+    slots[idx] = g;
+    hashes.push_back(h);
+    key_arena.append(key);
+    key_offs.push_back(key_arena.size());
+    states.resize(states.size() + aggs.size());
+    *inserted = true;
+    if ((size() * 2) > slots.size())
+        grow();
+    return g;
+}
+
+void GroupTable::accumulate(uint32_t g, uint32_t k, const agg_state& v,
+                            bool init) {
+    agg_state& acc = states[(g * aggs.size()) + k];
+    if (init) {
+        acc = v;
+        return;
+    }
+    const int op = aggs[k].op_type;
+    switch (aggStateField(aggs[k].col_type)) {
+        case ASF_INT: acc.i = mergeVal(acc.i, v.i, op); break;
+        case ASF_UINT: acc.u = mergeVal(acc.u, v.u, op); break;
+        default: acc.d = mergeVal(acc.d, v.d, op); break;
+    }
+}
+
+// the value a data row contributes to a cnt, in the cnt col's type class
+static agg_state countOne(int col_type) {
+    agg_state one;
+    switch (aggStateField(col_type)) {
+        case ASF_INT: one.i = 1; break;
+        case ASF_UINT: one.u = 1; break;
+        default: one.d = 1; break;
+    }
+    return one;
+}
+
+void GroupTable::updateFlexRows(const std::vector<flexbuffers::Vector>& rows,
+                                const SelectionBitmap& sel,
+                                const FbDicts& dicts) {
+    assert (!merge_mode);
+    std::vector<uint32_t> rnums;
+    sel.toRowNums(rnums);
+    for (auto it = rnums.begin(); it != rnums.end(); ++it) {
+        const flexbuffers::Vector& row = rows[*it];
+        key_buf.clear();
+        for (auto itk = keys.begin(); itk != keys.end(); ++itk)
+            appendFlexKey(key_buf, row, itk->idx, itk->type, dicts);
+
+        bool inserted;
+        uint32_t g = findOrInsert(key_buf, &inserted);
+        for (uint32_t k = 0; k < aggs.size(); k++) {
+            if (aggs[k].op_type == SOT_cnt)
+                accumulate(g, k, countOne(aggs[k].col_type), inserted);
+            else
+                accumulate(g, k, flexAggState(row[aggs[k].col_idx],
+                                         aggs[k].col_type), inserted);
+        }
+    }
+}
+
+void GroupTable::updateArrowRows(std::shared_ptr<arrow::Table>& table,
+                                 const std::vector<uint32_t>& rnums) {
+    assert (!merge_mode);
+    std::vector<std::shared_ptr<arrow::Array>> key_cols;
+    std::vector<std::shared_ptr<arrow::Array>> agg_cols;
+    for (auto it = keys.begin(); it != keys.end(); ++it)
+        key_cols.push_back(table->column(it->idx)->chunk(0));
+    for (auto it = aggs.begin(); it != aggs.end(); ++it)
+        agg_cols.push_back(table->column(it->col_idx)->chunk(0));
+
+    for (auto it = rnums.begin(); it != rnums.end(); ++it) {
+        const uint32_t rnum = *it;
+        key_buf.clear();
+        for (uint32_t j = 0; j < keys.size(); j++)
+            appendArrowKey(key_buf, key_cols[j], keys[j].type, rnum);
+
+        bool inserted;
+        uint32_t g = findOrInsert(key_buf, &inserted);
+        for (uint32_t k = 0; k < aggs.size(); k++) {
+            if (aggs[k].op_type == SOT_cnt)
+                accumulate(g, k, countOne(aggs[k].col_type), inserted);
+            else
+                accumulate(g, k, arrowAggState(agg_cols[k], aggs[k].col_type, rnum),
+                           inserted);
+        }
+    }
+}
+
+void GroupTable::updateSkyRoot(const sky_root& root) {
+    assert (merge_mode);
+    setTableInfo(root.skyhook_version, root.data_structure_version,
+                 root.data_schema_version, root.db_schema_name,
+                 root.table_name);
+    const uint32_t nkeys = keys.size();
+    row_offs rows = static_cast<row_offs>(root.data_vec);
+    for (uint32_t i = 0; i < root.nrows; i++) {
+        if (root.delete_vec.at(i) == 1)
+            continue;
+        auto row = rows->Get(i)->data_flexbuffer_root().AsVector();
+        key_buf.clear();
+        for (uint32_t j = 0; j < nkeys; j++)
+            appendFlexKey(key_buf, row, j, keys[j].type, root.dicts);
+
+        bool inserted;
+        uint32_t g = findOrInsert(key_buf, &inserted);
+        for (uint32_t k = 0; k < aggs.size(); k++)
+            accumulate(g, k, flexAggState(row[nkeys + k], aggs[k].col_type),
+                       inserted);
+    }
+}
+
+void GroupTable::merge(const GroupTable& other) {
+    assert (other.aggs.size() == aggs.size());
+    if (other.empty())
+        return;
+    setTableInfo(other.skyhook_version, other.data_structure_version,
+                 other.data_schema_version, other.db_schema_name,
+                 other.table_name);
+    for (uint32_t og = 0; og < other.size(); og++) {
+        const uint32_t off = other.key_offs[og];
+        key_buf.assign(other.key_arena, off, other.key_offs[og + 1] - off);
+        bool inserted;
+        uint32_t g = findOrInsert(key_buf, &inserted);
+        for (uint32_t k = 0; k < aggs.size(); k++)
+            accumulate(g, k, other.value(og, k), inserted);
+    }
+}
+
+void GroupTable::addKeys(uint32_t g, flexbuffers::Builder& flexbldr) const {
+    const char* p = key_arena.data() + key_offs[g];
+    for (auto it = keys.begin(); it != keys.end(); ++it) {
+        if (aggStateField(it->type) == ASF_STRING) {
+            uint32_t len;
+            memcpy(&len, p, sizeof(len));
+            flexbldr.Add(std::string(p + sizeof(len), len));
+            p += sizeof(len) + len;
+            continue;
+        }
+        agg_state v;
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        addAggState(flexbldr, v, it->type);
+    }
+}
+
+double GroupTable::valueAsDouble(uint32_t g, uint32_t k) const {
+    const agg_state& v = value(g, k);
+    switch (aggStateField(aggs[k].col_type)) {
+        case ASF_INT: return static_cast<double>(v.i);
+        case ASF_UINT: return static_cast<double>(v.u);
+        default: return v.d;
+    }
+}
+
+void GroupTable::addValue(uint32_t g, uint32_t k,
+                          flexbuffers::Builder& flexbldr) const {
+    const agg_state& v = value(g, k);
+    switch (aggs[k].col_type) {
+        case SDT_UINT32: flexbldr.Add(static_cast<uint32_t>(v.u)); break;
+        case SDT_FLOAT: flexbldr.Add(static_cast<float>(v.d)); break;
+        default:
+            switch (aggStateField(aggs[k].col_type)) {
+                case ASF_INT: flexbldr.Add(v.i); break;
+                case ASF_UINT: flexbldr.Add(v.u); break;
+                default: flexbldr.Add(v.d); break;
+            }
+    }
+}
+
+void GroupTable::setTableInfo(int _skyhook_version,
+                              int _data_structure_version,
+                              int _data_schema_version,
+                              const std::string& _db_schema_name,
+                              const std::string& _table_name) {
+    skyhook_version = _skyhook_version;
+    data_structure_version = _data_structure_version;
+    data_schema_version = _data_schema_version;
+    db_schema_name = _db_schema_name;
+    table_name = _table_name;
+}
+
+void GroupTable::buildFb(flatbuffers::FlatBufferBuilder& flatbldr,
+                         const std::string& result_schema,
+                         group_row_fn row_fn) const {
+    std::vector<flatbuffers::Offset<Tables::Record>> offs;
+    delete_vector dead_rows;
+    nullbits_vector nb(2, 0);
+    flexbuffers::Builder flexbldr;
+    for (uint32_t g = 0; g < size(); g++) {
+        flexbldr.Clear();
+        flexbldr.Vector([&]() {
+            if (row_fn) {
+                row_fn(g, flexbldr);
+                return;
+            }
+            addKeys(g, flexbldr);
+            for (uint32_t k = 0; k < aggs.size(); k++)
+                addValue(g, k, flexbldr);
+        });
+        flexbldr.Finish();
+        auto row_data = flatbldr.CreateVector(flexbldr.GetBuffer());
+        auto nullbits = flatbldr.CreateVector(nb);
+        int RID = -1;  // group recs only, since these are derived data
+        offs.push_back(Tables::CreateRecord(flatbldr, RID, nullbits, row_data));
+        dead_rows.push_back(0);
+    }
+
+    auto table = CreateTable(
+        flatbldr,
+        SFT_FLATBUF_FLEX_ROW,
+        skyhook_version,
+        data_structure_version,
+        data_schema_version,
+        flatbldr.CreateString(result_schema),
+        flatbldr.CreateString(db_schema_name),
+        flatbldr.CreateString(table_name),
+        flatbldr.CreateVector(dead_rows),
+        flatbldr.CreateVector(offs),
+        offs.size());
+    flatbldr.Finish(table);
+}
+
+std::string GroupTable::toString() const {
+    std::string s("GroupTable:");
+    s.append(" .keys=" + std::to_string(keys.size()));
+    s.append(" .aggs=" + std::to_string(aggs.size()));
+    s.append(" .merge_mode=" + std::to_string(merge_mode));
+    s.append(" .groups=" + std::to_string(size()));
+    s.append(" .slots=" + std::to_string(slots.size()));
+    s.append(" .mem_bytes=" + std::to_string(memBytes()));
+    s.append(" .max_bytes=" + std::to_string(max_bytes));
+    return s;
+}
+
+} // end namespace Tables
@@ -0,0 +1,179 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+
+#ifndef CLS_TABULAR_GROUPBY_H
+#define CLS_TABULAR_GROUPBY_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+#include "cls_tabular_utils.h"
+#include "cls_tabular_predicates.h"
+
+
+// Grouped aggregation.
+// A GroupTable maps the values of one or more group key cols to a set of
+// running aggs, using an open addressing hash table over the encoded keys.
+// cls computes the partial aggs of each group for the rows of an object, the
+// client merges the partials of each group from all objects with the same
+// table in merge mode, where the cnt partials are summed.
+
+
+namespace Tables {
+
+// default memory budget of the group table per exec_query_op call
+const uint64_t GROUPBY_MAX_BYTES_DEFAULT = 64 * 1024 * 1024;
+
+// a running agg value, stored per the agg col type class
+union agg_state {
+    int64_t i;
+    uint64_t u;
+    double d;
+};
+
+// the agg_state field that holds a value of a col type, strings are held
+// separately by the caller
+enum AggStateField {
+    ASF_INT,
+    ASF_UINT,
+    ASF_DOUBLE,
+    ASF_STRING
+};
+
+int aggStateField(int col_type);
+
+// read a numeric col value into the agg_state field for its type
+agg_state flexAggState(const flexbuffers::Reference& ref, int col_type);
+agg_state arrowAggState(const std::shared_ptr<arrow::Array>& a,
+                        int col_type, uint32_t rnum);
+
+// add a numeric value in its col type to a flexbuf vector being built
+void addAggState(flexbuffers::Builder& flexbldr, const agg_state& v,
+                 int col_type);
+
+// one agg computed per group over the col col_idx
+struct group_agg {
+    int col_idx;
+    int col_type;
+    int op_type;
+};
+
+// the global agg preds of a query, in pred order
+std::vector<group_agg> groupAggsFromPreds(const predicate_vec& preds);
+
+// adds the result cols of group g to a flexbuf vector being built
+typedef std::function<void(uint32_t g, flexbuffers::Builder& flexbldr)>
+    group_row_fn;
+
+class GroupTable {
+public:
+    // in merge mode rows hold each group's keys followed by its partial aggs,
+    // else the aggs are computed over the cols of the data rows.
+    // max_bytes of 0 places no bound on the table size.
+    GroupTable(const schema_vec& keys,
+               const std::vector<group_agg>& aggs,
+               bool merge_mode,
+               uint64_t max_bytes=0);
+
+    uint32_t size() const {return key_offs.size() - 1;}
+    uint32_t numAggs() const {return aggs.size();}
+    bool empty() const {return size() == 0;}
+
+    // approximate heap bytes held by the table
+    uint64_t memBytes() const;
+
+    // true once the table has grown beyond its memory budget
+    bool full() const {return max_bytes > 0 and memBytes() >= max_bytes;}
+
+    void clear();
+
+    // accumulate the selected rows of a batch of flexbuf rows, of a flatbuf
+    // with the dictionary encoded cols dicts
+    void updateFlexRows(const std::vector<flexbuffers::Vector>& rows,
+                        const SelectionBitmap& sel,
+                        const FbDicts& dicts);
+
+    // accumulate the rows rnums of a single chunk arrow table, such as one
+    // record batch of a larger table
+    void updateArrowRows(std::shared_ptr<arrow::Table>& table,
+                         const std::vector<uint32_t>& rnums);
+
+    // accumulate the groups of a flatbuf result built by buildFb()
+    void updateSkyRoot(const sky_root& root);
+
+    // merge the groups of another table with the same keys and aggs
+    void merge(const GroupTable& other);
+
+    // add the key values of group g to a flexbuf vector being built
+    void addKeys(uint32_t g, flexbuffers::Builder& flexbldr) const;
+
+    // the running value of agg k of group g
+    const agg_state& value(uint32_t g, uint32_t k) const {
+        return states[(g * aggs.size()) + k];
+    }
+
+    // the running value of agg k of group g as a double
+    double valueAsDouble(uint32_t g, uint32_t k) const;
+
+    // add the typed value of agg k of group g to a flexbuf vector
+    void addValue(uint32_t g, uint32_t k, flexbuffers::Builder& flexbldr) const;
+
+    // set the table info of the input data, copied into buildFb() results
+    void setTableInfo(int skyhook_version,
+                      int data_structure_version,
+                      int data_schema_version,
+                      const std::string& db_schema_name,
+                      const std::string& table_name);
+
+    // build a flatbuf flex row table with one row per group, by default
+    // holding the group's keys then its aggs, per the result schema string.
+    void buildFb(flatbuffers::FlatBufferBuilder& flatbldr,
+                 const std::string& result_schema,
+                 group_row_fn row_fn=nullptr) const;
+
+    std::string toString() const;
+
+private:
+    schema_vec keys;
+    std::vector<group_agg> aggs;
+    bool merge_mode;
+    uint64_t max_bytes;
+
+    int skyhook_version;
+    int data_structure_version;
+    int data_schema_version;
+    std::string db_schema_name;
+    std::string table_name;
+
+    // group g's encoded key is
+    // key_arena[key_offs[g], key_offs[g+1])
+    std::string key_arena;
+    std::vector<uint32_t> key_offs;
+    std::vector<uint64_t> hashes;
+    std::vector<agg_state> states;
+
+    // open addressing slots holding group ids, power of 2 sized
+    std::vector<uint32_t> slots;
+    uint64_t slot_mask;
+
+    // reused to encode the key of each row
+    std::string key_buf;
+
+    uint32_t findOrInsert(const std::string& key, bool* inserted);
+    void grow();
+    void accumulate(uint32_t g, uint32_t k, const agg_state& v, bool init);
+};
+
+} // end namespace Tables
+
+
+#endif
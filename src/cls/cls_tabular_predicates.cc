@@ -0,0 +1,788 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+#include "cls_tabular_predicates.h"
+
+
+namespace Tables {
+
+/*
+ * SelectionBitmap
+ */
+
+void SelectionBitmap::reset(uint32_t n, bool val) {
+    nbits = n;
+    words.assign((n + 63) / 64, val ? ~0ULL : 0ULL);
+    clearTail();
+}
+
+// bits beyond nbits must stay zero so count() and none() are exact
+void SelectionBitmap::clearTail() {
+    if (nbits % 64 and !words.empty())
+        words.back() &= (1ULL << (nbits % 64)) - 1;
+}
+
+void SelectionBitmap::andWith(const SelectionBitmap& other) {
+    assert (other.nbits == nbits);
+    for (size_t i = 0; i < words.size(); i++)
+        words[i] &= other.words[i];
+}
+
+void SelectionBitmap::orWith(const SelectionBitmap& other) {
+    assert (other.nbits == nbits);
+    for (size_t i = 0; i < words.size(); i++)
+        words[i] |= other.words[i];
+}
+
+uint32_t SelectionBitmap::count() const {
+    uint32_t c = 0;
+    for (size_t i = 0; i < words.size(); i++)
+        c += __builtin_popcountll(words[i]);
+    return c;
+}
+
+bool SelectionBitmap::none() const {
+    for (size_t i = 0; i < words.size(); i++)
+        if (words[i]) return false;
+    return true;
+}
+
+void SelectionBitmap::toRowNums(std::vector<uint32_t>& out, uint32_t base) const {
+    for (size_t i = 0; i < words.size(); i++) {
+        uint64_t w = words[i];
+        while (w) {
+            uint32_t bit = __builtin_ctzll(w);
+            out.push_back(base + (i * 64) + bit);
+            w &= w - 1;
+        }
+    }
+}
+
+std::string SelectionBitmap::toString() const {
+    std::string s("SelectionBitmap:");
+    s.append(" nbits=" + std::to_string(nbits));
+    s.append(" selected=" + std::to_string(count()));
+    return s;
+}
+
+
+/*
+ * Kernels
+ * Each kernel is instantiated per storage type S and comparison op, so the
+ * inner loops are branch free over contiguous values and can be vectorized
+ * by the compiler.
+ */
+
+struct op_lt  { template <typename S> static bool apply(S a, S b) {return a < b;} };
+struct op_gt  { template <typename S> static bool apply(S a, S b) {return a > b;} };
+struct op_eq  { template <typename S> static bool apply(S a, S b) {return a == b;} };
+struct op_ne  { template <typename S> static bool apply(S a, S b) {return a != b;} };
+struct op_leq { template <typename S> static bool apply(S a, S b) {return a <= b;} };
+struct op_geq { template <typename S> static bool apply(S a, S b) {return a >= b;} };
+
+template <typename S, typename Op>
+static void cmp_kernel(const compiled_pred& cp, const void* vals,
+                       uint32_t n, uint64_t* out) {
+    const S* v = static_cast<const S*>(vals);
+    const S c = cp.constVal<S>();
+    const uint32_t full = n / 64;
+    for (uint32_t w = 0; w < full; w++) {
+        const S* p = v + (w * 64);
+        uint64_t bits = 0;
+        for (uint32_t j = 0; j < 64; j++)
+            bits |= static_cast<uint64_t>(Op::apply(p[j], c)) << j;
+        out[w] = bits;
+    }
+    if (n % 64) {
+        const S* p = v + (full * 64);
+        uint64_t bits = 0;
+        for (uint32_t j = 0; j < n % 64; j++)
+            bits |= static_cast<uint64_t>(Op::apply(p[j], c)) << j;
+        out[full] = bits;
+    }
+}
+
+// the widened type used by the scalar compare() functions
+template <typename S>
+struct cmp_widen {
+    typedef typename std::conditional<std::is_same<S, bool>::value, bool,
+            typename std::conditional<std::is_floating_point<S>::value, double,
+            typename std::conditional<std::is_signed<S>::value, int64_t,
+                                      uint64_t>::type>::type>::type type;
+};
+
+// logical and bitwise ops are rare, these reuse the scalar compare()
+template <typename S>
+static void generic_kernel(const compiled_pred& cp, const void* vals,
+                           uint32_t n, uint64_t* out) {
+    typedef typename cmp_widen<S>::type W;
+    const S* v = static_cast<const S*>(vals);
+    const W c = static_cast<W>(cp.constVal<S>());
+    memset(out, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        if (compare(static_cast<W>(v[i]), c, cp.op_type))
+            out[i >> 6] |= (1ULL << (i & 63));
+    }
+}
+
+template <typename S>
+static pred_kernel_fn select_cmp_kernel(int op) {
+    switch (op) {
+        case SOT_lt:  return &cmp_kernel<S, op_lt>;
+        case SOT_gt:  return &cmp_kernel<S, op_gt>;
+        case SOT_eq:  return &cmp_kernel<S, op_eq>;
+        case SOT_ne:  return &cmp_kernel<S, op_ne>;
+        case SOT_leq: return &cmp_kernel<S, op_leq>;
+        case SOT_geq: return &cmp_kernel<S, op_geq>;
+        default:      return &generic_kernel<S>;
+    }
+}
+
+static void like_kernel(const compiled_pred& cp, const void* vals,
+                        uint32_t n, uint64_t* out) {
+    const str_ref* v = static_cast<const str_ref*>(vals);
+    memset(out, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        if (cp.like->match(v[i].data, v[i].len))
+            out[i >> 6] |= (1ULL << (i & 63));
+    }
+}
+
+// char cols are stored as 1 byte ints, match the regex on the single char
+template <typename S>
+static void char_like_kernel(const compiled_pred& cp, const void* vals,
+                             uint32_t n, uint64_t* out) {
+    const S* v = static_cast<const S*>(vals);
+    memset(out, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        const char c = static_cast<char>(v[i]);
+        if (cp.like->match(&c, 1))
+            out[i >> 6] |= (1ULL << (i & 63));
+    }
+}
+
+template <typename Op>
+static void date_kernel(const compiled_pred& cp, const void* vals,
+                        uint32_t n, uint64_t* out) {
+    const str_ref* v = static_cast<const str_ref*>(vals);
+    memset(out, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        boost::gregorian::date d = \
+            boost::gregorian::from_string(std::string(v[i].data, v[i].len));
+        if (Op::apply(d, cp.dval))
+            out[i >> 6] |= (1ULL << (i & 63));
+    }
+}
+
+// lexicographic order of a string value and a pred constant, as strcmp
+static inline int str_cmp(const char* s, uint32_t len, const std::string& c) {
+    int r = memcmp(s, c.data(), std::min(static_cast<size_t>(len), c.size()));
+    if (r != 0)
+        return r;
+    if (len == c.size())
+        return 0;
+    return len < c.size() ? -1 : 1;
+}
+
+template <typename Op>
+static void str_kernel(const compiled_pred& cp, const void* vals,
+                       uint32_t n, uint64_t* out) {
+    const str_ref* v = static_cast<const str_ref*>(vals);
+    memset(out, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        if (Op::apply(str_cmp(v[i].data, v[i].len, cp.sval), 0))
+            out[i >> 6] |= (1ULL << (i & 63));
+    }
+}
+
+// binary search of each value in the sorted members of the pred
+template <bool In>
+static void in_kernel(const compiled_pred& cp, const void* vals,
+                      uint32_t n, uint64_t* out) {
+    const str_ref* v = static_cast<const str_ref*>(vals);
+    memset(out, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        auto it = std::lower_bound(cp.in_vals.begin(), cp.in_vals.end(), v[i],
+                                   [](const std::string& m, const str_ref& r) {
+                                       return str_cmp(r.data, r.len, m) > 0;
+                                   });
+        bool found = it != cp.in_vals.end() and
+                     str_cmp(v[i].data, v[i].len, *it) == 0;
+        if (found == In)
+            out[i >> 6] |= (1ULL << (i & 63));
+    }
+}
+
+static pred_kernel_fn select_str_kernel(int op) {
+    switch (op) {
+        case SOT_lt:     return &str_kernel<op_lt>;
+        case SOT_gt:     return &str_kernel<op_gt>;
+        case SOT_eq:     return &str_kernel<op_eq>;
+        case SOT_ne:     return &str_kernel<op_ne>;
+        case SOT_leq:    return &str_kernel<op_leq>;
+        case SOT_geq:    return &str_kernel<op_geq>;
+        case SOT_in:     return &in_kernel<true>;
+        case SOT_not_in: return &in_kernel<false>;
+        default: assert (TablesErrCodes::PredicateComparisonNotDefined==0);
+    }
+    return NULL;  // should be unreachable
+}
+
+// rows of a dictionary encoded col, selected by the pass bit of their code.
+// codes outside of the dictionary never pass.
+static void dict_code_kernel(const compiled_pred& cp, const void* vals,
+                             uint32_t n, uint64_t* out) {
+    const uint32_t* v = static_cast<const uint32_t*>(vals);
+    const uint64_t* pass = cp.dict_pass.data();
+    const uint64_t ncodes = cp.dict_pass.size() * 64;
+    memset(out, 0, ((n + 63) / 64) * sizeof(uint64_t));
+    for (uint32_t i = 0; i < n; i++) {
+        const uint32_t c = v[i];
+        if (c < ncodes and ((pass[c >> 6] >> (c & 63)) & 1))
+            out[i >> 6] |= (1ULL << (i & 63));
+    }
+}
+
+static pred_kernel_fn select_date_kernel(int op) {
+    switch (op) {
+        case SOT_before:
+        case SOT_lt:  return &date_kernel<op_lt>;
+        case SOT_after:
+        case SOT_gt:  return &date_kernel<op_gt>;
+        case SOT_eq:  return &date_kernel<op_eq>;
+        case SOT_ne:  return &date_kernel<op_ne>;
+        case SOT_leq: return &date_kernel<op_leq>;
+        case SOT_geq: return &date_kernel<op_geq>;
+        default: assert (TablesErrCodes::PredicateComparisonNotDefined==0);
+    }
+    return NULL;  // should be unreachable
+}
+
+// S is the gathered storage type, T is the predicate's value type
+template <typename S, typename T>
+static void agg_kernel(const compiled_pred& cp, const void* vals,
+                       const SelectionBitmap& sel) {
+    TypedPredicate<T>* p = static_cast<TypedPredicate<T>*>(cp.pred);
+    const S* v = static_cast<const S*>(vals);
+    T acc = p->Val();
+    const uint64_t* words = sel.data();
+    for (uint32_t i = 0; i < sel.nwords(); i++) {
+        uint64_t w = words[i];
+        while (w) {
+            uint32_t r = (i * 64) + __builtin_ctzll(w);
+            acc = computeAgg(static_cast<T>(v[r]), acc, cp.op_type);
+            w &= w - 1;
+        }
+    }
+    p->updateAgg(acc);
+}
+
+template <typename S, typename T>
+static void compile_numeric(compiled_pred& cp) {
+    TypedPredicate<T>* p = dynamic_cast<TypedPredicate<T>*>(cp.pred);
+    assert (p != NULL);
+    const S c = static_cast<S>(p->Val());
+    memcpy(&cp.cval_bits, &c, sizeof(S));
+    cp.elem_size = sizeof(S);
+    if (cp.is_agg)
+        cp.agg_update = &agg_kernel<S, T>;
+    else if (cp.op_type == SOT_like)
+        cp.kernel = &char_like_kernel<S>;
+    else
+        cp.kernel = select_cmp_kernel<S>(cp.op_type);
+}
+
+compiled_pred compilePredicate(PredicateBase* pb) {
+
+    compiled_pred cp;
+    cp.pred = pb;
+    cp.col_idx = pb->colIdx();
+    cp.col_type = pb->colType();
+    cp.op_type = pb->opType();
+    cp.chain_op_type = pb->chainOpType();
+    cp.is_agg = pb->isGlobalAgg();
+    cp.elem_size = 0;
+    cp.kernel = NULL;
+    cp.agg_update = NULL;
+    cp.cval_bits = 0;
+    cp.like = NULL;
+    cp.value_kernel = NULL;
+    cp.dict_bound = false;
+    cp.nevaluated = 0;
+    cp.npassed = 0;
+
+    switch (cp.col_type) {
+        case SDT_BOOL:   compile_numeric<bool, bool>(cp); break;
+        case SDT_INT8:   compile_numeric<int8_t, int8_t>(cp); break;
+        case SDT_INT16:  compile_numeric<int16_t, int16_t>(cp); break;
+        case SDT_INT32:  compile_numeric<int32_t, int32_t>(cp); break;
+        case SDT_INT64:  compile_numeric<int64_t, int64_t>(cp); break;
+        case SDT_UINT8:  compile_numeric<uint8_t, uint8_t>(cp); break;
+        case SDT_UINT16: compile_numeric<uint16_t, uint16_t>(cp); break;
+        case SDT_UINT32: compile_numeric<uint32_t, uint32_t>(cp); break;
+        case SDT_UINT64: compile_numeric<uint64_t, uint64_t>(cp); break;
+        case SDT_FLOAT:  compile_numeric<float, float>(cp); break;
+        case SDT_DOUBLE: compile_numeric<double, double>(cp); break;
+        case SDT_CHAR:   compile_numeric<int8_t, char>(cp); break;
+        case SDT_UCHAR:  compile_numeric<uint8_t, unsigned char>(cp); break;
+        case SDT_STRING:
+        case SDT_DATE: {
+            TypedPredicate<std::string>* p = \
+                    dynamic_cast<TypedPredicate<std::string>*>(pb);
+            assert (p != NULL);
+            cp.elem_size = sizeof(str_ref);
+            if (cp.col_type == SDT_DATE) {
+                cp.dval = boost::gregorian::from_string(p->Val());
+                cp.kernel = select_date_kernel(cp.op_type);
+            }
+            else if (cp.op_type == SOT_like) {
+                cp.kernel = &like_kernel;
+            }
+            else {
+                cp.sval = p->Val();
+                if (cp.op_type == SOT_in or cp.op_type == SOT_not_in) {
+                    boost::split(cp.in_vals, cp.sval,
+                                 boost::is_any_of(PRED_IN_DELIM));
+                    std::sort(cp.in_vals.begin(), cp.in_vals.end());
+                }
+                cp.kernel = select_str_kernel(cp.op_type);
+            }
+            cp.value_kernel = cp.kernel;
+            break;
+        }
+        default: assert (TablesErrCodes::PredicateComparisonNotDefined==0);
+    }
+
+    // char/uchar preds keep their own compiled regex as well
+    if (cp.op_type == SOT_like) {
+        switch (cp.col_type) {
+            case SDT_CHAR:
+                cp.like = dynamic_cast<TypedPredicate<char>*>(pb)->getMatcher();
+                break;
+            case SDT_UCHAR:
+                cp.like = dynamic_cast<TypedPredicate<unsigned char>*>(pb)->getMatcher();
+                break;
+            default:
+                cp.like = dynamic_cast<TypedPredicate<std::string>*>(pb)->getMatcher();
+        }
+        assert (cp.like != NULL);
+    }
+
+    // strings are gathered by reference and compared by value, dates are
+    // parsed per row, and regex matches cost the most.
+    if (cp.op_type == SOT_like)
+        cp.cost = 16;
+    else if (cp.col_type == SDT_DATE)
+        cp.cost = 8;
+    else if (cp.col_type == SDT_STRING)
+        cp.cost = 4;
+    else
+        cp.cost = 1;
+    cp.value_cost = cp.cost;
+    return cp;
+}
+
+// cost / fraction of rows removed, with the pass fraction estimated with
+// add-one smoothing so a pred not yet evaluated ranks by its cost alone.
+double compiled_pred::rank() const {
+    double pass = (npassed + 1.0) / (nevaluated + 2.0);
+    return cost / std::max(1.0 - pass, 1e-6);
+}
+
+std::string compiled_pred::toString() const {
+    std::string s("compiled_pred:");
+    s.append(" col_idx=" + std::to_string(col_idx));
+    s.append(" col_type=" + std::to_string(col_type));
+    s.append(" op_type=" + std::to_string(op_type));
+    s.append(" chain_op_type=" + std::to_string(chain_op_type));
+    s.append(" is_agg=" + std::to_string(is_agg));
+    s.append(" elem_size=" + std::to_string(elem_size));
+    s.append(" dict_bound=" + std::to_string(dict_bound));
+    s.append(" cost=" + std::to_string(cost));
+    s.append(" nevaluated=" + std::to_string(nevaluated));
+    s.append(" npassed=" + std::to_string(npassed));
+    return s;
+}
+
+
+/*
+ * Flexbuf value access, one instantiation per storage type
+ */
+
+template <typename S> static inline S flexAs(const flexbuffers::Reference& r);
+template <> inline bool flexAs<bool>(const flexbuffers::Reference& r) {return r.AsBool();}
+template <> inline int8_t flexAs<int8_t>(const flexbuffers::Reference& r) {return r.AsInt8();}
+template <> inline int16_t flexAs<int16_t>(const flexbuffers::Reference& r) {return r.AsInt16();}
+template <> inline int32_t flexAs<int32_t>(const flexbuffers::Reference& r) {return r.AsInt32();}
+template <> inline int64_t flexAs<int64_t>(const flexbuffers::Reference& r) {return r.AsInt64();}
+template <> inline uint8_t flexAs<uint8_t>(const flexbuffers::Reference& r) {return r.AsUInt8();}
+template <> inline uint16_t flexAs<uint16_t>(const flexbuffers::Reference& r) {return r.AsUInt16();}
+template <> inline uint32_t flexAs<uint32_t>(const flexbuffers::Reference& r) {return r.AsUInt32();}
+template <> inline uint64_t flexAs<uint64_t>(const flexbuffers::Reference& r) {return r.AsUInt64();}
+template <> inline float flexAs<float>(const flexbuffers::Reference& r) {return r.AsFloat();}
+template <> inline double flexAs<double>(const flexbuffers::Reference& r) {return r.AsDouble();}
+
+template <typename S>
+static void gather_flex(const std::vector<flexbuffers::Vector>& rows,
+                        const std::vector<int64_t>& rids,
+                        int col_idx, void* out) {
+    S* o = static_cast<S*>(out);
+    const size_t n = rows.size();
+    if (col_idx == RID_COL_INDEX) {  // RID val not in the row
+        for (size_t i = 0; i < n; i++)
+            o[i] = static_cast<S>(rids[i]);
+        return;
+    }
+    for (size_t i = 0; i < n; i++)
+        o[i] = flexAs<S>(rows[i][col_idx]);
+}
+
+static void gather_flex_str(const std::vector<flexbuffers::Vector>& rows,
+                            int col_idx, void* out) {
+    str_ref* o = static_cast<str_ref*>(out);
+    for (size_t i = 0; i < rows.size(); i++) {
+        flexbuffers::String s = rows[i][col_idx].AsString();
+        o[i].data = s.c_str();
+        o[i].len = s.length();
+    }
+}
+
+void* PredicateEngine::gatherFlex(const compiled_pred& cp,
+                                  const std::vector<flexbuffers::Vector>& rows,
+                                  const std::vector<int64_t>& rids) {
+    const size_t nbytes = rows.size() * cp.elem_size;
+    if (scratch.size() * sizeof(uint64_t) < nbytes)
+        scratch.resize((nbytes / sizeof(uint64_t)) + 1);
+    void* out = scratch.data();
+
+    // the codes of a dictionary encoded string/date col
+    if (cp.dict_bound) {
+        gather_flex<uint32_t>(rows, rids, cp.col_idx, out);
+        return out;
+    }
+
+    switch (cp.col_type) {
+        case SDT_BOOL:   gather_flex<bool>(rows, rids, cp.col_idx, out); break;
+        case SDT_CHAR:
+        case SDT_INT8:   gather_flex<int8_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_INT16:  gather_flex<int16_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_INT32:  gather_flex<int32_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_INT64:  gather_flex<int64_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_UCHAR:
+        case SDT_UINT8:  gather_flex<uint8_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_UINT16: gather_flex<uint16_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_UINT32: gather_flex<uint32_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_UINT64: gather_flex<uint64_t>(rows, rids, cp.col_idx, out); break;
+        case SDT_FLOAT:  gather_flex<float>(rows, rids, cp.col_idx, out); break;
+        case SDT_DOUBLE: gather_flex<double>(rows, rids, cp.col_idx, out); break;
+        case SDT_STRING:
+        case SDT_DATE:   gather_flex_str(rows, cp.col_idx, out); break;
+        default: assert (TablesErrCodes::PredicateComparisonNotDefined==0);
+    }
+    return out;
+}
+
+
+/*
+ * Arrow value access, contiguous batches are read in place from the array
+ * buffer, row number lists are gathered into the scratch buffer.
+ */
+
+template <typename ArrayT, typename S>
+static const void* gather_arrow(std::shared_ptr<arrow::Array>& arr,
+                                int64_t start,
+                                const uint32_t* rnums,
+                                uint32_t n,
+                                void* out) {
+    auto a = std::static_pointer_cast<ArrayT>(arr);
+    const S* raw = reinterpret_cast<const S*>(a->raw_values());
+    if (rnums == NULL)
+        return raw + start;
+    S* o = static_cast<S*>(out);
+    for (uint32_t i = 0; i < n; i++)
+        o[i] = raw[rnums[i]];
+    return out;
+}
+
+const void* PredicateEngine::gatherArrow(const compiled_pred& cp,
+                                         std::shared_ptr<arrow::Table>& table,
+                                         int num_cols,
+                                         int64_t start,
+                                         const uint32_t* rnums,
+                                         uint32_t n) {
+    const size_t nbytes = n * cp.elem_size;
+    if (scratch.size() * sizeof(uint64_t) < nbytes)
+        scratch.resize((nbytes / sizeof(uint64_t)) + 1);
+    void* out = scratch.data();
+
+    // RID vals are kept in their own int64 col after the data cols
+    int col = cp.col_idx;
+    if (col == RID_COL_INDEX)
+        col = ARROW_RID_INDEX(num_cols);
+    std::shared_ptr<arrow::Array> arr = table->column(col)->chunk(0);
+
+    if (cp.col_idx == RID_COL_INDEX) {
+        if (cp.col_type == SDT_UINT64)
+            return gather_arrow<arrow::Int64Array, uint64_t>(arr, start, rnums, n, out);
+        return gather_arrow<arrow::Int64Array, int64_t>(arr, start, rnums, n, out);
+    }
+
+    switch (cp.col_type) {
+        case SDT_BOOL: {
+            // arrow bools are bit packed, always unpack them
+            auto a = std::static_pointer_cast<arrow::BooleanArray>(arr);
+            bool* o = static_cast<bool*>(out);
+            for (uint32_t i = 0; i < n; i++)
+                o[i] = a->Value(rnums ? rnums[i] : start + i);
+            return out;
+        }
+        case SDT_CHAR:
+        case SDT_INT8:
+            return gather_arrow<arrow::Int8Array, int8_t>(arr, start, rnums, n, out);
+        case SDT_INT16:
+            return gather_arrow<arrow::Int16Array, int16_t>(arr, start, rnums, n, out);
+        case SDT_INT32:
+            return gather_arrow<arrow::Int32Array, int32_t>(arr, start, rnums, n, out);
+        case SDT_INT64:
+            return gather_arrow<arrow::Int64Array, int64_t>(arr, start, rnums, n, out);
+        case SDT_UCHAR:
+        case SDT_UINT8:
+            return gather_arrow<arrow::UInt8Array, uint8_t>(arr, start, rnums, n, out);
+        case SDT_UINT16:
+            return gather_arrow<arrow::UInt16Array, uint16_t>(arr, start, rnums, n, out);
+        case SDT_UINT32:
+            return gather_arrow<arrow::UInt32Array, uint32_t>(arr, start, rnums, n, out);
+        case SDT_UINT64:
+            return gather_arrow<arrow::UInt64Array, uint64_t>(arr, start, rnums, n, out);
+        case SDT_FLOAT:
+            return gather_arrow<arrow::FloatArray, float>(arr, start, rnums, n, out);
+        case SDT_DOUBLE:
+            return gather_arrow<arrow::DoubleArray, double>(arr, start, rnums, n, out);
+        case SDT_STRING:
+        case SDT_DATE: {
+            auto a = std::static_pointer_cast<arrow::StringArray>(arr);
+            str_ref* o = static_cast<str_ref*>(out);
+            for (uint32_t i = 0; i < n; i++) {
+                int32_t len = 0;
+                const uint8_t* v = a->GetValue(rnums ? rnums[i] : start + i, &len);
+                o[i].data = reinterpret_cast<const char*>(v);
+                o[i].len = len;
+            }
+            return out;
+        }
+        default: assert (TablesErrCodes::PredicateComparisonNotDefined==0);
+    }
+    return NULL;  // should be unreachable
+}
+
+
+/*
+ * PredicateEngine
+ */
+
+PredicateEngine::PredicateEngine(predicate_vec& preds) :
+    and_chained(true),
+    nbatches(0),
+    dicts_bound(false)
+{
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        compiled_pred cp = compilePredicate(*it);
+        if (cp.is_agg)
+            aggs.push_back(cp);
+        else
+            filters.push_back(cp);
+    }
+    scratch.resize((PRED_BATCH_ROWS * sizeof(str_ref)) / sizeof(uint64_t));
+
+    // an or-chained pred depends on the preds before it, so any order
+    // other than the query order could change the result.
+    for (auto it = filters.begin(); it != filters.end(); ++it) {
+        if (it->chain_op_type == SOT_logical_or)
+            and_chained = false;
+    }
+    rankFilters();
+}
+
+// order and-chained preds by rank, the sort is stable so ties keep their
+// query order.
+void PredicateEngine::rankFilters() {
+    if (!and_chained or filters.size() < 2)
+        return;
+    std::stable_sort(filters.begin(), filters.end(),
+                     [](const compiled_pred& a, const compiled_pred& b) {
+                         return a.rank() < b.rank();
+                     });
+}
+
+// same and/or chaining as applyPredicates(): the first pred's chain op sets
+// the initial row value, and an AND pred stops evaluation of any row that
+// has already failed so later OR preds cannot revive it.
+void PredicateEngine::beginBatch(uint32_t n) {
+    if (++nbatches % PRED_RANK_BATCHES == 0)
+        rankFilters();
+    bool init = true;
+    if (!filters.empty() and filters[0].chain_op_type == SOT_logical_or)
+        init = false;
+    passed.reset(n, init);
+    alive.reset(n, true);
+    colpass.reset(n, false);
+}
+
+bool PredicateEngine::shortCircuit(const compiled_pred& cp) {
+    if (cp.chain_op_type == SOT_logical_or)
+        return false;
+    alive.andWith(passed);
+    return alive.none();
+}
+
+// ncand is the number of rows the pred was evaluated for, i.e., still
+// passing before an and-chained pred, which then counts the rows it passed.
+void PredicateEngine::combine(compiled_pred& cp, uint32_t ncand) {
+    if (cp.chain_op_type == SOT_logical_or) {
+        colpass.andWith(alive);
+        passed.orWith(colpass);
+    }
+    else {
+        passed.andWith(colpass);
+        if (and_chained) {
+            cp.nevaluated += ncand;
+            cp.npassed += passed.count();
+        }
+    }
+}
+
+void PredicateEngine::endBatch(SelectionBitmap& sel) {
+    sel.andWith(passed);
+}
+
+void PredicateEngine::evalFlexRows(const std::vector<flexbuffers::Vector>& rows,
+                                   const std::vector<int64_t>& rids,
+                                   SelectionBitmap& sel) {
+    assert (sel.size() == rows.size());
+    if (filters.empty() or sel.none())
+        return;
+
+    beginBatch(rows.size());
+    for (auto it = filters.begin(); it != filters.end(); ++it) {
+        if (shortCircuit(*it)) break;
+        const void* vals = gatherFlex(*it, rows, rids);
+        it->kernel(*it, vals, rows.size(), colpass.data());
+        combine(*it, and_chained ? alive.count() : rows.size());
+    }
+    endBatch(sel);
+}
+
+// each pred on an encoded col is evaluated by its value kernel over the
+// col's dictionary, the pass bits of the codes are then looked up per row
+// by a kernel over the gathered codes.  Preds on cols that are not encoded
+// in this flatbuf go back to their value kernels.
+void PredicateEngine::bindDicts(const FbDicts& dicts) {
+    if (!dicts_bound and dicts.empty())
+        return;
+    dicts_bound = false;
+    std::vector<str_ref> vals;
+    for (auto it = filters.begin(); it != filters.end(); ++it) {
+        compiled_pred& cp = *it;
+        const dict_values* dict = NULL;
+        if (cp.col_type == SDT_STRING or cp.col_type == SDT_DATE)
+            dict = dicts.get(cp.col_idx);
+        if (dict == NULL) {
+            if (cp.dict_bound) {
+                cp.kernel = cp.value_kernel;
+                cp.elem_size = sizeof(str_ref);
+                cp.cost = cp.value_cost;
+                cp.dict_bound = false;
+            }
+            continue;
+        }
+        vals.resize(dict->size());
+        for (unsigned i = 0; i < dict->size(); i++) {
+            const flatbuffers::String* v = dict->Get(i);
+            vals[i].data = v->c_str();
+            vals[i].len = v->size();
+        }
+        cp.dict_pass.assign((vals.size() + 63) / 64, 0);
+        if (!vals.empty())
+            cp.value_kernel(cp, vals.data(), vals.size(), cp.dict_pass.data());
+        cp.kernel = &dict_code_kernel;
+        cp.elem_size = sizeof(uint32_t);
+        cp.cost = 1;
+        cp.dict_bound = true;
+        dicts_bound = true;
+    }
+}
+
+void PredicateEngine::updateAggsFlexRows(const std::vector<flexbuffers::Vector>& rows,
+                                         const std::vector<int64_t>& rids,
+                                         const SelectionBitmap& sel) {
+    if (aggs.empty() or sel.none())
+        return;
+    for (auto it = aggs.begin(); it != aggs.end(); ++it) {
+        const void* vals = gatherFlex(*it, rows, rids);
+        it->agg_update(*it, vals, sel);
+    }
+}
+
+void PredicateEngine::evalArrowRows(std::shared_ptr<arrow::Table>& table,
+                                    int num_cols,
+                                    int64_t start,
+                                    const uint32_t* rnums,
+                                    uint32_t n,
+                                    SelectionBitmap& sel) {
+    assert (sel.size() == n);
+    if (filters.empty() or sel.none())
+        return;
+
+    // arrow string cols are never dictionary encoded once read
+    if (dicts_bound)
+        bindDicts(FbDicts());
+
+    // Rows failing an and-chained pred are never evaluated again, so once
+    // few rows still pass, only those are gathered and evaluated and the
+    // results are scattered back into colpass.
+    beginBatch(n);
+    for (auto it = filters.begin(); it != filters.end(); ++it) {
+        if (shortCircuit(*it)) break;
+        uint32_t ncand = and_chained ? alive.count() : n;
+        if (ncand * 2 > n) {
+            const void* vals = gatherArrow(*it, table, num_cols, start, rnums, n);
+            it->kernel(*it, vals, n, colpass.data());
+        }
+        else {
+            cand_pos.clear();
+            alive.toRowNums(cand_pos);
+            cand_rnums.resize(ncand);
+            for (uint32_t j = 0; j < ncand; j++)
+                cand_rnums[j] = rnums ? rnums[cand_pos[j]] : start + cand_pos[j];
+            const void* vals = gatherArrow(*it, table, num_cols, 0,
+                                           cand_rnums.data(), ncand);
+            candpass.reset(ncand, false);
+            it->kernel(*it, vals, ncand, candpass.data());
+            colpass.reset(n, false);
+            for (uint32_t j = 0; j < ncand; j++) {
+                if (candpass.test(j))
+                    colpass.set(cand_pos[j]);
+            }
+        }
+        combine(*it, ncand);
+    }
+    endBatch(sel);
+}
+
+std::string PredicateEngine::toString() const {
+    std::string s("PredicateEngine:\n");
+    for (auto it = filters.begin(); it != filters.end(); ++it)
+        s.append("  filter " + it->toString() + "\n");
+    for (auto it = aggs.begin(); it != aggs.end(); ++it)
+        s.append("  agg " + it->toString() + "\n");
+    return s;
+}
+
+} // end namespace Tables
@@ -0,0 +1,208 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+
+#ifndef CLS_TABULAR_PREDICATES_H
+#define CLS_TABULAR_PREDICATES_H
+
+#include <string>
+#include <vector>
+
+#include "cls_tabular_utils.h"
+
+
+// Vectorized predicate evaluation.
+// A predicate_vec is compiled once per query into typed kernels, each kernel
+// evaluates one predicate over a batch of column values and produces a
+// selection bitmap.  The per-row dynamic_cast and colType() switch done by
+// applyPredicates() is replaced by a single dispatch per predicate per batch.
+
+
+namespace Tables {
+
+// number of rows evaluated per kernel invocation
+const uint32_t PRED_BATCH_ROWS = 1024;
+
+// and-chained filter preds are reordered by rank every this many batches
+const uint32_t PRED_RANK_BATCHES = 8;
+
+// one bit per row of a batch, bit i set means row i is selected
+class SelectionBitmap {
+public:
+    SelectionBitmap(uint32_t n=0, bool val=false) {reset(n, val);}
+
+    void reset(uint32_t n, bool val);
+    uint32_t size() const {return nbits;}
+    uint32_t nwords() const {return words.size();}
+    uint64_t* data() {return words.data();}
+    const uint64_t* data() const {return words.data();}
+
+    bool test(uint32_t i) const {return (words[i >> 6] >> (i & 63)) & 1;}
+    void set(uint32_t i) {words[i >> 6] |= (1ULL << (i & 63));}
+    void clear(uint32_t i) {words[i >> 6] &= ~(1ULL << (i & 63));}
+
+    void andWith(const SelectionBitmap& other);
+    void orWith(const SelectionBitmap& other);
+    uint32_t count() const;
+    bool none() const;
+
+    // append the selected positions, offset by base, to out
+    void toRowNums(std::vector<uint32_t>& out, uint32_t base=0) const;
+
+    std::string toString() const;
+
+private:
+    uint32_t nbits;
+    std::vector<uint64_t> words;
+    void clearTail();
+};
+
+struct compiled_pred;
+
+// evaluates cp over n contiguous values, writing ceil(n/64) bitmap words
+typedef void (*pred_kernel_fn)(const compiled_pred& cp,
+                               const void* vals,
+                               uint32_t n,
+                               uint64_t* out);
+
+// accumulates the selected values into the agg pred's running value
+typedef void (*agg_update_fn)(const compiled_pred& cp,
+                              const void* vals,
+                              const SelectionBitmap& sel);
+
+// reference to a string value that lives in the input data blob
+struct str_ref {
+    const char* data;
+    uint32_t len;
+};
+
+// predicate bound to a kernel for its col type and op type
+struct compiled_pred {
+    PredicateBase* pred;      // source pred, aggs accumulate back into it
+    int col_idx;
+    int col_type;
+    int op_type;
+    int chain_op_type;
+    bool is_agg;
+    size_t elem_size;         // bytes per gathered value
+    pred_kernel_fn kernel;    // filter preds only
+    agg_update_fn agg_update; // agg preds only
+    int64_t cval_bits;        // typed constant, stored in native col type
+    const LikeMatcher* like;  // owned by the source pred
+    boost::gregorian::date dval;
+    std::string sval;         // string cmp preds only
+    std::vector<std::string> in_vals;  // in/not_in preds only, sorted
+
+    // a string/date pred on a dictionary encoded col is evaluated once per
+    // blob over the col's dictionary, its kernel then selects rows by code
+    pred_kernel_fn value_kernel;  // kernel over the col's string values
+    double value_cost;
+    bool dict_bound;
+    std::vector<uint64_t> dict_pass;  // one bit per code, set if it passes
+    double cost;              // relative per row cost of gather + kernel
+    uint64_t nevaluated;      // rows evaluated so far, for its selectivity
+    uint64_t npassed;         // rows of those passing
+
+    // expected cost per row removed, and-chained preds are evaluated in
+    // increasing rank order, i.e., cheapest and most selective first
+    double rank() const;
+
+    template <typename T>
+    T constVal() const {
+        T v;
+        memcpy(&v, &cval_bits, sizeof(T));
+        return v;
+    }
+
+    std::string toString() const;
+};
+
+class PredicateEngine {
+public:
+    PredicateEngine(predicate_vec& preds);
+
+    bool empty() const {return filters.empty() and aggs.empty();}
+    bool hasFilters() const {return !filters.empty();}
+    bool hasAggs() const {return !aggs.empty();}
+
+    // true if the filter preds are all and-chained, so can be reordered
+    bool reorderable() const {return and_chained;}
+
+    // evaluate the filter preds over a batch of flexbuf rows.
+    // on input sel holds the candidate rows (e.g., not deleted), on output
+    // only the candidates that pass all of the preds (and/or) remain set.
+    void evalFlexRows(const std::vector<flexbuffers::Vector>& rows,
+                      const std::vector<int64_t>& rids,
+                      SelectionBitmap& sel);
+
+    // bind the string/date filter preds to the dictionaries of the encoded
+    // cols of the flatbuf whose rows are evaluated next, must be called for
+    // each flatbuf before evalFlexRows() of its rows.
+    void bindDicts(const FbDicts& dicts);
+
+    // accumulate the agg preds over the selected flexbuf rows
+    void updateAggsFlexRows(const std::vector<flexbuffers::Vector>& rows,
+                            const std::vector<int64_t>& rids,
+                            const SelectionBitmap& sel);
+
+    // evaluate the filter preds over a batch of arrow rows, either the
+    // contiguous rows [start, start+n) or the row numbers rnums[0..n), of a
+    // single chunk table such as one record batch of a larger table
+    void evalArrowRows(std::shared_ptr<arrow::Table>& table,
+                       int num_cols,
+                       int64_t start,
+                       const uint32_t* rnums,
+                       uint32_t n,
+                       SelectionBitmap& sel);
+
+    std::string toString() const;
+
+private:
+    std::vector<compiled_pred> filters;
+    std::vector<compiled_pred> aggs;
+    bool and_chained;
+    uint32_t nbatches;
+    bool dicts_bound;  // some filter is bound to a dictionary
+
+    // reused per batch to gather values and hold per pred results
+    std::vector<uint64_t> scratch;
+    SelectionBitmap colpass;  // rows passing the current pred
+    SelectionBitmap alive;    // rows not yet short-circuited by an AND
+    SelectionBitmap passed;   // running and/or result of the preds
+
+    // and-chained preds only evaluate the rows still passing, these hold
+    // the batch positions and row nums of those rows, and their results
+    std::vector<uint32_t> cand_pos;
+    std::vector<uint32_t> cand_rnums;
+    SelectionBitmap candpass;
+
+    void* gatherFlex(const compiled_pred& cp,
+                     const std::vector<flexbuffers::Vector>& rows,
+                     const std::vector<int64_t>& rids);
+    const void* gatherArrow(const compiled_pred& cp,
+                            std::shared_ptr<arrow::Table>& table,
+                            int num_cols,
+                            int64_t start,
+                            const uint32_t* rnums,
+                            uint32_t n);
+    void beginBatch(uint32_t n);
+    bool shortCircuit(const compiled_pred& cp);
+    void combine(compiled_pred& cp, uint32_t ncand);
+    void endBatch(SelectionBitmap& sel);
+    void rankFilters();
+};
+
+// compile a single predicate, asserts if the col/op type is not supported
+compiled_pred compilePredicate(PredicateBase* pb);
+
+} // end namespace Tables
+
+
+#endif
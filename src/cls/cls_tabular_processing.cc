@@ -13,6 +13,121 @@
 
 namespace Tables {
 
+/*
+ * Function: projectFlexRow
+ * Description: Build the flexbuf vector of the query schema cols of a row,
+ *              locating each col within the data row.
+ * @param[out] flexbldr    : Cleared builder the row is built into
+ * @param[in] row          : Data row
+ * @param[in] query_schema : Schema of an query
+ * @param[in] col_idx_max  : Max valid col idx of the data rows
+ * @param[in] dicts        : Dictionaries of the encoded cols of the data rows
+ * @param[in] keep_codes   : Copy the codes of encoded cols, else decode them
+ * @param[in] table_name   : Table name, for error messages
+ * @param[in] rid          : Row id, for error messages
+ * @param[out] errmsg      : Error message
+ *
+ * Return Value: error code
+ */
+static int projectFlexRow(
+    flexbuffers::Builder& flexbldr,
+    const flexbuffers::Vector& row,
+    schema_vec& query_schema,
+    int col_idx_max,
+    const FbDicts& dicts,
+    bool keep_codes,
+    const std::string& table_name,
+    int64_t rid,
+    std::string& errmsg)
+{
+    int errcode = 0;
+    flexbldr.Vector([&]() {
+
+        // iter over the query schema, locating it within the data schema
+        for (auto it=query_schema.begin();
+                  it!=query_schema.end() && !errcode; ++it) {
+            col_info col = *it;
+            if (col.idx < AGG_COL_LAST or col.idx > col_idx_max) {
+                errcode = TablesErrCodes::RequestedColIndexOOB;
+                errmsg.append("ERROR processSkyFb(): table=" +
+                        table_name + "; rid=" +
+                        std::to_string(rid) + " col.idx=" +
+                        std::to_string(col.idx) + " OOB.");
+
+            } else if ((col.type == SDT_STRING or col.type == SDT_DATE) and
+                       dicts.get(col.idx) != NULL) {
+                if (keep_codes) {
+                    flexbldr.UInt(row[col.idx].AsUInt32());
+                } else {
+                    size_t len = 0;
+                    const char* s = dicts.getChars(row, col.idx, &len);
+                    flexbldr.String(s, len);
+                }
+
+            } else {
+
+                switch(col.type) {  // encode data val into flexbuf
+
+                    case SDT_INT8:
+                        flexbldr.Add(row[col.idx].AsInt8());
+                        break;
+                    case SDT_INT16:
+                        flexbldr.Add(row[col.idx].AsInt16());
+                        break;
+                    case SDT_INT32:
+                        flexbldr.Add(row[col.idx].AsInt32());
+                        break;
+                    case SDT_INT64:
+                        flexbldr.Add(row[col.idx].AsInt64());
+                        break;
+                    case SDT_UINT8:
+                        flexbldr.Add(row[col.idx].AsUInt8());
+                        break;
+                    case SDT_UINT16:
+                        flexbldr.Add(row[col.idx].AsUInt16());
+                        break;
+                    case SDT_UINT32:
+                        flexbldr.Add(row[col.idx].AsUInt32());
+                        break;
+                    case SDT_UINT64:
+                        flexbldr.Add(row[col.idx].AsUInt64());
+                        break;
+                    case SDT_CHAR:
+                        flexbldr.Add(row[col.idx].AsInt8());
+                        break;
+                    case SDT_UCHAR:
+                        flexbldr.Add(row[col.idx].AsUInt8());
+                        break;
+                    case SDT_BOOL:
+                        flexbldr.Add(row[col.idx].AsBool());
+                        break;
+                    case SDT_FLOAT:
+                        flexbldr.Add(row[col.idx].AsFloat());
+                        break;
+                    case SDT_DOUBLE:
+                        flexbldr.Add(row[col.idx].AsDouble());
+                        break;
+                    case SDT_DATE:
+                        flexbldr.Add(row[col.idx].AsString().str());
+                        break;
+                    case SDT_STRING:
+                        flexbldr.Add(row[col.idx].AsString().str());
+                        break;
+                    default: {
+                        errcode = TablesErrCodes::UnsupportedSkyDataType;
+                        errmsg.append("ERROR processSkyFb(): table=" +
+                                table_name + "; rid=" +
+                                std::to_string(rid) + " col.type=" +
+                                std::to_string(col.type) +
+                                " UnsupportedSkyDataType.");
+                    }
+                }
+            }
+        }
+    });
+    return errcode;
+}
+
 
 /*
  * Function: processSkyFb
@@ -38,11 +153,43 @@ int processSkyFb(
     const size_t datasz,
     std::string& errmsg,
     const std::vector<uint32_t>& row_nums)
+{
+    PredicateEngine engine(preds);
+    BuilderPool pool;
+    return processSkyFb(flatbldr, data_schema, query_schema, preds, engine,
+                        pool, dataptr, datasz, errmsg, row_nums);
+}
+
+/*
+ * Function: processSkyFb
+ * Description: Same as above, but with the preds already compiled by the
+ *              caller so that one engine can be reused across many blobs.
+ *              Agg preds keep accumulating across calls, the agg row of
+ *              the last call covers all of the blobs.
+ * @param[in] engine       : Compiled form of preds
+ * @param[in] pool         : Builders reused for each row's flexbuf
+ * @param[in] max_rows     : Stop once this many rows are encoded, 0 for all
+ *
+ * Return Value: error code
+ */
+int processSkyFb(
+    flatbuffers::FlatBufferBuilder& flatbldr,
+    schema_vec& data_schema,
+    schema_vec& query_schema,
+    predicate_vec& preds,
+    PredicateEngine& engine,
+    BuilderPool& pool,
+    const char* dataptr,
+    const size_t datasz,
+    std::string& errmsg,
+    const std::vector<uint32_t>& row_nums,
+    uint64_t max_rows)
 {
     int errcode = 0;
     delete_vector dead_rows;
     std::vector<flatbuffers::Offset<Tables::Record>> offs;
     sky_root root = getSkyRoot(dataptr, datasz, SFT_FLATBUF_FLEX_ROW);
+    engine.bindDicts(root.dicts);
 
     // identify the max col idx, to prevent flexbuf vector oob error
     int col_idx_max = -1;
@@ -51,7 +198,10 @@ int processSkyFb(
             col_idx_max = it->idx;
     }
 
-    bool project_all = std::equal(data_schema.begin(), data_schema.end(),
+    // when all cols are projected in order, each passing row is copied into
+    // the result as is, instead of decoding and re-encoding its flexbuf.
+    bool project_all = (data_schema.size() == query_schema.size()) and
+                       std::equal(data_schema.begin(), data_schema.end(),
                                   query_schema.begin(), compareColInfo);
 
     // build the flexbuf with computed aggregates, aggs are computed for
@@ -69,148 +219,125 @@ int processSkyFb(
         nrows = row_nums.size();
     }
 
+    // rows are processed in batches, the preds are evaluated over the whole
+    // batch by the engine's typed kernels which produce a selection bitmap
+    // of the passing rows, then only the selected rows are encoded below.
     // 1. check the preds for passing
     // 2a. accumulate agg preds (return flexbuf built after all rows) or
     // 2b. build the return flatbuf inline below from each row's projection
-    for (uint32_t i = 0; i < nrows; i++) {
-
-        // process row i or the specified row number
-        uint32_t rnum = 0;
-        if (process_all_rows) rnum = i;
-        else rnum = row_nums[i];
-        if (rnum > root.nrows) {
-            errmsg += "ERROR: rnum(" + std::to_string(rnum) +
-                      ") > root.nrows(" + to_string(root.nrows) + ")";
-            return RowIndexOOB;
-        }
+    row_offs root_rows = static_cast<row_offs>(root.data_vec);
+    std::vector<const Tables::Record*> batch_recs;
+    std::vector<flexbuffers::Vector> batch_rows;
+    std::vector<int64_t> batch_rids;
+    std::vector<uint32_t> batch_sel;
+    batch_recs.reserve(PRED_BATCH_ROWS);
+    batch_rows.reserve(PRED_BATCH_ROWS);
+    batch_rids.reserve(PRED_BATCH_ROWS);
+    batch_sel.reserve(PRED_BATCH_ROWS);
+    SelectionBitmap sel;
+
+    // with a row limit, rows are no longer scanned once it is reached
+    bool limited = encode_rows and max_rows > 0;
+
+    for (uint32_t bstart = 0; bstart < nrows && !errcode;
+         bstart += PRED_BATCH_ROWS) {
+
+        if (limited and offs.size() >= max_rows)
+            break;
+
+        uint32_t bsize = std::min(PRED_BATCH_ROWS, nrows - bstart);
+        batch_recs.clear();
+        batch_rows.clear();
+        batch_rids.clear();
+        batch_sel.clear();
+        sel.reset(bsize, true);
+
+        for (uint32_t j = 0; j < bsize; j++) {
+
+            // process row i or the specified row number
+            uint32_t i = bstart + j;
+            uint32_t rnum = 0;
+            if (process_all_rows) rnum = i;
+            else rnum = row_nums[i];
+            if (rnum >= root.nrows) {
+                errmsg += "ERROR: rnum(" + std::to_string(rnum) +
+                          ") >= root.nrows(" + to_string(root.nrows) + ")";
+                return RowIndexOOB;
+            }
 
-         // skip dead rows.
-        if (root.delete_vec[rnum] == 1) continue;
+            const Tables::Record* r = root_rows->Get(rnum);
+            batch_recs.push_back(r);
+            batch_rows.push_back(r->data_flexbuffer_root().AsVector());
+            batch_rids.push_back(r->RID());
 
-        // get a skyhook record struct
-        sky_rec rec = getSkyRec(static_cast<row_offs>(root.data_vec)->Get(rnum));
-
-        // apply predicates to this record
-        if (!preds.empty()) {
-            bool pass = applyPredicates(preds, rec);
-            if (!pass) continue;  // skip non matching rows.
+            // skip dead rows.
+            if (root.delete_vec[rnum] == 1) sel.clear(j);
         }
 
-        // note: agg preds are accumlated in the predicate itself during
-        // applyPredicates above, then later added to result fb outside
-        // of this loop (i.e., they are not encoded into the result fb yet)
-        // thus we can skip the below encoding of rows into the result fb
-        // and just continue accumulating agg preds in this processing loop.
+        // apply predicates to this batch of records
+        if (engine.hasFilters())
+            engine.evalFlexRows(batch_rows, batch_rids, sel);
+
+        // note: agg preds are accumlated in the predicate itself here,
+        // then later added to result fb outside of this loop (i.e., they
+        // are not encoded into the result fb yet) thus we can skip the
+        // below encoding of rows into the result fb and just continue
+        // accumulating agg preds in this processing loop.
+        if (engine.hasAggs())
+            engine.updateAggsFlexRows(batch_rows, batch_rids, sel);
         if (!encode_rows) continue;
 
-        if (project_all) {
-            // TODO:  just pass through row table offset to new data_vec
-            // (which is also type offs), do not rebuild row table and flexbuf
-        }
-
-        // build the return projection for this row.
-        auto row = rec.data.AsVector();
-        flexbuffers::Builder *flexbldr = new flexbuffers::Builder();
-        flatbuffers::Offset<flatbuffers::Vector<unsigned char>> datavec;
+        sel.toRowNums(batch_sel);
+        for (auto its = batch_sel.begin(); its != batch_sel.end(); ++its) {
 
-        flexbldr->Vector([&]() {
-
-            // iter over the query schema, locating it within the data schema
-            for (auto it=query_schema.begin();
-                      it!=query_schema.end() && !errcode; ++it) {
-                col_info col = *it;
-                if (col.idx < AGG_COL_LAST or col.idx > col_idx_max) {
-                    errcode = TablesErrCodes::RequestedColIndexOOB;
-                    errmsg.append("ERROR processSkyFb(): table=" +
-                            root.table_name + "; rid=" +
-                            std::to_string(rec.RID) + " col.idx=" +
-                            std::to_string(col.idx) + " OOB.");
-
-                } else {
-
-                    switch(col.type) {  // encode data val into flexbuf
+            if (limited and offs.size() >= max_rows)
+                break;
 
-                        case SDT_INT8:
-                            flexbldr->Add(row[col.idx].AsInt8());
-                            break;
-                        case SDT_INT16:
-                            flexbldr->Add(row[col.idx].AsInt16());
-                            break;
-                        case SDT_INT32:
-                            flexbldr->Add(row[col.idx].AsInt32());
-                            break;
-                        case SDT_INT64:
-                            flexbldr->Add(row[col.idx].AsInt64());
-                            break;
-                        case SDT_UINT8:
-                            flexbldr->Add(row[col.idx].AsUInt8());
-                            break;
-                        case SDT_UINT16:
-                            flexbldr->Add(row[col.idx].AsUInt16());
-                            break;
-                        case SDT_UINT32:
-                            flexbldr->Add(row[col.idx].AsUInt32());
-                            break;
-                        case SDT_UINT64:
-                            flexbldr->Add(row[col.idx].AsUInt64());
-                            break;
-                        case SDT_CHAR:
-                            flexbldr->Add(row[col.idx].AsInt8());
-                            break;
-                        case SDT_UCHAR:
-                            flexbldr->Add(row[col.idx].AsUInt8());
-                            break;
-                        case SDT_BOOL:
-                            flexbldr->Add(row[col.idx].AsBool());
-                            break;
-                        case SDT_FLOAT:
-                            flexbldr->Add(row[col.idx].AsFloat());
-                            break;
-                        case SDT_DOUBLE:
-                            flexbldr->Add(row[col.idx].AsDouble());
-                            break;
-                        case SDT_DATE:
-                            flexbldr->Add(row[col.idx].AsString().str());
-                            break;
-                        case SDT_STRING:
-                            flexbldr->Add(row[col.idx].AsString().str());
-                            break;
-                        default: {
-                            errcode = TablesErrCodes::UnsupportedSkyDataType;
-                            errmsg.append("ERROR processSkyFb(): table=" +
-                                    root.table_name + "; rid=" +
-                                    std::to_string(rec.RID) + " col.type=" +
-                                    std::to_string(col.type) +
-                                    " UnsupportedSkyDataType.");
-                        }
-                    }
-                }
+            const Tables::Record* recptr = batch_recs[*its];
+            const flexbuffers::Vector& row = batch_rows[*its];
+            const int64_t rid = batch_rids[*its];
+
+            if (project_all) {
+                // pass through the row's flexbuf and nullbits as raw bytes
+                auto row_data = flatbldr.CreateVector(recptr->data()->Data(),
+                                                      recptr->data()->size());
+                auto nullbits = flatbldr.CreateVector(recptr->nullbits()->data(),
+                                                      recptr->nullbits()->size());
+                offs.push_back(Tables::CreateRecord(flatbldr, rid, nullbits,
+                                                    row_data));
+                dead_rows.push_back(0);
+                continue;
             }
-        });
 
-        // finalize the row's projected data within our flexbuf
-        flexbldr->Finish();
+            // build the return projection for this row.
+            errcode = projectFlexRow(pool.flexBuilder(), row, query_schema,
+                                     col_idx_max, root.dicts, true,
+                                     root.table_name, rid, errmsg);
 
-        // build the return ROW flatbuf that contains the flexbuf data
-        auto row_data = flatbldr.CreateVector(flexbldr->GetBuffer());
-        delete flexbldr;
+            // finalize the row's projected data within our flexbuf and
+            // build the return ROW flatbuf that contains the flexbuf data
+            auto row_data = pool.finishFlex(flatbldr);
 
-        // TODO: update nullbits
-        auto nullbits = flatbldr.CreateVector(rec.nullbits);
-        flatbuffers::Offset<Tables::Record> row_off = \
-                Tables::CreateRecord(flatbldr, rec.RID, nullbits, row_data);
+            // TODO: update nullbits
+            auto nullbits = flatbldr.CreateVector(recptr->nullbits()->data(),
+                                                recptr->nullbits()->size());
+            flatbuffers::Offset<Tables::Record> row_off = \
+                    Tables::CreateRecord(flatbldr, rid, nullbits, row_data);
 
-        // Continue building the ROOT flatbuf's dead vector and rowOffsets vec
-        dead_rows.push_back(0);
-        offs.push_back(row_off);
+            // Continue building the ROOT flatbuf's dead vector and rowOffsets vec
+            dead_rows.push_back(0);
+            offs.push_back(row_off);
+        }
     }
 
     // here we build the return flatbuf result with agg values that were
-    // accumulated above in applyPredicates (agg predicates do not return
-    // true false but update their internal values each time processed
+    // accumulated above by the predicate engine (agg predicates do not return
+    // true false but update their internal values each time processed.
+    // the values are not reset, so successive calls with the same preds
+    // return running aggs over all blobs processed so far.
     if (encode_aggs) { //  encode accumulated agg pred val into return flexbuf
         PredicateBase* pb;
-        flexbuffers::Builder *flexbldr = new flexbuffers::Builder();
+        flexbuffers::Builder *flexbldr = &pool.flexBuilder();
         flexbldr->Vector([&]() {
             for (auto itp = preds.begin(); itp != preds.end(); ++itp) {
 
@@ -223,7 +350,6 @@ int processSkyFb(
                                 dynamic_cast<TypedPredicate<int64_t>*>(pb);
                         int64_t agg_val = p->Val();
                         flexbldr->Add(agg_val);
-                        p->updateAgg(0);  // reset accumulated add val
                         break;
                     }
                     case SDT_UINT32: {
@@ -231,7 +357,6 @@ int processSkyFb(
                                 dynamic_cast<TypedPredicate<uint32_t>*>(pb);
                         uint32_t agg_val = p->Val();
                         flexbldr->Add(agg_val);
-                        p->updateAgg(0);  // reset accumulated add val
                         break;
                     }
                     case SDT_UINT64: {
@@ -239,7 +364,6 @@ int processSkyFb(
                                 dynamic_cast<TypedPredicate<uint64_t>*>(pb);
                         uint64_t agg_val = p->Val();
                         flexbldr->Add(agg_val);
-                        p->updateAgg(0);  // reset accumulated add val
                         break;
                     }
                     case SDT_FLOAT: {
@@ -247,7 +371,6 @@ int processSkyFb(
                                 dynamic_cast<TypedPredicate<float>*>(pb);
                         float agg_val = p->Val();
                         flexbldr->Add(agg_val);
-                        p->updateAgg(0);  // reset accumulated add val
                         break;
                     }
                     case SDT_DOUBLE: {
@@ -255,19 +378,15 @@ int processSkyFb(
                                 dynamic_cast<TypedPredicate<double>*>(pb);
                         double agg_val = p->Val();
                         flexbldr->Add(agg_val);
-                        p->updateAgg(0);  // reset accumulated add val
                         break;
                     }
                     default:  assert(UnsupportedAggDataType==0);
                 }
             }
         });
-        // finalize the row's projected data within our flexbuf
-        flexbldr->Finish();
-
+        // finalize the row's projected data within our flexbuf and
         // build the return ROW flatbuf that contains the flexbuf data
-        auto row_data = flatbldr.CreateVector(flexbldr->GetBuffer());
-        delete flexbldr;
+        auto row_data = pool.finishFlex(flatbldr);
 
         // assume no nullbits in the agg results. ?
         nullbits_vector nb(2,0);
@@ -293,6 +412,23 @@ int processSkyFb(
     auto delete_v = flatbldr.CreateVector(dead_rows);
     auto rows_v = flatbldr.CreateVector(offs);
 
+    // projected cols stay dictionary encoded, so the dictionaries of the
+    // encoded cols are sent along with the rows, at their result position.
+    // passed through rows keep their data col positions.
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>>> dicts_v = 0;
+    if (encode_rows and !offs.empty() and !root.dicts.empty()) {
+        std::vector<int> dict_pos;
+        if (project_all) {
+            for (int j = 0; j <= col_idx_max; j++)
+                dict_pos.push_back(j);
+        }
+        else {
+            for (auto it = query_schema.begin(); it != query_schema.end(); ++it)
+                dict_pos.push_back(it->idx);
+        }
+        dicts_v = copyDicts(flatbldr, root.dicts, dict_pos);
+    }
+
     auto table = CreateTable(
         flatbldr,
         root.data_format_type,
@@ -304,7 +440,8 @@ int processSkyFb(
         table_name,
         delete_v,
         rows_v,
-        offs.size());
+        offs.size(),
+        dicts_v);
 
     // NOTE: the fb may be incomplete/empty, but must finish() else internal
     // fb lib assert finished() fails, hence we must always return a valid fb
@@ -315,6 +452,119 @@ int processSkyFb(
 }
 
 
+/*
+ * Function: selectArrowRows
+ * Description: Select the live rows of the input arrow table that pass the
+ *              filter preds, evaluated by the engine in batches.
+ * @param[in] input_table  : Input single chunk arrow table, i.e., one batch
+ * @param[in] num_cols     : Number of data cols in the input table
+ * @param[in] nrows        : Number of rows in the input table
+ * @param[in] engine       : Compiled preds for the query
+ * @param[in] row_nums     : Specified rows to be processed, or all if empty
+ * @param[out] result_rows : Selected row numbers, in input order
+ * @param[out] errmsg      : Error message
+ * @param[in] max_rows     : Stop once this many rows are selected, 0 for all
+ *
+ * Return Value: error code
+ */
+static int selectArrowRows(
+        std::shared_ptr<arrow::Table>& input_table,
+        int num_cols,
+        uint32_t nrows,
+        PredicateEngine& engine,
+        const std::vector<uint32_t>& row_nums,
+        std::vector<uint32_t>& result_rows,
+        std::string& errmsg,
+        uint64_t max_rows=0)
+{
+    auto delvec_chunk = input_table->column(ARROW_DELVEC_INDEX(num_cols))->chunk(0);
+    auto delvec = std::static_pointer_cast<arrow::BooleanArray>(delvec_chunk);
+
+    bool process_all_rows = row_nums.empty();
+    uint32_t ncand = process_all_rows ? nrows : row_nums.size();
+    SelectionBitmap sel;
+    result_rows.clear();
+    result_rows.reserve(ncand);
+
+    for (uint32_t bstart = 0; bstart < ncand; bstart += PRED_BATCH_ROWS) {
+        if (max_rows > 0 and result_rows.size() >= max_rows)
+            break;
+        uint32_t bsize = std::min(PRED_BATCH_ROWS, ncand - bstart);
+        const uint32_t* rnums = process_all_rows ? NULL : &row_nums[bstart];
+        sel.reset(bsize, true);
+
+        // skip dead rows.
+        for (uint32_t j = 0; j < bsize; j++) {
+            uint32_t rnum = process_all_rows ? bstart + j : rnums[j];
+            if (rnum >= nrows) {
+                errmsg += "ERROR: rnum(" + std::to_string(rnum) +
+                          ") >= nrows(" + std::to_string(nrows) + ")";
+                return RowIndexOOB;
+            }
+            if (delvec->Value(rnum)) sel.clear(j);
+        }
+
+        if (engine.hasFilters())
+            engine.evalArrowRows(input_table, num_cols, bstart, rnums, bsize, sel);
+
+        for (uint32_t j = 0; j < bsize; j++) {
+            if (max_rows > 0 and result_rows.size() >= max_rows)
+                break;
+            if (sel.test(j))
+                result_rows.push_back(process_all_rows ? bstart + j : rnums[j]);
+        }
+    }
+    return 0;
+}
+
+
+/*
+ * Function: sliceArrowCols
+ * Description: When the selected rows form one contiguous range, e.g., when no
+ *              rows were filtered out or deleted, the output cols are built as
+ *              zero-copy slices of the input cols instead of row by row.
+ *              Note the slices reference the input data, so the output table
+ *              must not outlive the input dataptr.
+ * @param[in] input_table  : Input single chunk arrow table, i.e., one batch
+ * @param[in] query_schema : Schema of an query
+ * @param[in] col_idx_max  : Max valid col idx of the input table
+ * @param[in] result_rows  : Selected row numbers
+ * @param[out] array_list  : Output cols, set only if sliced
+ *
+ * Return Value: true if the output cols were sliced
+ */
+static bool sliceArrowCols(
+        std::shared_ptr<arrow::Table>& input_table,
+        schema_vec& query_schema,
+        int col_idx_max,
+        const std::vector<uint32_t>& result_rows,
+        std::vector<std::shared_ptr<arrow::Array>>& array_list)
+{
+    for (uint32_t i = 1; i < result_rows.size(); i++) {
+        if (result_rows[i] != result_rows[0] + i)
+            return false;
+    }
+
+    // let the row by row path report any invalid cols
+    for (auto it = query_schema.begin(); it != query_schema.end(); ++it) {
+        if (it->idx < 0 or it->idx > col_idx_max)
+            return false;
+    }
+
+    // when every row is selected the input cols are passed thru as is
+    int64_t start = result_rows.empty() ? 0 : result_rows[0];
+    int64_t len = result_rows.size();
+    for (auto it = query_schema.begin(); it != query_schema.end(); ++it) {
+        auto col_chunk = input_table->column(it->idx)->chunk(0);
+        if (start == 0 and len == col_chunk->length())
+            array_list.push_back(col_chunk);
+        else
+            array_list.push_back(col_chunk->Slice(start, len));
+    }
+    return true;
+}
+
+
 /*
  * Function: processArrowCol
  * Description: Process the input arrow table columnwise for the corresponding
@@ -339,32 +589,56 @@ int processArrowCol(
         const size_t datasz,
         std::string& errmsg,
         const std::vector<uint32_t>& row_nums)
+{
+    PredicateEngine engine(preds);
+    return processArrowCol(table, tbl_schema, query_schema, preds, engine,
+                           dataptr, datasz, errmsg, row_nums);
+}
+
+/*
+ * Function: processArrowCol
+ * Description: Same as above, but with the preds already compiled by the
+ *              caller so that one engine can be reused across many blobs.
+ * @param[in] engine       : Compiled form of preds
+ * @param[in] max_rows     : Stop once this many rows are selected, 0 for all
+ *
+ * Return Value: error code
+ */
+int processArrowCol(
+        std::shared_ptr<arrow::Table>* table,
+        schema_vec& tbl_schema,
+        schema_vec& query_schema,
+        predicate_vec& preds,
+        PredicateEngine& engine,
+        const char* dataptr,
+        const size_t datasz,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums,
+        uint64_t max_rows)
 {
    int errcode = 0;
-    int processed_rows = 0;
+    uint64_t processed_rows = 0;
     int num_cols = std::distance(tbl_schema.begin(), tbl_schema.end());
-    auto pool = arrow::default_memory_pool();
-    std::vector<arrow::ArrayBuilder *> builder_list;
-    std::vector<std::shared_ptr<arrow::Array>> array_list;
     std::vector<std::shared_ptr<arrow::Field>> output_tbl_fields_vec;
     std::shared_ptr<arrow::Buffer> buffer =                             \
         arrow::MutableBuffer::Wrap(reinterpret_cast<uint8_t*>(const_cast<char*>(dataptr)), datasz);
     std::shared_ptr<arrow::Table> input_table, temp_table;
     std::vector<uint32_t> result_rows;
+    std::vector<uint32_t> batch_rows;
+    std::vector<arrow_batch> batches;
 
     // Get input table from dataptr
     extract_arrow_from_buffer(&input_table, buffer);
 
     auto schema = input_table->schema();
     auto metadata = schema->metadata();
-    uint32_t nrows = atoi(metadata->value(METADATA_NUM_ROWS).c_str());
-
-    // TODO: should we verify these are the same as nrows
-    // int64_t nrows_from_api = input_table->num_rows();
 
-    // Get number of rows to be processed
-    if (!row_nums.empty()) {
-        result_rows = row_nums;
+    // The input table is processed one record batch at a time, and each batch
+    // with selected rows adds one chunk to each output col.
+    errcode = arrow_table_batches(input_table, batches);
+    if (errcode) {
+        errmsg.append("ERROR processArrowCol(): reading record batches");
+        return errcode;
     }
 
     // identify the max col idx, to prevent flexbuf vector oob error
@@ -374,296 +648,187 @@ int processArrowCol(
             col_idx_max = it->idx;
     }
 
-    // Apply predicates to all the columns and get the rows which
-    // satifies the condition
-    if (!preds.empty()) {
-        // Iterate through each column in print the data inside it
-        for (auto it = tbl_schema.begin(); it != tbl_schema.end(); ++it) {
-            col_info col = *it;
-
-            applyPredicatesArrowCol(preds,
-                                    input_table->column(col.idx)->chunk(0),
-                                    col.idx,
-                                    result_rows);
-        }
-        nrows = result_rows.size();
-    }
-
-    // At this point we have rows which satisfied the required predicates.
-    // Now create the output arrow table from input table.
-
     // Iterate through query schema vector to get the details of columns i.e name and type.
-    // Also, get the builder arrays required for each data type
     for (auto it = query_schema.begin(); it != query_schema.end() && !errcode; ++it) {
         col_info col = *it;
 
-        // Create the array builders for respective datatypes. Use these array
-        // builders to store data to array vectors. These array vectors holds the
-        // actual column values. Also, add the details of column (Name and Datatype)
+        // Add the details of column (Name and Datatype), the col values are
+        // sliced or taken from the input cols below.
         switch(col.type) {
 
             case SDT_BOOL: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::BooleanBuilder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::boolean()));
                 break;
             }
             case SDT_INT8: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::Int8Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::int8()));
                 break;
             }
             case SDT_INT16: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::Int16Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::int16()));
                 break;
             }
             case SDT_INT32: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::Int32Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::int32()));
                 break;
             }
             case SDT_INT64: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::Int64Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::int64()));
                 break;
             }
             case SDT_UINT8: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::UInt8Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::uint8()));
                 break;
             }
             case SDT_UINT16: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::UInt16Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::uint16()));
                 break;
             }
             case SDT_UINT32: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::UInt32Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::uint32()));
                 break;
             }
             case SDT_UINT64: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::UInt64Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::uint64()));
                 break;
             }
             case SDT_FLOAT: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::FloatBuilder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::float32()));
                 break;
             }
             case SDT_DOUBLE: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::DoubleBuilder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::float64()));
                 break;
             }
             case SDT_CHAR: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::Int8Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::int8()));
                 break;
             }
             case SDT_UCHAR: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::UInt8Builder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::uint8()));
                 break;
             }
             case SDT_DATE:
             case SDT_STRING: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::StringBuilder(pool));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::utf8()));
                 break;
             }
             case SDT_JAGGEDARRAY_BOOL: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::ListBuilder(pool,std::make_shared<arrow::BooleanBuilder>(pool)));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::list(arrow::boolean())));
                 break;
             }
             case SDT_JAGGEDARRAY_INT32: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::ListBuilder(pool,std::make_shared<arrow::Int32Builder>(pool)));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::list(arrow::int32())));
                 break;
             }
              case SDT_JAGGEDARRAY_UINT32: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::ListBuilder(pool,std::make_shared<arrow::UInt32Builder>(pool)));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::list(arrow::uint32())));
                 break;
             }
             case SDT_JAGGEDARRAY_INT64: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::ListBuilder(pool,std::make_shared<arrow::Int64Builder>(pool)));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::list(arrow::int64())));
                 break;
             }
             case SDT_JAGGEDARRAY_UINT64: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::ListBuilder(pool,std::make_shared<arrow::UInt64Builder>(pool)));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::list(arrow::uint64())));
                 break;
             }
             case SDT_JAGGEDARRAY_FLOAT: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::ListBuilder(pool,std::make_shared<arrow::FloatBuilder>(pool)));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::list(arrow::float32())));
                 break;
             }
             case SDT_JAGGEDARRAY_DOUBLE: {
-                auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::ListBuilder(pool,std::make_shared<arrow::DoubleBuilder>(pool)));
-                builder_list.emplace_back(ptr.get());
-                ptr.release();
                 output_tbl_fields_vec.push_back(arrow::field(col.name, arrow::list(arrow::float64())));
                 break;
             }
             default: {
-                errcode = TablesErrCodes::UnsupportedSkyDataType;
-                errmsg.append("ERROR processArrow()");
-                return errcode;
-            }
-        }
-    }
-
-    // Copy values from input table rows to the output table rows
-    for (uint32_t i = 0; i < nrows; i++) {
-
-        uint32_t rnum = i;
-        if (!preds.empty())
-            rnum = result_rows[i];
-
-        // skip dead rows.
-        auto delvec_chunk = input_table->column(ARROW_DELVEC_INDEX(num_cols))->chunk(0);
-        if (std::static_pointer_cast<arrow::BooleanArray>(delvec_chunk)->Value(rnum) == true) continue;
-
-        processed_rows++;
-
-        // iter over the query schema and add the values from input table
-        // to output table
-        for (auto it = query_schema.begin(); it != query_schema.end() && !errcode; ++it) {
-            col_info col = *it;
-            auto builder = builder_list[std::distance(query_schema.begin(), it)];
-
-            auto processing_chunk = input_table->column(col.idx)->chunk(0);
-
-            if (col.idx < AGG_COL_LAST or col.idx > col_idx_max) {
-                errcode = TablesErrCodes::RequestedColIndexOOB;
-                errmsg.append("ERROR processArrowCol()");
-                return errcode;
-            } else {
-                if (col.nullable) {  // check nullbit
-                    if (processing_chunk->IsNull(rnum)) {
-                        builder->AppendNull();
-                        continue;
-                    }
-                }
-
-                // Append data from input tbale to the respective data type builders
-                switch(col.type) {
+                errcode = TablesErrCodes::UnsupportedSkyDataType;
+                errmsg.append("ERROR processArrow()");
+                return errcode;
+            }
+        }
+    }
 
-                    case SDT_BOOL:
-                        static_cast<arrow::BooleanBuilder *>(builder)->Append(std::static_pointer_cast<arrow::BooleanArray>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_INT8:
-                        static_cast<arrow::Int8Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int8Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_INT16:
-                        static_cast<arrow::Int16Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int16Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_INT32:
-                        static_cast<arrow::Int32Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int32Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_INT64:
-                        static_cast<arrow::Int64Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int64Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_UINT8:
-                        static_cast<arrow::UInt8Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt8Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_UINT16:
-                        static_cast<arrow::UInt16Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt16Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_UINT32:
-                        static_cast<arrow::UInt32Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt32Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_UINT64:
-                        static_cast<arrow::UInt64Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt64Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_FLOAT:
-                        static_cast<arrow::FloatBuilder *>(builder)->Append(std::static_pointer_cast<arrow::FloatArray>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_DOUBLE:
-                        static_cast<arrow::DoubleBuilder *>(builder)->Append(std::static_pointer_cast<arrow::DoubleArray>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_CHAR:
-                        static_cast<arrow::Int8Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int8Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_UCHAR:
-                        static_cast<arrow::UInt8Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt8Array>(processing_chunk)->Value(rnum));
-                        break;
-                    case SDT_DATE:
-                    case SDT_STRING:
-                        static_cast<arrow::StringBuilder *>(builder)->Append(std::static_pointer_cast<arrow::StringArray>(processing_chunk)->GetString(rnum));
-                        break;
-                    case SDT_JAGGEDARRAY_FLOAT: {
-                        // advance to the start of a new list row
-                        static_cast<arrow::ListBuilder *>(builder)->Append();
+    // all specified rows must be in the table, the row nums are sorted
+    if (!row_nums.empty() and row_nums.back() >= input_table->num_rows()) {
+        errmsg += "ERROR: rnum(" + std::to_string(row_nums.back()) +
+                  ") >= nrows(" + std::to_string(input_table->num_rows()) + ")";
+        return RowIndexOOB;
+    }
 
-                        // extract list builder as int32 builder
+    // Select the rows of each batch, then add them to the output cols
+    std::vector<arrow::ArrayVector> chunk_list(query_schema.size());
+    uint32_t next_row = 0;
+    for (auto b = batches.begin(); b != batches.end() && !errcode; ++b) {
+        if (max_rows > 0 and processed_rows >= max_rows)
+            break;
+        std::shared_ptr<arrow::Table>& batch_table = b->table;
+        uint32_t nrows = batch_table->num_rows();
+
+        // the specified rows, as batch row nums
+        if (!row_nums.empty()) {
+            next_row = arrow_batch_rows(*b, row_nums, next_row, batch_rows);
+            if (batch_rows.empty())
+                continue;
+        }
 
-                        // TODO: extract prev values and append to ib
-                        // ib->AppendValues(vector.data(), vector.size());
-                        break;
-                    }
-                    default: {
-                        errcode = TablesErrCodes::UnsupportedSkyDataType;
-                        errmsg.append("ERROR processArrow()");
-                        return errcode;
-                    }
+        // Apply predicates to the specified (or all) live rows and get the
+        // rows which satisfy the condition
+        errcode = selectArrowRows(batch_table, num_cols, nrows, engine,
+                                  batch_rows, result_rows, errmsg,
+                                  max_rows > 0 ? max_rows - processed_rows : 0);
+        if (errcode)
+            return errcode;
+        nrows = result_rows.size();
+        if (nrows == 0)
+            continue;
+        processed_rows += nrows;
+
+        // zero-copy output cols if possible, else gather each projected
+        // col once, the selected rows are taken from the col by the take
+        // kernel given the row nums as its indices.
+        std::vector<std::shared_ptr<arrow::Array>> array_list;
+        bool sliced = sliceArrowCols(batch_table, query_schema, col_idx_max,
+                                     result_rows, array_list);
+
+        if (!sliced) {
+            arrow::UInt32Array indices(nrows, arrow::Buffer::Wrap(result_rows));
+            for (auto it = query_schema.begin(); it != query_schema.end(); ++it) {
+                if (it->idx < 0 or it->idx > col_idx_max) {
+                    errmsg.append("ERROR processArrowCol()");
+                    return TablesErrCodes::RequestedColIndexOOB;
+                }
+                auto col_chunk = batch_table->column(it->idx)->chunk(0);
+                arrow::Result<std::shared_ptr<arrow::Array>> result = \
+                    arrow::compute::Take(*col_chunk, indices);
+                if (!result.ok()) {
+                    errmsg.append("ERROR processArrowCol(): take " +
+                                  result.status().ToString());
+                    return TablesErrCodes::ArrowStatusErr;
                 }
+                array_list.push_back(std::move(result).ValueOrDie());
             }
         }
+        for (unsigned i = 0; i < array_list.size(); i++)
+            chunk_list[i].push_back(array_list[i]);
     }
 
-    // Finalize the chunks holding the data
-    for (auto it = builder_list.begin(); it != builder_list.end(); ++it) {
-        auto builder = *it;
-        std::shared_ptr<arrow::Array> chunk;
-        builder->Finish(&chunk);
-        array_list.push_back(chunk);
-        delete builder;
+    // Finalize the cols holding the data, a col without any selected rows
+    // holds one empty chunk.
+    std::vector<std::shared_ptr<arrow::ChunkedArray>> column_list;
+    for (unsigned i = 0; i < output_tbl_fields_vec.size(); i++) {
+        auto type = output_tbl_fields_vec[i]->type();
+        if (chunk_list[i].empty()) {
+            arrow::Result<std::shared_ptr<arrow::Array>> result = \
+                arrow::MakeArrayOfNull(type, 0);
+            if (!result.ok()) {
+                errmsg.append("ERROR processArrowCol(): empty col");
+                return TablesErrCodes::ArrowStatusErr;
+            }
+            chunk_list[i].push_back(std::move(result).ValueOrDie());
+        }
+        column_list.push_back(std::make_shared<arrow::ChunkedArray>(
+                chunk_list[i], type));
     }
 
     // Add skyhook metadata to arrow metadata.
@@ -689,7 +854,7 @@ int processArrowCol(
     schema = std::make_shared<arrow::Schema>(output_tbl_fields_vec, output_tbl_metadata);
 
     // Finally, create a arrow table from schema and array vector
-    *table = arrow::Table::Make(schema, array_list);
+    *table = arrow::Table::Make(schema, column_list);
 
     return errcode;
 
@@ -720,13 +885,36 @@ int processArrow(
     const size_t datasz,
     std::string& errmsg,
     const std::vector<uint32_t>& row_nums)
+{
+    PredicateEngine engine(preds);
+    return processArrow(table, tbl_schema, query_schema, preds, engine,
+                        dataptr, datasz, errmsg, row_nums);
+}
+
+/*
+ * Function: processArrow
+ * Description: Same as above, but with the preds already compiled by the
+ *              caller so that one engine can be reused across many blobs.
+ * @param[in] engine       : Compiled form of preds
+ *
+ * Return Value: error code
+ */
+int processArrow(
+    std::shared_ptr<arrow::Table>* table,
+    schema_vec& tbl_schema,
+    schema_vec& query_schema,
+    predicate_vec& preds,
+    PredicateEngine& engine,
+    const char* dataptr,
+    const size_t datasz,
+    std::string& errmsg,
+    const std::vector<uint32_t>& row_nums)
 {
     int errcode = 0;
     int processed_rows = 0;
     int num_cols = std::distance(tbl_schema.begin(), tbl_schema.end());
     auto pool = arrow::default_memory_pool();
     std::vector<arrow::ArrayBuilder *> builder_list;
-    std::vector<std::shared_ptr<arrow::Array>> array_list;
     std::vector<std::shared_ptr<arrow::Field>> output_tbl_fields_vec;
     std::shared_ptr<arrow::Buffer> buffer = arrow::MutableBuffer::Wrap(reinterpret_cast<uint8_t*>(const_cast<char*>(dataptr)), datasz);
     std::shared_ptr<arrow::Table> input_table, temp_table;
@@ -737,12 +925,15 @@ int processArrow(
     auto schema = input_table->schema();
     auto metadata = schema->metadata();
 
-    // Get number of rows to be processed
-    bool process_all_rows = true;
-    uint32_t nrows = atoi(metadata->value(METADATA_NUM_ROWS).c_str());
-    if (!row_nums.empty()) {
-        process_all_rows = false;  // process specified row numbers only
-        nrows = row_nums.size();
+    std::vector<uint32_t> result_rows;
+    std::vector<uint32_t> batch_rows;
+    std::vector<arrow_batch> batches;
+
+    // The input table is processed one record batch at a time
+    errcode = arrow_table_batches(input_table, batches);
+    if (errcode) {
+        errmsg.append("ERROR processArrow(): reading record batches");
+        return errcode;
     }
 
     // identify the max col idx, to prevent flexbuf vector oob error
@@ -918,111 +1109,148 @@ int processArrow(
         }
     }
 
-    for (uint32_t i = 0; i < nrows; i++) {
+    // all specified rows must be in the table, the row nums are sorted
+    if (!row_nums.empty() and row_nums.back() >= input_table->num_rows()) {
+        errmsg += "ERROR: rnum(" + std::to_string(row_nums.back()) +
+                  ") >= nrows(" + std::to_string(input_table->num_rows()) + ")";
+        return RowIndexOOB;
+    }
 
-        // process row i or the specified row number
-        uint32_t rnum = 0;
-        if (process_all_rows) rnum = i;
-        else rnum = row_nums[i];
-        if (rnum > nrows) {
-            errmsg += "ERROR: rnum(" + std::to_string(rnum) +
-                      ") > nrows(" + to_string(nrows) + ")";
-            return RowIndexOOB;
+    // Select the rows of each batch, then add them to the output cols
+    std::vector<arrow::ArrayVector> chunk_list(query_schema.size());
+    uint32_t next_row = 0;
+    for (auto b = batches.begin(); b != batches.end() && !errcode; ++b) {
+        std::shared_ptr<arrow::Table>& batch_table = b->table;
+        uint32_t nrows = batch_table->num_rows();
+
+        // the specified rows, as batch row nums
+        if (!row_nums.empty()) {
+            next_row = arrow_batch_rows(*b, row_nums, next_row, batch_rows);
+            if (batch_rows.empty())
+                continue;
         }
 
-        // skip dead rows.
-        auto delvec_chunk = input_table->column(ARROW_DELVEC_INDEX(num_cols))->chunk(0);
-        if (std::static_pointer_cast<arrow::BooleanArray>(delvec_chunk)->Value(i) == true) continue;
+        // Apply predicates to the specified (or all) live rows and get the
+        // rows which satisfy the condition
+        errcode = selectArrowRows(batch_table, num_cols, nrows, engine,
+                                  batch_rows, result_rows, errmsg);
+        if (errcode)
+            return errcode;
+        nrows = result_rows.size();
+        if (nrows == 0)
+            continue;
+        processed_rows += nrows;
 
-        // Apply predicates
-        if (!preds.empty()) {
-            bool pass = applyPredicatesArrow(preds, input_table, i);
-            if (!pass) continue;  // skip non matching rows.
-        }
-        processed_rows++;
+        // zero-copy output cols if possible, else copy the rows below
+        std::vector<std::shared_ptr<arrow::Array>> array_list;
+        bool sliced = sliceArrowCols(batch_table, query_schema, col_idx_max,
+                                     result_rows, array_list);
 
-        // iter over the query schema and add the values from input table
-        // to output table
-        for (auto it = query_schema.begin(); it != query_schema.end() && !errcode; ++it) {
-            col_info col = *it;
-            auto builder = builder_list[std::distance(query_schema.begin(), it)];
+        if (!sliced) {
+            for (uint32_t i = 0; i < nrows; i++) {
 
-            auto processing_chunk = input_table->column(col.idx)->chunk(0);
+                uint32_t rnum = result_rows[i];
 
-            if (col.idx < AGG_COL_LAST or col.idx > col_idx_max) {
-                errcode = TablesErrCodes::RequestedColIndexOOB;
-                errmsg.append("ERROR processArrow()");
-                return errcode;
-            } else {
-                if (col.nullable) {  // check nullbit
-                    if (processing_chunk->IsNull(i)) {
-                        builder->AppendNull();
-                        continue;
+                // iter over the query schema and add the values from input table
+                // to output table
+                for (auto it = query_schema.begin(); it != query_schema.end() && !errcode; ++it) {
+                    col_info col = *it;
+                    auto builder = builder_list[std::distance(query_schema.begin(), it)];
+
+                    if (col.idx < AGG_COL_LAST or col.idx > col_idx_max) {
+                        errcode = TablesErrCodes::RequestedColIndexOOB;
+                        errmsg.append("ERROR processArrow()");
+                        return errcode;
+                    } else {
+                        auto processing_chunk = batch_table->column(col.idx)->chunk(0);
+
+                        if (col.nullable) {  // check nullbit
+                            if (processing_chunk->IsNull(rnum)) {
+                                builder->AppendNull();
+                                continue;
+                            }
+                        }
+
+                        // Append data from input tbale to the respective data type builders
+                        switch(col.type) {
+
+                        case SDT_BOOL:
+                            static_cast<arrow::BooleanBuilder *>(builder)->Append(std::static_pointer_cast<arrow::BooleanArray>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_INT8:
+                            static_cast<arrow::Int8Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int8Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_INT16:
+                            static_cast<arrow::Int16Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int16Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_INT32:
+                            static_cast<arrow::Int32Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int32Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_INT64:
+                            static_cast<arrow::Int64Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int64Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_UINT8:
+                            static_cast<arrow::UInt8Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt8Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_UINT16:
+                            static_cast<arrow::UInt16Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt16Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_UINT32:
+                            static_cast<arrow::UInt32Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt32Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_UINT64:
+                            static_cast<arrow::UInt64Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt64Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_FLOAT:
+                            static_cast<arrow::FloatBuilder *>(builder)->Append(std::static_pointer_cast<arrow::FloatArray>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_DOUBLE:
+                            static_cast<arrow::DoubleBuilder *>(builder)->Append(std::static_pointer_cast<arrow::DoubleArray>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_CHAR:
+                            static_cast<arrow::Int8Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int8Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_UCHAR:
+                            static_cast<arrow::UInt8Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt8Array>(processing_chunk)->Value(rnum));
+                            break;
+                        case SDT_DATE:
+                        case SDT_STRING:
+                            static_cast<arrow::StringBuilder *>(builder)->Append(std::static_pointer_cast<arrow::StringArray>(processing_chunk)->GetString(rnum));
+                            break;
+                        default: {
+                            errcode = TablesErrCodes::UnsupportedSkyDataType;
+                            errmsg.append("ERROR processArrow()");
+                            return errcode;
+                        }
+                        }
                     }
                 }
+            }
 
-                // Append data from input tbale to the respective data type builders
-                switch(col.type) {
-
-                case SDT_BOOL:
-                    static_cast<arrow::BooleanBuilder *>(builder)->Append(std::static_pointer_cast<arrow::BooleanArray>(processing_chunk)->Value(i));
-                    break;
-                case SDT_INT8:
-                    static_cast<arrow::Int8Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int8Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_INT16:
-                    static_cast<arrow::Int16Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int16Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_INT32:
-                    static_cast<arrow::Int32Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int32Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_INT64:
-                    static_cast<arrow::Int64Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int64Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_UINT8:
-                    static_cast<arrow::UInt8Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt8Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_UINT16:
-                    static_cast<arrow::UInt16Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt16Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_UINT32:
-                    static_cast<arrow::UInt32Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt32Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_UINT64:
-                    static_cast<arrow::UInt64Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt64Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_FLOAT:
-                    static_cast<arrow::FloatBuilder *>(builder)->Append(std::static_pointer_cast<arrow::FloatArray>(processing_chunk)->Value(i));
-                    break;
-                case SDT_DOUBLE:
-                    static_cast<arrow::DoubleBuilder *>(builder)->Append(std::static_pointer_cast<arrow::DoubleArray>(processing_chunk)->Value(i));
-                    break;
-                case SDT_CHAR:
-                    static_cast<arrow::Int8Builder *>(builder)->Append(std::static_pointer_cast<arrow::Int8Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_UCHAR:
-                    static_cast<arrow::UInt8Builder *>(builder)->Append(std::static_pointer_cast<arrow::UInt8Array>(processing_chunk)->Value(i));
-                    break;
-                case SDT_DATE:
-                case SDT_STRING:
-                    static_cast<arrow::StringBuilder *>(builder)->Append(std::static_pointer_cast<arrow::StringArray>(processing_chunk)->GetString(i));
-                    break;
-                default: {
-                    errcode = TablesErrCodes::UnsupportedSkyDataType;
-                    errmsg.append("ERROR processArrow()");
-                    return errcode;
-                }
-                }
+            // Finish this batch's chunk of each col, the builders are reused
+            for (auto it = builder_list.begin(); it != builder_list.end(); ++it) {
+                std::shared_ptr<arrow::Array> chunk;
+                (*it)->Finish(&chunk);
+                array_list.push_back(chunk);
             }
         }
+        for (unsigned i = 0; i < array_list.size(); i++)
+            chunk_list[i].push_back(array_list[i]);
     }
 
-    // Finalize the chunks holding the data
+    // Finalize the cols holding the data, a col without any selected rows
+    // holds one empty chunk.
+    std::vector<std::shared_ptr<arrow::ChunkedArray>> column_list;
     for (auto it = builder_list.begin(); it != builder_list.end(); ++it) {
         auto builder = *it;
-        std::shared_ptr<arrow::Array> chunk;
-        builder->Finish(&chunk);
-        array_list.push_back(chunk);
+        int i = std::distance(builder_list.begin(), it);
+        if (chunk_list[i].empty()) {
+            std::shared_ptr<arrow::Array> chunk;
+            builder->Finish(&chunk);
+            chunk_list[i].push_back(chunk);
+        }
+        column_list.push_back(std::make_shared<arrow::ChunkedArray>(
+                chunk_list[i], output_tbl_fields_vec[i]->type()));
         delete builder;
     }
 
@@ -1049,10 +1277,363 @@ int processArrow(
     schema = std::make_shared<arrow::Schema>(output_tbl_fields_vec, output_tbl_metadata);
 
     // Finally, create a arrow table from schema and array vector
-    *table = arrow::Table::Make(schema, array_list);
+    *table = arrow::Table::Make(schema, column_list);
+    return errcode;
+}
+
+
+/*
+ * Function: processSkyFbGroups
+ * Description: Accumulate the live rows of a flatbuffer that pass the filter
+ *              preds into their groups.  No result is built here, the caller
+ *              builds the group rows once all blobs are processed, or
+ *              earlier if the group table reaches its memory budget.
+ * @param[out] groups      : Group table the rows are accumulated into
+ * @param[in] engine       : Compiled preds for the query
+ * @param[in] dataptr      : Input table in the form of char array
+ * @param[in] datasz       : Size of char array
+ * @param[out] errmsg      : Error message
+ * @param[in] row_nums     : Specified rows to be processed, or all if empty
+ *
+ * Return Value: error code
+ */
+int processSkyFbGroups(
+    GroupTable& groups,
+    PredicateEngine& engine,
+    const char* dataptr,
+    const size_t datasz,
+    std::string& errmsg,
+    const std::vector<uint32_t>& row_nums)
+{
+    sky_root root = getSkyRoot(dataptr, datasz, SFT_FLATBUF_FLEX_ROW);
+    engine.bindDicts(root.dicts);
+    groups.setTableInfo(root.skyhook_version,
+                        root.data_structure_version,
+                        root.data_schema_version,
+                        root.db_schema_name,
+                        root.table_name);
+
+    bool process_all_rows = row_nums.empty();
+    uint32_t nrows = process_all_rows ? root.nrows : row_nums.size();
+    row_offs root_rows = static_cast<row_offs>(root.data_vec);
+    std::vector<flexbuffers::Vector> batch_rows;
+    std::vector<int64_t> batch_rids;
+    batch_rows.reserve(PRED_BATCH_ROWS);
+    batch_rids.reserve(PRED_BATCH_ROWS);
+    SelectionBitmap sel;
+
+    for (uint32_t bstart = 0; bstart < nrows; bstart += PRED_BATCH_ROWS) {
+        uint32_t bsize = std::min(PRED_BATCH_ROWS, nrows - bstart);
+        batch_rows.clear();
+        batch_rids.clear();
+        sel.reset(bsize, true);
+
+        for (uint32_t j = 0; j < bsize; j++) {
+            uint32_t rnum = process_all_rows ? bstart + j : row_nums[bstart + j];
+            if (rnum >= root.nrows) {
+                errmsg += "ERROR: rnum(" + std::to_string(rnum) +
+                          ") >= root.nrows(" + to_string(root.nrows) + ")";
+                return RowIndexOOB;
+            }
+            const Tables::Record* r = root_rows->Get(rnum);
+            batch_rows.push_back(r->data_flexbuffer_root().AsVector());
+            batch_rids.push_back(r->RID());
+
+            // skip dead rows.
+            if (root.delete_vec[rnum] == 1) sel.clear(j);
+        }
+
+        if (engine.hasFilters())
+            engine.evalFlexRows(batch_rows, batch_rids, sel);
+        groups.updateFlexRows(batch_rows, sel, root.dicts);
+    }
+    return 0;
+}
+
+/*
+ * Function: processArrowGroups
+ * Description: Same as above, for an arrow table.
+ * @param[in] tbl_schema   : Schema of an input table
+ *
+ * Return Value: error code
+ */
+int processArrowGroups(
+    GroupTable& groups,
+    schema_vec& tbl_schema,
+    PredicateEngine& engine,
+    const char* dataptr,
+    const size_t datasz,
+    std::string& errmsg,
+    const std::vector<uint32_t>& row_nums)
+{
+    int num_cols = std::distance(tbl_schema.begin(), tbl_schema.end());
+    std::shared_ptr<arrow::Buffer> buffer = arrow::MutableBuffer::Wrap(reinterpret_cast<uint8_t*>(const_cast<char*>(dataptr)), datasz);
+    std::shared_ptr<arrow::Table> input_table;
+
+    // Get input table from dataptr
+    extract_arrow_from_buffer(&input_table, buffer);
+
+    auto metadata = input_table->schema()->metadata();
+    groups.setTableInfo(
+        atoi(metadata->value(METADATA_SKYHOOK_VERSION).c_str()),
+        atoi(metadata->value(METADATA_DATA_STRUCTURE_VERSION).c_str()),
+        atoi(metadata->value(METADATA_DATA_SCHEMA_VERSION).c_str()),
+        metadata->value(METADATA_DB_SCHEMA),
+        metadata->value(METADATA_TABLE_NAME));
+
+    std::vector<arrow_batch> batches;
+    int errcode = arrow_table_batches(input_table, batches);
+    if (errcode) {
+        errmsg.append("ERROR processArrowGroups(): reading record batches");
+        return errcode;
+    }
+    if (!row_nums.empty() and row_nums.back() >= input_table->num_rows()) {
+        errmsg += "ERROR: rnum(" + std::to_string(row_nums.back()) +
+                  ") >= nrows(" + std::to_string(input_table->num_rows()) + ")";
+        return RowIndexOOB;
+    }
+
+    // accumulate the selected rows one batch at a time
+    std::vector<uint32_t> result_rows;
+    std::vector<uint32_t> batch_rows;
+    uint32_t next_row = 0;
+    for (auto b = batches.begin(); b != batches.end(); ++b) {
+        if (!row_nums.empty()) {
+            next_row = arrow_batch_rows(*b, row_nums, next_row, batch_rows);
+            if (batch_rows.empty())
+                continue;
+        }
+        errcode = selectArrowRows(b->table, num_cols, b->table->num_rows(),
+                                  engine, batch_rows, result_rows, errmsg);
+        if (errcode)
+            return errcode;
+        groups.updateArrowRows(b->table, result_rows);
+    }
+    return 0;
+}
+
+/*
+ * Function: processSkyFbTopK
+ * Description: Keep the live rows of a flatbuffer that pass the filter preds
+ *              and rank in the top-k of the key col.  A row is projected
+ *              only if it ranks before the last row kept so far.  The caller
+ *              builds the result from the kept rows once all blobs are done.
+ * @param[out] topk        : Top-k rows kept so far
+ * @param[in] data_schema  : Schema of an input table
+ * @param[in] query_schema : Schema of an query
+ * @param[in] engine       : Compiled preds for the query
+ * @param[in] pool         : Builders reused for each row's flexbuf
+ * @param[in] dataptr      : Input table in the form of char array
+ * @param[in] datasz       : Size of char array
+ * @param[out] errmsg      : Error message
+ * @param[in] row_nums     : Specified rows to be processed, or all if empty
+ *
+ * Return Value: error code
+ */
+int processSkyFbTopK(
+    TopKRows& topk,
+    schema_vec& data_schema,
+    schema_vec& query_schema,
+    PredicateEngine& engine,
+    BuilderPool& pool,
+    const char* dataptr,
+    const size_t datasz,
+    std::string& errmsg,
+    const std::vector<uint32_t>& row_nums)
+{
+    int errcode = 0;
+    sky_root root = getSkyRoot(dataptr, datasz, SFT_FLATBUF_FLEX_ROW);
+    engine.bindDicts(root.dicts);
+    topk.setTableInfo(root.skyhook_version,
+                      root.data_structure_version,
+                      root.data_schema_version,
+                      root.db_schema_name,
+                      root.table_name);
+
+    // identify the max col idx, to prevent flexbuf vector oob error
+    int col_idx_max = -1;
+    for (auto it = data_schema.begin(); it != data_schema.end(); ++it) {
+        if (it->idx > col_idx_max)
+            col_idx_max = it->idx;
+    }
+    const int key_idx = topk.keyCol().idx;
+
+    bool process_all_rows = row_nums.empty();
+    uint32_t nrows = process_all_rows ? root.nrows : row_nums.size();
+    row_offs root_rows = static_cast<row_offs>(root.data_vec);
+    std::vector<const Tables::Record*> batch_recs;
+    std::vector<flexbuffers::Vector> batch_rows;
+    std::vector<int64_t> batch_rids;
+    std::vector<uint32_t> batch_sel;
+    batch_recs.reserve(PRED_BATCH_ROWS);
+    batch_rows.reserve(PRED_BATCH_ROWS);
+    batch_rids.reserve(PRED_BATCH_ROWS);
+    batch_sel.reserve(PRED_BATCH_ROWS);
+    SelectionBitmap sel;
+    nullbits_vector nullbits;
+
+    for (uint32_t bstart = 0; bstart < nrows && !errcode;
+         bstart += PRED_BATCH_ROWS) {
+        uint32_t bsize = std::min(PRED_BATCH_ROWS, nrows - bstart);
+        batch_recs.clear();
+        batch_rows.clear();
+        batch_rids.clear();
+        batch_sel.clear();
+        sel.reset(bsize, true);
+
+        for (uint32_t j = 0; j < bsize; j++) {
+            uint32_t rnum = process_all_rows ? bstart + j : row_nums[bstart + j];
+            if (rnum >= root.nrows) {
+                errmsg += "ERROR: rnum(" + std::to_string(rnum) +
+                          ") >= root.nrows(" + to_string(root.nrows) + ")";
+                return RowIndexOOB;
+            }
+            const Tables::Record* r = root_rows->Get(rnum);
+            batch_recs.push_back(r);
+            batch_rows.push_back(r->data_flexbuffer_root().AsVector());
+            batch_rids.push_back(r->RID());
+
+            // skip dead rows.
+            if (root.delete_vec[rnum] == 1) sel.clear(j);
+        }
+
+        if (engine.hasFilters())
+            engine.evalFlexRows(batch_rows, batch_rids, sel);
+
+        sel.toRowNums(batch_sel);
+        for (auto its = batch_sel.begin();
+             its != batch_sel.end() && !errcode; ++its) {
+            const flexbuffers::Vector& row = batch_rows[*its];
+            topk_key key = topk.flexKey(row, key_idx, root.dicts);
+            if (!topk.accepts(key))
+                continue;
+
+            const Tables::Record* recptr = batch_recs[*its];
+            // kept rows may come from any fb, so are decoded
+            errcode = projectFlexRow(pool.flexBuilder(), row, query_schema,
+                                     col_idx_max, root.dicts, false,
+                                     root.table_name, batch_rids[*its],
+                                     errmsg);
+            nullbits.assign(recptr->nullbits()->begin(),
+                            recptr->nullbits()->end());
+            topk.push(key, batch_rids[*its], nullbits, pool.finishFlex());
+        }
+    }
     return errcode;
 }
 
+/*
+ * Function: processArrowTopK
+ * Description: Same as above, for an arrow table.  The kept rows are
+ *              projected into flexbufs, so the result is a flatbuffer.
+ * @param[in] tbl_schema   : Schema of an input table
+ *
+ * Return Value: error code
+ */
+int processArrowTopK(
+    TopKRows& topk,
+    schema_vec& tbl_schema,
+    schema_vec& query_schema,
+    PredicateEngine& engine,
+    const char* dataptr,
+    const size_t datasz,
+    std::string& errmsg,
+    const std::vector<uint32_t>& row_nums)
+{
+    int num_cols = std::distance(tbl_schema.begin(), tbl_schema.end());
+    std::shared_ptr<arrow::Buffer> buffer = arrow::MutableBuffer::Wrap(reinterpret_cast<uint8_t*>(const_cast<char*>(dataptr)), datasz);
+    std::shared_ptr<arrow::Table> input_table;
+
+    // Get input table from dataptr
+    extract_arrow_from_buffer(&input_table, buffer);
+
+    auto metadata = input_table->schema()->metadata();
+    topk.setTableInfo(
+        atoi(metadata->value(METADATA_SKYHOOK_VERSION).c_str()),
+        atoi(metadata->value(METADATA_DATA_STRUCTURE_VERSION).c_str()),
+        atoi(metadata->value(METADATA_DATA_SCHEMA_VERSION).c_str()),
+        metadata->value(METADATA_DB_SCHEMA),
+        metadata->value(METADATA_TABLE_NAME));
+
+    // identify the max col idx, to prevent oob error
+    int col_idx_max = -1;
+    for (auto it = tbl_schema.begin(); it != tbl_schema.end(); ++it) {
+        if (it->idx > col_idx_max)
+            col_idx_max = it->idx;
+    }
+
+    for (auto it = query_schema.begin(); it != query_schema.end(); ++it) {
+        if (it->idx < 0 or it->idx > col_idx_max) {
+            errmsg.append("ERROR processArrowTopK()");
+            return TablesErrCodes::RequestedColIndexOOB;
+        }
+    }
+
+    std::vector<arrow_batch> batches;
+    int errcode = arrow_table_batches(input_table, batches);
+    if (errcode) {
+        errmsg.append("ERROR processArrowTopK(): reading record batches");
+        return errcode;
+    }
+    if (!row_nums.empty() and row_nums.back() >= input_table->num_rows()) {
+        errmsg += "ERROR: rnum(" + std::to_string(row_nums.back()) +
+                  ") >= nrows(" + std::to_string(input_table->num_rows()) + ")";
+        return RowIndexOOB;
+    }
+
+    std::vector<uint32_t> result_rows;
+    std::vector<uint32_t> batch_rows;
+    std::vector<std::shared_ptr<arrow::Array>> cols;
+    flexbuffers::Builder flexbldr;
+    nullbits_vector nullbits;
+    uint32_t next_row = 0;
+    for (auto b = batches.begin(); b != batches.end(); ++b) {
+        if (!row_nums.empty()) {
+            next_row = arrow_batch_rows(*b, row_nums, next_row, batch_rows);
+            if (batch_rows.empty())
+                continue;
+        }
+        errcode = selectArrowRows(b->table, num_cols, b->table->num_rows(),
+                                  engine, batch_rows, result_rows, errmsg);
+        if (errcode)
+            return errcode;
+
+        cols.clear();
+        for (auto it = query_schema.begin(); it != query_schema.end(); ++it)
+            cols.push_back(b->table->column(it->idx)->chunk(0));
+        auto key_chunk = b->table->column(topk.keyCol().idx)->chunk(0);
+
+        for (auto it = result_rows.begin(); it != result_rows.end(); ++it) {
+            const uint32_t rnum = *it;
+            topk_key key = topk.arrowKey(key_chunk, rnum);
+            if (!topk.accepts(key))
+                continue;
+
+            nullbits.assign(2, 0);
+            flexbldr.Clear();
+            flexbldr.Vector([&]() {
+                for (uint32_t c = 0; c < query_schema.size(); c++) {
+                    const col_info& col = query_schema[c];
+                    if (col.nullable and cols[c]->IsNull(rnum)) {
+                        setNullBit(nullbits, col.idx);
+                        flexbldr.Null();
+                    }
+                    else if (aggStateField(col.type) == ASF_STRING) {
+                        auto s = std::static_pointer_cast<arrow::StringArray>(cols[c]);
+                        flexbldr.Add(s->GetString(rnum));
+                    }
+                    else {
+                        addAggState(flexbldr, arrowAggState(cols[c], col.type, rnum),
+                                    col.type);
+                    }
+                }
+            });
+            flexbldr.Finish();
+            topk.push(key, b->offset + rnum, nullbits, flexbldr.GetBuffer());
+        }
+    }
+    return 0;
+}
 
 
 /*
@@ -1162,7 +1743,7 @@ int processSkyFbWASM(
 
         // apply predicates to this record
         if (!preds.empty()) {
-            bool pass = applyPredicates(preds, rec);
+            bool pass = applyPredicates(preds, rec, &root.dicts);
             if (!pass) continue;  // skip non matching rows.
         }
 
@@ -1240,10 +1821,8 @@ int processSkyFbWASM(
                             flexbldr->Add(row[col.idx].AsDouble());
                             break;
                         case SDT_DATE:
-                            flexbldr->Add(row[col.idx].AsString().str());
-                            break;
-                        case SDT_STRING:
-                            flexbldr->Add(row[col.idx].AsString().str());
+                        case SDT_STRING:  // decoded, if dictionary encoded
+                            flexbldr->Add(root.dicts.getString(row, col.idx));
                             break;
                         default: {
                             errcode = TablesErrCodes::UnsupportedSkyDataType;
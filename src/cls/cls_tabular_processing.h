@@ -15,7 +15,12 @@
 #include <string>
 #include <sstream>
 
+#include <arrow/compute/api.h>
+
 #include "cls_tabular_utils.h"
+#include "cls_tabular_predicates.h"
+#include "cls_tabular_groupby.h"
+#include "cls_tabular_topk.h"
 #include "cls_tabular.h"
 
 
@@ -37,6 +42,21 @@ int processSkyFb(
         std::string& errmsg,
         const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
 
+// same as above, reusing a predicate engine and builders from the caller,
+// optionally encoding no more than max_rows rows
+int processSkyFb(
+        flatbuffers::FlatBufferBuilder& flatb,
+        schema_vec& data_schema,
+        schema_vec& query_schema,
+        predicate_vec& preds,
+        PredicateEngine& engine,
+        BuilderPool& pool,
+        const char* fb,
+        const size_t fb_size,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums=std::vector<uint32_t>(),
+        uint64_t max_rows=0);
+
 // process arrow format data blob, col access style
 int processArrowCol(
         std::shared_ptr<arrow::Table>* table,
@@ -48,6 +68,20 @@ int processArrowCol(
         std::string& errmsg,
         const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
 
+// same as above, reusing a predicate engine compiled by the caller,
+// optionally selecting no more than max_rows rows
+int processArrowCol(
+        std::shared_ptr<arrow::Table>* table,
+        schema_vec& tbl_schema,
+        schema_vec& query_schema,
+        predicate_vec& preds,
+        PredicateEngine& engine,
+        const char* dataptr,
+        const size_t datasz,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums=std::vector<uint32_t>(),
+        uint64_t max_rows=0);
+
 // process arrow format data blob, row access style
 int processArrow(
         std::shared_ptr<arrow::Table>* table,
@@ -59,6 +93,60 @@ int processArrow(
         std::string& errmsg,
         const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
 
+// same as above, reusing a predicate engine compiled by the caller
+int processArrow(
+        std::shared_ptr<arrow::Table>* table,
+        schema_vec& tbl_schema,
+        schema_vec& query_schema,
+        predicate_vec& preds,
+        PredicateEngine& engine,
+        const char* dataptr,
+        const size_t datasz,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
+
+// accumulate the passing rows of a flatbuffer format data blob into groups
+int processSkyFbGroups(
+        GroupTable& groups,
+        PredicateEngine& engine,
+        const char* fb,
+        const size_t fb_size,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
+
+// accumulate the passing rows of an arrow format data blob into groups
+int processArrowGroups(
+        GroupTable& groups,
+        schema_vec& tbl_schema,
+        PredicateEngine& engine,
+        const char* dataptr,
+        const size_t datasz,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
+
+// keep the top-k passing rows of a flatbuffer format data blob
+int processSkyFbTopK(
+        TopKRows& topk,
+        schema_vec& data_schema,
+        schema_vec& query_schema,
+        PredicateEngine& engine,
+        BuilderPool& pool,
+        const char* fb,
+        const size_t fb_size,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
+
+// keep the top-k passing rows of an arrow format data blob
+int processArrowTopK(
+        TopKRows& topk,
+        schema_vec& tbl_schema,
+        schema_vec& query_schema,
+        PredicateEngine& engine,
+        const char* dataptr,
+        const size_t datasz,
+        std::string& errmsg,
+        const std::vector<uint32_t>& row_nums=std::vector<uint32_t>());
+
 // process flatbuffer format data blob with wasm
 int processSkyFbWASM(
         char* _flatbldr,
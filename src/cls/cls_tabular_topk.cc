@@ -0,0 +1,187 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+#include "cls_tabular_topk.h"
+
+
+namespace Tables {
+
+TopKRows::TopKRows(const col_info& _key_col, bool _desc, uint64_t _k) :
+    key_col(_key_col),
+    desc(_desc),
+    k(_k),
+    skyhook_version(0),
+    data_structure_version(0),
+    data_schema_version(0)
+{
+    assert (k > 0);
+    heap.reserve(std::min(k, static_cast<uint64_t>(PRED_BATCH_ROWS)));
+}
+
+topk_key TopKRows::flexKey(const flexbuffers::Vector& row, int pos,
+                           const FbDicts& dicts) const {
+    topk_key key;
+    if (aggStateField(key_col.type) == ASF_STRING)
+        key.str = dicts.getString(row, pos);
+    else
+        key.num = flexAggState(row[pos], key_col.type);
+    return key;
+}
+
+topk_key TopKRows::arrowKey(const std::shared_ptr<arrow::Array>& a,
+                            uint32_t rnum) const {
+    topk_key key;
+    if (aggStateField(key_col.type) == ASF_STRING)
+        key.str = std::static_pointer_cast<arrow::StringArray>(a)->GetString(rnum);
+    else
+        key.num = arrowAggState(a, key_col.type, rnum);
+    return key;
+}
+
+bool TopKRows::before(const topk_key& a, const topk_key& b) const {
+    bool lt, gt;
+    switch (aggStateField(key_col.type)) {
+        case ASF_INT: lt = a.num.i < b.num.i; gt = a.num.i > b.num.i; break;
+        case ASF_UINT: lt = a.num.u < b.num.u; gt = a.num.u > b.num.u; break;
+        case ASF_DOUBLE: lt = a.num.d < b.num.d; gt = a.num.d > b.num.d; break;
+        default: lt = a.str < b.str; gt = a.str > b.str; break;
+    }
+    return desc ? gt : lt;
+}
+
+bool TopKRows::accepts(const topk_key& key) const {
+    return heap.size() < k or before(key, heap.front().key);
+}
+
+void TopKRows::pushEntry(entry&& e) {
+    auto cmp = [this](const entry& a, const entry& b) {
+        return before(a.key, b.key);
+    };
+    if (heap.size() == k) {
+        std::pop_heap(heap.begin(), heap.end(), cmp);
+        heap.back() = std::move(e);
+    }
+    else {
+        heap.push_back(std::move(e));
+    }
+    std::push_heap(heap.begin(), heap.end(), cmp);
+}
+
+void TopKRows::push(const topk_key& key,
+                    int64_t rid,
+                    const nullbits_vector& nullbits,
+                    const std::vector<uint8_t>& data) {
+    if (!accepts(key))
+        return;
+    entry e;
+    e.key = key;
+    e.rid = rid;
+    e.nullbits = nullbits;
+    e.data = data;
+    pushEntry(std::move(e));
+}
+
+void TopKRows::updateSkyRoot(const sky_root& root, int key_pos) {
+    setTableInfo(root.skyhook_version, root.data_structure_version,
+                 root.data_schema_version, root.db_schema_name,
+                 root.table_name);
+    row_offs rows = static_cast<row_offs>(root.data_vec);
+    for (uint32_t i = 0; i < root.nrows; i++) {
+        if (root.delete_vec.at(i) == 1)
+            continue;
+        const Tables::Record* rec = rows->Get(i);
+        topk_key key = flexKey(rec->data_flexbuffer_root().AsVector(),
+                               key_pos, root.dicts);
+        if (!accepts(key))
+            continue;
+        entry e;
+        e.key = std::move(key);
+        e.rid = rec->RID();
+        e.nullbits.assign(rec->nullbits()->begin(), rec->nullbits()->end());
+        e.data.assign(rec->data()->Data(),
+                      rec->data()->Data() + rec->data()->size());
+        pushEntry(std::move(e));
+    }
+}
+
+void TopKRows::merge(const TopKRows& other) {
+    if (other.empty())
+        return;
+    setTableInfo(other.skyhook_version, other.data_structure_version,
+                 other.data_schema_version, other.db_schema_name,
+                 other.table_name);
+    for (auto it = other.heap.begin(); it != other.heap.end(); ++it) {
+        if (!accepts(it->key))
+            continue;
+        entry e(*it);
+        pushEntry(std::move(e));
+    }
+}
+
+void TopKRows::setTableInfo(int _skyhook_version,
+                            int _data_structure_version,
+                            int _data_schema_version,
+                            const std::string& _db_schema_name,
+                            const std::string& _table_name) {
+    skyhook_version = _skyhook_version;
+    data_structure_version = _data_structure_version;
+    data_schema_version = _data_schema_version;
+    db_schema_name = _db_schema_name;
+    table_name = _table_name;
+}
+
+void TopKRows::buildFb(flatbuffers::FlatBufferBuilder& flatbldr,
+                       const std::string& result_schema) const {
+
+    // heap order to key order, ties keep their heap order
+    std::vector<const entry*> sorted;
+    sorted.reserve(heap.size());
+    for (auto it = heap.begin(); it != heap.end(); ++it)
+        sorted.push_back(&(*it));
+    std::stable_sort(sorted.begin(), sorted.end(),
+                     [this](const entry* a, const entry* b) {
+                         return before(a->key, b->key);
+                     });
+
+    std::vector<flatbuffers::Offset<Tables::Record>> offs;
+    delete_vector dead_rows;
+    for (auto it = sorted.begin(); it != sorted.end(); ++it) {
+        auto row_data = flatbldr.CreateVector((*it)->data);
+        auto nullbits = flatbldr.CreateVector((*it)->nullbits);
+        offs.push_back(Tables::CreateRecord(flatbldr, (*it)->rid, nullbits,
+                                            row_data));
+        dead_rows.push_back(0);
+    }
+
+    auto table = CreateTable(
+        flatbldr,
+        SFT_FLATBUF_FLEX_ROW,
+        skyhook_version,
+        data_structure_version,
+        data_schema_version,
+        flatbldr.CreateString(result_schema),
+        flatbldr.CreateString(db_schema_name),
+        flatbldr.CreateString(table_name),
+        flatbldr.CreateVector(dead_rows),
+        flatbldr.CreateVector(offs),
+        offs.size());
+    flatbldr.Finish(table);
+}
+
+std::string TopKRows::toString() const {
+    std::string s("TopKRows:");
+    s.append(" .key_col=" + key_col.name);
+    s.append(" .desc=" + std::to_string(desc));
+    s.append(" .k=" + std::to_string(k));
+    s.append(" .rows=" + std::to_string(heap.size()));
+    return s;
+}
+
+} // end namespace Tables
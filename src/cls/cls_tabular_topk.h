@@ -0,0 +1,106 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+
+#ifndef CLS_TABULAR_TOPK_H
+#define CLS_TABULAR_TOPK_H
+
+#include <string>
+#include <vector>
+
+#include "cls_tabular_utils.h"
+#include "cls_tabular_groupby.h"
+
+
+// Top-k rows for order by col limit k.
+// A TopKRows keeps the first k rows in the order of one key col, as a bounded
+// heap whose top is the last of the kept rows, so a row is only encoded if
+// it ranks before that one.  cls keeps the top-k rows of an object, and the
+// client merges the top-k rows of each object into the final top-k.
+
+
+namespace Tables {
+
+// sort key of a row, num holds numeric keys, str holds string and date keys
+struct topk_key {
+    agg_state num;
+    std::string str;
+};
+
+class TopKRows {
+public:
+    TopKRows(const col_info& key_col, bool desc, uint64_t k);
+
+    uint64_t size() const {return heap.size();}
+    bool empty() const {return heap.empty();}
+    const col_info& keyCol() const {return key_col;}
+
+    // read the key of a row from its key col value at pos
+    topk_key flexKey(const flexbuffers::Vector& row, int pos,
+                     const FbDicts& dicts) const;
+    topk_key arrowKey(const std::shared_ptr<arrow::Array>& a,
+                      uint32_t rnum) const;
+
+    // true if a row with this key would be kept
+    bool accepts(const topk_key& key) const;
+
+    // keep a row given its result flexbuf data, if it ranks in the top-k
+    void push(const topk_key& key,
+              int64_t rid,
+              const nullbits_vector& nullbits,
+              const std::vector<uint8_t>& data);
+
+    // keep the top-k rows of a flatbuf result, with the key at key_pos
+    void updateSkyRoot(const sky_root& root, int key_pos);
+
+    // keep the top-k rows of both tables
+    void merge(const TopKRows& other);
+
+    // set the table info of the input data, copied into buildFb() results
+    void setTableInfo(int skyhook_version,
+                      int data_structure_version,
+                      int data_schema_version,
+                      const std::string& db_schema_name,
+                      const std::string& table_name);
+
+    // build a flatbuf flex row table of the kept rows in key order
+    void buildFb(flatbuffers::FlatBufferBuilder& flatbldr,
+                 const std::string& result_schema) const;
+
+    std::string toString() const;
+
+private:
+    struct entry {
+        topk_key key;
+        int64_t rid;
+        nullbits_vector nullbits;
+        std::vector<uint8_t> data;
+    };
+
+    const col_info key_col;
+    const bool desc;
+    const uint64_t k;
+    std::vector<entry> heap;
+
+    int skyhook_version;
+    int data_structure_version;
+    int data_schema_version;
+    std::string db_schema_name;
+    std::string table_name;
+
+    // true if key a ranks before key b in the result
+    bool before(const topk_key& a, const topk_key& b) const;
+    void pushEntry(entry&& e);
+};
+
+} // end namespace Tables
+
+
+#endif
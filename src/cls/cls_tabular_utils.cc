@@ -9,6 +9,9 @@
 */
 
 
+#include <lz4.h>
+#include <zstd.h>
+
 #include "cls_tabular_utils.h"
 #include "cls_tabular_processing.h"
 
@@ -461,6 +464,7 @@ int skyOpTypeFromString(std::string op) {
     else if (op=="max") op_type = SOT_max;
     else if (op=="sum") op_type = SOT_sum;
     else if (op=="cnt") op_type = SOT_cnt;
+    else if (op=="avg") op_type = SOT_avg;
     else if (op=="like") op_type = SOT_like;
     else if (op=="in") op_type = SOT_in;
     else if (op=="not_in") op_type = SOT_not_in;
@@ -495,6 +499,7 @@ std::string skyOpTypeToString(int op) {
     else if (op==SOT_max) op_str = "max";
     else if (op==SOT_sum) op_str = "sum";
     else if (op==SOT_cnt) op_str = "cnt";
+    else if (op==SOT_avg) op_str = "avg";
     else if (op==SOT_like) op_str = "like";
     else if (op==SOT_in) op_str = "in";
     else if (op==SOT_not_in) op_str = "not_in";
@@ -555,12 +560,131 @@ void printSkyRecHeader(sky_rec &r) {
     }
 }
 
+// two digit strings of 00..99, to convert integers two digits at a time
+static const char DIGIT_PAIRS[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+void OutputBuffer::appendUInt(uint64_t v) {
+    char b[20];  // max digits of a uint64
+    char* p = b + sizeof(b);
+    while (v >= 100) {
+        unsigned i = (v % 100) * 2;
+        v /= 100;
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + i, 2);
+    }
+    if (v >= 10) {
+        p -= 2;
+        memcpy(p, DIGIT_PAIRS + v * 2, 2);
+    } else {
+        *--p = static_cast<char>('0' + v);
+    }
+    buf.append(p, b + sizeof(b) - p);
+}
+
+void OutputBuffer::appendInt(int64_t v) {
+    if (v < 0) {
+        buf.push_back('-');
+        appendUInt(0 - static_cast<uint64_t>(v));
+    } else {
+        appendUInt(static_cast<uint64_t>(v));
+    }
+}
+
+void OutputBuffer::appendDouble(double v) {
+    char b[32];
+    int n = snprintf(b, sizeof(b), "%g", v);
+    buf.append(b, n);
+}
+
+void OutputBuffer::appendDoubleFixed(double v) {
+    char b[64];
+    int n = snprintf(b, sizeof(b), "%f", v);
+    if (n < static_cast<int>(sizeof(b)))
+        buf.append(b, n);
+    else
+        buf.append(std::to_string(v));  // very large magnitudes only
+}
+
+// days of a yyyy-mm-dd date since the postgres epoch, as the julian day of
+// boost::gregorian::from_string minus POSTGRES_EPOCH_JDATE.  Only dates of
+// the common form with a day that is valid in every month are converted
+// here, boost parses and validates all others.
+static int32_t pgBinaryDate(const char* s, size_t len)
+{
+    auto digits = [s](int from, int n) {
+        int v = 0;
+        for (int i = from; i < from + n; i++) {
+            if (s[i] < '0' or s[i] > '9') return -1;
+            v = v * 10 + (s[i] - '0');
+        }
+        return v;
+    };
+    if (len == 10 and s[4] == '-' and s[7] == '-') {
+        int y = digits(0, 4);
+        int m = digits(5, 2);
+        int d = digits(8, 2);
+        if (y >= 1400 and m >= 1 and m <= 12 and d >= 1 and d <= 28) {
+            int a = (14 - m) / 12;
+            int yy = y + 4800 - a;
+            int mm = m + 12 * a - 3;
+            int jdn = d + (153 * mm + 2) / 5 + 365 * yy + yy / 4 - yy / 100 +
+                      yy / 400 - 32045;
+            return jdn - Tables::POSTGRES_EPOCH_JDATE;
+        }
+    }
+    boost::gregorian::date dt = \
+        boost::gregorian::from_string(std::string(s, len));
+    return dt.julian_day() - Tables::POSTGRES_EPOCH_JDATE;
+}
+
+// postgres binary copy header, output once before the first row
+static void appendPGBinaryHeader(OutputBuffer& out)
+{
+    // 11 byte signature sequence
+    const char* header_signature = "PGCOPY\n\377\r\n\0";
+    out.append(header_signature, 11);
+
+    // 32 bit flags field, set bit#16=1 only if OIDs included in data
+    out.appendBigEndian(static_cast<int32_t>(0));
+
+    // 32 bit extra header len
+    out.appendBigEndian(static_cast<int32_t>(0));
+}
+
+long long int printFlatbufFlexRowAsCsv(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        std::ostream& out) {
+
+    OutputBuffer buf;
+    long long int counter = printFlatbufFlexRowAsCsv(dataptr, datasz,
+                                                     print_header,
+                                                     print_verbose,
+                                                     max_to_print, buf);
+    out.write(buf.data(), buf.size());
+    return counter;
+}
+
 long long int printFlatbufFlexRowAsCsv(
         const char* dataptr,
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print) {
+        long long int max_to_print,
+        OutputBuffer& out) {
 
     // get root table ptr as sky struct
     sky_root root = getSkyRoot(dataptr, datasz, SFT_FLATBUF_FLEX_ROW);
@@ -574,16 +698,19 @@ long long int printFlatbufFlexRowAsCsv(
     if (print_header) {
         bool first = true;
         for (schema_vec::iterator it = sc.begin(); it != sc.end(); ++it) {
-            if (!first) std::cout << CSV_DELIM;
+            if (!first) out.put(CSV_DELIM);
             first = false;
-            std::cout << it->name;
-            if (it->is_key) std::cout << "(key)";
-            if (!it->nullable) std::cout << "(NOT NULL)";
+            out.append(it->name);
+            if (it->is_key) out.append("(key)");
+            if (!it->nullable) out.append("(NOT NULL)");
 
         }
-        std::cout << std::endl; // newline to start first row.
+        out.put('\n'); // newline to start first row.
     }
 
+    // csv text is usually about the size of the flexbuf rows
+    out.reserve(out.size() + datasz);
+
     long long int counter = 0;
     for (uint32_t i = 0; i < root.nrows; i++, counter++) {
         if (counter >= max_to_print)
@@ -602,48 +729,43 @@ long long int printFlatbufFlexRowAsCsv(
             printSkyRecHeader(skyrec);
 
         // for each col in the row, print a NULL or the col's value/
-        bool first = true;
         for (uint32_t j = 0; j < sc.size(); j++) {
-            if (!first) std::cout << CSV_DELIM;
-            first = false;
-            col_info col = sc.at(j);
+            if (j > 0) out.put(CSV_DELIM);
+            const col_info& col = sc[j];
 
             if (col.nullable) {  // check nullbit
-                bool is_null = false;
-                int pos = col.idx / (8*sizeof(skyrec.nullbits.at(0)));
-                int col_bitmask = 1 << col.idx;
-                if ((col_bitmask & skyrec.nullbits.at(pos)) != 0)  {
-                    is_null =true;
-                }
-                if (is_null) {
-                    std::cout << "NULL";
+                if (isNullBitSet(skyrec.nullbits, col.idx))  {
+                    out.append("NULL", 4);
                     continue;
                 }
             }
+
+            // NOTE: 8 bit ints are output as chars, as by ostream
             switch (col.type) {
-                case SDT_BOOL: std::cout << row[j].AsBool(); break;
-                case SDT_INT8: std::cout << row[j].AsInt8(); break;
-                case SDT_INT16: std::cout << row[j].AsInt16(); break;
-                case SDT_INT32: std::cout << row[j].AsInt32(); break;
-                case SDT_INT64: std::cout << row[j].AsInt64(); break;
-                case SDT_UINT8: std::cout << row[j].AsUInt8(); break;
-                case SDT_UINT16: std::cout << row[j].AsUInt16(); break;
-                case SDT_UINT32: std::cout << row[j].AsUInt32(); break;
-                case SDT_UINT64: std::cout << row[j].AsUInt64(); break;
-                case SDT_FLOAT: std::cout << row[j].AsFloat(); break;
-                case SDT_DOUBLE: std::cout << row[j].AsDouble(); break;
-                case SDT_CHAR: std::cout <<
-                    std::string(1, row[j].AsInt8()); break;
-                case SDT_UCHAR: std::cout <<
-                    std::string(1, row[j].AsUInt8()); break;
-                case SDT_DATE: std::cout <<
-                    row[j].AsString().str(); break;
-                case SDT_STRING: std::cout <<
-                    row[j].AsString().str(); break;
+                case SDT_BOOL: out.put(row[j].AsBool() ? '1' : '0'); break;
+                case SDT_INT8: out.put(row[j].AsInt8()); break;
+                case SDT_INT16: out.appendInt(row[j].AsInt16()); break;
+                case SDT_INT32: out.appendInt(row[j].AsInt32()); break;
+                case SDT_INT64: out.appendInt(row[j].AsInt64()); break;
+                case SDT_UINT8: out.put(row[j].AsUInt8()); break;
+                case SDT_UINT16: out.appendUInt(row[j].AsUInt16()); break;
+                case SDT_UINT32: out.appendUInt(row[j].AsUInt32()); break;
+                case SDT_UINT64: out.appendUInt(row[j].AsUInt64()); break;
+                case SDT_FLOAT: out.appendDouble(row[j].AsFloat()); break;
+                case SDT_DOUBLE: out.appendDouble(row[j].AsDouble()); break;
+                case SDT_CHAR: out.put(row[j].AsInt8()); break;
+                case SDT_UCHAR: out.put(row[j].AsUInt8()); break;
+                case SDT_DATE:
+                case SDT_STRING: {
+                    size_t len = 0;
+                    const char* str = root.dicts.getChars(row, j, &len);
+                    out.append(str, len);
+                    break;
+                }
                 default: assert (TablesErrCodes::UnknownSkyDataType);
             }
         }
-        std::cout << std::endl;  // newline to start next row.
+        out.put('\n');  // newline to start next row.
     }
     return counter;
 }
@@ -653,41 +775,38 @@ long long int printFlatbufFlexRowAsPGBinary(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print) {
+        long long int max_to_print,
+        std::ostream& out) {
+
+    OutputBuffer buf;
+    long long int counter = printFlatbufFlexRowAsPGBinary(dataptr, datasz,
+                                                          print_header,
+                                                          print_verbose,
+                                                          max_to_print, buf);
+    out.write(buf.data(), buf.size());
+    return counter;
+}
+
+long long int printFlatbufFlexRowAsPGBinary(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out) {
 
     // get root table ptr as sky struct
     sky_root root = getSkyRoot(dataptr, datasz, SFT_FLATBUF_FLEX_ROW);
     schema_vec sc = schemaFromString(root.data_schema);
     assert(!sc.empty());
 
-    // postgres fstreams expect big endianness
-    bool big_endian = is_big_endian();
-    stringstream ss(std::stringstream::in |
-                    std::stringstream::out|
-                    std::stringstream::binary);
-
     // print binary stream header sequence first time only
-    if (print_header) {
-
-        // 11 byte signature sequence
-        const char* header_signature = "PGCOPY\n\377\r\n\0";
-        ss.write(header_signature, 11);
-
-        // 32 bit flags field, set bit#16=1 only if OIDs included in data
-        int flags_field = 0;
-        ss.write(reinterpret_cast<const char*>(&flags_field),
-                 sizeof(flags_field));
-
-        // 32 bit extra header len
-        int header_extension_len = 0;
-        ss.write(reinterpret_cast<const char*>(&header_extension_len),
-                 sizeof(header_extension_len));
-    }
+    if (print_header)
+        appendPGBinaryHeader(out);
 
     // 16 bit int, assumes same num cols for all rows below.
     int16_t ncols = static_cast<int16_t>(sc.size());
-    if (!big_endian)
-        ncols = __builtin_bswap16(ncols);
+    out.reserve(out.size() + datasz);
 
     // row printing counter, used with --limit flag
     long long int counter = 0;
@@ -700,7 +819,7 @@ long long int printFlatbufFlexRowAsPGBinary(
             getSkyRec(static_cast<row_offs>(root.data_vec)->Get(i));
 
         // 16 bit int num cols in this row (all rows same ncols currently)
-        ss.write(reinterpret_cast<const char*>(&ncols), sizeof(ncols));
+        out.appendBigEndian(ncols);
 
         // get the flexbuf row's data as a flexbuf vec
         auto row = skyrec.data.AsVector();
@@ -708,213 +827,60 @@ long long int printFlatbufFlexRowAsPGBinary(
         // for each col in the row, print a NULL or the col's value/
         for (unsigned j = 0; j < sc.size(); j++ ) {
 
-            col_info col = sc.at(j);
+            const col_info& col = sc[j];
 
             if (col.nullable) {  // check nullbit
-                bool is_null = false;
-                int pos = col.idx / (8*sizeof(skyrec.nullbits.at(0)));
-                int col_bitmask = 1 << col.idx;
-                if ((col_bitmask & skyrec.nullbits.at(pos)) != 0)  {
-                    is_null = true;
-                }
-                if (is_null) {
+                if (isNullBitSet(skyrec.nullbits, col.idx))  {
                     // for null we only write the int representation of null,
                     // followed by no data
-                    ss.write(reinterpret_cast<const char*>(&PGNULLBINARY),
-                             sizeof(PGNULLBINARY));
+                    out.appendPGNull();
                     continue;
                 }
             }
 
-            // for each col, write 32 bit data len followed by data as char*
+            // for each col, write 32 bit data len followed by data
             switch (col.type) {
-
-            case SDT_BOOL: {
-                uint8_t val = row[j].AsBool();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    // val is single byte, has no endianness
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                break;
-            }
-            case SDT_INT8: {
-                int8_t val = row[j].AsInt8();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    // val is single byte, has no endianness
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                break;
-            }
-            case SDT_INT16: {
-                int16_t val = row[j].AsInt16();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    val = __builtin_bswap16(val);
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                break;
-            }
-            case SDT_INT32: {
-                int32_t val = row[j].AsInt32();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    val = __builtin_bswap32(val);
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                break;
-            }
-            case SDT_INT64: {
-                int64_t val = row[j].AsInt64();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    val = __builtin_bswap64(val);
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                break;
-            }
-            case SDT_UINT8: {
-                uint8_t val = row[j].AsUInt8();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    // val is single byte, has no endianness
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                break;
-            }
-            case SDT_UINT16: {
-                uint16_t val = row[j].AsUInt16();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    val = __builtin_bswap16(val);
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
+            case SDT_BOOL:
+                out.appendPGField(static_cast<uint8_t>(row[j].AsBool()));
                 break;
-            }
-            case SDT_UINT32: {
-                uint32_t val = row[j].AsUInt32();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    val = __builtin_bswap32(val);
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
+            case SDT_INT8:
+            case SDT_CHAR:
+                out.appendPGField(row[j].AsInt8());
                 break;
-            }
-            case SDT_UINT64: {
-                uint64_t val = row[j].AsUInt64();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    val = __builtin_bswap64(val);
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
+            case SDT_INT16: out.appendPGField(row[j].AsInt16()); break;
+            case SDT_INT32: out.appendPGField(row[j].AsInt32()); break;
+            case SDT_INT64: out.appendPGField(row[j].AsInt64()); break;
+            case SDT_UINT8:
+            case SDT_UCHAR:
+                out.appendPGField(row[j].AsUInt8());
                 break;
-            }
-            case SDT_FLOAT:    // postgres float is alias for double
-            case SDT_DOUBLE: {
+            case SDT_UINT16: out.appendPGField(row[j].AsUInt16()); break;
+            case SDT_UINT32: out.appendPGField(row[j].AsUInt32()); break;
+            case SDT_UINT64: out.appendPGField(row[j].AsUInt64()); break;
 
-                double val = 0.0;
-                if (col.type == SDT_FLOAT)
-                    val = row[j].AsFloat();  // flexbuf api requires type
-                else
-                    val = row[j].AsDouble();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    char val_bigend[len];
-                    char* vptr = (char*)&val;
-                    val_bigend[0]=vptr[7];
-                    val_bigend[1]=vptr[6];
-                    val_bigend[2]=vptr[5];
-                    val_bigend[3]=vptr[4];
-                    val_bigend[4]=vptr[3];
-                    val_bigend[5]=vptr[2];
-                    val_bigend[6]=vptr[1];
-                    val_bigend[7]=vptr[0];
-                    len = __builtin_bswap32(len);
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(val_bigend, sizeof(val));
-                }
-                else {
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                }
-                break;
-            }
-            case SDT_CHAR: {
-                int8_t val = row[j].AsInt8();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    // val is single byte, has no endianness
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                break;
-            }
-            case SDT_UCHAR: {
-                uint8_t val = row[j].AsUInt8();
-                int32_t len = sizeof(val);
-                if (!big_endian) {
-                    // val is single byte, has no endianness
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
+            // postgres float is alias for double
+            // flexbuf api requires type
+            case SDT_FLOAT:
+                out.appendPGField(static_cast<double>(row[j].AsFloat()));
                 break;
-            }
+            case SDT_DOUBLE: out.appendPGField(row[j].AsDouble()); break;
             case SDT_DATE: {
                 // postgres uses 4 byte int date vals, offset by pg epoch
-                std::string strdate = row[j].AsString().str();
-                int32_t len = 4;  // fixed, postgres date specification
-                boost::gregorian::date d = \
-                    boost::gregorian::from_string(strdate);
-                int32_t val = d.julian_day() - Tables::POSTGRES_EPOCH_JDATE;
-                if (!big_endian) {
-                    val = __builtin_bswap32(val);
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
+                size_t len = 0;
+                const char* str = root.dicts.getChars(row, j, &len);
+                out.appendPGField(pgBinaryDate(str, len));
                 break;
             }
             case SDT_STRING: {
-                std::string val = row[j].AsString().str();
-                int32_t len = val.length();
-                if (!big_endian) {
-                    // val is byte array, has no endianness
-                    len = __builtin_bswap32(len);
-                }
-                ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                ss.write(val.c_str(), static_cast<int>(val.length()));
+                size_t len = 0;
+                const char* str = root.dicts.getChars(row, j, &len);
+                out.appendPGField(str, static_cast<int32_t>(len));
                 break;
             }
             default: assert (TablesErrCodes::UnknownSkyDataType);
             }
         }
     }
-
-    // rewind and output all row data for this fb
-    ss.seekg (0, ios::beg);
-    std::cout << ss.rdbuf();
-    ss.flush();
     return counter;
 }
 
@@ -923,7 +889,8 @@ long long int printJSONAsCsv(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print) {
+        long long int max_to_print,
+        std::ostream& out) {
 
     // get root table ptr as sky struct
     sky_root root = getSkyRoot(dataptr, datasz, SFT_JSON);
@@ -937,14 +904,14 @@ long long int printJSONAsCsv(
     if (print_header) {
         bool first = true;
         for (schema_vec::iterator it = sc.begin(); it != sc.end(); ++it) {
-            if (!first) std::cout << CSV_DELIM;
+            if (!first) out << CSV_DELIM;
             first = false;
-            std::cout << it->name;
-            if (it->is_key) std::cout << "(key)";
-            if (!it->nullable) std::cout << "(NOT NULL)";
+            out << it->name;
+            if (it->is_key) out << "(key)";
+            if (!it->nullable) out << "(NOT NULL)";
 
         }
-        std::cout << std::endl; // newline to start first row.
+        out << std::endl; // newline to start first row.
     }
 
     // iterate over each row data (Record_FBX)
@@ -983,7 +950,7 @@ long long int printJSONAsCsv(
             // for each row, extract as json string and print cols
             // from each row according to schema_vec sc.
             json_str = data->Get(j)->str();
-            std::cout << "row[" << i << "]=" << json_str << std::endl;
+            out << "row[" << i << "]=" << json_str << std::endl;
 
             rapidjson::Document doc;
             doc.Parse(json_str.c_str());
@@ -998,11 +965,11 @@ long long int printJSONAsCsv(
 
             assert(d.HasMember("V"));
             assert(d["V"].IsString());
-            std::cout << d["V"].GetString() << std::endl;
+            out << d["V"].GetString() << std::endl;
 
             assert(d.HasMember("S"));
             assert(d["S"].IsString());
-            std::cout << d["S"].GetString() << std::endl;
+            out << d["S"].GetString() << std::endl;
         }
     }
     return counter;
@@ -1014,19 +981,20 @@ long long int printExampleFormatAsCsv(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print) {
+        long long int max_to_print,
+        std::ostream& out) {
 
     // convert dataptr to desired format, here just a char string.
     std::string formatted_data(dataptr);
 
     // print extra info from result data.
     if (print_verbose)
-        std::cout << "EXAMPLE VERBOSE METADATA";
+        out << "EXAMPLE VERBOSE METADATA";
 
     // print header row showing data schema
     if (print_header) {
-        std::cout << "EXAMPLE SCHEMA HEADER";
-        std::cout << std::endl; // newline to start first data row.
+        out << "EXAMPLE SCHEMA HEADER";
+        out << std::endl; // newline to start first data row.
     }
 
     std::vector<std::string> data_rows;
@@ -1037,15 +1005,111 @@ long long int printExampleFormatAsCsv(
     for (uint32_t i = 0; i < data_rows.size(); i++, counter++) {
         if (counter >= max_to_print)
             break;
-        std::cout << data_rows[i] <<std::endl;  // newline to start next row.
+        out << data_rows[i] <<std::endl;  // newline to start next row.
     }
     return counter;
 }
 
 
+// zstd level for compressed blobs, favoring speed over ratio as blobs are
+// compressed by cls on the result path.
+static const int BLOB_ZSTD_LEVEL = 1;
+
+/*
+ * Function: compressBlob
+ * Description: Compress a data blob with the given CompressionType.
+ * @param[in] compression : enum CompressionType, other than none
+ * @param[in] data        : Blob data
+ * @param[in] size        : Blob size in bytes
+ * @param[out] out        : Compressed blob, resized to its size
+ * Return Value: error code
+ */
+int compressBlob(int compression, const char* data, size_t size,
+                 std::vector<char>& out)
+{
+    switch (compression) {
+        case lz4: {
+            if (size > LZ4_MAX_INPUT_SIZE)
+                return BlobCompressionFailure;
+            out.resize(LZ4_compressBound(size));
+            int n = LZ4_compress_default(data, out.data(), size, out.size());
+            if (n <= 0)
+                return BlobCompressionFailure;
+            out.resize(n);
+            return 0;
+        }
+        case zstd: {
+            out.resize(ZSTD_compressBound(size));
+            size_t n = ZSTD_compress(out.data(), out.size(), data, size,
+                                     BLOB_ZSTD_LEVEL);
+            if (ZSTD_isError(n))
+                return BlobCompressionFailure;
+            out.resize(n);
+            return 0;
+        }
+        default:
+            return BlobCompressionTypeNotRecognized;
+    }
+}
+
+/*
+ * Function: decompressBlob
+ * Description: Decompress a data blob compressed by compressBlob.
+ * @param[in] compression : enum CompressionType, other than none
+ * @param[in] data        : Compressed blob data
+ * @param[in] size        : Compressed blob size in bytes
+ * @param[in] raw_size    : Blob size in bytes uncompressed
+ * @param[out] out        : Decompressed blob, resized to raw_size
+ * Return Value: error code
+ */
+int decompressBlob(int compression, const char* data, size_t size,
+                   size_t raw_size, std::vector<char>& out)
+{
+    out.resize(raw_size);
+    switch (compression) {
+        case lz4: {
+            int n = LZ4_decompress_safe(data, out.data(), size, raw_size);
+            if (n < 0 or static_cast<size_t>(n) != raw_size)
+                return BlobDecompressionFailure;
+            return 0;
+        }
+        case zstd: {
+            size_t n = ZSTD_decompress(out.data(), raw_size, data, size);
+            if (ZSTD_isError(n) or n != raw_size)
+                return BlobDecompressionFailure;
+            return 0;
+        }
+        default:
+            return BlobCompressionTypeNotRecognized;
+    }
+}
+
+/*
+ * Function: decompressSkyMeta
+ * Description: Decompress the blob of an fbmeta, if it is compressed, so it
+ *              can be processed like any other.  meta then refers to the
+ *              decompressed blob held in buf.
+ * @param[in,out] meta : fbmeta of the blob
+ * @param[out] buf     : Holds the decompressed blob, reused across calls
+ * Return Value: error code
+ */
+int decompressSkyMeta(sky_meta& meta, std::vector<char>& buf)
+{
+    if (meta.blob_compression == none)
+        return 0;
+    int ret = decompressBlob(meta.blob_compression, meta.blob_data,
+                             meta.blob_size, meta.blob_raw_size, buf);
+    if (ret != 0)
+        return ret;
+    meta.blob_compression = none;
+    meta.blob_data = buf.data();
+    meta.blob_size = buf.size();
+    return 0;
+}
+
 // creates an fb meta data structure to wrap the underlying data
-// format (SkyFormatType)
-void
+// format (SkyFormatType), compressing the data if requested
+int
 createFbMeta(
     flatbuffers::FlatBufferBuilder* meta_builder,
     int data_format,
@@ -1054,8 +1118,21 @@ createFbMeta(
     bool data_deleted,                 // def=false
     size_t data_orig_off,              // def=0
     size_t data_orig_len,              // def=0
-    CompressionType data_compression)  // def=none
+    int data_compression)              // def=none
 {
+    size_t raw_size = 0;
+    std::vector<char> compressed;
+    if (data_compression != none) {
+        int ret = compressBlob(data_compression,
+                               reinterpret_cast<const char*>(data),
+                               data_size, compressed);
+        if (ret != 0)
+            return ret;
+        raw_size = data_size;
+        data = reinterpret_cast<unsigned char*>(compressed.data());
+        data_size = compressed.size();
+    }
+
     flatbuffers::Offset<flatbuffers::Vector<unsigned char>> data_blob = \
             meta_builder->CreateVector(data, data_size);
 
@@ -1067,9 +1144,11 @@ createFbMeta(
             data_deleted,
             data_orig_off,
             data_orig_len,
-            data_compression);
+            data_compression,
+            raw_size);
     meta_builder->Finish(meta_offset);
     assert (meta_builder->GetSize()>0);   // temp check for debug only
+    return 0;
 }
 
 
@@ -1092,7 +1171,8 @@ sky_meta getSkyMeta(bufferlist *bl, bool is_meta, int data_format) {
             meta->blob_data()->size(), // blob actual size
 
             // serialized blob data
-            reinterpret_cast<const char*>(meta->blob_data()->Data()));
+            reinterpret_cast<const char*>(meta->blob_data()->Data()),
+            meta->blob_raw_size());   // blob size uncompressed, if compressed
     }
     else {
         return sky_meta(    // for testing new raw formats without meta wrapper
@@ -1120,6 +1200,7 @@ sky_root getSkyRoot(const char *ds, size_t ds_size, int ds_format) {
     delete_vector delete_vec;
     const void* data_vec;
     uint32_t nrows;
+    FbDicts dicts;
 
     switch (ds_format) {
 
@@ -1136,6 +1217,7 @@ sky_root getSkyRoot(const char *ds, size_t ds_size, int ds_format) {
                                        root->delete_vector()->end());
             data_vec = root->rows();
             nrows = root->nrows();
+            dicts = FbDicts(root);
             break;
         }
 
@@ -1194,7 +1276,8 @@ sky_root getSkyRoot(const char *ds, size_t ds_size, int ds_format) {
         table_name,
         delete_vec,
         data_vec,
-        nrows
+        nrows,
+        dicts
     );
 }
 
@@ -1237,6 +1320,152 @@ sky_rec getSkyRec(const Tables::Record* rec, int format) {
 *}
 */
 
+FbDicts::FbDicts(const Tables::Table* root) {
+    auto dv = root->dictionaries();
+    if (dv == NULL)
+        return;
+    for (unsigned i = 0; i < dv->size(); i++) {
+        const Tables::Dictionary* d = dv->Get(i);
+        int pos = d->col_idx();
+        if (pos < 0 or pos >= MAX_TABLE_COLS or d->values() == NULL)
+            continue;
+        if (pos >= static_cast<int>(cols.size()))
+            cols.resize(pos + 1, NULL);
+        cols[pos] = d->values();
+    }
+}
+
+const char* FbDicts::getChars(const flexbuffers::Vector& row, int pos,
+                              size_t* len) const {
+    const dict_values* dict = get(pos);
+    if (dict == NULL) {
+        flexbuffers::String s = row[pos].AsString();
+        *len = s.length();
+        return s.c_str();
+    }
+    uint32_t code = row[pos].AsUInt32();
+    if (code >= dict->size()) {
+        *len = 0;
+        return "";
+    }
+    const flatbuffers::String* s = dict->Get(code);
+    *len = s->size();
+    return s->c_str();
+}
+
+std::vector<int> FbDicts::positions() const {
+    std::vector<int> pos;
+    for (unsigned i = 0; i < cols.size(); i++) {
+        if (cols[i] != NULL)
+            pos.push_back(i);
+    }
+    return pos;
+}
+
+DictEncoder::DictEncoder(const std::vector<int>& encode_cols) {
+    for (auto it = encode_cols.begin(); it != encode_cols.end(); ++it) {
+        if (encodes(*it))
+            continue;
+        if (*it >= static_cast<int>(slots.size()))
+            slots.resize(*it + 1, -1);
+        slots[*it] = dicts.size();
+        dicts.push_back(col_dict());
+        dicts.back().pos = *it;
+    }
+}
+
+uint32_t DictEncoder::code(int pos, const char* s, size_t len) {
+    col_dict& d = dicts[slots[pos]];
+    auto ret = d.codes.emplace(std::string(s, len), d.values.size());
+    if (ret.second)
+        d.values.push_back(ret.first->first);
+    return ret.first->second;
+}
+
+flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>>>
+DictEncoder::finish(flatbuffers::FlatBufferBuilder& fbb) const {
+    if (dicts.empty())
+        return 0;
+    std::vector<flatbuffers::Offset<Tables::Dictionary>> offs;
+    for (auto it = dicts.begin(); it != dicts.end(); ++it) {
+        auto values = fbb.CreateVectorOfStrings(it->values);
+        offs.push_back(Tables::CreateDictionary(fbb, it->pos, values));
+    }
+    return fbb.CreateVector(offs);
+}
+
+void DictEncoder::clear() {
+    for (auto it = dicts.begin(); it != dicts.end(); ++it) {
+        it->codes.clear();
+        it->values.clear();
+    }
+}
+
+flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>>>
+copyDicts(flatbuffers::FlatBufferBuilder& fbb,
+          const FbDicts& dicts,
+          const std::vector<int>& src_pos) {
+    if (dicts.empty())
+        return 0;
+    std::vector<flatbuffers::Offset<Tables::Dictionary>> offs;
+    std::vector<flatbuffers::Offset<flatbuffers::String>> values;
+    for (unsigned j = 0; j < src_pos.size(); j++) {
+        const dict_values* dict = dicts.get(src_pos[j]);
+        if (dict == NULL)
+            continue;
+        values.clear();
+        for (unsigned i = 0; i < dict->size(); i++) {
+            const flatbuffers::String* s = dict->Get(i);
+            values.push_back(fbb.CreateString(s->c_str(), s->size()));
+        }
+        offs.push_back(Tables::CreateDictionary(fbb, j,
+                                                fbb.CreateVector(values)));
+    }
+    if (offs.empty())
+        return 0;
+    return fbb.CreateVector(offs);
+}
+
+void recodeFlexRow(flexbuffers::Builder& flexbldr,
+                   const flexbuffers::Vector& row,
+                   const schema_vec& data_schema,
+                   const FbDicts& src,
+                   DictEncoder& dst) {
+    flexbldr.Vector([&]() {
+        for (auto it = data_schema.begin(); it != data_schema.end(); ++it) {
+            int pos = it->idx;
+            if (pos < 0 or pos >= static_cast<int>(row.size()))
+                continue;  // RID and other special cols
+            switch (it->type) {
+                case SDT_BOOL: flexbldr.Add(row[pos].AsBool()); break;
+                case SDT_INT8:
+                case SDT_CHAR: flexbldr.Add(row[pos].AsInt8()); break;
+                case SDT_INT16: flexbldr.Add(row[pos].AsInt16()); break;
+                case SDT_INT32: flexbldr.Add(row[pos].AsInt32()); break;
+                case SDT_INT64: flexbldr.Add(row[pos].AsInt64()); break;
+                case SDT_UINT8:
+                case SDT_UCHAR: flexbldr.Add(row[pos].AsUInt8()); break;
+                case SDT_UINT16: flexbldr.Add(row[pos].AsUInt16()); break;
+                case SDT_UINT32: flexbldr.Add(row[pos].AsUInt32()); break;
+                case SDT_UINT64: flexbldr.Add(row[pos].AsUInt64()); break;
+                case SDT_FLOAT: flexbldr.Add(row[pos].AsFloat()); break;
+                case SDT_DOUBLE: flexbldr.Add(row[pos].AsDouble()); break;
+                case SDT_DATE:
+                case SDT_STRING: {
+                    size_t len = 0;
+                    const char* s = src.getChars(row, pos, &len);
+                    if (dst.encodes(pos))
+                        flexbldr.UInt(dst.code(pos, s, len));
+                    else
+                        flexbldr.String(s, len);
+                    break;
+                }
+                default: assert (TablesErrCodes::UnknownSkyDataType==0);
+            }
+        }
+    });
+}
+
 bool hasAggPreds(predicate_vec &preds) {
     for (auto it=preds.begin(); it!=preds.end();++it)
         if ((*it)->isGlobalAgg()) return true;
@@ -1245,7 +1474,8 @@ bool hasAggPreds(predicate_vec &preds) {
 
 // used by processFormat_X methods
 // returns true if the record passes all of the predicates (and/or)
-bool applyPredicates(predicate_vec& pv, sky_rec& rec) {
+// dicts are those of the flatbuf of rec, if any of its cols are encoded
+bool applyPredicates(predicate_vec& pv, sky_rec& rec, const FbDicts* dicts) {
 
     bool rowpass = false;
     bool init_rowpass = false;
@@ -1430,10 +1660,9 @@ bool applyPredicates(predicate_vec& pv, sky_rec& rec) {
                 TypedPredicate<char>* p= \
                         dynamic_cast<TypedPredicate<char>*>(*it);
                 if (p->opType() == SOT_like) {
-                    // use strings for regex
-                    std::string colval = row[p->colIdx()].AsString().str();
-                    std::string predval = std::to_string(p->Val());
-                    colpass = compare(colval,predval,p->opType(),p->colType());
+                    // match the pred's compiled pattern on the char
+                    const char colval = row[p->colIdx()].AsInt8();
+                    colpass = p->getMatcher()->match(&colval, 1);
                 }
                 else {
                     // use int val comparision method
@@ -1453,10 +1682,9 @@ bool applyPredicates(predicate_vec& pv, sky_rec& rec) {
                 TypedPredicate<unsigned char>* p = \
                         dynamic_cast<TypedPredicate<unsigned char>*>(*it);
                 if (p->opType() == SOT_like) {
-                    // use strings for regex
-                    std::string colval = row[p->colIdx()].AsString().str();
-                    std::string predval = std::to_string(p->Val());
-                    colpass = compare(colval,predval,p->opType(),p->colType());
+                    // match the pred's compiled pattern on the char
+                    const char colval = row[p->colIdx()].AsUInt8();
+                    colpass = p->getMatcher()->match(&colval, 1);
                 }
                 else {
                     // use int val comparision method
@@ -1476,8 +1704,25 @@ bool applyPredicates(predicate_vec& pv, sky_rec& rec) {
             case SDT_DATE: {
                 TypedPredicate<std::string>* p = \
                         dynamic_cast<TypedPredicate<std::string>*>(*it);
-                string colval = row[p->colIdx()].AsString().str();
-                colpass = compare(colval,p->Val(),p->opType(),p->colType());
+                if (dicts != NULL and dicts->get(p->colIdx()) != NULL) {
+                    string colval = dicts->getString(row, p->colIdx());
+                    if (p->opType() == SOT_like)
+                        colpass = p->getMatcher()->match(colval.c_str(),
+                                                         colval.length());
+                    else
+                        colpass = compare(colval, p->Val(), p->opType(),
+                                          p->colType());
+                }
+                else if (p->opType() == SOT_like) {
+                    // match in place on the flexbuf string
+                    auto colval = row[p->colIdx()].AsString();
+                    colpass = p->getMatcher()->match(colval.c_str(),
+                                                     colval.length());
+                }
+                else {
+                    string colval = row[p->colIdx()].AsString().str();
+                    colpass = compare(colval,p->Val(),p->opType(),p->colType());
+                }
                 break;
             }
 
@@ -1510,6 +1755,20 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
     bool init_rowpass = false;
 
     int num_cols = table->num_columns();
+
+    // element_index is a table row, find the chunk (record batch) holding
+    // it, all cols of a table read from an ipc stream are chunked alike.
+    int chunk_idx = 0;
+    int64_t chunk_row = element_index;
+    if (num_cols > 0) {
+        auto col_chunks = table->column(0);
+        while (chunk_idx < col_chunks->num_chunks() - 1 and
+               chunk_row >= col_chunks->chunk(chunk_idx)->length()) {
+            chunk_row -= col_chunks->chunk(chunk_idx)->length();
+            chunk_idx++;
+        }
+    }
+
     for (auto it = pv.begin(); it != pv.end(); ++it) {
 
         int chain_optype = (*it)->chainOpType();
@@ -1534,8 +1793,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_BOOL: {
                 TypedPredicate<bool>* p = \
                         dynamic_cast<TypedPredicate<bool>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                bool colval = std::static_pointer_cast<arrow::BooleanArray>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                bool colval = std::static_pointer_cast<arrow::BooleanArray>(array)->Value(chunk_row);
                 bool predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1547,8 +1806,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_INT8: {
                 TypedPredicate<int8_t>* p = \
                         dynamic_cast<TypedPredicate<int8_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                int8_t colval = std::static_pointer_cast<arrow::Int8Array>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                int8_t colval = std::static_pointer_cast<arrow::Int8Array>(array)->Value(chunk_row);
                 int8_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1562,8 +1821,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_INT16: {
                 TypedPredicate<int16_t>* p = \
                         dynamic_cast<TypedPredicate<int16_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                int16_t colval = std::static_pointer_cast<arrow::Int16Array>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                int16_t colval = std::static_pointer_cast<arrow::Int16Array>(array)->Value(chunk_row);
                 int16_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1577,8 +1836,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_INT32: {
                 TypedPredicate<int32_t>* p = \
                         dynamic_cast<TypedPredicate<int32_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                int32_t colval = std::static_pointer_cast<arrow::Int32Array>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                int32_t colval = std::static_pointer_cast<arrow::Int32Array>(array)->Value(chunk_row);
                 int32_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1592,11 +1851,11 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_INT64: {
                 TypedPredicate<int64_t>* p = \
                         dynamic_cast<TypedPredicate<int64_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
                 int64_t colval = 0;
                 if ((*it)->colIdx() == RID_COL_INDEX)
-                    array = table->column(ARROW_RID_INDEX(num_cols))->chunk(0);
-                colval = std::static_pointer_cast<arrow::Int64Array>(array)->Value(element_index);
+                    array = table->column(ARROW_RID_INDEX(num_cols))->chunk(chunk_idx);
+                colval = std::static_pointer_cast<arrow::Int64Array>(array)->Value(chunk_row);
                 int64_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1608,8 +1867,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_UINT8: {
                 TypedPredicate<uint8_t>* p = \
                         dynamic_cast<TypedPredicate<uint8_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                uint8_t colval = std::static_pointer_cast<arrow::UInt8Array>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                uint8_t colval = std::static_pointer_cast<arrow::UInt8Array>(array)->Value(chunk_row);
                 uint8_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1623,8 +1882,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_UINT16: {
                 TypedPredicate<uint16_t>* p = \
                         dynamic_cast<TypedPredicate<uint16_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                uint16_t colval = std::static_pointer_cast<arrow::UInt16Array>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                uint16_t colval = std::static_pointer_cast<arrow::UInt16Array>(array)->Value(chunk_row);
                 uint16_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1638,8 +1897,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_UINT32: {
                 TypedPredicate<uint32_t>* p = \
                         dynamic_cast<TypedPredicate<uint32_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                uint32_t colval = std::static_pointer_cast<arrow::UInt32Array>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                uint32_t colval = std::static_pointer_cast<arrow::UInt32Array>(array)->Value(chunk_row);
                 uint32_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1653,14 +1912,14 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_UINT64: {
                 TypedPredicate<uint64_t>* p = \
                         dynamic_cast<TypedPredicate<uint64_t>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
                 uint64_t colval = 0;
                 if ((*it)->colIdx() == RID_COL_INDEX) {
-                    array = table->column(ARROW_RID_INDEX(num_cols))->chunk(0);
-                    colval = std::static_pointer_cast<arrow::Int64Array>(array)->Value(element_index);
+                    array = table->column(ARROW_RID_INDEX(num_cols))->chunk(chunk_idx);
+                    colval = std::static_pointer_cast<arrow::Int64Array>(array)->Value(chunk_row);
                 }
                 else
-                    colval = std::static_pointer_cast<arrow::UInt64Array>(array)->Value(element_index);
+                    colval = std::static_pointer_cast<arrow::UInt64Array>(array)->Value(chunk_row);
                 uint64_t predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1672,8 +1931,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_FLOAT: {
                 TypedPredicate<float>* p = \
                         dynamic_cast<TypedPredicate<float>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                float colval = std::static_pointer_cast<arrow::FloatArray>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                float colval = std::static_pointer_cast<arrow::FloatArray>(array)->Value(chunk_row);
                 float predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1687,8 +1946,8 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_DOUBLE: {
                 TypedPredicate<double>* p = \
                         dynamic_cast<TypedPredicate<double>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                double colval = std::static_pointer_cast<arrow::DoubleArray>(array)->Value(element_index);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                double colval = std::static_pointer_cast<arrow::DoubleArray>(array)->Value(chunk_row);
                 double predval = p->Val();
                 if (p->isGlobalAgg())
                     p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1700,16 +1959,15 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_CHAR: {
                 TypedPredicate<char>* p= \
                         dynamic_cast<TypedPredicate<char>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
                 if (p->opType() == SOT_like) {
-                    // use strings for regex
-                    std::string colval = std::to_string((char)std::static_pointer_cast<arrow::Int8Array>(array)->Value(element_index));
-                    std::string predval = std::to_string(p->Val());
-                    colpass = compare(colval,predval,p->opType(),p->colType());
+                    // match the pred's compiled pattern on the char
+                    const char colval = std::static_pointer_cast<arrow::Int8Array>(array)->Value(chunk_row);
+                    colpass = p->getMatcher()->match(&colval, 1);
                 }
                 else {
                     // use int val comparision method
-                    int8_t colval = std::static_pointer_cast<arrow::Int8Array>(array)->Value(element_index);
+                    int8_t colval = std::static_pointer_cast<arrow::Int8Array>(array)->Value(chunk_row);
                     int8_t predval = p->Val();
                     if (p->isGlobalAgg())
                         p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1724,16 +1982,15 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_UCHAR: {
                 TypedPredicate<unsigned char>* p = \
                         dynamic_cast<TypedPredicate<unsigned char>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
                 if (p->opType() == SOT_like) {
-                    // use strings for regex
-                    std::string colval = std::to_string((char)std::static_pointer_cast<arrow::UInt8Array>(array)->Value(element_index));
-                    std::string predval = std::to_string(p->Val());
-                    colpass = compare(colval,predval,p->opType(),p->colType());
+                    // match the pred's compiled pattern on the char
+                    const char colval = std::static_pointer_cast<arrow::UInt8Array>(array)->Value(chunk_row);
+                    colpass = p->getMatcher()->match(&colval, 1);
                 }
                 else {
                     // use int val comparision method
-                    uint8_t colval = std::static_pointer_cast<arrow::UInt8Array>(array)->Value(element_index);
+                    uint8_t colval = std::static_pointer_cast<arrow::UInt8Array>(array)->Value(chunk_row);
                     uint8_t predval = p->Val();
                     if (p->isGlobalAgg())
                         p->updateAgg(computeAgg(colval,predval,p->opType()));
@@ -1749,9 +2006,19 @@ bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& tabl
             case SDT_DATE: {
                 TypedPredicate<std::string>* p = \
                         dynamic_cast<TypedPredicate<std::string>*>(*it);
-                auto array = table->column(p->colIdx())->chunk(0);
-                string colval = std::static_pointer_cast<arrow::StringArray>(array)->GetString(element_index);
-                colpass = compare(colval,p->Val(),p->opType(),p->colType());
+                auto array = table->column(p->colIdx())->chunk(chunk_idx);
+                auto str_array = std::static_pointer_cast<arrow::StringArray>(array);
+                if (p->opType() == SOT_like) {
+                    // match in place on the arrow value buffer
+                    int32_t len = 0;
+                    const uint8_t* colval = str_array->GetValue(chunk_row, &len);
+                    colpass = p->getMatcher()->match(
+                        reinterpret_cast<const char*>(colval), len);
+                }
+                else {
+                    string colval = str_array->GetString(chunk_row);
+                    colpass = compare(colval,p->Val(),p->opType(),p->colType());
+                }
                 break;
             }
 
@@ -1935,11 +2202,10 @@ void applyPredicatesArrowCol(predicate_vec& pv,
                     TypedPredicate<char>* p=                        \
                         dynamic_cast<TypedPredicate<char>*>(*it);
                     if (p->opType() == SOT_like) {
-                        // use strings for regex
-                        std::string colval =                            \
-                            std::to_string((char)std::static_pointer_cast<arrow::Int8Array>(col_array)->Value(row_idx));
-                        std::string predval = std::to_string(p->Val());
-                        if (compare(colval,predval,p->opType(),p->colType()))
+                        // match the pred's compiled pattern on the char
+                        const char colval =                             \
+                            std::static_pointer_cast<arrow::Int8Array>(col_array)->Value(row_idx);
+                        if (p->getMatcher()->match(&colval, 1))
                             passed_rows.push_back(row_idx);
                     }
                     else {
@@ -1957,10 +2223,9 @@ void applyPredicatesArrowCol(predicate_vec& pv,
                     TypedPredicate<unsigned char>* p =                  \
                         dynamic_cast<TypedPredicate<unsigned char>*>(*it);
                     if (p->opType() == SOT_like) {
-                        // use strings for regex
-                        std::string colval = std::to_string((char)std::static_pointer_cast<arrow::UInt8Array>(col_array)->Value(row_idx));
-                        std::string predval = std::to_string(p->Val());
-                        if (compare(colval, predval, p->opType(), p->colType()))
+                        // match the pred's compiled pattern on the char
+                        const char colval = std::static_pointer_cast<arrow::UInt8Array>(col_array)->Value(row_idx);
+                        if (p->getMatcher()->match(&colval, 1))
                             passed_rows.push_back(row_idx);
                     }
                     else {
@@ -1977,9 +2242,20 @@ void applyPredicatesArrowCol(predicate_vec& pv,
                 case SDT_DATE: {
                     TypedPredicate<std::string>* p =                    \
                         dynamic_cast<TypedPredicate<std::string>*>(*it);
-                    string colval = std::static_pointer_cast<arrow::StringArray>(col_array)->GetString(row_idx);
-                    if (compare(colval, p->Val(), p->opType(), p->colType()))
+                    auto str_array = std::static_pointer_cast<arrow::StringArray>(col_array);
+                    if (p->opType() == SOT_like) {
+                        // match in place on the arrow value buffer
+                        int32_t len = 0;
+                        const uint8_t* colval = str_array->GetValue(row_idx, &len);
+                        if (p->getMatcher()->match(
+                                reinterpret_cast<const char*>(colval), len))
                             passed_rows.push_back(row_idx);
+                    }
+                    else {
+                        string colval = str_array->GetString(row_idx);
+                        if (compare(colval, p->Val(), p->opType(), p->colType()))
+                            passed_rows.push_back(row_idx);
+                    }
                     break;
                 }
                 default: assert (TablesErrCodes::PredicateComparisonNotDefined==0);
@@ -2081,7 +2357,61 @@ bool compare(const double& val1, const double& val2, const int& op) {
     return false;  // should be unreachable
 }
 
-// used for date types or regex on alphanumeric types
+LikeMatcher::LikeMatcher(const std::string& pattern) :
+    regx(pattern),
+    match_kind(LIKE_REGEX) {
+
+    // anchors only, the rest must be free of regex syntax to be a literal
+    size_t start = 0;
+    size_t end = pattern.size();
+    bool anchor_start = end > 0 and pattern[0] == '^';
+    if (anchor_start)
+        start++;
+    bool anchor_end = end > start and pattern[end - 1] == '$' and
+                      (end < 2 or pattern[end - 2] != '\\');
+    if (anchor_end)
+        end--;
+
+    std::string lit = pattern.substr(start, end - start);
+    if (lit.find_first_of(".[]()*+?{}|\\^$") != std::string::npos)
+        return;
+
+    literal = lit;
+    if (literal.empty() and !(anchor_start and anchor_end))
+        match_kind = LIKE_ANY;
+    else if (anchor_start and anchor_end)
+        match_kind = LIKE_EXACT;
+    else if (anchor_start)
+        match_kind = LIKE_PREFIX;
+    else if (anchor_end)
+        match_kind = LIKE_SUFFIX;
+    else
+        match_kind = LIKE_CONTAINS;
+}
+
+bool LikeMatcher::match(const char* s, size_t len) const {
+
+    const size_t n = literal.size();
+    switch (match_kind) {
+        case LIKE_ANY:
+            return true;
+        case LIKE_EXACT:
+            return len == n and memcmp(s, literal.data(), n) == 0;
+        case LIKE_PREFIX:
+            return len >= n and memcmp(s, literal.data(), n) == 0;
+        case LIKE_SUFFIX:
+            return len >= n and memcmp(s + len - n, literal.data(), n) == 0;
+        case LIKE_CONTAINS:
+            if (n == 1)
+                return memchr(s, literal[0], len) != NULL;
+            return memmem(s, len, literal.data(), n) != NULL;
+        default:
+            return RE2::PartialMatch(re2::StringPiece(s, len), regx);
+    }
+}
+
+// used for date types, regex on alphanumeric types, and the lexicographic
+// comparison and in/not_in membership of string types
 bool compare(const std::string& val1, const std::string& val2, const int& op, const int& data_type) {
 switch(data_type){
     case SDT_DATE:{
@@ -2100,9 +2430,29 @@ switch(data_type){
         }
         break;
     }
+    case SDT_STRING: {
+        switch (op) {
+            case SOT_like: return RE2::PartialMatch(val1, RE2(val2));
+            case SOT_lt: return val1 < val2;
+            case SOT_gt: return val1 > val2;
+            case SOT_eq: return val1 == val2;
+            case SOT_ne: return val1 != val2;
+            case SOT_leq: return val1 <= val2;
+            case SOT_geq: return val1 >= val2;
+            case SOT_in:
+            case SOT_not_in: {
+                vector<std::string> members;
+                boost::split(members, val2, boost::is_any_of(PRED_IN_DELIM));
+                bool found = std::find(members.begin(), members.end(),
+                                       val1) != members.end();
+                return (op == SOT_in) == found;
+            }
+            default: assert (TablesErrCodes::PredicateComparisonNotDefined==0);
+        }
+        break;
+    }
     case SDT_CHAR:
     case SDT_UCHAR:
-    case SDT_STRING:
             if (op == SOT_like) return RE2::PartialMatch(val1, RE2(val2));
             else assert (TablesErrCodes::PredicateComparisonNotDefined==0);
         break;
@@ -2131,45 +2481,258 @@ bool compare(const bool& val1, const bool& val2, const int& op) {
     return false;  // should be unreachable
 }
 
-// for our rocksdb entries, this creates the value portion by padding int
-// values and create a representative string.
-// Format of keys is like IDX_REC:*-LINEITEM:LINENUMBER-ORDERKEY:00000000000000000001-00000000000000000006
-// the data portion of this key is: "00000000000000000001-00000000000000000006"
-std::string buildKeyData(int data_type, uint64_t new_data) {
-    std::string data_str = u64tostr(new_data);
-    int len = data_str.length();
-    int pos = 0;  // pos in u64string to get the minimum keychars for type
-    switch (data_type) {
-        case SDT_BOOL:
-            pos = len-1;
-            break;
-        case SDT_CHAR:
-        case SDT_UCHAR:
-        case SDT_INT8:
-        case SDT_UINT8:
-            pos = len-3;
-            break;
-        case SDT_INT16:
-        case SDT_UINT16:
-            pos = len-5;
-            break;
-        case SDT_INT32:
-        case SDT_UINT32:
-            pos = len-10;
-            break;
-        case SDT_INT64:
-        case SDT_UINT64:
-            pos = 0;
-            break;
+void RowBitmap::set(uint32_t row) {
+    uint32_t w = row >> 6;
+    if (words.empty()) {
+        base = w;
+        words.push_back(0);
     }
-    return data_str.substr(pos, len);
+    else if (w < base) {
+        words.insert(words.begin(), base - w, 0);
+        base = w;
+    }
+    else if (w >= base + words.size()) {
+        words.resize(w - base + 1, 0);
+    }
+    words[w - base] |= (1ULL << (row & 63));
 }
 
-// for our rocksdb key, create the prefix based on the index type, the
-// dbschema name (Table Group), the table name, and the cols contained
-// in the key, for multi-col indexes.
-// Format of keys is like IDX_REC:*-LINEITEM:LINENUMBER-ORDERKEY:00000000000000000001-00000000000000000006
-// the prefix portion of this key is: "IDX_REC:*-LINEITEM:LINENUMBER-ORDERKEY"
+bool RowBitmap::test(uint32_t row) const {
+    uint32_t w = row >> 6;
+    if (w < base or w >= base + words.size())
+        return false;
+    return (words[w - base] >> (row & 63)) & 1;
+}
+
+uint32_t RowBitmap::count() const {
+    uint32_t n = 0;
+    for (auto w : words)
+        n += __builtin_popcountll(w);
+    return n;
+}
+
+void RowBitmap::andWith(const RowBitmap& other) {
+    uint32_t lo = std::max(base, other.base);
+    uint32_t hi = std::min(base + words.size(),
+                           other.base + other.words.size());
+    if (lo >= hi) {
+        words.clear();
+        base = 0;
+        return;
+    }
+    std::vector<uint64_t> result(hi - lo);
+    for (uint32_t w = lo; w < hi; w++)
+        result[w - lo] = words[w - base] & other.words[w - other.base];
+    words.swap(result);
+    base = lo;
+    trim();
+}
+
+void RowBitmap::orWith(const RowBitmap& other) {
+    if (other.words.empty())
+        return;
+    if (words.empty()) {
+        *this = other;
+        return;
+    }
+    uint32_t lo = std::min(base, other.base);
+    uint32_t hi = std::max(base + words.size(),
+                           other.base + other.words.size());
+    std::vector<uint64_t> result(hi - lo, 0);
+    for (uint32_t i = 0; i < words.size(); i++)
+        result[base - lo + i] = words[i];
+    for (uint32_t i = 0; i < other.words.size(); i++)
+        result[other.base - lo + i] |= other.words[i];
+    words.swap(result);
+    base = lo;
+}
+
+void RowBitmap::toRowNums(std::vector<uint32_t>& out) const {
+    for (size_t i = 0; i < words.size(); i++) {
+        uint64_t w = words[i];
+        while (w) {
+            uint32_t bit = __builtin_ctzll(w);
+            out.push_back(((base + i) * 64) + bit);
+            w &= w - 1;
+        }
+    }
+}
+
+std::string RowBitmap::toString() const {
+    std::string s("RowBitmap:");
+    s.append(" first_word=" + std::to_string(base));
+    s.append(" nwords=" + std::to_string(words.size()));
+    s.append(" rows=" + std::to_string(count()));
+    return s;
+}
+
+void RowBitmap::trim() {
+    size_t first = 0;
+    while (first < words.size() and words[first] == 0)
+        first++;
+    if (first == words.size()) {
+        words.clear();
+        base = 0;
+        return;
+    }
+    size_t last = words.size();
+    while (words[last - 1] == 0)
+        last--;
+    words.erase(words.begin() + last, words.end());
+    words.erase(words.begin(), words.begin() + first);
+    base += first;
+}
+
+static void appendVarint(std::string& s, uint32_t v) {
+    while (v >= 0x80) {
+        s.push_back(static_cast<char>(v | 0x80));
+        v >>= 7;
+    }
+    s.push_back(static_cast<char>(v));
+}
+
+static uint32_t readVarint(const std::string& s, size_t& off) {
+    uint32_t v = 0;
+    for (int shift = 0; off < s.size() and shift < 32; shift += 7) {
+        uint8_t b = static_cast<uint8_t>(s[off++]);
+        v |= static_cast<uint32_t>(b & 0x7f) << shift;
+        if ((b & 0x80) == 0)
+            break;
+    }
+    return v;
+}
+
+void encodeTxtPostings(const txt_postings_vec& postings,
+                       struct idx_txt_postings& list) {
+    list = idx_txt_postings();
+    appendTxtPostings(postings, list);
+}
+
+void appendTxtPostings(const txt_postings_vec& postings,
+                       struct idx_txt_postings& list) {
+
+    // the last posting of the list, decoding only its last block
+    txt_posting prev = {0, 0};
+    if (list.npostings > 0) {
+        TxtPostingsCursor c(list);
+        c.seek({list.block_fbs.back(), list.block_rows.back()});
+        for (; c.valid(); c.next())
+            prev = c.value();
+    }
+
+    for (auto it = postings.begin(); it != postings.end(); ++it) {
+        const txt_posting& p = *it;
+        if (list.npostings > 0 and !(prev < p))
+            continue;  // not after the list, already posted
+        if (list.npostings % TXT_POSTINGS_BLOCK == 0) {
+            list.block_fbs.push_back(p.fb_num);
+            list.block_rows.push_back(p.row_num);
+            list.block_offs.push_back(list.deltas.size());
+        }
+        else {
+            // the fb delta, then the row delta within the same fb, else
+            // the row num itself since rows restart from 0 in each fb.
+            appendVarint(list.deltas, p.fb_num - prev.fb_num);
+            appendVarint(list.deltas, p.fb_num == prev.fb_num ?
+                                      p.row_num - prev.row_num : p.row_num);
+        }
+        list.npostings++;
+        prev = p;
+    }
+}
+
+TxtPostingsCursor::TxtPostingsCursor(const struct idx_txt_postings& _list) :
+    list(_list),
+    pos(0),
+    off(0),
+    cur({0, 0}) {
+        if (valid())
+            loadBlock(0);
+}
+
+void TxtPostingsCursor::loadBlock(uint32_t block) {
+    pos = block * TXT_POSTINGS_BLOCK;
+    off = list.block_offs[block];
+    cur.fb_num = list.block_fbs[block];
+    cur.row_num = list.block_rows[block];
+}
+
+void TxtPostingsCursor::next() {
+    pos++;
+    if (!valid())
+        return;
+    if (pos % TXT_POSTINGS_BLOCK == 0) {
+        loadBlock(pos / TXT_POSTINGS_BLOCK);
+        return;
+    }
+    uint32_t fb_delta = readVarint(list.deltas, off);
+    uint32_t row = readVarint(list.deltas, off);
+    cur.row_num = (fb_delta == 0) ? cur.row_num + row : row;
+    cur.fb_num += fb_delta;
+}
+
+void TxtPostingsCursor::seek(const txt_posting& target) {
+    if (!valid() or !(cur < target))
+        return;
+
+    // jump to the last block starting at or before target, if it is after
+    // the current block, then decode up to target within it.
+    uint32_t block = pos / TXT_POSTINGS_BLOCK;
+    uint32_t lo = block + 1;
+    uint32_t hi = list.block_fbs.size();
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        txt_posting first = {list.block_fbs[mid], list.block_rows[mid]};
+        if (target < first)
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+    if (lo - 1 > block)
+        loadBlock(lo - 1);
+    while (valid() and cur < target)
+        next();
+}
+
+// for our rocksdb entries, this creates the value portion by padding int
+// values and create a representative string.
+// Format of keys is like IDX_REC:*-LINEITEM:LINENUMBER-ORDERKEY:00000000000000000001-00000000000000000006
+// the data portion of this key is: "00000000000000000001-00000000000000000006"
+std::string buildKeyData(int data_type, uint64_t new_data) {
+    std::string data_str = u64tostr(new_data);
+    int len = data_str.length();
+    int pos = 0;  // pos in u64string to get the minimum keychars for type
+    switch (data_type) {
+        case SDT_BOOL:
+            pos = len-1;
+            break;
+        case SDT_CHAR:
+        case SDT_UCHAR:
+        case SDT_INT8:
+        case SDT_UINT8:
+            pos = len-3;
+            break;
+        case SDT_INT16:
+        case SDT_UINT16:
+            pos = len-5;
+            break;
+        case SDT_INT32:
+        case SDT_UINT32:
+            pos = len-10;
+            break;
+        case SDT_INT64:
+        case SDT_UINT64:
+            pos = 0;
+            break;
+    }
+    return data_str.substr(pos, len);
+}
+
+// for our rocksdb key, create the prefix based on the index type, the
+// dbschema name (Table Group), the table name, and the cols contained
+// in the key, for multi-col indexes.
+// Format of keys is like IDX_REC:*-LINEITEM:LINENUMBER-ORDERKEY:00000000000000000001-00000000000000000006
+// the prefix portion of this key is: "IDX_REC:*-LINEITEM:LINENUMBER-ORDERKEY"
 std::string buildKeyPrefix(
         int idx_type,
         std::string schema_name,
@@ -2213,6 +2776,9 @@ std::string buildKeyPrefix(
     case SIT_IDX_TXT:
         idx_type_str =  SkyIdxTypeMap.at(SIT_IDX_TXT);
         break;
+    case SIT_IDX_ZONE:
+        idx_type_str =  SkyIdxTypeMap.at(SIT_IDX_ZONE);
+        break;
     default:
         idx_type_str = "IDX_UNK";
     }
@@ -2372,6 +2938,953 @@ void extract_typedpred_val(Tables::PredicateBase* pb, uint64_t& val) {
     }
 }
 
+std::vector<std::vector<std::string>> textPredTerms(PredicateBase* pb) {
+
+    std::vector<std::vector<std::string>> terms;
+    TypedPredicate<std::string>* p = \
+        dynamic_cast<TypedPredicate<std::string>*>(pb);
+    if (p == NULL)
+        return terms;
+
+    std::string val = boost::algorithm::to_lower_copy(p->Val());
+    boost::trim(val);
+    if (val.empty())
+        return terms;
+
+    vector<std::string> groups;
+    boost::split(groups, val, boost::is_any_of(" \t\r\f\v\n"),
+                 boost::token_compress_on);
+    for (auto it = groups.begin(); it != groups.end(); ++it) {
+        vector<std::string> alts;
+        boost::split(alts, *it, boost::is_any_of("|"),
+                     boost::token_compress_on);
+        alts.erase(std::remove(alts.begin(), alts.end(), std::string()),
+                   alts.end());
+        if (!alts.empty())
+            terms.push_back(alts);
+    }
+    return terms;
+}
+
+std::string textTermsRegex(const std::vector<std::string>& alternatives) {
+    std::string alts;
+    for (auto it = alternatives.begin(); it != alternatives.end(); ++it) {
+        if (!alts.empty())
+            alts += "|";
+        alts += RE2::QuoteMeta(*it);
+    }
+    return "(?i)(^|\\s)(" + alts + ")(\\s|$)";
+}
+
+std::string buildColStatsKey(
+        std::string schema_name,
+        std::string table_name,
+        std::string colname) {
+
+    boost::trim(schema_name);
+    boost::trim(table_name);
+    if (schema_name.empty())
+        schema_name = DBSCHEMA_NAME_DEFAULT;
+    if (table_name.empty())
+        table_name = TABLE_NAME_DEFAULT;
+
+    return (
+        COL_STATS_KEY_PREFIX + IDX_KEY_DELIM_OUTER +
+        schema_name + IDX_KEY_DELIM_INNER +
+        table_name + IDX_KEY_DELIM_OUTER +
+        colname
+    );
+}
+
+bool stats_val_to_double(int col_type, const std::string& s, double* val) {
+
+    try {
+        switch (col_type) {
+            case SDT_INT8:
+            case SDT_INT16:
+            case SDT_INT32:
+            case SDT_INT64:
+            case SDT_UINT8:
+            case SDT_UINT16:
+            case SDT_UINT32:
+            case SDT_UINT64:
+            case SDT_FLOAT:
+            case SDT_DOUBLE:
+                *val = std::stod(s);
+                return true;
+            case SDT_CHAR:
+            case SDT_UCHAR:
+            case SDT_BOOL:
+                // stored as their numeric value
+                *val = std::stod(s);
+                return true;
+            case SDT_DATE: {
+                boost::gregorian::date d = boost::gregorian::from_string(s);
+                *val = static_cast<double>(d.day_number());
+                return true;
+            }
+            default:
+                return false;
+        }
+    }
+    catch (...) {
+        return false;
+    }
+}
+
+bool pred_val_to_double(Tables::PredicateBase* pb, double* val) {
+
+    switch (pb->colType()) {
+        case SDT_INT8:
+        case SDT_INT16:
+        case SDT_INT32:
+        case SDT_INT64: {
+            int64_t v = 0;
+            extract_typedpred_val(pb, v);
+            *val = static_cast<double>(v);
+            return true;
+        }
+        case SDT_UINT8:
+        case SDT_UINT16:
+        case SDT_UINT32:
+        case SDT_UINT64: {
+            uint64_t v = 0;
+            extract_typedpred_val(pb, v);
+            *val = static_cast<double>(v);
+            return true;
+        }
+        case SDT_CHAR: {
+            TypedPredicate<char>* p = dynamic_cast<TypedPredicate<char>*>(pb);
+            *val = static_cast<double>(p->Val());
+            return true;
+        }
+        case SDT_UCHAR: {
+            TypedPredicate<unsigned char>* p = \
+                dynamic_cast<TypedPredicate<unsigned char>*>(pb);
+            *val = static_cast<double>(p->Val());
+            return true;
+        }
+        case SDT_BOOL: {
+            TypedPredicate<bool>* p = dynamic_cast<TypedPredicate<bool>*>(pb);
+            *val = static_cast<double>(p->Val());
+            return true;
+        }
+        case SDT_FLOAT: {
+            TypedPredicate<float>* p = dynamic_cast<TypedPredicate<float>*>(pb);
+            *val = static_cast<double>(p->Val());
+            return true;
+        }
+        case SDT_DOUBLE: {
+            TypedPredicate<double>* p = \
+                dynamic_cast<TypedPredicate<double>*>(pb);
+            *val = p->Val();
+            return true;
+        }
+        case SDT_DATE: {
+            TypedPredicate<std::string>* p = \
+                dynamic_cast<TypedPredicate<std::string>*>(pb);
+            return stats_val_to_double(SDT_DATE, p->Val(), val);
+        }
+        default:
+            return false;
+    }
+}
+
+static double default_pred_selectivity(int op_type) {
+    switch (op_type) {
+        case SOT_eq: return SELECTIVITY_DEFAULT_EQ;
+        case SOT_ne: return 1.0 - SELECTIVITY_DEFAULT_EQ;
+        case SOT_lt:
+        case SOT_gt:
+        case SOT_leq:
+        case SOT_geq:
+        case SOT_like:
+        case SOT_before:
+        case SOT_after:
+            return SELECTIVITY_DEFAULT_RANGE;
+        default:
+            return 1.0;
+    }
+}
+
+/*
+ * Estimate the fraction of rows passing a pred from its col's histogram.
+ * The col_stats hist is nbins equi-width bins over [min_val, max_val], and
+ * values within a bin are assumed uniformly distributed.  Eq selectivity
+ * assumes each distinct value in a bin is equally frequent, where the
+ * distinct count of a bin is bounded by its width for discrete types.
+ */
+double estimate_pred_selectivity(Tables::PredicateBase* pb,
+                                 const col_stats& stats) {
+
+    int op_type = pb->opType();
+    double v, lo, hi;
+    if (stats.nbins == 0 or stats.hist.size() < stats.nbins or
+        !pred_val_to_double(pb, &v) or
+        !stats_val_to_double(stats.col_type, stats.min_val, &lo) or
+        !stats_val_to_double(stats.col_type, stats.max_val, &hi) or
+        hi < lo)
+        return default_pred_selectivity(op_type);
+
+    double total = 0;
+    for (unsigned i = 0; i < stats.nbins; i++)
+        total += stats.hist[i];
+    if (total <= 0)
+        return default_pred_selectivity(op_type);
+
+    bool discrete = stats.col_type != SDT_FLOAT and
+                    stats.col_type != SDT_DOUBLE;
+    double width = (hi - lo) / stats.nbins;
+
+    // bin edges are the equi-depth bounds if present, else equi-width.
+    std::vector<double> edges(stats.nbins + 1);
+    bool equi_depth = stats.bounds.size() == stats.nbins + 1;
+    for (unsigned i = 0; i <= stats.nbins; i++) {
+        edges[i] = lo + i * width;
+        if (equi_depth and
+            !stats_val_to_double(stats.col_type, stats.bounds[i], &edges[i]))
+            return default_pred_selectivity(op_type);
+    }
+
+    // frac of rows < v, and frac of rows == v
+    double frac_lt = 0;
+    double frac_eq = 0;
+    if (v < lo) {
+        frac_lt = 0;
+    }
+    else if (v > hi) {
+        frac_lt = 1;
+    }
+    else if (width == 0) {
+        frac_eq = 1;  // single valued col
+    }
+    else {
+        for (unsigned i = 0; i < stats.nbins; i++) {
+            double bin_lo = edges[i];
+            double bin_hi = edges[i + 1];
+            bool last = (i == stats.nbins - 1);
+            if (bin_hi < v or (bin_hi == v and bin_lo < bin_hi and !last)) {
+                frac_lt += stats.hist[i];
+            }
+            else if (bin_lo == bin_hi) {
+                // equi-depth bin of a single frequent value
+                if (bin_lo == v)
+                    frac_eq += stats.hist[i];
+            }
+            else if (bin_lo <= v) {
+                frac_lt += stats.hist[i] * (v - bin_lo) / (bin_hi - bin_lo);
+
+                // distinct vals in the bin, by its share of the col's rows
+                double ndistinct = stats.hist[i];
+                if (stats.distinct_count > 0)
+                    ndistinct = std::max(1.0,
+                        stats.distinct_count * stats.hist[i] / total);
+                if (discrete)
+                    ndistinct = std::min(ndistinct,
+                        std::max(1.0, std::ceil(bin_hi - bin_lo)));
+                if (ndistinct > 0)
+                    frac_eq += stats.hist[i] / ndistinct;
+            }
+        }
+        frac_lt /= total;
+        frac_eq /= total;
+    }
+
+    double sel;
+    switch (op_type) {
+        case SOT_eq: sel = frac_eq; break;
+        case SOT_ne: sel = 1 - frac_eq; break;
+        case SOT_lt:
+        case SOT_before:
+            sel = frac_lt; break;
+        case SOT_leq: sel = frac_lt + frac_eq; break;
+        case SOT_gt:
+        case SOT_after:
+            sel = 1 - frac_lt - frac_eq; break;
+        case SOT_geq: sel = 1 - frac_lt; break;
+        default:
+            return default_pred_selectivity(op_type);
+    }
+
+    // hist only counts non-null rows, and nulls never pass a comparison
+    if (stats.nrows > 0 and stats.null_count <= stats.nrows)
+        sel *= static_cast<double>(stats.nrows - stats.null_count) /
+               stats.nrows;
+    return std::min(1.0, std::max(0.0, sel));
+}
+
+/*
+ * Estimate the fraction of rows passing all (and-ed) preds.  Preds on the
+ * same col are combined as an interval, i.e., each pred excludes the rows
+ * it rejects, so a lower and upper bound give the rows between them.
+ * Preds on different cols are assumed independent, as for multicol
+ * equality over a multicol index.
+ */
+double estimate_selectivity(const predicate_vec& preds,
+                            const std::map<int, col_stats>& stats,
+                            bool* have_stats) {
+
+    *have_stats = true;
+    std::map<int, double> col_sel;  // col idx to its selectivity
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        PredicateBase* pb = *it;
+        if (pb->isGlobalAgg())
+            continue;
+
+        double sel;
+        auto its = stats.find(pb->colIdx());
+        if (its == stats.end()) {
+            *have_stats = false;
+            sel = default_pred_selectivity(pb->opType());
+        }
+        else {
+            sel = estimate_pred_selectivity(pb, its->second);
+        }
+
+        // start with all rows for the col, remove those rejected by pred
+        auto itc = col_sel.find(pb->colIdx());
+        if (itc == col_sel.end())
+            itc = col_sel.insert(std::make_pair(pb->colIdx(), 1.0)).first;
+        itc->second = std::max(0.0, itc->second - (1.0 - sel));
+    }
+
+    double sel = 1.0;
+    for (auto it = col_sel.begin(); it != col_sel.end(); ++it)
+        sel *= it->second;
+    return sel;
+}
+
+void distinct_sketch::add(uint64_t hash) {
+
+    uint64_t idx = hash >> (64 - STATS_SKETCH_BITS);
+    uint64_t rest = (hash << STATS_SKETCH_BITS) |
+                    (1ULL << (STATS_SKETCH_BITS - 1));  // bounds the rank
+    uint8_t rank = __builtin_clzll(rest) + 1;
+    if (rank > regs[idx])
+        regs[idx] = rank;
+}
+
+void distinct_sketch::merge(const distinct_sketch& other) {
+    for (unsigned i = 0; i < regs.size(); i++)
+        regs[i] = std::max(regs[i], other.regs[i]);
+}
+
+uint64_t distinct_sketch::estimate() const {
+
+    double m = regs.size();
+    double sum = 0;
+    unsigned zeros = 0;
+    for (unsigned i = 0; i < regs.size(); i++) {
+        sum += std::ldexp(1.0, -regs[i]);
+        if (regs[i] == 0)
+            zeros++;
+    }
+    if (zeros == regs.size())
+        return 0;
+
+    double alpha = 0.7213 / (1 + 1.079 / m);
+    double est = alpha * m * m / sum;
+    if (est <= 2.5 * m and zeros > 0)
+        est = m * std::log(m / zeros);  // small range correction
+    return static_cast<uint64_t>(std::llround(est));
+}
+
+// splitmix64 finalizer, spreads the bits of ints for the sketch
+uint64_t distinct_sketch::hash_int(uint64_t v) {
+    v += 0x9e3779b97f4a7c15ULL;
+    v = (v ^ (v >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    v = (v ^ (v >> 27)) * 0x94d049bb133111ebULL;
+    return v ^ (v >> 31);
+}
+
+uint64_t distinct_sketch::hash_str(const std::string& s) {
+    return hash_int(std::hash<std::string>()(s));
+}
+
+col_summary::col_summary(int type) :
+    col_type(type),
+    numeric(type != SDT_STRING and type != SDT_DATE),
+    nsampled(0),
+    nnulls(0),
+    have_val(false),
+    imin(0), imax(0),
+    umin(0), umax(0),
+    dmin(0), dmax(0) {}
+
+void col_summary::add(int64_t v) {
+    if (!have_val or v < imin) imin = v;
+    if (!have_val or v > imax) imax = v;
+    have_val = true;
+    nsampled++;
+    vals.push_back(static_cast<double>(v));
+    sketch.add(distinct_sketch::hash_int(static_cast<uint64_t>(v)));
+}
+
+void col_summary::add(uint64_t v) {
+    if (!have_val or v < umin) umin = v;
+    if (!have_val or v > umax) umax = v;
+    have_val = true;
+    nsampled++;
+    vals.push_back(static_cast<double>(v));
+    sketch.add(distinct_sketch::hash_int(v));
+}
+
+void col_summary::add(double v) {
+    if (!have_val or v < dmin) dmin = v;
+    if (!have_val or v > dmax) dmax = v;
+    have_val = true;
+    nsampled++;
+    vals.push_back(v);
+    uint64_t bits;
+    std::memcpy(&bits, &v, sizeof(bits));
+    sketch.add(distinct_sketch::hash_int(bits));
+}
+
+void col_summary::add(const std::string& v) {
+    if (!have_val or v < smin) smin = v;
+    if (!have_val or v > smax) smax = v;
+    have_val = true;
+    nsampled++;
+    strs.push_back(v);
+    sketch.add(distinct_sketch::hash_str(v));
+}
+
+// format a numeric stats val the same as its col values
+static std::string stats_val_to_string(int col_type, double v) {
+    switch (col_type) {
+        case SDT_FLOAT:
+        case SDT_DOUBLE: {
+            std::ostringstream ss;
+            ss << std::setprecision(17) << v;
+            return ss.str();
+        }
+        case SDT_UINT8:
+        case SDT_UINT16:
+        case SDT_UINT32:
+        case SDT_UINT64:
+        case SDT_UCHAR:
+            return std::to_string(static_cast<uint64_t>(v));
+        default:
+            return std::to_string(static_cast<int64_t>(v));
+    }
+}
+
+std::string col_summary::min_str() const {
+    if (!have_val) return "";
+    switch (col_type) {
+        case SDT_STRING:
+        case SDT_DATE:
+            return smin;
+        case SDT_FLOAT:
+        case SDT_DOUBLE:
+            return stats_val_to_string(col_type, dmin);
+        case SDT_UINT8:
+        case SDT_UINT16:
+        case SDT_UINT32:
+        case SDT_UINT64:
+        case SDT_UCHAR:
+            return std::to_string(umin);
+        default:
+            return std::to_string(imin);
+    }
+}
+
+std::string col_summary::max_str() const {
+    if (!have_val) return "";
+    switch (col_type) {
+        case SDT_STRING:
+        case SDT_DATE:
+            return smax;
+        case SDT_FLOAT:
+        case SDT_DOUBLE:
+            return stats_val_to_string(col_type, dmax);
+        case SDT_UINT8:
+        case SDT_UINT16:
+        case SDT_UINT32:
+        case SDT_UINT64:
+        case SDT_UCHAR:
+            return std::to_string(umax);
+        default:
+            return std::to_string(imax);
+    }
+}
+
+// add the flexbuf val of a col to its summary
+static void summarize_flex_val(const flexbuffers::Reference& val,
+                               col_summary& s) {
+    switch (s.col_type) {
+        case SDT_BOOL: s.add(static_cast<int64_t>(val.AsBool())); break;
+        case SDT_INT8:
+        case SDT_CHAR: s.add(static_cast<int64_t>(val.AsInt8())); break;
+        case SDT_INT16: s.add(static_cast<int64_t>(val.AsInt16())); break;
+        case SDT_INT32: s.add(static_cast<int64_t>(val.AsInt32())); break;
+        case SDT_INT64: s.add(static_cast<int64_t>(val.AsInt64())); break;
+        case SDT_UINT8:
+        case SDT_UCHAR: s.add(static_cast<uint64_t>(val.AsUInt8())); break;
+        case SDT_UINT16: s.add(static_cast<uint64_t>(val.AsUInt16())); break;
+        case SDT_UINT32: s.add(static_cast<uint64_t>(val.AsUInt32())); break;
+        case SDT_UINT64: s.add(static_cast<uint64_t>(val.AsUInt64())); break;
+        case SDT_FLOAT: s.add(static_cast<double>(val.AsFloat())); break;
+        case SDT_DOUBLE: s.add(val.AsDouble()); break;
+        case SDT_DATE:
+        case SDT_STRING: s.add(val.AsString().str()); break;
+        default: assert (TablesErrCodes::UnknownSkyDataType==0);
+    }
+}
+
+// add the arrow array val of a col to its summary
+static void summarize_arrow_val(const std::shared_ptr<arrow::Array>& array,
+                                int64_t i,
+                                col_summary& s,
+                                bool null_vals) {
+    if (array->IsNull(i)) {
+        if (!null_vals) {
+            s.add_null();
+            return;
+        }
+        s.nnulls++;
+    }
+    switch (s.col_type) {
+        case SDT_BOOL:
+            s.add(static_cast<int64_t>(std::static_pointer_cast<arrow::BooleanArray>(array)->Value(i)));
+            break;
+        case SDT_INT8:
+        case SDT_CHAR:
+            s.add(static_cast<int64_t>(std::static_pointer_cast<arrow::Int8Array>(array)->Value(i)));
+            break;
+        case SDT_INT16:
+            s.add(static_cast<int64_t>(std::static_pointer_cast<arrow::Int16Array>(array)->Value(i)));
+            break;
+        case SDT_INT32:
+            s.add(static_cast<int64_t>(std::static_pointer_cast<arrow::Int32Array>(array)->Value(i)));
+            break;
+        case SDT_INT64:
+            s.add(static_cast<int64_t>(std::static_pointer_cast<arrow::Int64Array>(array)->Value(i)));
+            break;
+        case SDT_UINT8:
+        case SDT_UCHAR:
+            s.add(static_cast<uint64_t>(std::static_pointer_cast<arrow::UInt8Array>(array)->Value(i)));
+            break;
+        case SDT_UINT16:
+            s.add(static_cast<uint64_t>(std::static_pointer_cast<arrow::UInt16Array>(array)->Value(i)));
+            break;
+        case SDT_UINT32:
+            s.add(static_cast<uint64_t>(std::static_pointer_cast<arrow::UInt32Array>(array)->Value(i)));
+            break;
+        case SDT_UINT64:
+            s.add(static_cast<uint64_t>(std::static_pointer_cast<arrow::UInt64Array>(array)->Value(i)));
+            break;
+        case SDT_FLOAT:
+            s.add(static_cast<double>(std::static_pointer_cast<arrow::FloatArray>(array)->Value(i)));
+            break;
+        case SDT_DOUBLE:
+            s.add(std::static_pointer_cast<arrow::DoubleArray>(array)->Value(i));
+            break;
+        case SDT_DATE:
+        case SDT_STRING:
+            s.add(std::static_pointer_cast<arrow::StringArray>(array)->GetString(i));
+            break;
+        default: assert (TablesErrCodes::UnknownSkyDataType==0);
+    }
+}
+
+int summarize_cols(
+        const char* data,
+        size_t size,
+        int format,
+        const schema_vec& data_schema,
+        int stride,
+        uint64_t* nrows,
+        std::vector<col_summary>& summaries,
+        std::string& errmsg,
+        bool null_vals) {
+
+    if (stride < 1)
+        stride = 1;
+    if (summaries.empty()) {
+        for (auto it = data_schema.begin(); it != data_schema.end(); ++it)
+            summaries.push_back(col_summary(it->type));
+    }
+    if (summaries.size() != data_schema.size()) {
+        errmsg.append("ERROR summarize_cols: summaries do not match schema");
+        return TablesErrCodes::RequestedColNotPresent;
+    }
+
+    uint64_t live = 0;
+    switch (format) {
+
+        case SFT_FLATBUF_FLEX_ROW: {
+            sky_root root = getSkyRoot(data, size, SFT_FLATBUF_FLEX_ROW);
+            for (uint32_t i = 0; i < root.nrows; i++) {
+                if (root.delete_vec.at(i) == 1) continue;  // skip dead rows.
+                if ((live++ % stride) != 0) continue;
+
+                sky_rec rec = \
+                    getSkyRec(static_cast<row_offs>(root.data_vec)->Get(i));
+                auto row = rec.data.AsVector();
+                for (unsigned j = 0; j < data_schema.size(); j++) {
+                    const col_info& col = data_schema[j];
+                    if (col.idx < 0 or col.idx >= (int)row.size())
+                        continue;  // RID and other special cols
+                    if (col.nullable) {
+                        if (isNullBitSet(rec.nullbits, col.idx)) {
+                            if (!null_vals) {
+                                summaries[j].add_null();
+                                continue;
+                            }
+                            summaries[j].nnulls++;
+                        }
+                    }
+                    if (root.dicts.get(col.idx) != NULL)
+                        summaries[j].add(root.dicts.getString(row, col.idx));
+                    else
+                        summarize_flex_val(row[col.idx], summaries[j]);
+                }
+            }
+            break;
+        }
+
+        case SFT_ARROW: {
+            std::shared_ptr<arrow::Table> table;
+            std::shared_ptr<arrow::Buffer> buffer = \
+                arrow::MutableBuffer::Wrap(
+                    reinterpret_cast<uint8_t*>(const_cast<char*>(data)), size);
+            extract_arrow_from_buffer(&table, buffer);
+            auto metadata = table->schema()->metadata();
+            int num_cols = schemaFromString(
+                    metadata->value(METADATA_DATA_SCHEMA)).size();
+            uint32_t arrow_nrows = std::stoi(
+                    metadata->value(METADATA_NUM_ROWS));
+            if (arrow_nrows == 0)
+                break;
+
+            // summarize one record batch at a time
+            std::vector<arrow_batch> batches;
+            if (arrow_table_batches(table, batches) != 0) {
+                errmsg.append("ERROR summarize_cols: reading record batches");
+                return TablesErrCodes::ArrowStatusErr;
+            }
+            std::vector<std::shared_ptr<arrow::Array>> arrays;
+            for (auto b = batches.begin(); b != batches.end(); ++b) {
+                auto delvec = std::static_pointer_cast<arrow::BooleanArray>(
+                    b->table->column(ARROW_DELVEC_INDEX(num_cols))->chunk(0));
+                arrays.clear();
+                for (unsigned j = 0; j < data_schema.size(); j++) {
+                    int idx = data_schema[j].idx;
+                    if (idx < 0 or idx >= num_cols)
+                        arrays.push_back(nullptr);
+                    else
+                        arrays.push_back(b->table->column(idx)->chunk(0));
+                }
+
+                for (int64_t i = 0; i < b->table->num_rows(); i++) {
+                    if (delvec->Value(i)) continue;  // skip dead rows.
+                    if ((live++ % stride) != 0) continue;
+                    for (unsigned j = 0; j < data_schema.size(); j++) {
+                        if (arrays[j])
+                            summarize_arrow_val(arrays[j], i, summaries[j],
+                                                null_vals);
+                    }
+                }
+            }
+            break;
+        }
+
+        default:
+            errmsg.append("ERROR summarize_cols: unsupported format " +
+                          std::to_string(format));
+            return TablesErrCodes::UnsupportedSkyDataType;
+    }
+
+    *nrows += live;
+    return 0;
+}
+
+col_stats build_col_stats(
+        const std::string& table_name,
+        col_info col,
+        col_summary& summary,
+        uint64_t nrows,
+        int stats_level,
+        int nbins,
+        int64_t cur_time) {
+
+    uint64_t nvals = summary.numeric ? summary.vals.size()
+                                     : summary.strs.size();
+    nbins = std::max(0, std::min<int>(nbins, nvals));
+
+    // scale the sampled counts up to all rows of the object
+    double scale = summary.nsampled ?
+        static_cast<double>(nrows) / summary.nsampled : 0;
+
+    // equi-depth bins, bin b starts at the b*nvals/nbins sorted val.
+    std::vector<int> hist(nbins, 0);
+    std::vector<std::string> bounds;
+    if (nbins > 0) {
+        if (summary.numeric)
+            std::sort(summary.vals.begin(), summary.vals.end());
+        else
+            std::sort(summary.strs.begin(), summary.strs.end());
+        for (int b = 0; b <= nbins; b++) {
+            uint64_t pos = (b == nbins) ? nvals - 1 : b * nvals / nbins;
+            if (summary.numeric)
+                bounds.push_back(stats_val_to_string(col.type,
+                                                     summary.vals[pos]));
+            else
+                bounds.push_back(summary.strs[pos]);
+        }
+        for (int b = 0; b < nbins; b++) {
+            uint64_t first = b * nvals / nbins;
+            uint64_t last = (b + 1) * nvals / nbins;
+            hist[b] = static_cast<int>(std::llround((last - first) * scale));
+        }
+    }
+
+    col_stats stats(col.idx, col.type, 0, stats_level, cur_time,
+                    table_name, col.toString(), summary.min_str(),
+                    summary.max_str(), nbins, hist);
+    stats.bounds = bounds;
+    stats.nrows = nrows;
+    stats.null_count = std::min<uint64_t>(nrows,
+            std::llround(summary.nnulls * scale));
+
+    // a sample that is nearly all distinct likely comes from a col that is
+    // too, otherwise assume the sample saw most of the distinct vals.
+    uint64_t ndistinct = std::min(summary.sketch.estimate(), nvals);
+    if (scale > 1 and ndistinct >= 0.9 * nvals)
+        ndistinct = std::llround(ndistinct * scale);
+    stats.distinct_count = std::min(ndistinct, nrows);
+    return stats;
+}
+
+// order of 2 col_stats vals, numerically for numeric cols
+static bool stats_val_less(int col_type, bool numeric,
+                           const std::string& a, const std::string& b) {
+    double da, db;
+    if (numeric and stats_val_to_double(col_type, a, &da) and
+        stats_val_to_double(col_type, b, &db))
+        return da < db;
+    return a < b;
+}
+
+void merge_col_stats(
+        col_stats& stats,
+        col_summary& summary,
+        uint64_t nrows,
+        int64_t cur_time) {
+
+    if (nrows == 0)
+        return;
+    uint64_t nvals = summary.numeric ? summary.vals.size()
+                                     : summary.strs.size();
+    double scale = summary.nsampled ?
+        static_cast<double>(nrows) / summary.nsampled : 0;
+
+    // add the sampled vals to the existing bins, vals beyond the bounds
+    // are added to the first or last bin, whose bound is then extended.
+    bool have_bounds = stats.bounds.size() == stats.nbins + 1;
+    if (stats.nbins > 0 and stats.hist.size() == stats.nbins and
+        (have_bounds or summary.numeric)) {
+
+        std::vector<double> added(stats.nbins, 0);
+        std::vector<double> dbounds;
+        double lo = 0, hi = 0;
+        if (summary.numeric and have_bounds) {
+            for (auto it = stats.bounds.begin(); it != stats.bounds.end(); ++it) {
+                double d = 0;
+                stats_val_to_double(stats.col_type, *it, &d);
+                dbounds.push_back(d);
+            }
+        }
+        else if (summary.numeric) {
+            stats_val_to_double(stats.col_type, stats.min_val, &lo);
+            stats_val_to_double(stats.col_type, stats.max_val, &hi);
+        }
+
+        for (uint64_t i = 0; i < nvals; i++) {
+            size_t b = 0;
+            if (summary.numeric and have_bounds) {
+                b = std::upper_bound(dbounds.begin() + 1, dbounds.end() - 1,
+                                     summary.vals[i]) - (dbounds.begin() + 1);
+            }
+            else if (summary.numeric) {
+                if (hi > lo) {
+                    double w = (summary.vals[i] - lo) / (hi - lo);
+                    b = std::min<double>(std::max(w, 0.0) * stats.nbins,
+                                         stats.nbins - 1);
+                }
+            }
+            else {
+                b = std::upper_bound(stats.bounds.begin() + 1,
+                                     stats.bounds.end() - 1,
+                                     summary.strs[i]) -
+                    (stats.bounds.begin() + 1);
+            }
+            added[b] += scale;
+        }
+        for (unsigned b = 0; b < stats.nbins; b++)
+            stats.hist[b] += static_cast<int>(std::llround(added[b]));
+    }
+
+    if (summary.have_val) {
+        std::string smin = summary.min_str();
+        std::string smax = summary.max_str();
+        if (stats.min_val.empty() or
+            stats_val_less(stats.col_type, summary.numeric, smin,
+                           stats.min_val))
+            stats.min_val = smin;
+        if (stats.max_val.empty() or
+            stats_val_less(stats.col_type, summary.numeric, stats.max_val,
+                           smax))
+            stats.max_val = smax;
+        if (have_bounds and stats.nbins > 0) {
+            if (stats_val_less(stats.col_type, summary.numeric, smin,
+                               stats.bounds.front()))
+                stats.bounds.front() = smin;
+            if (stats_val_less(stats.col_type, summary.numeric,
+                               stats.bounds.back(), smax))
+                stats.bounds.back() = smax;
+        }
+    }
+
+    stats.nrows += nrows;
+    stats.null_count = std::min<uint64_t>(stats.nrows, stats.null_count +
+            std::llround(summary.nnulls * scale));
+
+    // as in build_col_stats, then an upper bound over all rows since the
+    // appended vals may repeat prior ones.
+    uint64_t ndistinct = std::min(summary.sketch.estimate(), nvals);
+    if (scale > 1 and ndistinct >= 0.9 * nvals)
+        ndistinct = std::llround(ndistinct * scale);
+    stats.distinct_count = std::min(stats.nrows,
+                                    stats.distinct_count + ndistinct);
+    stats.utc = cur_time;
+}
+
+idx_zone_entry build_zone_entry(
+        const schema_vec& data_schema,
+        const std::vector<col_summary>& summaries,
+        uint64_t nrows) {
+
+    idx_zone_entry zone;
+    zone.nrows = nrows;
+    for (unsigned i = 0; i < summaries.size() and i < data_schema.size(); i++) {
+        const col_info& col = data_schema[i];
+        if (col.idx < 0)
+            continue;
+        zone.add_col(col.idx, col.type, summaries[i].min_str(),
+                     summaries[i].max_str(), summaries[i].nnulls);
+    }
+    return zone;
+}
+
+// compare a zone map min/max val to a pred val, set ok false if the col
+// type is not comparable here.  returns <0, 0, >0 as bound <, ==, > val.
+static int zone_val_cmp(int col_type, const std::string& bound,
+                        PredicateBase* pb, bool* ok) {
+
+    *ok = true;
+    try {
+        switch (col_type) {
+            case SDT_INT8:
+            case SDT_INT16:
+            case SDT_INT32:
+            case SDT_INT64: {
+                int64_t b = std::stoll(bound);
+                int64_t v = 0;
+                extract_typedpred_val(pb, v);
+                return (b < v) ? -1 : (b > v);
+            }
+            case SDT_UINT8:
+            case SDT_UINT16:
+            case SDT_UINT32:
+            case SDT_UINT64: {
+                uint64_t b = std::stoull(bound);
+                uint64_t v = 0;
+                extract_typedpred_val(pb, v);
+                return (b < v) ? -1 : (b > v);
+            }
+            case SDT_STRING: {
+                TypedPredicate<std::string>* p = \
+                    dynamic_cast<TypedPredicate<std::string>*>(pb);
+                return bound.compare(p->Val());
+            }
+            default: {
+                // bool, char, float, double and dates are exact as doubles
+                double b, v;
+                if (!stats_val_to_double(col_type, bound, &b) or
+                    !pred_val_to_double(pb, &v))
+                    break;
+                return (b < v) ? -1 : (b > v);
+            }
+        }
+    }
+    catch (...) {}
+    *ok = false;
+    return 0;
+}
+
+bool zone_may_match(const predicate_vec& preds, const idx_zone_entry& zone) {
+
+    // only a conjunction of preds can exclude the fb
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        if ((*it)->chainOpType() != SOT_logical_and)
+            return true;
+    }
+
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        PredicateBase* pb = *it;
+        if (pb->isGlobalAgg())
+            continue;
+
+        int op_type = pb->opType();
+        switch (op_type) {
+            case SOT_lt:
+            case SOT_gt:
+            case SOT_eq:
+            case SOT_ne:
+            case SOT_leq:
+            case SOT_geq:
+            case SOT_before:
+            case SOT_after:
+                break;
+            default:
+                continue;  // cannot be checked against min/max
+        }
+
+        auto itc = std::find(zone.col_ids.begin(), zone.col_ids.end(),
+                             pb->colIdx());
+        if (itc == zone.col_ids.end())
+            continue;
+        unsigned c = itc - zone.col_ids.begin();
+
+        bool ok_min, ok_max;
+        int cmp_min = zone_val_cmp(zone.col_types[c], zone.min_vals[c],
+                                   pb, &ok_min);
+        int cmp_max = zone_val_cmp(zone.col_types[c], zone.max_vals[c],
+                                   pb, &ok_max);
+        if (!ok_min or !ok_max)
+            continue;
+
+        bool may_match = true;
+        switch (op_type) {
+            case SOT_eq: may_match = cmp_min <= 0 and cmp_max >= 0; break;
+            case SOT_ne: may_match = cmp_min != 0 or cmp_max != 0; break;
+            case SOT_lt:
+            case SOT_before:
+                may_match = cmp_min < 0; break;
+            case SOT_leq: may_match = cmp_min <= 0; break;
+            case SOT_gt:
+            case SOT_after:
+                may_match = cmp_max > 0; break;
+            case SOT_geq: may_match = cmp_max >= 0; break;
+        }
+        if (!may_match)
+            return false;
+    }
+    return true;
+}
+
 /* @todo: This is a temporary function to demonstrate buffer is read from the file.
  * In reality, Ceph will return a bufferlist containing a buffer.
  */
@@ -2434,12 +3947,40 @@ int extract_arrow_from_buffer(std::shared_ptr<arrow::Table>* table, const std::s
     // this check crashes if num_rows not in metadata (e.g., HEP array tables)
     // if (atoi(metadata->value(METADATA_NUM_ROWS).c_str()) == 0)
 
+    // dictionary encoded string cols are decoded here once, so the table
+    // only holds plain utf8 string cols
+    std::vector<int> dict_cols;
+    for (int i = 0; i < schema->num_fields(); i++) {
+        if (schema->field(i)->type()->id() == arrow::Type::DICTIONARY)
+            dict_cols.push_back(i);
+    }
+    if (!dict_cols.empty()) {
+        std::vector<std::shared_ptr<arrow::Field>> fields = schema->fields();
+        for (auto it = dict_cols.begin(); it != dict_cols.end(); ++it)
+            fields[*it] = arrow::field(fields[*it]->name(), arrow::utf8());
+        schema = std::make_shared<arrow::Schema>(fields, metadata);
+    }
+
     // Initilaization related to read to apache arrow
     std::vector<std::shared_ptr<arrow::RecordBatch>> batch_vec;
     while (true){
         std::shared_ptr<arrow::RecordBatch> chunk;
         reader->ReadNext(&chunk);
         if (chunk == nullptr) break;
+        if (!dict_cols.empty()) {
+            std::vector<std::shared_ptr<arrow::Array>> columns = chunk->columns();
+            for (auto it = dict_cols.begin(); it != dict_cols.end(); ++it) {
+                auto dict_array = \
+                    std::static_pointer_cast<arrow::DictionaryArray>(columns[*it]);
+                arrow::Result<std::shared_ptr<arrow::Array>> result = \
+                    arrow::compute::Take(*dict_array->dictionary(),
+                                         *dict_array->indices());
+                if (!result.ok())
+                    return TablesErrCodes::ArrowStatusErr;
+                columns[*it] = std::move(result).ValueOrDie();
+            }
+            chunk = arrow::RecordBatch::Make(schema, chunk->num_rows(), columns);
+        }
         batch_vec.push_back(chunk);
     }
 
@@ -2778,6 +4319,258 @@ int convert_arrow_to_buffer(const std::shared_ptr<arrow::Table> &table, std::sha
     return 0;
 }
 
+uint8_t* BufferPtrAllocator::allocate(size_t size)
+{
+    bp = bufferptr(buffer::create_aligned(size, sizeof(flatbuffers::largest_scalar_t)));
+    return reinterpret_cast<uint8_t*>(bp.c_str());
+}
+
+void BufferPtrAllocator::deallocate(uint8_t *p, size_t size)
+{
+    // bufferlists that were appended to still hold their own reference.
+    if (bp.length() and p == reinterpret_cast<uint8_t*>(bp.c_str()))
+        bp = bufferptr();
+}
+
+uint8_t* BufferPtrAllocator::reallocate_downward(uint8_t *old_p,
+                                                 size_t old_size,
+                                                 size_t new_size,
+                                                 size_t in_use_back,
+                                                 size_t in_use_front)
+{
+    bufferptr old_bp = bp;  // keeps old_p valid until it is copied
+    uint8_t* new_p = allocate(new_size);
+    memcpy_downward(old_p, old_size, new_p, new_size, in_use_back,
+                    in_use_front);
+    return new_p;
+}
+
+void BufferPtrAllocator::appendTo(flatbuffers::FlatBufferBuilder& builder,
+                                  bufferlist& bl)
+{
+    size_t off = builder.GetBufferPointer() -
+                 reinterpret_cast<uint8_t*>(bp.c_str());
+    assert (off + builder.GetSize() <= bp.length());
+    bl.append(bp, off, builder.GetSize());
+}
+
+uint8_t* CountingAllocator::allocate(size_t size)
+{
+    stats->fb_allocs++;
+    return flatbuffers::DefaultAllocator::allocate(size);
+}
+
+uint8_t* CountingAllocator::reallocate_downward(uint8_t *old_p,
+                                                size_t old_size,
+                                                size_t new_size,
+                                                size_t in_use_back,
+                                                size_t in_use_front)
+{
+    stats->fb_reallocs++;
+    return flatbuffers::DefaultAllocator::reallocate_downward(
+            old_p, old_size, new_size, in_use_back, in_use_front);
+}
+
+void PooledFlatBufferBuilder::reset(size_t expected_size)
+{
+    Clear();
+
+    // grow once up front rather than doubling while building.
+    if (buf_.capacity() < expected_size) {
+        buf_.make_space(expected_size);
+        buf_.clear();
+    }
+}
+
+BuilderPool::~BuilderPool()
+{
+    for (auto it = bldrs.begin(); it != bldrs.end(); ++it)
+        delete *it;
+}
+
+flexbuffers::Builder& BuilderPool::flexBuilder()
+{
+    flex_bldr.Clear();
+    return flex_bldr;
+}
+
+const std::vector<uint8_t>& BuilderPool::finishFlex()
+{
+    flex_bldr.Finish();
+    const std::vector<uint8_t>& buf = flex_bldr.GetBuffer();
+    alloc_stats.flex_rows++;
+    if (buf.capacity() > flex_capacity) {
+        alloc_stats.flex_grows++;
+        flex_capacity = buf.capacity();
+    }
+    return buf;
+}
+
+flatbuffers::Offset<flatbuffers::Vector<uint8_t>> BuilderPool::finishFlex(
+        flatbuffers::FlatBufferBuilder& flatbldr)
+{
+    return flatbldr.CreateVector(finishFlex());
+}
+
+flatbuffers::FlatBufferBuilder& BuilderPool::resultBuilder(
+        size_t expected_size)
+{
+    result_bldr.reset(expected_size);
+    return result_bldr;
+}
+
+flatbuffers::FlatBufferBuilder& BuilderPool::metaBuilder(size_t expected_size)
+{
+    // fbmeta fields and vtable are small, the blob dominates.
+    meta_bldr.reset(expected_size + 128);
+    return meta_bldr;
+}
+
+flatbuffers::FlatBufferBuilder* BuilderPool::acquire()
+{
+    if (free_bldrs.empty()) {
+        bldrs.push_back(new PooledFlatBufferBuilder(&alloc));
+        return bldrs.back();
+    }
+    PooledFlatBufferBuilder* bldr = free_bldrs.back();
+    free_bldrs.pop_back();
+    return bldr;
+}
+
+void BuilderPool::release(flatbuffers::FlatBufferBuilder* bldr)
+{
+    PooledFlatBufferBuilder* pbldr = static_cast<PooledFlatBufferBuilder*>(bldr);
+    pbldr->reset(0);
+    free_bldrs.push_back(pbldr);
+}
+
+/*
+ * Function: get_arrow_ipc_size
+ * Description: Compute the size of the ipc stream for an arrow table by
+ *              writing it to a mock output stream, which only counts the
+ *              bytes and does not copy any of the table data.
+ * @param[in] table  : Arrow table to be measured
+ * @param[out] size  : Number of bytes in the ipc stream
+ * Return Value: error code
+ */
+int get_arrow_ipc_size(const std::shared_ptr<arrow::Table> &table,
+                       int64_t* size)
+{
+    arrow::io::MockOutputStream mock;
+    const arrow::ipc::IpcWriteOptions options = arrow::ipc::IpcWriteOptions::Defaults();
+    arrow::Result<std::shared_ptr<arrow::ipc::RecordBatchWriter>> result = \
+        arrow::ipc::NewStreamWriter(&mock, table->schema(), options);
+    if (!result.ok())
+        return ArrowStatusErr;
+    std::shared_ptr<arrow::ipc::RecordBatchWriter> writer = \
+        std::move(result).ValueOrDie();
+    if (!writer->WriteTable(*(table.get())).ok() or !writer->Close().ok())
+        return ArrowStatusErr;
+    *size = mock.GetExtentBytesWritten();
+    return 0;
+}
+
+// writes the ipc stream of an arrow table into blob of exactly ipc_size
+static int write_arrow_ipc(const std::shared_ptr<arrow::Table> &table,
+                           unsigned char* blob,
+                           int64_t ipc_size)
+{
+    std::shared_ptr<arrow::Buffer> blob_buffer = arrow::MutableBuffer::Wrap(blob, ipc_size);
+    arrow::io::FixedSizeBufferWriter output(blob_buffer);
+    const arrow::ipc::IpcWriteOptions options = arrow::ipc::IpcWriteOptions::Defaults();
+    arrow::Result<std::shared_ptr<arrow::ipc::RecordBatchWriter>> result = \
+        arrow::ipc::NewStreamWriter(&output, table->schema(), options);
+    if (!result.ok())
+        return ArrowStatusErr;
+    std::shared_ptr<arrow::ipc::RecordBatchWriter> writer = \
+        std::move(result).ValueOrDie();
+    if (!writer->WriteTable(*(table.get())).ok() or !writer->Close().ok())
+        return ArrowStatusErr;
+    return 0;
+}
+
+/*
+ * Function: convert_arrow_to_fbmeta
+ * Description: Serialize an arrow table and wrap it in an fbmeta without the
+ *              intermediate copies of convert_arrow_to_buffer + createFbMeta.
+ *              The fbmeta is built first with an uninitialized blob vector
+ *              of the exact ipc stream size, then the ipc stream is written
+ *              directly into that vector, and the finished fbmeta memory is
+ *              appended to the bufferlist by reference.  A compressed blob
+ *              is instead written to a temporary buffer and compressed into
+ *              the fbmeta.
+ * @param[in] table       : Arrow table to be converted
+ * @param[out] bl         : Bufferlist the fbmeta is appended to
+ * @param[in] compression : enum CompressionType of the blob
+ * Return Value: error code
+ */
+int convert_arrow_to_fbmeta(const std::shared_ptr<arrow::Table> &table,
+                            bufferlist& bl,
+                            int compression)
+{
+    int64_t ipc_size = 0;
+    int ret = get_arrow_ipc_size(table, &ipc_size);
+    if (ret != 0)
+        return ret;
+
+    if (compression != none) {
+        std::vector<unsigned char> ipc(ipc_size);
+        ret = write_arrow_ipc(table, ipc.data(), ipc_size);
+        if (ret != 0)
+            return ret;
+        std::vector<char> compressed;
+        ret = compressBlob(compression, reinterpret_cast<const char*>(ipc.data()),
+                           ipc_size, compressed);
+        if (ret != 0)
+            return ret;
+        flatbuffers::FlatBufferBuilder meta_builder(compressed.size() + 1024);
+        flatbuffers::Offset<FB_Meta> meta_offset = Tables::CreateFB_Meta(
+                meta_builder,
+                SFT_ARROW,
+                meta_builder.CreateVector(
+                    reinterpret_cast<const unsigned char*>(compressed.data()),
+                    compressed.size()),
+                compressed.size(),
+                false,
+                0,
+                0,
+                compression,
+                ipc_size);
+        meta_builder.Finish(meta_offset);
+        bl.append(reinterpret_cast<const char*>(meta_builder.GetBufferPointer()),
+                  meta_builder.GetSize());
+        return 0;
+    }
+
+    // size the builder so the fbmeta fields fit without a reallocation
+    BufferPtrAllocator allocator;
+    flatbuffers::FlatBufferBuilder meta_builder(ipc_size + 1024, &allocator);
+    unsigned char* blob = nullptr;
+    flatbuffers::Offset<flatbuffers::Vector<unsigned char>> data_blob = \
+            meta_builder.CreateUninitializedVector(ipc_size, &blob);
+    flatbuffers::Offset<FB_Meta> meta_offset = Tables::CreateFB_Meta(
+            meta_builder,
+            SFT_ARROW,
+            data_blob,
+            ipc_size,
+            false,
+            0,
+            0,
+            none);
+    meta_builder.Finish(meta_offset);
+
+    // locate the blob vector again since the builder may have moved it
+    const FB_Meta* meta = GetFB_Meta(meta_builder.GetBufferPointer());
+    blob = const_cast<unsigned char*>(meta->blob_data()->Data());
+
+    ret = write_arrow_ipc(table, blob, ipc_size);
+    if (ret != 0)
+        return ret;
+
+    allocator.appendTo(meta_builder, bl);
+    return 0;
+}
+
 /*
  * Function: compress_arrow_tables
  * Description: Compress the given arrow tables into single arrow table. Before
@@ -2793,13 +4586,41 @@ int compress_arrow_tables(std::vector<std::shared_ptr<arrow::Table>> &table_vec,
     auto original_schema = (table_ptr)->schema();
 
     // Check if schema for all tables are same, otherwise return error
+    // (the num rows metadata of each table differs, so it is not compared)
+    int64_t num_rows = 0;
     for (auto it = table_vec.begin(); it != table_vec.end(); it++) {
         auto table_schema = (*it)->schema();
-        if (!original_schema->Equals(*table_schema.get()))
+        if (!original_schema->Equals(*table_schema.get(), false))
             return TablesErrCodes::ArrowStatusErr;
+        num_rows += (*it)->num_rows();
+    }
+
+    // The chunks of each col of every table become the chunks of the col of
+    // the output table, no data is copied.
+    int num_cols = original_schema->num_fields();
+    std::vector<std::shared_ptr<arrow::ChunkedArray>> column_list;
+    for (int i = 0; i < num_cols; i++) {
+        arrow::ArrayVector chunks;
+        for (auto it = table_vec.begin(); it != table_vec.end(); it++) {
+            auto col_chunks = (*it)->column(i)->chunks();
+            chunks.insert(chunks.end(), col_chunks.begin(), col_chunks.end());
+        }
+        column_list.push_back(std::make_shared<arrow::ChunkedArray>(
+                chunks, original_schema->field(i)->type()));
+    }
+
+    // Copy the skyhook metadata, with the total num rows
+    auto orig_metadata = original_schema->metadata();
+    std::shared_ptr<arrow::KeyValueMetadata> metadata (new arrow::KeyValueMetadata);
+    for (int64_t i = 0; orig_metadata and i < orig_metadata->size(); i++) {
+        if (orig_metadata->key(i) == ToString(METADATA_NUM_ROWS))
+            metadata->Append(orig_metadata->key(i), std::to_string(num_rows));
+        else
+            metadata->Append(orig_metadata->key(i), orig_metadata->value(i));
     }
+    auto schema = std::make_shared<arrow::Schema>(original_schema->fields(), metadata);
 
-    // TODO: Change schema metadata for the created table
+    *table = arrow::Table::Make(schema, column_list, num_rows);
     return 0;
 }
 
@@ -2822,7 +4643,10 @@ int split_arrow_table(std::shared_ptr<arrow::Table> &table, int max_rows,
     int remaining_rows = std::stoi(orig_metadata->value(METADATA_NUM_ROWS));
     int offset = 0;
 
-    while ((remaining_rows / max_rows) >= 1) {
+    if (max_rows < 1)
+        return TablesErrCodes::ArrowStatusErr;
+
+    while (remaining_rows > 0) {
 
         // Extract skyhook metadata from original table.
         std::shared_ptr<arrow::KeyValueMetadata> metadata (new arrow::KeyValueMetadata);
@@ -2865,15 +4689,93 @@ int split_arrow_table(std::shared_ptr<arrow::Table> &table, int max_rows,
         }
         offset += max_rows;
 
-        // Finally, create the arrow table based on schema and column vector
-        std::shared_ptr<arrow::Table> table = arrow::Table::Make(schema, column_list);
-        table_vec->push_back(table);
-        remaining_rows -= max_rows;
+        // Finally, create the arrow table based on schema and column vector
+        std::shared_ptr<arrow::Table> table = arrow::Table::Make(schema, column_list);
+        table_vec->push_back(table);
+        remaining_rows -= max_rows;
+    }
+    return 0;
+}
+
+/*
+ * Function: rebatch_arrow_table
+ * Description: Split the given arrow table into tables of at most max_rows
+ * and compress them back into one table, whose cols then have one chunk per
+ * split table.  The ipc stream of the table is written as one record batch
+ * per chunk, so this bounds the size of the batches processed by cls.
+ * @param[in,out] table : Table to be rebatched.
+ * @param[in] max_rows  : Maximum number of rows a batch can have.
+ * Return Value: error code
+ */
+int rebatch_arrow_table(std::shared_ptr<arrow::Table> &table, int max_rows)
+{
+    if (max_rows < 1 or table->num_rows() <= max_rows)
+        return 0;
+
+    std::vector<std::shared_ptr<arrow::Table>> table_vec;
+    int ret = split_arrow_table(table, max_rows, &table_vec);
+    if (ret != 0)
+        return ret;
+    return compress_arrow_tables(table_vec, &table);
+}
+
+/*
+ * Function: arrow_table_batches
+ * Description: Get the record batches of the given arrow table, each as a
+ * single chunk table with the schema (and metadata) of the given table.  The
+ * batches are zero-copy slices of the table cols, split wherever a chunk of
+ * any col ends.  A table whose cols are single chunks is its own batch.
+ * @param[in] table    : Table to be read.
+ * @param[out] batches : Batches of the table in row order.
+ * Return Value: error code
+ */
+int arrow_table_batches(const std::shared_ptr<arrow::Table> &table,
+                        std::vector<arrow_batch>& batches)
+{
+    batches.clear();
+    if (table->num_rows() == 0)
+        return 0;
+
+    bool single_chunk = true;
+    for (int i = 0; i < table->num_columns() and single_chunk; i++) {
+        if (table->column(i)->num_chunks() != 1)
+            single_chunk = false;
+    }
+    if (single_chunk) {
+        batches.push_back(arrow_batch{table, 0});
+        return 0;
+    }
+
+    arrow::TableBatchReader reader(*(table.get()));
+    int64_t offset = 0;
+    while (true) {
+        std::shared_ptr<arrow::RecordBatch> batch;
+        if (!reader.ReadNext(&batch).ok())
+            return TablesErrCodes::ArrowStatusErr;
+        if (batch == nullptr)
+            break;
+        batches.push_back(arrow_batch{
+            arrow::Table::Make(table->schema(), batch->columns(),
+                               batch->num_rows()),
+            offset});
+        offset += batch->num_rows();
     }
     return 0;
 }
 
-// TODO: This function may need some changes as we have a single chunk for a column
+uint32_t arrow_batch_rows(const arrow_batch& batch,
+                          const std::vector<uint32_t>& rnums,
+                          uint32_t begin,
+                          std::vector<uint32_t>& batch_rnums)
+{
+    batch_rnums.clear();
+    int64_t end = batch.offset + batch.table->num_rows();
+    uint32_t i = begin;
+    for (; i < rnums.size() and rnums[i] < end; i++)
+        batch_rnums.push_back(rnums[i] - batch.offset);
+    return i;
+}
+
 int print_arrowbuf_colwise(std::shared_ptr<arrow::Table>& table)
 {
     std::vector<std::shared_ptr<arrow::Array>> array_list;
@@ -3055,17 +4957,129 @@ void printArrowHeader(std::shared_ptr<const arrow::KeyValueMetadata> &metadata)
               << metadata->value(METADATA_NUM_ROWS).c_str() << std::endl;
 }
 
+// col of an arrow batch, resolved once per batch so that the row loops of
+// the printers read the col's values in place rather than casting the
+// array for every value.
+struct arrow_col_reader {
+    int type;
+    std::shared_ptr<arrow::Array> array;
+    const void* values;  // raw values of the fixed width types
+    bool has_nulls;
+
+    bool isNull(int64_t i) const {return has_nulls and array->IsNull(i);}
+
+    template <typename T>
+    T value(int64_t i) const {return static_cast<const T*>(values)[i];}
+
+    bool boolValue(int64_t i) const {
+        return static_cast<const arrow::BooleanArray*>(array.get())->Value(i);
+    }
+
+    const char* strValue(int64_t i, int32_t* len) const {
+        return reinterpret_cast<const char*>(
+            static_cast<const arrow::StringArray*>(array.get())->GetValue(i,
+                                                                          len));
+    }
+};
+
+static int arrow_col_reader_init(arrow_col_reader& r, int type,
+                                 const std::shared_ptr<arrow::Array>& array)
+{
+    r.type = type;
+    r.array = array;
+    r.values = nullptr;
+    r.has_nulls = array->null_count() > 0;
+    switch (type) {
+        case SDT_BOOL:
+        case SDT_DATE:
+        case SDT_STRING:
+            break;
+        case SDT_INT8:
+        case SDT_CHAR:
+            r.values = std::static_pointer_cast<arrow::Int8Array>(array)->raw_values();
+            break;
+        case SDT_INT16:
+            r.values = std::static_pointer_cast<arrow::Int16Array>(array)->raw_values();
+            break;
+        case SDT_INT32:
+            r.values = std::static_pointer_cast<arrow::Int32Array>(array)->raw_values();
+            break;
+        case SDT_INT64:
+            r.values = std::static_pointer_cast<arrow::Int64Array>(array)->raw_values();
+            break;
+        case SDT_UINT8:
+        case SDT_UCHAR:
+            r.values = std::static_pointer_cast<arrow::UInt8Array>(array)->raw_values();
+            break;
+        case SDT_UINT16:
+            r.values = std::static_pointer_cast<arrow::UInt16Array>(array)->raw_values();
+            break;
+        case SDT_UINT32:
+            r.values = std::static_pointer_cast<arrow::UInt32Array>(array)->raw_values();
+            break;
+        case SDT_UINT64:
+            r.values = std::static_pointer_cast<arrow::UInt64Array>(array)->raw_values();
+            break;
+        case SDT_FLOAT:
+            r.values = std::static_pointer_cast<arrow::FloatArray>(array)->raw_values();
+            break;
+        case SDT_DOUBLE:
+            r.values = std::static_pointer_cast<arrow::DoubleArray>(array)->raw_values();
+            break;
+        default:
+            return TablesErrCodes::UnsupportedSkyDataType;
+    }
+    return 0;
+}
+
+// readers of the data cols of a batch, followed by its RID and delete
+// vector cols if with_meta_cols.
+static int arrow_batch_readers(std::shared_ptr<arrow::Table>& batch,
+                               schema_vec& sc,
+                               bool with_meta_cols,
+                               std::vector<arrow_col_reader>& readers)
+{
+    int num_cols = sc.size();
+    readers.resize(num_cols + (with_meta_cols ? 2 : 0));
+    for (int i = 0; i < num_cols; i++) {
+        int ret = arrow_col_reader_init(readers[i], sc[i].type,
+                                        batch->column(i)->chunk(0));
+        if (ret != 0)
+            return ret;
+    }
+    if (with_meta_cols) {
+        arrow_col_reader_init(readers[num_cols], SDT_INT64,
+            batch->column(ARROW_RID_INDEX(num_cols))->chunk(0));
+        arrow_col_reader_init(readers[num_cols + 1], SDT_BOOL,
+            batch->column(ARROW_DELVEC_INDEX(num_cols))->chunk(0));
+    }
+    return 0;
+}
+
+long long int printArrowbufRowAsCsv(const char* dataptr,
+                                    const size_t datasz,
+                                    bool print_header,
+                                    bool print_verbose,
+                                    long long int max_to_print,
+                                    std::ostream& out)
+{
+    OutputBuffer buf;
+    long long int counter = printArrowbufRowAsCsv(dataptr, datasz,
+                                                  print_header, print_verbose,
+                                                  max_to_print, buf);
+    out.write(buf.data(), buf.size());
+    return counter;
+}
+
 long long int printArrowbufRowAsCsv(const char* dataptr,
                                     const size_t datasz,
                                     bool print_header,
                                     bool print_verbose,
-                                    long long int max_to_print)
+                                    long long int max_to_print,
+                                    OutputBuffer& out)
 {
     // Each column in arrow is represented using Chunked Array. A chunked array is
     // a vector of chunks i.e. arrays which holds actual data.
-
-    // Declare vector for columns (i.e. chunked_arrays)
-    std::vector<std::shared_ptr<arrow::Array>> chunk_vec;
     std::shared_ptr<arrow::Table> table;
     std::shared_ptr<arrow::Buffer> buffer;
 
@@ -3078,130 +5092,89 @@ long long int printArrowbufRowAsCsv(const char* dataptr,
     auto schema = table->schema();
     auto metadata = schema->metadata();
     schema_vec sc = schemaFromString(metadata->value(METADATA_DATA_SCHEMA));
-    int num_rows = std::stoi(metadata->value(METADATA_NUM_ROWS));
-    int num_cols = 0;
+    int num_cols = sc.size();
 
     if (print_verbose)
         printArrowHeader(metadata);
 
-    // Get the names of each column and get the vector of chunks
-    for (auto it = sc.begin(); it != sc.end(); ++it) {
-        col_info col = *it;
-        if (print_header) {
-            std::cout << table->field(std::distance(sc.begin(), it))->name();
-            if (it->is_key) std::cout << "(key)";
-            if (!it->nullable) std::cout << "(NOT NULL)";
-            std::cout << CSV_DELIM;
+    // Get the names of each column
+    if (print_header) {
+        for (auto it = sc.begin(); it != sc.end(); ++it) {
+            out.append(table->field(std::distance(sc.begin(), it))->name());
+            if (it->is_key) out.append("(key)");
+            if (!it->nullable) out.append("(NOT NULL)");
+            out.put(CSV_DELIM);
         }
-        chunk_vec.emplace_back(table->column(std::distance(sc.begin(), it))->chunk(0));
-    }
-
-    if (print_verbose) {
-        num_cols = sc.size();
-
-        if (print_header) {
-            std::cout << table->field(ARROW_RID_INDEX(num_cols))->name()
-                      << CSV_DELIM;
-            std::cout << table->field(ARROW_DELVEC_INDEX(num_cols))->name()
-                      << CSV_DELIM;
+        if (print_verbose) {
+            out.append(table->field(ARROW_RID_INDEX(num_cols))->name());
+            out.put(CSV_DELIM);
+            out.append(table->field(ARROW_DELVEC_INDEX(num_cols))->name());
+            out.put(CSV_DELIM);
         }
-
-        // Add RID and delete vector column
-        chunk_vec.emplace_back(table->column(ARROW_RID_INDEX(num_cols))->chunk(0));
-        chunk_vec.emplace_back(table->column(ARROW_DELVEC_INDEX(num_cols))->chunk(0));
+        out.put('\n');
     }
 
-    if (print_header)
-        std::cout << std::endl;
+    // The rows are printed one record batch at a time
+    std::vector<arrow_batch> batches;
+    if (arrow_table_batches(table, batches) != 0)
+        return TablesErrCodes::ArrowStatusErr;
+
+    out.reserve(out.size() + datasz);
 
     long long int counter = 0;
-    for (int i = 0; i < num_rows; i++, counter++) {
+    std::vector<arrow_col_reader> cols;
+    for (auto b = batches.begin(); b != batches.end(); ++b) {
         if (counter >= max_to_print) break;
 
-        // For this row get the data from each columns
-        for (auto it = sc.begin(); it != sc.end(); ++it) {
-            col_info col = *it;
-            auto print_array = chunk_vec[std::distance(sc.begin(), it)];
-
-            if (print_array->IsNull(i)) {
-                std::cout << "NULL" << CSV_DELIM;
-                continue;
-            }
-
-            switch(col.type) {
-                case SDT_BOOL: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::BooleanArray>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_INT8: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::Int8Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_INT16: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::Int16Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_INT32: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::Int32Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_INT64: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::Int64Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_UINT8: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::UInt8Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_UINT16: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::UInt16Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_UINT32: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::UInt32Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_UINT64: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::UInt64Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_CHAR: {
-                    std::cout << static_cast<char>(std::static_pointer_cast<arrow::Int8Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_UCHAR: {
-                    std::cout << static_cast<unsigned char>(std::static_pointer_cast<arrow::UInt8Array>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_FLOAT: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::FloatArray>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_DOUBLE: {
-                    std::cout << std::to_string(std::static_pointer_cast<arrow::DoubleArray>(print_array)->Value(i));
-                    break;
-                }
-                case SDT_DATE:
-                case SDT_STRING: {
-                    std::cout << std::static_pointer_cast<arrow::StringArray>(print_array)->GetString(i);
-                    break;
+        // resolve the cols of this batch, with the RID and delete vector
+        // cols when verbose
+        int ret = arrow_batch_readers(b->table, sc, print_verbose, cols);
+        if (ret != 0)
+            return ret;
+
+        int64_t nrows = b->table->num_rows();
+        for (int64_t i = 0; i < nrows; i++, counter++) {
+            if (counter >= max_to_print) break;
+
+            // For this row get the data from each columns, the meta cols
+            // are always last in cols.
+            for (auto c = cols.begin(); c != cols.end(); ++c) {
+                if (c->isNull(i)) {
+                    out.append("NULL", 4);
+                    out.put(CSV_DELIM);
+                    continue;
                 }
-                default: {
-                    return TablesErrCodes::UnsupportedSkyDataType;
+
+                // NOTE: numbers are output as by std::to_string
+                switch(c->type) {
+                    case SDT_BOOL: out.put(c->boolValue(i) ? '1' : '0'); break;
+                    case SDT_INT8: out.appendInt(c->value<int8_t>(i)); break;
+                    case SDT_INT16: out.appendInt(c->value<int16_t>(i)); break;
+                    case SDT_INT32: out.appendInt(c->value<int32_t>(i)); break;
+                    case SDT_INT64: out.appendInt(c->value<int64_t>(i)); break;
+                    case SDT_UINT8: out.appendUInt(c->value<uint8_t>(i)); break;
+                    case SDT_UINT16: out.appendUInt(c->value<uint16_t>(i)); break;
+                    case SDT_UINT32: out.appendUInt(c->value<uint32_t>(i)); break;
+                    case SDT_UINT64: out.appendUInt(c->value<uint64_t>(i)); break;
+                    case SDT_CHAR: out.put(c->value<int8_t>(i)); break;
+                    case SDT_UCHAR: out.put(c->value<uint8_t>(i)); break;
+                    case SDT_FLOAT: out.appendDoubleFixed(c->value<float>(i)); break;
+                    case SDT_DOUBLE: out.appendDoubleFixed(c->value<double>(i)); break;
+                    case SDT_DATE:
+                    case SDT_STRING: {
+                        int32_t len = 0;
+                        const char* s = c->strValue(i, &len);
+                        out.append(s, len);
+                        break;
+                    }
+                    default: {
+                        return TablesErrCodes::UnsupportedSkyDataType;
+                    }
                 }
+                out.put(CSV_DELIM);
             }
-            std::cout << CSV_DELIM;
+            out.put('\n');  // newline to start next row.
         }
-        if (print_verbose) {
-            // Print RID
-            auto print_array = chunk_vec[ARROW_RID_INDEX(num_cols)];
-            std::cout << std::to_string(std::static_pointer_cast<arrow::Int64Array>(print_array)->Value(i)) << CSV_DELIM;
-
-            // Print Deleted Vector
-            print_array = chunk_vec[ARROW_DELVEC_INDEX(num_cols)];
-            std::cout << std::to_string(std::static_pointer_cast<arrow::BooleanArray>(print_array)->Value(i)) << CSV_DELIM;
-        }
-        std::cout << std::endl;  // newline to start next row.
     }
     return counter;
 }
@@ -3212,14 +5185,29 @@ long long int printArrowbufRowAsPGBinary(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print)
+        long long int max_to_print,
+        std::ostream& out)
+{
+    OutputBuffer buf;
+    long long int counter = printArrowbufRowAsPGBinary(dataptr, datasz,
+                                                       print_header,
+                                                       print_verbose,
+                                                       max_to_print, buf);
+    out.write(buf.data(), buf.size());
+    return counter;
+}
+
+long long int printArrowbufRowAsPGBinary(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out)
 {
 
     // Each column in arrow is represented using Chunked Array. A chunked array is
     // a vector of chunks i.e. arrays which holds actual data.
-
-    // Declare vector for columns (i.e. chunked_arrays)
-    std::vector<std::shared_ptr<arrow::Array>> chunk_vec;
     std::shared_ptr<arrow::Table> table;
     std::shared_ptr<arrow::Buffer> buffer;
 
@@ -3232,253 +5220,92 @@ long long int printArrowbufRowAsPGBinary(
     auto schema = table->schema();
     auto metadata = schema->metadata();
     schema_vec sc = schemaFromString(metadata->value(METADATA_DATA_SCHEMA));
-    int num_rows = std::stoi(metadata->value(METADATA_NUM_ROWS));
-
-    // postgres fstreams expect big endianness
-    bool big_endian = is_big_endian();
-    stringstream ss(std::stringstream::in |
-                    std::stringstream::out|
-                    std::stringstream::binary);
 
     // print binary stream header sequence first time only
-    if (print_header) {
-
-        // 11 byte signature sequence
-        const char* header_signature = "PGCOPY\n\377\r\n\0";
-        ss.write(header_signature, 11);
-
-        // 32 bit flags field, set bit#16=1 only if OIDs included in data
-        int flags_field = 0;
-        ss.write(reinterpret_cast<const char*>(&flags_field),
-                 sizeof(flags_field));
-
-        // 32 bit extra header len
-        int header_extension_len = 0;
-        ss.write(reinterpret_cast<const char*>(&header_extension_len),
-                 sizeof(header_extension_len));
-    }
+    if (print_header)
+        appendPGBinaryHeader(out);
 
-    // Get the names of each column and get the vector of chunks
-    for (auto it = sc.begin(); it != sc.end(); ++it) {
-        chunk_vec.emplace_back(table->column(std::distance(sc.begin(), it))->chunk(0));
-    }
+    // The rows are printed one record batch at a time
+    std::vector<arrow_batch> batches;
+    if (arrow_table_batches(table, batches) != 0)
+        return TablesErrCodes::ArrowStatusErr;
 
     // 16 bit int, assumes same num cols for all rows below.
     int16_t ncols = static_cast<int16_t>(sc.size());
-    if (!big_endian)
-        ncols = __builtin_bswap16(ncols);
+    out.reserve(out.size() + datasz);
 
     // row printing counter, used with --limit flag
     long long int counter = 0;
-    for (int i = 0; i < num_rows; i++, counter++) {
+    std::vector<arrow_col_reader> cols;
+    for (auto b = batches.begin(); b != batches.end(); ++b) {
         if (counter >= max_to_print) break;
-        // TODO: if (root.delete_vec.at(i) == 1) continue;
 
-        // 16 bit int num cols in this row (all rows same ncols currently)
-        ss.write(reinterpret_cast<const char*>(&ncols), sizeof(ncols));
+        int ret = arrow_batch_readers(b->table, sc, false, cols);
+        if (ret != 0)
+            return ret;
 
-        // For this row get the data from each columns
-        for (auto it = sc.begin(); it != sc.end(); ++it) {
-            col_info col = *it;
-            auto print_array = chunk_vec[std::distance(sc.begin(), it)];
+        int64_t nrows = b->table->num_rows();
+        for (int64_t i = 0; i < nrows; i++, counter++) {
+            if (counter >= max_to_print) break;
+            // TODO: if (root.delete_vec.at(i) == 1) continue;
 
-            if (print_array->IsNull(i)) {
-                // for null we only write the int representation of null,
-                // followed by no data
-                ss.write(reinterpret_cast<const char*>(&PGNULLBINARY),
-                         sizeof(PGNULLBINARY));
-                continue;
-            }
+            // 16 bit int num cols in this row (all rows same ncols currently)
+            out.appendBigEndian(ncols);
 
-            switch(col.type) {
-                case SDT_BOOL: {
-                    uint8_t val = std::static_pointer_cast<arrow::BooleanArray>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        // val is single byte, has no endianness
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_INT8: {
-                    int8_t val = std::static_pointer_cast<arrow::Int8Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        // val is single byte, has no endianness
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_INT16: {
-                    int16_t val = std::static_pointer_cast<arrow::Int16Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        val = __builtin_bswap16(val);
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_INT32: {
-                    int32_t val = std::static_pointer_cast<arrow::Int32Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        val = __builtin_bswap32(val);
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_INT64: {
-                    int64_t val = std::static_pointer_cast<arrow::Int64Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        val = __builtin_bswap64(val);
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_UINT8: {
-                    uint8_t val = std::static_pointer_cast<arrow::UInt8Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        // val is single byte, has no endianness
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_UINT16: {
-                    uint16_t val = std::static_pointer_cast<arrow::UInt16Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        val = __builtin_bswap16(val);
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_UINT32: {
-                    uint32_t val =std::static_pointer_cast<arrow::UInt32Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        val = __builtin_bswap32(val);
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_UINT64: {
-                    uint64_t val = std::static_pointer_cast<arrow::UInt64Array>(print_array)->Value(i);
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        val = __builtin_bswap64(val);
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_CHAR: {
-                    int8_t val = static_cast<char>(std::static_pointer_cast<arrow::Int8Array>(print_array)->Value(i));
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        // val is single byte, has no endianness
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_UCHAR: {
-                    uint8_t val = static_cast<unsigned char>(std::static_pointer_cast<arrow::UInt8Array>(print_array)->Value(i));
-                    int32_t len = sizeof(val);
-                    if (!big_endian) {
-                        // val is single byte, has no endianness
-                        len = __builtin_bswap32(len);
-                    }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_FLOAT:
-                case SDT_DOUBLE: {
-                    // postgres float is alias for double, so we always output a binary double.
-                    double val = 0.0;
-                    if (col.type == SDT_FLOAT)
-                        val = std::static_pointer_cast<arrow::FloatArray>(print_array)->Value(i);
-                    else
-                        val = std::static_pointer_cast<arrow::DoubleArray>(print_array)->Value(i);
-                    int32_t len = 8;
-                    if (!big_endian) {
-                        char val_bigend[len];
-                        char* vptr = (char*)&val;
-                        val_bigend[0]=vptr[7];
-                        val_bigend[1]=vptr[6];
-                        val_bigend[2]=vptr[5];
-                        val_bigend[3]=vptr[4];
-                        val_bigend[4]=vptr[3];
-                        val_bigend[5]=vptr[2];
-                        val_bigend[6]=vptr[1];
-                        val_bigend[7]=vptr[0];
-                        len = __builtin_bswap32(len);
-                        ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                        ss.write(val_bigend, sizeof(val));
-                    }
-                    else {
-                        ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                        ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    }
-                    break;
+            // For this row get the data from each columns
+            for (auto c = cols.begin(); c != cols.end(); ++c) {
+                if (c->isNull(i)) {
+                    // for null we only write the int representation of null,
+                    // followed by no data
+                    out.appendPGNull();
+                    continue;
                 }
-                case SDT_DATE: {
-                    // postgres uses 4 byte int date vals, offset by pg epoch
-                    std::string strdate = std::static_pointer_cast<arrow::StringArray>(print_array)->GetString(i);
-                    int32_t len = sizeof(int32_t);
-                    boost::gregorian::date d = \
-                        boost::gregorian::from_string(strdate);
-                    int32_t val = d.julian_day() - Tables::POSTGRES_EPOCH_JDATE;
-                    if (!big_endian) {
-                        val = __builtin_bswap32(val);
-                        len = __builtin_bswap32(len);
+
+                switch(c->type) {
+                    case SDT_BOOL:
+                        out.appendPGField(static_cast<uint8_t>(c->boolValue(i)));
+                        break;
+                    case SDT_INT8:
+                    case SDT_CHAR:
+                        out.appendPGField(c->value<int8_t>(i));
+                        break;
+                    case SDT_INT16: out.appendPGField(c->value<int16_t>(i)); break;
+                    case SDT_INT32: out.appendPGField(c->value<int32_t>(i)); break;
+                    case SDT_INT64: out.appendPGField(c->value<int64_t>(i)); break;
+                    case SDT_UINT8:
+                    case SDT_UCHAR:
+                        out.appendPGField(c->value<uint8_t>(i));
+                        break;
+                    case SDT_UINT16: out.appendPGField(c->value<uint16_t>(i)); break;
+                    case SDT_UINT32: out.appendPGField(c->value<uint32_t>(i)); break;
+                    case SDT_UINT64: out.appendPGField(c->value<uint64_t>(i)); break;
+
+                    // postgres float is alias for double, so we always
+                    // output a binary double.
+                    case SDT_FLOAT:
+                        out.appendPGField(static_cast<double>(c->value<float>(i)));
+                        break;
+                    case SDT_DOUBLE: out.appendPGField(c->value<double>(i)); break;
+                    case SDT_DATE: {
+                        // postgres uses 4 byte int date vals, offset by pg epoch
+                        int32_t len = 0;
+                        const char* s = c->strValue(i, &len);
+                        out.appendPGField(pgBinaryDate(s, len));
+                        break;
                     }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(reinterpret_cast<const char*>(&val), sizeof(val));
-                    break;
-                }
-                case SDT_STRING: {
-                    std::string val = std::static_pointer_cast<arrow::StringArray>(print_array)->GetString(i);
-                    int32_t len = val.length();
-                    if (!big_endian) {
-                        // val is byte array, has no endianness
-                        len = __builtin_bswap32(len);
+                    case SDT_STRING: {
+                        int32_t len = 0;
+                        const char* s = c->strValue(i, &len);
+                        out.appendPGField(s, len);
+                        break;
                     }
-                    ss.write(reinterpret_cast<const char*>(&len), sizeof(len));
-                    ss.write(val.c_str(), static_cast<int>(val.length()));
-                    break;
+                    default: {
+                        return TablesErrCodes::UnsupportedSkyDataType;
                     }
-                default: {
-                    return TablesErrCodes::UnsupportedSkyDataType;
                 }
             }
         }
     }
-
-    // rewind and output all row data for this fb
-    ss.seekg (0, ios::beg);
-    std::cout << ss.rdbuf();
-    ss.flush();
     return counter;
 }
 
@@ -3488,14 +5315,27 @@ long long int printArrowbufRowAsPyArrowBinary(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print)
+        long long int max_to_print,
+        std::ostream& out)
 {
+    OutputBuffer buf;
+    long long int num_rows = printArrowbufRowAsPyArrowBinary(dataptr, datasz,
+                                                             print_header,
+                                                             print_verbose,
+                                                             max_to_print,
+                                                             buf);
+    out.write(buf.data(), buf.size());
+    return num_rows;
+}
 
-    // Each column in arrow is represented using Chunked Array. A chunked array is
-    // a vector of chunks i.e. arrays which holds actual data.
-
-    // Declare vector for columns (i.e. chunked_arrays)
-    std::vector<std::shared_ptr<arrow::Array>> chunk_vec;
+long long int printArrowbufRowAsPyArrowBinary(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out)
+{
     std::shared_ptr<arrow::Table> table;
     std::shared_ptr<arrow::Buffer> buffer;
     std::string str_buff(dataptr, datasz);
@@ -3506,33 +5346,22 @@ long long int printArrowbufRowAsPyArrowBinary(
     // which is stored as a metadata
     auto schema = table->schema();
     auto metadata = schema->metadata();
-    schema_vec sc = schemaFromString(metadata->value(PYARROW_METADATA_DATA_SCHEMA));
     int num_rows = table->num_rows();
 
     if (print_verbose) {
-        std::cout << "\n\n\n[SKYHOOKDM PyArrow HEP HEADER]\n"
-                  << ToString(PYARROW_METADATA_DATA_SCHEMA) << ":"
-                  << metadata->value(PYARROW_METADATA_DATA_SCHEMA)
-                  << std::endl;
+        std::stringstream ss;
+        ss << "\n\n\n[SKYHOOKDM PyArrow HEP HEADER]\n"
+           << ToString(PYARROW_METADATA_DATA_SCHEMA) << ":"
+           << metadata->value(PYARROW_METADATA_DATA_SCHEMA)
+           << std::endl;
+        out.append(ss.str());
     }
 
-    // output binary buffer as sstream for pyarrow consumption.
-    stringstream ss(std::stringstream::in  |
-                    std::stringstream::out |
-                    std::stringstream::binary);
-
-
-    // add buf len to output
+    // output the buf len (native byte order) then the arrow buf itself, for
+    // pyarrow consumption.
     uint64_t buf_len = static_cast<uint64_t>(datasz);
-    ss.write(reinterpret_cast<const char*>(&buf_len), sizeof(buf_len));
-
-    // add const char* arrow buf
-    ss.write(dataptr, datasz);
-
-    // rewind and output the stream
-    ss.seekg (0, ios::beg);
-    std::cout << ss.rdbuf();
-    ss.flush();
+    out.append(reinterpret_cast<const char*>(&buf_len), sizeof(buf_len));
+    out.append(dataptr, datasz);
 
     // TODO: ignores deleted rows for now.
     // max_to_print unused here, we just output the existing arrow table
@@ -3540,7 +5369,6 @@ long long int printArrowbufRowAsPyArrowBinary(
     return num_rows;
 }
 
-
 /*
  * Function: transform_fb_to_arrow
  * Description: Build arrow schema vector using skyhook schema information. Get the
@@ -3572,6 +5400,10 @@ int transform_fb_to_arrow(const char* fb,
     std::vector<std::shared_ptr<arrow::Field>> schema_vector;
     std::shared_ptr<arrow::KeyValueMetadata> metadata (new arrow::KeyValueMetadata);
 
+    // the dictionaries of the query cols that stay encoded, as arrow
+    // dictionary arrays of the int32 codes
+    std::vector<const dict_values*> dict_cols(query_schema.size(), NULL);
+
     // Add skyhook metadata to arrow metadata.
     // NOTE: Preserve the order of appending, as later they will be referenced using
     // enums.
@@ -3709,6 +5541,16 @@ int transform_fb_to_arrow(const char* fb,
             }
             case SDT_DATE:
             case SDT_STRING: {
+                const dict_values* dict = root.dicts.get(col.idx);
+                if (dict != NULL) {
+                    dict_cols[std::distance(query_schema.begin(), it)] = dict;
+                    auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::Int32Builder(pool));
+                    builder_list.emplace_back(ptr.get());
+                    ptr.release();
+                    schema_vector.push_back(arrow::field(col.name,
+                        arrow::dictionary(arrow::int32(), arrow::utf8())));
+                    break;
+                }
                 auto ptr = std::unique_ptr<arrow::ArrayBuilder>(new arrow::StringBuilder(pool));
                 builder_list.emplace_back(ptr.get());
                 ptr.release();
@@ -3754,13 +5596,7 @@ int transform_fb_to_arrow(const char* fb,
             col_info col = *it;
 
             if (col.nullable) {  // check nullbit
-                bool is_null = false;
-                int pos = col.idx / (8*sizeof(rec.nullbits.at(0)));
-                int col_bitmask = 1 << col.idx;
-                if ((col_bitmask & rec.nullbits.at(pos)) == 1)  {
-                    is_null = true;
-                }
-                if (is_null) {
+                if (isNullBitSet(rec.nullbits, col.idx)) {
                     builder->AppendNull();
                     continue;
                 }
@@ -3810,7 +5646,10 @@ int transform_fb_to_arrow(const char* fb,
                     break;
                 case SDT_DATE:
                 case SDT_STRING:
-                    static_cast<arrow::StringBuilder *>(builder)->Append(row[col.idx].AsString().str());
+                    if (dict_cols[std::distance(query_schema.begin(), it)])
+                        static_cast<arrow::Int32Builder *>(builder)->Append(row[col.idx].AsUInt32());
+                    else
+                        static_cast<arrow::StringBuilder *>(builder)->Append(row[col.idx].AsString().str());
                     break;
                 default: {
                     errcode = TablesErrCodes::UnsupportedSkyDataType;
@@ -3828,13 +5667,35 @@ int transform_fb_to_arrow(const char* fb,
         static_cast<arrow::BooleanBuilder *>(builder_list[ARROW_DELVEC_INDEX(num_cols)])->Append(del_vec[i]);
     }
 
-    // Finalize the arrays holding the data
+    // Finalize the arrays holding the data, the codes of an encoded col are
+    // the indices into an array of its dictionary values
     for (auto it = builder_list.begin(); it != builder_list.end(); ++it) {
         auto builder = *it;
         std::shared_ptr<arrow::Array> array;
         builder->Finish(&array);
-        array_list.push_back(array);
         delete builder;
+        unsigned i = std::distance(builder_list.begin(), it);
+        const dict_values* dict = i < dict_cols.size() ? dict_cols[i] : NULL;
+        if (dict != NULL and !errcode) {
+            arrow::StringBuilder dict_builder(pool);
+            for (unsigned k = 0; k < dict->size(); k++)
+                dict_builder.Append(dict->Get(k)->c_str(), dict->Get(k)->size());
+            std::shared_ptr<arrow::Array> dictionary;
+            dict_builder.Finish(&dictionary);
+            arrow::Result<std::shared_ptr<arrow::Array>> result = \
+                arrow::DictionaryArray::FromArrays(schema_vector[i]->type(),
+                                                   array, dictionary);
+            if (result.ok()) {
+                array = std::move(result).ValueOrDie();
+            } else {
+                errcode = TablesErrCodes::ArrowStatusErr;
+                errmsg.append("ERROR transform_row_to_col(): table=" +
+                              root.table_name + " col=" +
+                              query_schema[i].name +
+                              " codes outside of its dictionary.");
+            }
+        }
+        array_list.push_back(array);
     }
 
     // Generate schema from schema vector and add the metadata
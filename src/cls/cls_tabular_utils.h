@@ -16,6 +16,12 @@
 #include <sstream>
 #include <type_traits>
 #include <bitset>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <algorithm>
+#include <memory>
+#include <unordered_map>
 
 #include <include/types.h>
 #include <errno.h>
@@ -82,7 +88,13 @@ enum TablesErrCodes {
     EINVALID_TRANSFORM_FORMAT,
     EDECODE_BUFFERLIST_FAILURE,
     ECLIENTSIDE_PROCESSING_FAILURE,
-    ESTORAGESIDE_PROCESSING_FAILURE
+    ESTORAGESIDE_PROCESSING_FAILURE,
+    GroupByRequiresAggPreds,
+    OrderByRequiresLimit,
+    OrderByColNotProjected,
+    BlobCompressionTypeNotRecognized,
+    BlobCompressionFailure,
+    BlobDecompressionFailure
 };
 
 // skyhook data types, as supported by underlying data format
@@ -145,6 +157,7 @@ enum SkyOpType {
     SOT_max,
     SOT_sum,
     SOT_cnt,
+    SOT_avg,  // client side only, pushed down as a sum and a cnt
     // LEXICAL (regex)
     SOT_like,
     // MEMBERSHIP (collections) (TODO)
@@ -175,6 +188,7 @@ enum SkyIdxType
     SIT_IDX_RID,
     SIT_IDX_REC,
     SIT_IDX_TXT,
+    SIT_IDX_ZONE,
     SIT_IDX_UNK
 };
 
@@ -197,6 +211,7 @@ const std::map<SkyIdxType, std::string> SkyIdxTypeMap = {
     {SIT_IDX_RID, "IDX_RID"},
     {SIT_IDX_REC, "IDX_REC"},
     {SIT_IDX_TXT, "IDX_TXT"},
+    {SIT_IDX_ZONE, "IDX_ZMP"},
     {SIT_IDX_UNK, "IDX_UNK"}
 };
 
@@ -212,15 +227,17 @@ enum AggColIdx {
     AGG_COL_MAX = -2,
     AGG_COL_SUM = -3,
     AGG_COL_CNT = -4,
+    AGG_COL_AVG = -5,
     AGG_COL_FIRST = AGG_COL_MIN,
-    AGG_COL_LAST = AGG_COL_CNT,
+    AGG_COL_LAST = AGG_COL_AVG,
 };
 
 const std::map<std::string, int> AGG_COL_IDX = {
     {"min", AGG_COL_MIN},
     {"max", AGG_COL_MAX},
     {"sum", AGG_COL_SUM},
-    {"cnt", AGG_COL_CNT}
+    {"cnt", AGG_COL_CNT},
+    {"avg", AGG_COL_AVG}
 };
 
 const std::unordered_map<std::string, bool> IDX_STOPWORDS= {
@@ -245,6 +262,7 @@ const int offset_to_nullbits_vec = 6;
 const int offset_to_data = 8;
 const std::string PRED_DELIM_OUTER = ";";
 const std::string PRED_DELIM_INNER = ",";
+const std::string PRED_IN_DELIM = "|";  // between the values of an in pred
 const std::string PROJECT_DEFAULT = "*";
 const std::string SELECT_DEFAULT = "*";
 const std::string REGEX_DEFAULT_PATTERN = "/.^/";  // matches nothing.
@@ -253,6 +271,32 @@ const int MAX_TABLE_COLS = 128; // affects nullbits vector size (skyroot)
 const int MAX_INDEX_COLS = 4;
 const int DATASTRUCT_SEQ_NUM_MIN = 0;
 const int DATASTRUCT_SEQ_NUM_MAX = 10000;  // max per obj, before compaction
+const int IDX_BATCH_SIZE_DEFAULT = 1000;  // omap keys per batch when unset
+const int READ_BATCH_BYTES_MAX = 1 << 23;  // max len of coalesced fb reads
+const int ARROW_BATCH_BYTES_AUTO = 1 << 18;  // arrow batch len when auto sized
+const int QUERY_THREADS_MAX = 8;  // max threads per exec_query_op call
+const int QUERY_OSD_THREADS_MAX = 16;  // max extra query threads per OSD
+const int QUERY_THREAD_FBS = 4;   // fbmetas per thread per wave of reads
+const int TXT_POSTINGS_BLOCK = 128; // postings per block of a text index list
+const int QUERY_PLAN_CACHE_MAX = 64;  // parsed query plans cached per OSD
+const std::string COL_STATS_KEY_PREFIX = "COL_STATS";
+
+// index planning, selectivity used for preds on cols without col_stats
+const double SELECTIVITY_DEFAULT_EQ = 0.10;
+const double SELECTIVITY_DEFAULT_RANGE = 0.33;
+
+// index planning, relative cost of an omap index key fetch vs a row read
+const double COST_IDX_KEY_FETCH = 4.0;
+const double COST_ROW_READ = 1.0;
+
+// runstats, one of every stride rows is sampled and nbins hist bins per col
+const int STATS_SAMPLE_STRIDE_LOW = 100;
+const int STATS_SAMPLE_STRIDE_MED = 10;
+const int STATS_SAMPLE_STRIDE_HIGH = 1;
+const int STATS_NBINS_LOW = 8;
+const int STATS_NBINS_MED = 16;
+const int STATS_NBINS_HIGH = 32;
+const int STATS_SKETCH_BITS = 10;  // 2^bits distinct sketch registers
 const char CSV_DELIM = '|';
 const std::string IDX_KEY_DELIM_INNER = "-";
 const std::string IDX_KEY_DELIM_OUTER = ":";
@@ -311,6 +355,35 @@ public:
     PredicateValue& operator=(const PredicateValue& rhs);
 };
 
+// matcher of a LIKE pred pattern, compiled once per pred.  Patterns that
+// are a plain literal, optionally anchored by ^ and/or $, are matched with
+// memchr/memmem, others with the compiled regex (partial match).
+class LikeMatcher
+{
+public:
+    enum MatchKind {
+        LIKE_REGEX,
+        LIKE_ANY,       // empty pattern
+        LIKE_CONTAINS,  // lit
+        LIKE_PREFIX,    // ^lit
+        LIKE_SUFFIX,    // lit$
+        LIKE_EXACT      // ^lit$
+    };
+
+    explicit LikeMatcher(const std::string& pattern);
+
+    bool ok() const {return regx.ok();}
+    int kind() const {return match_kind;}
+    const std::string& pattern() const {return regx.pattern();}
+    bool match(const char* s, size_t len) const;
+    bool match(const std::string& s) const {return match(s.data(), s.size());}
+
+private:
+    re2::RE2 regx;
+    int match_kind;
+    std::string literal;
+};
+
 // PredBase is not template typed, derived is type templated,
 // allows us to have vectors of chained base class predicates
 class PredicateBase
@@ -323,6 +396,7 @@ public:
     virtual int chainOpType() = 0;
     virtual bool isGlobalAgg() = 0;
     virtual std::string toString() = 0;
+    virtual PredicateBase* clone() = 0;  // heap copy, caller owns
 };
 typedef std::vector<class PredicateBase*> predicate_vec;
 
@@ -334,7 +408,8 @@ private:
     const int col_type;
     const int op_type;
     const bool is_global_agg;
-    const re2::RE2* regx;
+    // LIKE preds only, shared by copies since matching is const/thread-safe
+    std::shared_ptr<const LikeMatcher> matcher;
     PredicateValue<T> value;
     const int chain_op_type;
 
@@ -344,7 +419,8 @@ public:
         col_type(type),
         op_type(op),
         is_global_agg(op==SOT_min || op==SOT_max ||
-                      op==SOT_sum || op==SOT_cnt),
+                      op==SOT_sum || op==SOT_cnt || op==SOT_avg),
+        matcher(nullptr),
         value(val),
         chain_op_type(ch_op) {
 
@@ -366,8 +442,12 @@ public:
                 case SOT_max:
                 case SOT_sum:
                 case SOT_cnt:
+                case SOT_avg:
                     assert (
                             (col_type==SDT_DATE) or
+                            ((std::is_same<T, std::string>::value) and
+                             col_type==SDT_STRING and
+                             op_type <= SOT_geq) or
                             (std::is_arithmetic<T>::value and
                             (col_type==SDT_INT8 ||
                              col_type==SDT_INT16 ||
@@ -399,10 +479,12 @@ public:
                     break;
 
                 // MEMBERSHIP (collections)
+                // string cols only, the value lists the members separated
+                // by PRED_IN_DELIM
                 case SOT_in:
                 case SOT_not_in:
-                    assert(((std::is_same<T, std::vector<T>>::value) == true));
-                    assert (TablesErrCodes::OpNotImplemented==0); // TODO
+                    assert ((std::is_same<T, std::string>::value) and
+                            col_type==SDT_STRING);
                     break;
 
                 // DATE (SQL)
@@ -450,8 +532,8 @@ public:
             std::string pattern;
             if (op_type == SOT_like) {
                 pattern = this->Val();  // force str type for regex
-                regx = new re2::RE2(pattern);
-                assert (regx->ok());
+                matcher = std::make_shared<const LikeMatcher>(pattern);
+                assert (matcher->ok());
             }
         }
 
@@ -460,11 +542,11 @@ public:
         col_type(p.col_type),
         op_type(p.op_type),
         is_global_agg(p.is_global_agg),
-        value(p.value.val) {
-            regx = new re2::RE2(p.regx->pattern());
-        }
+        matcher(p.matcher),
+        value(p.value.val),
+        chain_op_type(p.chain_op_type) {}
 
-    ~TypedPredicate() { }
+    ~TypedPredicate() {}
     TypedPredicate& getThis() {return *this;}
     const TypedPredicate& getThis() const {return *this;}
     virtual int colIdx() {return col_idx;}
@@ -473,7 +555,7 @@ public:
     virtual int chainOpType() {return chain_op_type;}
     virtual bool isGlobalAgg() {return is_global_agg;}
     T Val() {return value.val;}
-    const re2::RE2* getRegex() {return regx;}
+    const LikeMatcher* getMatcher() {return matcher.get();}
     void updateAgg(T newval) {value.val = newval;}
 
     std::string toString() {
@@ -488,6 +570,8 @@ public:
         s.append("\n");
         return s;
     }
+
+    virtual PredicateBase* clone() {return new TypedPredicate(*this);}
 };
 
 // col metadata used for the schema
@@ -581,6 +665,93 @@ typedef vector<uint64_t> nullbits_vector;
 typedef vector<uint64_t> cols_rids_vector;
 typedef flexbuffers::Reference row_data_ref;
 
+// the distinct values of a dictionary encoded col, value i has code i
+typedef flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> dict_values;
+
+// the dictionaries of the string/date cols of a flatbuf that are dictionary
+// encoded, by col position within the flexbuf rows.  The rows of an encoded
+// col hold the uint code of their value instead of the string itself.
+class FbDicts {
+public:
+    FbDicts() {}
+    explicit FbDicts(const Tables::Table* root);
+
+    bool empty() const {return cols.empty();}
+
+    // dictionary of the col at pos, or NULL if it holds plain strings
+    const dict_values* get(int pos) const {
+        if (pos < 0 or pos >= static_cast<int>(cols.size()))
+            return NULL;
+        return cols[pos];
+    }
+
+    // positions of the encoded cols
+    std::vector<int> positions() const;
+
+    // the string value of the col at pos of a row, decoded if encoded.
+    // a code outside of its dictionary reads as the empty string.
+    const char* getChars(const flexbuffers::Vector& row, int pos,
+                         size_t* len) const;
+    std::string getString(const flexbuffers::Vector& row, int pos) const {
+        size_t len = 0;
+        const char* s = getChars(row, pos, &len);
+        return std::string(s, len);
+    }
+
+private:
+    std::vector<const dict_values*> cols;
+};
+
+// assigns the codes of the encoded cols of a flatbuf being built, in first
+// seen order, and adds their dictionaries to the flatbuf when finished.
+class DictEncoder {
+public:
+    DictEncoder() {}
+    explicit DictEncoder(const std::vector<int>& encode_cols);
+
+    bool empty() const {return dicts.empty();}
+    bool encodes(int pos) const {
+        return pos >= 0 and pos < static_cast<int>(slots.size()) and
+               slots[pos] >= 0;
+    }
+
+    // code of the value of the encoded col at pos, added if not yet seen
+    uint32_t code(int pos, const char* s, size_t len);
+
+    // the dictionaries of the cols, to add to the flatbuf's root table
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>>>
+    finish(flatbuffers::FlatBufferBuilder& fbb) const;
+
+    // forget the values seen, the same cols are encoded for the next fb
+    void clear();
+
+private:
+    struct col_dict {
+        int pos;
+        std::unordered_map<std::string, uint32_t> codes;
+        std::vector<std::string> values;
+    };
+    std::vector<int> slots;  // index into dicts by col position, or -1
+    std::vector<col_dict> dicts;
+};
+
+// copy the dictionaries of the cols at src_pos[j] of a flatbuf, as those of
+// col j of the rows of another flatbuf, or 0 if none of them are encoded.
+flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>>>
+copyDicts(flatbuffers::FlatBufferBuilder& fbb,
+          const FbDicts& dicts,
+          const std::vector<int>& src_pos);
+
+// build a data row of a flatbuf with the dictionaries src into flexbldr, for
+// a flatbuf with the codes of dst.  the string/date cols that dst encodes
+// are added as its codes, all other cols as plain values.  the row is not
+// finished.
+void recodeFlexRow(flexbuffers::Builder& flexbldr,
+                   const flexbuffers::Vector& row,
+                   const schema_vec& data_schema,
+                   const FbDicts& src,
+                   DictEncoder& dst);
+
 // this flatbuf meta wrappers allows read/write transfer of a single,
 // complete, self-contained serialized data format on disk or wire.
 // data_ptr refers to the blob on disk, where the blob is of
@@ -590,11 +761,12 @@ struct fb_meta_format {
 
     size_t blob_orig_off;  // optional: offset of blob data in orig file
     size_t blob_orig_len;  // optional: num bytes in orig file
-    int blob_compression;  // optional: populated by enum {none, lzw, ...}
+    int blob_compression;  // optional: populated by enum CompressionType
     int blob_format;       // required: enum SkyFormatType (flatbuf,arrow, ...)
     bool blob_deleted;     // required: has this data been deleted?
     size_t blob_size;      // required: number of bytes in data blob
     const char* blob_data; // required: actual formatted data
+    size_t blob_raw_size;  // optional: num bytes of blob data uncompressed
 
     fb_meta_format (
         size_t _blob_orig_off,
@@ -603,14 +775,16 @@ struct fb_meta_format {
         int _blob_format,
         bool _blob_deleted,
         size_t _blob_size,
-        const char* _blob_data) :
+        const char* _blob_data,
+        size_t _blob_raw_size=0) :
                                 blob_orig_off(_blob_orig_off),
                                 blob_orig_len(_blob_orig_len),
                                 blob_compression(_blob_compression),
                                 blob_format(_blob_format),
                                 blob_deleted(_blob_deleted),
                                 blob_size(_blob_size),
-                                blob_data(_blob_data) {};
+                                blob_data(_blob_data),
+                                blob_raw_size(_blob_raw_size) {};
 };
 typedef struct fb_meta_format sky_meta;
 
@@ -638,6 +812,9 @@ struct root_table {
     uint32_t nrows;
     uint32_t ncols;
 
+    // dictionaries of the encoded cols of flatbuf rows, if any
+    FbDicts dicts;
+
     root_table(
         int _skyhook_version,
         int _data_format_type,
@@ -648,7 +825,8 @@ struct root_table {
         std::string _table_name,
         delete_vector _delete_vec,
         const void *_data_vec,
-        uint32_t _nrows) :
+        uint32_t _nrows,
+        FbDicts _dicts=FbDicts()) :
                         skyhook_version(_skyhook_version),
                         data_format_type(_data_format_type),
                         data_structure_version(_data_structure_version),
@@ -658,7 +836,8 @@ struct root_table {
                         table_name(_table_name),
                         delete_vec(_delete_vec),
                         data_vec(_data_vec),
-                        nrows(_nrows) {
+                        nrows(_nrows),
+                        dicts(_dicts) {
                             Tables::schema_vec v = \
                                 Tables::schemaFromString(data_schema);
                             ncols = v.size();
@@ -686,6 +865,89 @@ struct rec_table {
 };
 typedef struct rec_table sky_rec;
 
+// the nullbit of col idx is bit (63 - idx % 64) of word idx / 64, the order
+// written by sky_tabular_flatflex_writer.
+inline uint64_t nullbitMask(int idx) {
+    return 1ULL << (63 - (idx % 64));
+}
+inline bool isNullBitSet(const nullbits_vector& nullbits, int idx) {
+    return (nullbits.at(idx / 64) & nullbitMask(idx)) != 0;
+}
+inline void setNullBit(nullbits_vector& nullbits, int idx) {
+    nullbits.at(idx / 64) |= nullbitMask(idx);
+}
+
+// set of row numbers within one flatbuf, as a bitmap of only the words
+// covering [first row, last row], since index matches are often clustered.
+class RowBitmap {
+public:
+    RowBitmap() : base(0) {}
+
+    void set(uint32_t row);
+    bool test(uint32_t row) const;
+    bool empty() const {return words.empty();}
+    uint32_t count() const;
+
+    // keep only rows in both, or add the rows of other
+    void andWith(const RowBitmap& other);
+    void orWith(const RowBitmap& other);
+
+    // append the rows in ascending order to out
+    void toRowNums(std::vector<uint32_t>& out) const;
+    std::string toString() const;
+
+private:
+    uint32_t base;  // word index of words[0]
+    std::vector<uint64_t> words;
+    void trim();    // drop empty words at either end
+};
+
+// the logical location of a row containing a word of a text index
+struct txt_posting {
+    uint32_t fb_num;
+    uint32_t row_num;
+
+    bool operator<(const txt_posting& p) const {
+        return fb_num < p.fb_num or
+               (fb_num == p.fb_num and row_num < p.row_num);
+    }
+    bool operator==(const txt_posting& p) const {
+        return fb_num == p.fb_num and row_num == p.row_num;
+    }
+};
+typedef std::vector<txt_posting> txt_postings_vec;
+
+// encode the postings of a word, sorted and without duplicates, as a list.
+void encodeTxtPostings(const txt_postings_vec& postings,
+                       struct idx_txt_postings& list);
+
+// append sorted postings to a list, re-encoding none of its blocks.
+// postings not after the last of the list are skipped, so the fbs of an
+// incremental build may be posted again.
+void appendTxtPostings(const txt_postings_vec& postings,
+                       struct idx_txt_postings& list);
+
+// iterates the postings of a list in ascending order, decoding one block
+// at a time, and seek() skips any blocks preceding the target.
+class TxtPostingsCursor {
+public:
+    explicit TxtPostingsCursor(const struct idx_txt_postings& _list);
+
+    bool valid() const {return pos < list.npostings;}
+    const txt_posting& value() const {return cur;}
+    void next();
+
+    // advance to the first posting >= target
+    void seek(const txt_posting& target);
+
+private:
+    const struct idx_txt_postings& list;
+    uint32_t pos;   // index of cur within all postings
+    size_t off;     // offset of the next delta
+    txt_posting cur;
+    void loadBlock(uint32_t block);
+};
+
 // holds the result of a read to be done, resulting from an index lookup
 // regarding specific flatbufs+rows to be read or else a seq of all flatbufs
 // for which this struct is used to identify the physical location of the
@@ -694,38 +956,35 @@ struct read_info {
     int fb_seq_num;
     int off;
     int len;
-    std::vector<unsigned int> rnums;  //default to empty to read all rows
+    RowBitmap rows;  //default to empty to read all rows
 
     read_info(int _fb_seq_num,
               int _off,
               int _len,
-              std::vector<unsigned> _rnums) :
+              const RowBitmap& _rows) :
         fb_seq_num(_fb_seq_num),
         off(_off),
         len(_len),
-        rnums(_rnums) {};
+        rows(_rows) {};
 
     read_info(const read_info& r) :
         fb_seq_num(r.fb_seq_num),
         off(r.off),
         len(r.len),
-        rnums(r.rnums) {};
+        rows(r.rows) {};
 
     read_info() :
         fb_seq_num(),
         off(),
         len(),
-        rnums() {};
+        rows() {};
 
     std::string toString() {
-        std::string rows_str;
-        for (auto it = rnums.begin(); it != rnums.end(); ++it)
-            rows_str.append((std::to_string(*it) + ","));
         std::string s;
         s.append("index_read_info.fb_num=" + std::to_string(fb_seq_num));
         s.append("; index_read_info.off=" + std::to_string(off));
         s.append("; index_read_info.len=" + std::to_string(len));
-        s.append("; index_read_info.rnums=" + rows_str);
+        s.append("; index_read_info.rows=" + rows.toString());
         return s;
     }
 };
@@ -768,8 +1027,9 @@ const std::string TPCH_LINEITEM_TEST_SCHEMA_STRING_PROJECT = " \
 
 const std::string JSON_SAMPLE = "{\"V\":\"veruca\",\"S\":\"salt\"}";
 
-// creates a skymeta st
-void createFbMeta(
+// creates a skymeta st, returns an error code if the blob cannot be
+// compressed
+int createFbMeta(
     flatbuffers::FlatBufferBuilder *meta_builder,
     int data_format,
     unsigned char *data,
@@ -777,7 +1037,18 @@ void createFbMeta(
     bool data_deleted=false,
     size_t data_orig_off=0,
     size_t data_orig_len=0,
-    CompressionType data_compression=none);
+    int data_compression=none);
+
+// compress a blob per its CompressionType into out, or decompress a blob
+// of raw_size bytes uncompressed into out.
+int compressBlob(int compression, const char* data, size_t size,
+                 std::vector<char>& out);
+int decompressBlob(int compression, const char* data, size_t size,
+                   size_t raw_size, std::vector<char>& out);
+
+// if the blob of meta is compressed, decompress it into buf and point meta
+// at buf, reused across the blobs of an object.
+int decompressSkyMeta(sky_meta& meta, std::vector<char>& buf);
 
 // these extract the current data format (flatbuf) into a skyhook
 // root table and row table data structure defined above, abstracting
@@ -803,6 +1074,58 @@ sky_rec getSkyRec(
 *    int format=SFT_CSV);
 */
 
+// append-only byte buffer the row printers format into, owned by one
+// thread and written out in large chunks by the caller.  Numbers are
+// converted directly into the buffer, and the pg binary fields are appended
+// as big endian (len, value) pairs.
+class OutputBuffer
+{
+public:
+    OutputBuffer() {}
+
+    bool empty() const {return buf.empty();}
+    size_t size() const {return buf.size();}
+    const char* data() const {return buf.data();}
+    std::string& str() {return buf;}  // to hand off the bytes, e.g. by move
+    void clear() {buf.clear();}       // keeps the capacity for reuse
+    void reserve(size_t n) {buf.reserve(n);}
+
+    void put(char c) {buf.push_back(c);}
+    void append(const char* s, size_t len) {buf.append(s, len);}
+    void append(const std::string& s) {buf.append(s);}
+    void appendUInt(uint64_t v);
+    void appendInt(int64_t v);
+    void appendDouble(double v);       // as ostream << v, i.e., %g
+    void appendDoubleFixed(double v);  // as std::to_string(v), i.e., %f
+
+    // pg binary field of an integral or double value
+    template <typename T>
+    void appendPGField(T v) {
+        int32_t len = sizeof(T);
+        appendBigEndian(len);
+        appendBigEndian(v);
+    }
+    void appendPGField(const char* s, int32_t len) {
+        appendBigEndian(len);
+        buf.append(s, len);
+    }
+    void appendPGNull() {appendBigEndian(PGNULLBINARY);}
+
+    template <typename T>
+    void appendBigEndian(T v) {
+        static_assert(std::is_arithmetic<T>::value, "not a number");
+        char b[sizeof(T)];
+        memcpy(b, &v, sizeof(T));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+        std::reverse(b, b + sizeof(T));
+#endif
+        buf.append(b, sizeof(T));
+    }
+
+private:
+    std::string buf;
+};
+
 // print functions
 void printSkyRootHeader(sky_root &r);
 void printSkyRecHeader(sky_rec &r);
@@ -812,21 +1135,38 @@ long long int printFlatbufFlexRowAsCsv(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print);
+        long long int max_to_print,
+        std::ostream& out=std::cout);
+long long int printFlatbufFlexRowAsCsv(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out);
 
 long long int printJSONAsCsv(
         const char* dataptr,
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print);
+        long long int max_to_print,
+        std::ostream& out=std::cout);
 
 long long int printArrowbufRowAsCsv(
         const char* dataptr,
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print);
+        long long int max_to_print,
+        std::ostream& out=std::cout);
+long long int printArrowbufRowAsCsv(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out);
 
 // postgres binary fstream format
 long long int printFlatbufFlexRowAsPGBinary(
@@ -834,7 +1174,15 @@ long long int printFlatbufFlexRowAsPGBinary(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print);
+        long long int max_to_print,
+        std::ostream& out=std::cout);
+long long int printFlatbufFlexRowAsPGBinary(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out);
 
 // postgres binary fstream format
 long long int printArrowbufRowAsPGBinary(
@@ -842,7 +1190,15 @@ long long int printArrowbufRowAsPGBinary(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print);
+        long long int max_to_print,
+        std::ostream& out=std::cout);
+long long int printArrowbufRowAsPGBinary(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out);
 
 // pyarrow binary fstream format
 long long int printArrowbufRowAsPyArrowBinary(
@@ -850,7 +1206,15 @@ long long int printArrowbufRowAsPyArrowBinary(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print);
+        long long int max_to_print,
+        std::ostream& out=std::cout);
+long long int printArrowbufRowAsPyArrowBinary(
+        const char* dataptr,
+        const size_t datasz,
+        bool print_header,
+        bool print_verbose,
+        long long int max_to_print,
+        OutputBuffer& out);
 
 // print format example binary fstream format
 long long int printExampleFormatAsCsv(
@@ -858,7 +1222,8 @@ long long int printExampleFormatAsCsv(
         const size_t datasz,
         bool print_header,
         bool print_verbose,
-        long long int max_to_print);
+        long long int max_to_print,
+        std::ostream& out=std::cout);
 
 void printArrowHeader(std::shared_ptr<const arrow::KeyValueMetadata> &metadata);
 
@@ -884,7 +1249,8 @@ bool hasAggPreds(predicate_vec &preds);
 int skyOpTypeFromString(std::string s);
 std::string skyOpTypeToString(int op);
 
-bool applyPredicates(predicate_vec& pv, sky_rec& rec);
+bool applyPredicates(predicate_vec& pv, sky_rec& rec,
+                     const FbDicts* dicts=NULL);
 
 bool applyPredicatesArrow(predicate_vec& pv, std::shared_ptr<arrow::Table>& table,
                           int element_index);
@@ -893,27 +1259,23 @@ void applyPredicatesArrowCol(predicate_vec& pv,
                              std::shared_ptr<arrow::Array> col_array,
                              int col_idx, std::vector<uint32_t>& row_nums);
 
-inline
 bool compare(const int64_t& val1, const int64_t& val2, const int& op);
 
-inline
 bool compare(const uint64_t& val1, const uint64_t& val2, const int& op);
 
-inline
 bool compare(const double& val1, const double& val2, const int& op);
 
-inline
 bool compare(const bool& val1, const bool& val2, const int& op);
 
-inline  // used for date types or regex on alphanumeric types
+// used for date types or regex on alphanumeric types
 bool compare(const std::string& val1, const std::string& val2, const int& op, const int& data_type);
 
 template <typename T>
 T computeAgg(const T& val, const T& oldval, const int& op) {
 
     switch (op) {
-        case SOT_min: if (val < oldval) return val;
-        case SOT_max: if (val > oldval) return val;
+        case SOT_min: return (val < oldval) ? val : oldval;
+        case SOT_max: return (val > oldval) ? val : oldval;
         case SOT_sum: return oldval + val;
         case SOT_cnt: return oldval + 1;
         default: assert (TablesErrCodes::OpNotImplemented);
@@ -941,6 +1303,126 @@ bool check_predicate_ops_all_equality(predicate_vec index_preds);
 void extract_typedpred_val(Tables::PredicateBase* pb, uint64_t& val);
 void extract_typedpred_val(Tables::PredicateBase* pb, int64_t& val);
 
+// the words of a text index pred value (a like pred on the index col),
+// lower case as in the index.  Whitespace separated groups must all be in
+// a row, within each group any of the '|' separated alternatives.
+std::vector<std::vector<std::string>> textPredTerms(Tables::PredicateBase* pb);
+
+// like pred regex matching the same rows as a group of alternative words,
+// to apply a text index pred by a scan when the index is not used.
+std::string textTermsRegex(const std::vector<std::string>& alternatives);
+
+// omap key of the col_stats entry for a col
+std::string buildColStatsKey(
+        std::string schema_name,
+        std::string table_name,
+        std::string colname);
+
+// numeric value of a col_stats min/max or pred value, used for estimates.
+// returns false for types that are not ordered numerically (strings).
+bool stats_val_to_double(int col_type, const std::string& s, double* val);
+bool pred_val_to_double(Tables::PredicateBase* pb, double* val);
+
+// fraction of rows expected to pass a pred, from its col's histogram
+double estimate_pred_selectivity(Tables::PredicateBase* pb,
+                                 const col_stats& stats);
+
+// fraction of rows expected to pass all preds, have_stats is set false if
+// any pred col had no col_stats and so a default selectivity was used.
+double estimate_selectivity(const predicate_vec& preds,
+                            const std::map<int, col_stats>& stats,
+                            bool* have_stats);
+
+// HyperLogLog sketch of the number of distinct values added.
+class distinct_sketch {
+public:
+    distinct_sketch() : regs(1 << STATS_SKETCH_BITS, 0) {}
+    void add(uint64_t hash);
+    void merge(const distinct_sketch& other);
+    uint64_t estimate() const;
+
+    static uint64_t hash_int(uint64_t v);
+    static uint64_t hash_str(const std::string& s);
+
+private:
+    std::vector<uint8_t> regs;
+};
+
+// values of one col gathered from the rows sampled in an fbmeta.
+// numeric cols (incl bool, char) keep their vals, string and date cols
+// keep their strs, as dates are ordered by their iso string.
+struct col_summary {
+    int col_type;
+    bool numeric;
+    uint64_t nsampled;  // sampled rows, incl nulls
+    uint64_t nnulls;    // of the sampled rows
+    std::vector<double> vals;
+    std::vector<std::string> strs;
+    distinct_sketch sketch;
+
+    // exact min/max of the sampled vals, by type class
+    bool have_val;
+    int64_t imin, imax;
+    uint64_t umin, umax;
+    double dmin, dmax;
+    std::string smin, smax;
+
+    col_summary(int type=SDT_INT64);
+    void add_null() { nsampled++; nnulls++; }
+    void add(int64_t v);
+    void add(uint64_t v);
+    void add(double v);
+    void add(const std::string& v);
+    std::string min_str() const;
+    std::string max_str() const;
+};
+
+// sample rows of a flatbuf or arrow formatted fbmeta data blob into one
+// summary per data_schema col, skipping deleted rows.  One of every stride
+// live rows is sampled, nrows is set to the number of live rows.  Null vals
+// are left out of the min/max, unless null_vals is set, then they are
+// summarized by their stored val, as the predicate scan compares them.
+int summarize_cols(
+        const char* data,
+        size_t size,
+        int format,
+        const schema_vec& data_schema,
+        int stride,
+        uint64_t* nrows,
+        std::vector<col_summary>& summaries,
+        std::string& errmsg,
+        bool null_vals=false);
+
+// add the summary of nrows live rows appended to an object to its existing
+// col_stats, without rebuilding the histogram bins.
+void merge_col_stats(
+        col_stats& stats,
+        col_summary& summary,
+        uint64_t nrows,
+        int64_t cur_time);
+
+// build the zone map of an fb with nrows live rows from its col summaries,
+// which must include every row of the fb (stride 1) and its null vals.
+idx_zone_entry build_zone_entry(
+        const schema_vec& data_schema,
+        const std::vector<col_summary>& summaries,
+        uint64_t nrows);
+
+// false if the zone map shows no row of its fb can pass the and-ed preds,
+// true if some row may pass, or the preds cannot be checked.
+bool zone_may_match(const predicate_vec& preds, const idx_zone_entry& zone);
+
+// build the col_stats of a col from its summary of an object with nrows
+// live rows, with an equi-depth histogram of at most nbins bins.
+col_stats build_col_stats(
+        const std::string& table_name,
+        col_info col,
+        col_summary& summary,
+        uint64_t nrows,
+        int stats_level,
+        int nbins,
+        int64_t cur_time);
+
 /* Apache Arrow related functions */
 
 // Read/Write apache buffer on disk
@@ -956,11 +1438,153 @@ int extract_arrow_from_string(std::shared_ptr<arrow::Table>* table,
 int convert_arrow_to_buffer(const std::shared_ptr<arrow::Table> &table,
                             std::shared_ptr<arrow::Buffer>* buffer);
 
+// flatbuffers allocator backed by a single ceph bufferptr, so that a finished
+// fb can be appended to a bufferlist by reference, without copying it out.
+class BufferPtrAllocator : public flatbuffers::Allocator {
+public:
+    uint8_t *allocate(size_t size) override;
+    void deallocate(uint8_t *p, size_t size) override;
+    uint8_t *reallocate_downward(uint8_t *old_p, size_t old_size,
+                                 size_t new_size, size_t in_use_back,
+                                 size_t in_use_front) override;
+
+    // append the finished fb held in builder (which must be using this
+    // allocator) to bl, sharing this allocator's memory.
+    void appendTo(flatbuffers::FlatBufferBuilder& builder, bufferlist& bl);
+
+private:
+    bufferptr bp;
+};
+
+// allocation counters for the builders held by a BuilderPool
+struct builder_alloc_stats {
+    uint64_t fb_allocs;     // heap allocations by flatbuffer builders
+    uint64_t fb_reallocs;   // of which were growing an existing buffer
+    uint64_t flex_rows;     // flexbuffers built
+    uint64_t flex_grows;    // flexbuffers that outgrew the reused buffer
+
+    builder_alloc_stats() :
+        fb_allocs(0), fb_reallocs(0), flex_rows(0), flex_grows(0) {}
+
+    std::string toString() {
+        std::string s("builder_alloc_stats:");
+        s.append(" fb_allocs=" + std::to_string(fb_allocs));
+        s.append(" fb_reallocs=" + std::to_string(fb_reallocs));
+        s.append(" flex_rows=" + std::to_string(flex_rows));
+        s.append(" flex_grows=" + std::to_string(flex_grows));
+        return s;
+    }
+};
+
+// new/delete allocator that counts its calls into a builder_alloc_stats.
+class CountingAllocator : public flatbuffers::DefaultAllocator {
+public:
+    explicit CountingAllocator(builder_alloc_stats* s) : stats(s) {}
+    uint8_t *allocate(size_t size) override;
+    uint8_t *reallocate_downward(uint8_t *old_p, size_t old_size,
+                                 size_t new_size, size_t in_use_back,
+                                 size_t in_use_front) override;
+private:
+    builder_alloc_stats* stats;
+};
+
+// FlatBufferBuilder that keeps its buffer across uses, reset() clears the
+// builder state and only allocates when the expected size exceeds the
+// current capacity.
+class PooledFlatBufferBuilder : public flatbuffers::FlatBufferBuilder {
+public:
+    explicit PooledFlatBufferBuilder(flatbuffers::Allocator* alloc) :
+        flatbuffers::FlatBufferBuilder(1024, alloc) {}
+    void reset(size_t expected_size);
+    size_t capacity() const { return buf_.capacity(); }
+};
+
+// Builders reused across rows and fbmetas within one cls method call,
+// replacing a new flexbuffers::Builder per row and a new FlatBufferBuilder
+// per fbmeta.  Each builder returned is reset and only valid until the
+// next call for the same builder.
+class BuilderPool {
+public:
+    BuilderPool() :
+        alloc(&alloc_stats),
+        result_bldr(&alloc),
+        meta_bldr(&alloc),
+        flex_capacity(0) {}
+    ~BuilderPool();
+
+    // cleared flexbuffer builder for the next row
+    flexbuffers::Builder& flexBuilder();
+
+    // finish the current flexbuffer row, the buffer is owned by the pool
+    const std::vector<uint8_t>& finishFlex();
+
+    // finish the current flexbuffer row and copy it into flatbldr
+    flatbuffers::Offset<flatbuffers::Vector<uint8_t>> finishFlex(
+            flatbuffers::FlatBufferBuilder& flatbldr);
+
+    // cleared builder for a result blob, sized to expected_size bytes
+    flatbuffers::FlatBufferBuilder& resultBuilder(size_t expected_size);
+
+    // cleared builder for an fbmeta wrapping a blob of expected_size bytes
+    flatbuffers::FlatBufferBuilder& metaBuilder(size_t expected_size);
+
+    // cleared builder held until release(), for callers that build several
+    // blobs at once.  released builders keep their buffer for the next one.
+    flatbuffers::FlatBufferBuilder* acquire();
+    void release(flatbuffers::FlatBufferBuilder* bldr);
+
+    builder_alloc_stats& stats() { return alloc_stats; }
+
+private:
+    BuilderPool(const BuilderPool&);
+    BuilderPool& operator=(const BuilderPool&);
+
+    builder_alloc_stats alloc_stats;
+    CountingAllocator alloc;
+    PooledFlatBufferBuilder result_bldr;
+    PooledFlatBufferBuilder meta_bldr;
+    flexbuffers::Builder flex_bldr;
+    size_t flex_capacity;
+    std::vector<PooledFlatBufferBuilder*> bldrs;
+    std::vector<PooledFlatBufferBuilder*> free_bldrs;
+};
+
+// size in bytes of the arrow ipc stream for table
+int get_arrow_ipc_size(const std::shared_ptr<arrow::Table> &table,
+                       int64_t* size);
+
+// serialize the arrow table as an ipc stream directly into the blob of a
+// new fbmeta and append the fbmeta to bl, the data is copied only once.
+int convert_arrow_to_fbmeta(const std::shared_ptr<arrow::Table> &table,
+                            bufferlist& bl,
+                            int compression=none);
+
 int compress_arrow_tables(std::vector<std::shared_ptr<arrow::Table>> &table_vec,
                           std::shared_ptr<arrow::Table> *table);
 int split_arrow_table(std::shared_ptr<arrow::Table> &table, int max_rows,
                       std::vector<std::shared_ptr<arrow::Table>>* table_vec);
 
+// rechunk the arrow table into record batches of at most max_rows each, so
+// its ipc stream is written as bounded size batches.
+int rebatch_arrow_table(std::shared_ptr<arrow::Table> &table, int max_rows);
+
+// one record batch of an arrow table, as a single chunk table with the schema
+// of the table, so per batch code can read chunk(0) of each col.  offset is
+// the table row number of the first row of the batch.
+struct arrow_batch {
+    std::shared_ptr<arrow::Table> table;
+    int64_t offset;
+};
+int arrow_table_batches(const std::shared_ptr<arrow::Table> &table,
+                        std::vector<arrow_batch>& batches);
+
+// the batch rows of sorted table row numbers rnums[begin,...) as batch row
+// numbers, returns the index of the first rnum after the batch.
+uint32_t arrow_batch_rows(const arrow_batch& batch,
+                          const std::vector<uint32_t>& rnums,
+                          uint32_t begin,
+                          std::vector<uint32_t>& batch_rnums);
+
 int example_func(int counter);
 
 } // end namespace Tables
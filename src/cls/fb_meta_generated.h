@@ -18,7 +18,8 @@ struct FB_Meta FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
     VT_BLOB_DELETED = 10,
     VT_BLOB_ORIG_OFF = 12,
     VT_BLOB_ORIG_LEN = 14,
-    VT_BLOB_COMPRESSION = 16
+    VT_BLOB_COMPRESSION = 16,
+    VT_BLOB_RAW_SIZE = 18
   };
   int32_t blob_format() const {
     return GetField<int32_t>(VT_BLOB_FORMAT, 0);
@@ -41,6 +42,9 @@ struct FB_Meta FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   int32_t blob_compression() const {
     return GetField<int32_t>(VT_BLOB_COMPRESSION, 0);
   }
+  uint64_t blob_raw_size() const {
+    return GetField<uint64_t>(VT_BLOB_RAW_SIZE, 0);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<int32_t>(verifier, VT_BLOB_FORMAT) &&
@@ -51,6 +55,7 @@ struct FB_Meta FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
            VerifyField<uint64_t>(verifier, VT_BLOB_ORIG_OFF) &&
            VerifyField<uint64_t>(verifier, VT_BLOB_ORIG_LEN) &&
            VerifyField<int32_t>(verifier, VT_BLOB_COMPRESSION) &&
+           VerifyField<uint64_t>(verifier, VT_BLOB_RAW_SIZE) &&
            verifier.EndTable();
   }
 };
@@ -79,6 +84,9 @@ struct FB_MetaBuilder {
   void add_blob_compression(int32_t blob_compression) {
     fbb_.AddElement<int32_t>(FB_Meta::VT_BLOB_COMPRESSION, blob_compression, 0);
   }
+  void add_blob_raw_size(uint64_t blob_raw_size) {
+    fbb_.AddElement<uint64_t>(FB_Meta::VT_BLOB_RAW_SIZE, blob_raw_size, 0);
+  }
   explicit FB_MetaBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -99,8 +107,10 @@ inline flatbuffers::Offset<FB_Meta> CreateFB_Meta(
     bool blob_deleted = false,
     uint64_t blob_orig_off = 0,
     uint64_t blob_orig_len = 0,
-    int32_t blob_compression = 0) {
+    int32_t blob_compression = 0,
+    uint64_t blob_raw_size = 0) {
   FB_MetaBuilder builder_(_fbb);
+  builder_.add_blob_raw_size(blob_raw_size);
   builder_.add_blob_orig_len(blob_orig_len);
   builder_.add_blob_orig_off(blob_orig_off);
   builder_.add_blob_size(blob_size);
@@ -119,7 +129,8 @@ inline flatbuffers::Offset<FB_Meta> CreateFB_MetaDirect(
     bool blob_deleted = false,
     uint64_t blob_orig_off = 0,
     uint64_t blob_orig_len = 0,
-    int32_t blob_compression = 0) {
+    int32_t blob_compression = 0,
+    uint64_t blob_raw_size = 0) {
   auto blob_data__ = blob_data ? _fbb.CreateVector<uint8_t>(*blob_data) : 0;
   return Tables::CreateFB_Meta(
       _fbb,
@@ -129,7 +140,8 @@ inline flatbuffers::Offset<FB_Meta> CreateFB_MetaDirect(
       blob_deleted,
       blob_orig_off,
       blob_orig_len,
-      blob_compression);
+      blob_compression,
+      blob_raw_size);
 }
 
 inline const Tables::FB_Meta *GetFB_Meta(const void *buf) {
@@ -0,0 +1,877 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+/*
+ * Microbenchmark suite for the cls processing kernels, run without ceph.
+ * Synthetic blobs are built in memory from the SampleData schemas and rows
+ * (replicated to each requested row count and encoded the same way as
+ * sky_tabular_flatflex_writer), or loaded from an object file written by the
+ * writer with --data-file.  Each dataset is then run through processSkyFb,
+ * processArrowCol, processArrow and the legacy applyPredicates loop over a
+ * sweep of selectivities, projection widths and predicate column types, and
+ * through the fb/arrow transforms and print paths.  For each case the
+ * rows/sec, bytes/sec and heap allocations per iteration are reported as a
+ * json array, so results can be compared between releases.
+ *
+ * USAGE NOTES
+ * bin/sky_bench_kernels --sample-dir src/cls/SampleData \
+ *     --tables lineitem,ncols100 --rows 10000,100000 --json results.json
+ * bin/sky_bench_kernels --data-file skyhook.SFT_FLATBUF_FLEX_ROW.lineitem.0 \
+ *     --schema-file src/cls/SampleData/lineitem.schema.txt
+ * bin/sky_bench_kernels --kernels processSkyFb,applyPredicates
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <chrono>
+#include <atomic>
+#include <limits>
+#include <new>
+#include <set>
+#include <boost/program_options.hpp>
+#include <boost/algorithm/string.hpp>
+
+#include "cls_tabular_utils.h"
+#include "cls_tabular_predicates.h"
+#include "cls_tabular_processing.h"
+
+using namespace std;
+using namespace Tables;
+namespace po = boost::program_options;
+
+// heap allocations made by this process, counted by the global operator new
+// below so the allocations of each kernel can be reported.
+static std::atomic<uint64_t> alloc_count(0);
+static std::atomic<uint64_t> alloc_bytes(0);
+
+void* operator new(size_t size)
+{
+    alloc_count.fetch_add(1, std::memory_order_relaxed);
+    alloc_bytes.fetch_add(size, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+// discards anything written to it, used for the print paths and to silence
+// the kernels that print to std::cout
+class null_streambuf : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        return n;
+    }
+};
+
+struct bench_dataset {
+    std::string table_name;
+    std::string schema_str;
+    schema_vec schema;
+    uint64_t nrows;
+    std::vector<std::vector<std::string>> sample_rows;  // csv fields
+    std::vector<std::string> fb_blobs;                  // flatbuf blobs
+    std::vector<std::string> arrow_blobs;               // same data as arrow
+    uint64_t fb_bytes;
+    uint64_t arrow_bytes;
+
+    bench_dataset() : nrows(0), fb_bytes(0), arrow_bytes(0) {}
+};
+
+struct bench_case {
+    std::string name;           // which sweep this case belongs to
+    std::string preds;
+    double target_selectivity;  // < 0 when not targeted
+    std::string pred_col_type;
+    schema_vec query_schema;
+};
+
+struct bench_result {
+    std::string kernel;
+    std::string table;
+    std::string sweep;
+    std::string preds;
+    std::string pred_col_type;
+    uint64_t rows;
+    uint32_t projected_cols;
+    double target_selectivity;
+    uint64_t rows_out;
+    double seconds;
+    double rows_per_sec;
+    double bytes_per_sec;
+    double allocs_per_iter;
+    double alloc_bytes_per_iter;
+};
+
+static std::string jsonEscape(const std::string& s)
+{
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++) {
+        char c = s[i];
+        switch (c) {
+            case '"': out.append("\\\""); break;
+            case '\\': out.append("\\\\"); break;
+            case '\n': out.append("\\n"); break;
+            case '\t': out.append("\\t"); break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buf[8];
+                    snprintf(buf, sizeof(buf), "\\u%04x", c);
+                    out.append(buf);
+                }
+                else {
+                    out.push_back(c);
+                }
+        }
+    }
+    return out;
+}
+
+static void writeJson(std::ostream& out, const std::vector<bench_result>& results)
+{
+    out << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const bench_result& r = results[i];
+        out << "  {\"kernel\": \"" << jsonEscape(r.kernel) << "\""
+            << ", \"table\": \"" << jsonEscape(r.table) << "\""
+            << ", \"sweep\": \"" << jsonEscape(r.sweep) << "\""
+            << ", \"preds\": \"" << jsonEscape(r.preds) << "\""
+            << ", \"pred_col_type\": \"" << jsonEscape(r.pred_col_type) << "\""
+            << ", \"rows\": " << r.rows
+            << ", \"projected_cols\": " << r.projected_cols
+            << ", \"target_selectivity\": " << r.target_selectivity
+            << ", \"selectivity\": "
+            << (r.rows ? static_cast<double>(r.rows_out) / r.rows : 0)
+            << ", \"rows_out\": " << r.rows_out
+            << ", \"seconds\": " << r.seconds
+            << ", \"rows_per_sec\": " << r.rows_per_sec
+            << ", \"bytes_per_sec\": " << r.bytes_per_sec
+            << ", \"allocs_per_iter\": " << r.allocs_per_iter
+            << ", \"alloc_bytes_per_iter\": " << r.alloc_bytes_per_iter
+            << "}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    out << "]" << std::endl;
+}
+
+static std::string readFile(const std::string& fname)
+{
+    std::ifstream in(fname, std::ios::binary);
+    if (!in) {
+        cerr << "cannot open file '" << fname << "'" << std::endl;
+        exit(1);
+    }
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+// the schema of a SampleData schema file, with col names upper cased since
+// predsFromString upper cases the col names of the preds.
+static void loadSchema(bench_dataset& ds, const std::string& fname)
+{
+    std::vector<std::string> lines;
+    std::string content = readFile(fname);
+    boost::split(lines, content, boost::is_any_of("\n"));
+    std::string schema_str;
+    for (auto it = lines.begin(); it != lines.end(); ++it) {
+        boost::trim(*it);
+        if (it->empty())
+            continue;
+        schema_str.append(*it + "\n");
+    }
+    schema_vec sv = schemaFromString(schema_str);
+    for (auto it = sv.begin(); it != sv.end(); ++it) {
+        ds.schema.push_back(col_info(it->idx, it->type, it->is_key,
+                                     it->nullable,
+                                     boost::to_upper_copy(it->name)));
+    }
+    ds.schema_str = schemaToString(ds.schema);
+}
+
+static void loadSampleRows(bench_dataset& ds, const std::string& fname)
+{
+    std::vector<std::string> lines;
+    std::string content = readFile(fname);
+    boost::split(lines, content, boost::is_any_of("\n"));
+    for (auto it = lines.begin(); it != lines.end(); ++it) {
+        if (it->empty())
+            continue;
+        std::vector<std::string> fields;
+        boost::split(fields, *it, boost::is_any_of(std::string(1, CSV_DELIM)));
+        ds.sample_rows.push_back(fields);
+    }
+    if (ds.sample_rows.empty()) {
+        cerr << "no rows in '" << fname << "'" << std::endl;
+        exit(1);
+    }
+}
+
+// encode a csv row as sky_tabular_flatflex_writer does in getFlxBuffer
+static void encodeRow(flexbuffers::Builder& flx,
+                      const schema_vec& schema,
+                      const std::vector<std::string>& fields,
+                      nullbits_vector& nullbits)
+{
+    flx.Vector([&]() {
+        for (size_t i = 0; i < schema.size(); i++) {
+            const col_info& col = schema[i];
+            const std::string empty;
+            const std::string& f = col.idx < (int)fields.size() ?
+                                   fields[col.idx] : empty;
+            if (f == "NULL")
+                setNullBit(nullbits, i);
+            const char* s = f == "NULL" ? "0" : f.c_str();
+            switch (col.type) {
+                case SDT_INT8:
+                    flx.Add(static_cast<int8_t>(strtol(s, NULL, 10)));
+                    break;
+                case SDT_INT16:
+                    flx.Add(static_cast<int16_t>(strtol(s, NULL, 10)));
+                    break;
+                case SDT_INT32:
+                    flx.Add(static_cast<int32_t>(strtol(s, NULL, 10)));
+                    break;
+                case SDT_INT64:
+                    flx.Add(static_cast<int64_t>(strtoll(s, NULL, 10)));
+                    break;
+                case SDT_UINT8:
+                    flx.Add(static_cast<uint8_t>(strtoul(s, NULL, 10)));
+                    break;
+                case SDT_UINT16:
+                    flx.Add(static_cast<uint16_t>(strtoul(s, NULL, 10)));
+                    break;
+                case SDT_UINT32:
+                    flx.Add(static_cast<uint32_t>(strtoul(s, NULL, 10)));
+                    break;
+                case SDT_UINT64:
+                    flx.Add(static_cast<uint64_t>(strtoull(s, NULL, 10)));
+                    break;
+                case SDT_CHAR:
+                    flx.Add(static_cast<char>(f.empty() ? 0 : f[0]));
+                    break;
+                case SDT_UCHAR:
+                    flx.Add(static_cast<unsigned char>(f.empty() ? 0 : f[0]));
+                    break;
+                case SDT_BOOL:
+                    flx.Add(!f.empty());
+                    break;
+                case SDT_FLOAT:
+                    flx.Add(strtof(s, NULL));
+                    break;
+                case SDT_DOUBLE:
+                    flx.Add(strtod(s, NULL));
+                    break;
+                default:
+                    flx.Add(f);
+                    break;
+            }
+        }
+    });
+}
+
+// a flatbuf blob of nrows rows, cycling through the sample rows
+static std::string buildBlob(bench_dataset& ds, uint64_t nrows)
+{
+    flatbuffers::FlatBufferBuilder fbb(1024);
+    std::vector<flatbuffers::Offset<Tables::Record>> offs;
+    delete_vector dead_rows;
+    flexbuffers::Builder flexbldr;
+
+    for (uint64_t i = 0; i < nrows; i++) {
+        nullbits_vector nb(2, 0);
+        flexbldr.Clear();
+        encodeRow(flexbldr, ds.schema,
+                  ds.sample_rows[i % ds.sample_rows.size()], nb);
+        flexbldr.Finish();
+        auto row_data = fbb.CreateVector(flexbldr.GetBuffer());
+        auto nullbits = fbb.CreateVector(nb);
+        offs.push_back(Tables::CreateRecord(fbb, i, nullbits, row_data));
+        dead_rows.push_back(0);
+    }
+
+    auto table = CreateTable(
+        fbb,
+        SFT_FLATBUF_FLEX_ROW,
+        2,
+        1,
+        1,
+        fbb.CreateString(ds.schema_str),
+        fbb.CreateString("*"),
+        fbb.CreateString(ds.table_name),
+        fbb.CreateVector(dead_rows),
+        fbb.CreateVector(offs),
+        offs.size());
+    fbb.Finish(table);
+    return std::string(reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                       fbb.GetSize());
+}
+
+// the flatbuf blobs of an object file written by sky_tabular_flatflex_writer,
+// a sequence of encoded fbmeta bufferlists.
+static void loadDataFile(bench_dataset& ds, const std::string& fname)
+{
+    bufferlist file_bl;
+    std::string content = readFile(fname);
+    file_bl.append(content.data(), content.size());
+    bufferlist::const_iterator it = file_bl.begin();
+    while (!it.end()) {
+        bufferlist bl;
+        try {
+            ceph::decode(bl, it);
+        } catch (const buffer::error &err) {
+            cerr << "cannot decode fbmeta in '" << fname << "'" << std::endl;
+            exit(1);
+        }
+        sky_meta meta = getSkyMeta(&bl);
+        std::vector<char> buf;
+        if (decompressSkyMeta(meta, buf) != 0) {
+            cerr << "cannot decompress fbmeta in '" << fname << "'" << std::endl;
+            exit(1);
+        }
+        if (meta.blob_deleted)
+            continue;
+        if (meta.blob_format != SFT_FLATBUF_FLEX_ROW) {
+            cerr << "skipping fbmeta of format " << meta.blob_format
+                 << std::endl;
+            continue;
+        }
+        ds.fb_blobs.push_back(std::string(meta.blob_data, meta.blob_size));
+        sky_root root = getSkyRoot(meta.blob_data, meta.blob_size,
+                                   SFT_FLATBUF_FLEX_ROW);
+        ds.nrows += root.nrows;
+        if (ds.table_name.empty())
+            ds.table_name = root.table_name;
+    }
+}
+
+// arrow blobs holding the same data as the flatbuf blobs
+static void buildArrowBlobs(bench_dataset& ds)
+{
+    for (auto it = ds.fb_blobs.begin(); it != ds.fb_blobs.end(); ++it) {
+        std::string errmsg;
+        std::shared_ptr<arrow::Table> table;
+        std::shared_ptr<arrow::Buffer> buffer;
+        int ret = transform_fb_to_arrow(it->data(), it->size(), ds.schema,
+                                        errmsg, &table);
+        if (ret == 0)
+            ret = convert_arrow_to_buffer(table, &buffer);
+        if (ret != 0) {
+            cerr << "cannot transform " << ds.table_name << " to arrow: "
+                 << errmsg << std::endl;
+            exit(1);
+        }
+        ds.arrow_blobs.push_back(
+            std::string(reinterpret_cast<const char*>(buffer->data()),
+                        buffer->size()));
+    }
+    ds.arrow_bytes = 0;
+    for (auto it = ds.arrow_blobs.begin(); it != ds.arrow_blobs.end(); ++it)
+        ds.arrow_bytes += it->size();
+}
+
+static bool isIntType(int type)
+{
+    return type >= SDT_INT8 and type <= SDT_UINT64;
+}
+
+static std::string typeName(int type)
+{
+    if (type >= SDT_INT8 and type <= SDT_INT64) return "int";
+    if (type >= SDT_UINT8 and type <= SDT_UINT64) return "uint";
+    if (type == SDT_FLOAT) return "float";
+    if (type == SDT_DOUBLE) return "double";
+    if (type == SDT_STRING) return "string";
+    return "other";
+}
+
+// a "col,geq,val" pred selecting about selectivity of the sample rows
+static std::string rangePred(const bench_dataset& ds, const col_info& col,
+                             double selectivity)
+{
+    std::vector<double> vals;
+    for (auto it = ds.sample_rows.begin(); it != ds.sample_rows.end(); ++it)
+        vals.push_back(strtod(it->at(col.idx).c_str(), NULL));
+    std::sort(vals.begin(), vals.end());
+    size_t pos = static_cast<size_t>((1.0 - selectivity) * vals.size());
+    if (pos >= vals.size())
+        pos = vals.size() - 1;
+    std::stringstream ss;
+    ss.precision(17);
+    if (isIntType(col.type))
+        ss << static_cast<long long>(vals[pos]);
+    else
+        ss << vals[pos];
+    return col.name + ",geq," + ss.str() + ";";
+}
+
+// a "col,like,word" pred over a string col, the word is taken from the
+// middle sample row so it matches at least some rows.
+static std::string likePred(const bench_dataset& ds, const col_info& col)
+{
+    const std::string& val = \
+        ds.sample_rows[ds.sample_rows.size() / 2].at(col.idx);
+    std::vector<std::string> words;
+    boost::split(words, val, boost::is_any_of(" "), boost::token_compress_on);
+    std::string word;
+    for (auto it = words.begin(); it != words.end(); ++it)
+        if (it->size() > word.size())
+            word = *it;
+    return col.name + ",like," + word + ";";
+}
+
+static schema_vec firstCols(const schema_vec& schema, size_t n)
+{
+    return schema_vec(schema.begin(),
+                      schema.begin() + std::min(n, schema.size()));
+}
+
+static std::vector<bench_case> buildCases(const bench_dataset& ds,
+                                          const std::vector<double>& sels)
+{
+    std::vector<bench_case> cases;
+    if (ds.sample_rows.empty()) {
+        // loaded data, only a scan with no preds
+        cases.push_back({"scan", "", -1, "", ds.schema});
+        return cases;
+    }
+
+    // the sweep col is the first non-key numeric col
+    const col_info* sweep_col = NULL;
+    for (auto it = ds.schema.begin(); it != ds.schema.end(); ++it) {
+        if (!it->is_key and (isIntType(it->type) or it->type == SDT_FLOAT or
+                             it->type == SDT_DOUBLE)) {
+            sweep_col = &(*it);
+            break;
+        }
+    }
+    if (!sweep_col) {
+        cerr << "no numeric col to sweep in " << ds.table_name << std::endl;
+        exit(1);
+    }
+
+    for (auto it = sels.begin(); it != sels.end(); ++it) {
+        cases.push_back({"selectivity", rangePred(ds, *sweep_col, *it), *it,
+                         typeName(sweep_col->type), ds.schema});
+    }
+
+    const double proj_sel = 0.1;
+    std::vector<size_t> widths = {1, std::max<size_t>(1, ds.schema.size() / 4),
+                                  ds.schema.size()};
+    for (auto it = widths.begin(); it != widths.end(); ++it) {
+        cases.push_back({"projection", rangePred(ds, *sweep_col, proj_sel),
+                         proj_sel, typeName(sweep_col->type),
+                         firstCols(ds.schema, *it)});
+    }
+
+    // one pred on the first col of each type present in the schema
+    std::set<std::string> seen;
+    for (auto it = ds.schema.begin(); it != ds.schema.end(); ++it) {
+        std::string tname = typeName(it->type);
+        if (tname == "other" or seen.count(tname))
+            continue;
+        seen.insert(tname);
+        if (it->type == SDT_STRING)
+            cases.push_back({"col_type", likePred(ds, *it), -1, tname,
+                             ds.schema});
+        else
+            cases.push_back({"col_type", rangePred(ds, *it, proj_sel),
+                             proj_sel, tname, ds.schema});
+    }
+    return cases;
+}
+
+// runs fn once to warm up, then iterations times, timing the runs and
+// counting their heap allocations.  fn returns the rows it output.
+template <typename F>
+static bench_result runKernel(const std::string& kernel,
+                              const bench_dataset& ds,
+                              uint64_t nbytes,
+                              uint32_t iterations,
+                              F fn)
+{
+    bench_result r;
+    r.kernel = kernel;
+    r.table = ds.table_name;
+    r.rows = ds.nrows;
+    r.projected_cols = ds.schema.size();
+    r.target_selectivity = -1;
+    r.rows_out = fn();
+
+    uint64_t allocs0 = alloc_count.load();
+    uint64_t alloc_bytes0 = alloc_bytes.load();
+    auto t0 = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < iterations; i++)
+        r.rows_out = fn();
+    auto t1 = std::chrono::steady_clock::now();
+    uint64_t allocs = alloc_count.load() - allocs0;
+    uint64_t abytes = alloc_bytes.load() - alloc_bytes0;
+
+    r.seconds = std::chrono::duration<double>(t1 - t0).count();
+    double secs = r.seconds > 0 ? r.seconds : 1e-9;
+    r.rows_per_sec = static_cast<double>(ds.nrows) * iterations / secs;
+    r.bytes_per_sec = static_cast<double>(nbytes) * iterations / secs;
+    r.allocs_per_iter = static_cast<double>(allocs) / iterations;
+    r.alloc_bytes_per_iter = static_cast<double>(abytes) / iterations;
+    return r;
+}
+
+static uint64_t fbResultRows(flatbuffers::FlatBufferBuilder& flatbldr)
+{
+    sky_root root = getSkyRoot(
+        reinterpret_cast<const char*>(flatbldr.GetBufferPointer()),
+        flatbldr.GetSize(), SFT_FLATBUF_FLEX_ROW);
+    return root.nrows;
+}
+
+static void checkKernel(int ret, const std::string& kernel,
+                        const std::string& errmsg)
+{
+    if (ret != 0) {
+        cerr << "ERROR: " << kernel << " TablesErrCodes::" << ret << " "
+             << errmsg << std::endl;
+        exit(1);
+    }
+}
+
+static void runCase(bench_dataset& ds,
+                    const bench_case& bc,
+                    uint32_t iterations,
+                    const std::set<std::string>& kernels,
+                    std::vector<bench_result>& results)
+{
+    schema_vec query_schema = bc.query_schema;
+    predicate_vec preds = predsFromString(ds.schema, bc.preds);
+    PredicateEngine engine(preds);
+    BuilderPool pool;
+    std::string errmsg;
+    std::vector<bench_result> case_results;
+
+    auto want = [&](const std::string& k) {
+        return kernels.empty() or kernels.count(k);
+    };
+
+    if (want("processSkyFb")) {
+        case_results.push_back(runKernel("processSkyFb", ds, ds.fb_bytes,
+                                         iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.fb_blobs.begin(); it != ds.fb_blobs.end(); ++it) {
+                flatbuffers::FlatBufferBuilder& flatbldr = \
+                    pool.resultBuilder(it->size());
+                int ret = processSkyFb(flatbldr, ds.schema, query_schema,
+                                       preds, engine, pool, it->data(),
+                                       it->size(), errmsg);
+                checkKernel(ret, "processSkyFb", errmsg);
+                nout += fbResultRows(flatbldr);
+            }
+            return nout;
+        }));
+    }
+
+    if (want("applyPredicates")) {
+        case_results.push_back(runKernel("applyPredicates", ds, ds.fb_bytes,
+                                         iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.fb_blobs.begin(); it != ds.fb_blobs.end(); ++it) {
+                sky_root root = getSkyRoot(it->data(), it->size(),
+                                           SFT_FLATBUF_FLEX_ROW);
+                row_offs rows = static_cast<row_offs>(root.data_vec);
+                for (uint32_t i = 0; i < root.nrows; i++) {
+                    sky_rec rec = getSkyRec(rows->Get(i));
+                    if (applyPredicates(preds, rec))
+                        nout++;
+                }
+            }
+            return nout;
+        }));
+    }
+
+    if (want("processArrowCol")) {
+        case_results.push_back(runKernel("processArrowCol", ds, ds.arrow_bytes,
+                                         iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.arrow_blobs.begin(); it != ds.arrow_blobs.end();
+                 ++it) {
+                std::shared_ptr<arrow::Table> table;
+                int ret = processArrowCol(&table, ds.schema, query_schema,
+                                          preds, engine, it->data(),
+                                          it->size(), errmsg);
+                checkKernel(ret, "processArrowCol", errmsg);
+                nout += table->num_rows();
+            }
+            return nout;
+        }));
+    }
+
+    if (want("processArrow")) {
+        case_results.push_back(runKernel("processArrow", ds, ds.arrow_bytes,
+                                         iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.arrow_blobs.begin(); it != ds.arrow_blobs.end();
+                 ++it) {
+                std::shared_ptr<arrow::Table> table;
+                int ret = processArrow(&table, ds.schema, query_schema,
+                                       preds, engine, it->data(),
+                                       it->size(), errmsg);
+                checkKernel(ret, "processArrow", errmsg);
+                nout += table->num_rows();
+            }
+            return nout;
+        }));
+    }
+
+    for (auto it = case_results.begin(); it != case_results.end(); ++it) {
+        it->sweep = bc.name;
+        it->preds = bc.preds;
+        it->pred_col_type = bc.pred_col_type;
+        it->projected_cols = query_schema.size();
+        it->target_selectivity = bc.target_selectivity;
+        results.push_back(*it);
+    }
+
+    for (auto itp = preds.begin(); itp != preds.end(); ++itp)
+        delete *itp;
+}
+
+// the transforms and print paths, over all of the data with no preds
+static void runDataset(bench_dataset& ds,
+                       uint32_t iterations,
+                       const std::set<std::string>& kernels,
+                       std::vector<bench_result>& results)
+{
+    std::vector<bench_result> ds_results;
+    OutputBuffer outbuf;  // reused across blobs, as by the client workers
+    std::string errmsg;
+    long long int max_to_print = std::numeric_limits<long long int>::max();
+
+    auto want = [&](const std::string& k) {
+        return kernels.empty() or kernels.count(k);
+    };
+
+    if (want("transform_fb_to_arrow")) {
+        ds_results.push_back(runKernel("transform_fb_to_arrow", ds,
+                                       ds.fb_bytes, iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.fb_blobs.begin(); it != ds.fb_blobs.end(); ++it) {
+                std::shared_ptr<arrow::Table> table;
+                int ret = transform_fb_to_arrow(it->data(), it->size(),
+                                                ds.schema, errmsg, &table);
+                checkKernel(ret, "transform_fb_to_arrow", errmsg);
+                nout += table->num_rows();
+            }
+            return nout;
+        }));
+    }
+
+    // currently prints the arrow table colwise to std::cout, which is
+    // discarded by main while the kernels run.
+    if (want("transform_arrow_to_fb")) {
+        ds_results.push_back(runKernel("transform_arrow_to_fb", ds,
+                                       ds.arrow_bytes, iterations, [&]() {
+            flatbuffers::FlatBufferBuilder flatbldr(1024);
+            for (auto it = ds.arrow_blobs.begin(); it != ds.arrow_blobs.end();
+                 ++it) {
+                int ret = transform_arrow_to_fb(it->data(), it->size(),
+                                                errmsg, flatbldr);
+                checkKernel(ret, "transform_arrow_to_fb", errmsg);
+            }
+            return ds.nrows;
+        }));
+    }
+
+    if (want("printFlatbufFlexRowAsCsv")) {
+        ds_results.push_back(runKernel("printFlatbufFlexRowAsCsv", ds,
+                                       ds.fb_bytes, iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.fb_blobs.begin(); it != ds.fb_blobs.end(); ++it) {
+                outbuf.clear();
+                nout += printFlatbufFlexRowAsCsv(it->data(), it->size(),
+                                                 false, false, max_to_print,
+                                                 outbuf);
+            }
+            return nout;
+        }));
+    }
+
+    if (want("printFlatbufFlexRowAsPGBinary")) {
+        ds_results.push_back(runKernel("printFlatbufFlexRowAsPGBinary", ds,
+                                       ds.fb_bytes, iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.fb_blobs.begin(); it != ds.fb_blobs.end(); ++it) {
+                outbuf.clear();
+                nout += printFlatbufFlexRowAsPGBinary(it->data(), it->size(),
+                                                      false, false,
+                                                      max_to_print, outbuf);
+            }
+            return nout;
+        }));
+    }
+
+    if (want("printArrowbufRowAsCsv")) {
+        ds_results.push_back(runKernel("printArrowbufRowAsCsv", ds,
+                                       ds.arrow_bytes, iterations, [&]() {
+            uint64_t nout = 0;
+            for (auto it = ds.arrow_blobs.begin(); it != ds.arrow_blobs.end();
+                 ++it) {
+                outbuf.clear();
+                nout += printArrowbufRowAsCsv(it->data(), it->size(),
+                                              false, false, max_to_print,
+                                              outbuf);
+            }
+            return nout;
+        }));
+    }
+
+    for (auto it = ds_results.begin(); it != ds_results.end(); ++it) {
+        it->sweep = "dataset";
+        results.push_back(*it);
+    }
+}
+
+static bool needsArrow(const std::set<std::string>& kernels)
+{
+    if (kernels.empty())
+        return true;
+    for (auto it = kernels.begin(); it != kernels.end(); ++it)
+        if (it->find("rrow") != std::string::npos)
+            return true;
+    return false;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string sample_dir;
+    std::string tables_str;
+    std::string rows_str;
+    std::string sels_str;
+    std::string kernels_str;
+    std::string json_file;
+    std::string data_file;
+    std::string schema_file;
+    uint32_t iterations;
+
+    po::options_description gen_opts("General options");
+    gen_opts.add_options()
+      ("help,h", "show help message")
+      ("sample-dir", po::value<std::string>(&sample_dir)->default_value("src/cls/SampleData"), "dir of the <table>.schema.txt and <table>.100rows.csv sample data")
+      ("tables", po::value<std::string>(&tables_str)->default_value("lineitem,ncols100"), "comma separated sample tables")
+      ("rows", po::value<std::string>(&rows_str)->default_value("10000,100000"), "comma separated row counts of the synthetic blobs")
+      ("selectivities", po::value<std::string>(&sels_str)->default_value("1.0,0.5,0.1,0.01"), "comma separated selectivities of the selectivity sweep")
+      ("kernels", po::value<std::string>(&kernels_str)->default_value(""), "comma separated kernels to run, default all")
+      ("iterations", po::value<uint32_t>(&iterations)->default_value(3), "timed runs per case, after a warmup run")
+      ("json", po::value<std::string>(&json_file)->default_value("-"), "json results file, - for stdout")
+      ("data-file", po::value<std::string>(&data_file)->default_value(""), "object file written by sky_tabular_flatflex_writer, instead of the sample tables")
+      ("schema-file", po::value<std::string>(&schema_file)->default_value(""), "schema of the data-file");
+
+    po::options_description all_opts("Allowed options");
+    all_opts.add(gen_opts);
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, all_opts), vm);
+    if (vm.count("help")) {
+      std::cout << all_opts << std::endl;
+      return 1;
+    }
+    po::notify(vm);
+
+    if (iterations == 0) {
+        cerr << "iterations must be > 0" << std::endl;
+        exit(1);
+    }
+    if (!data_file.empty() and schema_file.empty()) {
+        cerr << "data-file requires a schema-file" << std::endl;
+        exit(1);
+    }
+
+    std::set<std::string> kernels;
+    if (!kernels_str.empty()) {
+        std::vector<std::string> ks;
+        boost::split(ks, kernels_str, boost::is_any_of(","),
+                     boost::token_compress_on);
+        kernels.insert(ks.begin(), ks.end());
+    }
+    std::vector<double> sels;
+    {
+        std::vector<std::string> ss;
+        boost::split(ss, sels_str, boost::is_any_of(","),
+                     boost::token_compress_on);
+        for (auto it = ss.begin(); it != ss.end(); ++it)
+            sels.push_back(std::stod(*it));
+    }
+
+    // build all of the datasets before timing anything
+    std::vector<bench_dataset> datasets;
+    if (!data_file.empty()) {
+        bench_dataset ds;
+        loadSchema(ds, schema_file);
+        loadDataFile(ds, data_file);
+        datasets.push_back(ds);
+    }
+    else {
+        std::vector<std::string> tables, rows;
+        boost::split(tables, tables_str, boost::is_any_of(","),
+                     boost::token_compress_on);
+        boost::split(rows, rows_str, boost::is_any_of(","),
+                     boost::token_compress_on);
+        for (auto itt = tables.begin(); itt != tables.end(); ++itt) {
+            bench_dataset sample;
+            sample.table_name = *itt;
+            loadSchema(sample, sample_dir + "/" + *itt + ".schema.txt");
+            loadSampleRows(sample, sample_dir + "/" + *itt + ".100rows.csv");
+            for (auto itr = rows.begin(); itr != rows.end(); ++itr) {
+                bench_dataset ds = sample;
+                ds.nrows = std::stoull(*itr);
+                ds.fb_blobs.push_back(buildBlob(ds, ds.nrows));
+                datasets.push_back(ds);
+            }
+        }
+    }
+    for (auto it = datasets.begin(); it != datasets.end(); ++it) {
+        for (auto itb = it->fb_blobs.begin(); itb != it->fb_blobs.end(); ++itb)
+            it->fb_bytes += itb->size();
+        if (needsArrow(kernels))
+            buildArrowBlobs(*it);
+    }
+
+    // some kernels print to std::cout, discard it while they run
+    std::vector<bench_result> results;
+    null_streambuf nullbuf;
+    std::streambuf* coutbuf = std::cout.rdbuf(&nullbuf);
+    for (auto it = datasets.begin(); it != datasets.end(); ++it) {
+        std::vector<bench_case> cases = buildCases(*it, sels);
+        for (auto itc = cases.begin(); itc != cases.end(); ++itc)
+            runCase(*it, *itc, iterations, kernels, results);
+        runDataset(*it, iterations, kernels, results);
+        cerr << it->table_name << " rows=" << it->nrows << " done" << std::endl;
+    }
+    std::cout.rdbuf(coutbuf);
+
+    if (json_file == "-") {
+        writeJson(std::cout, results);
+    }
+    else {
+        std::ofstream out(json_file);
+        if (!out) {
+            cerr << "cannot open file '" << json_file << "'" << std::endl;
+            exit(1);
+        }
+        writeJson(out, results);
+    }
+    return 0;
+}
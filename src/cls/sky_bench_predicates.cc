@@ -0,0 +1,223 @@
+/*
+* Copyright (C) 2018 The Regents of the University of California
+* All Rights Reserved
+*
+* This library can redistribute it and/or modify under the terms
+* of the GNU Lesser General Public License Version 2.1 as published
+* by the Free Software Foundation.
+*
+*/
+
+/*
+ * Microbenchmark for predicate evaluation over a flatbuf blob.
+ * A synthetic lineitem blob is built in memory, then each query's preds are
+ * evaluated over all rows using both the legacy row-at-a-time path
+ * (getSkyRec + applyPredicates) and the batched PredicateEngine, and the
+ * rows/sec of each is reported.  The matching row counts are also compared
+ * so any result mismatch between the two paths is reported as an error.
+ *
+ * USAGE NOTES
+ * bin/sky_bench_predicates --num_rows 1000000 --iterations 5
+ */
+
+#include <iostream>
+#include <chrono>
+#include <random>
+#include <boost/program_options.hpp>
+
+#include "cls_tabular_utils.h"
+#include "cls_tabular_predicates.h"
+#include "cls_tabular_processing.h"
+
+using namespace std;
+using namespace Tables;
+namespace po = boost::program_options;
+
+const std::string BENCH_SCHEMA("0 3 1 0 ORDERKEY ; 1 3 0 1 PARTKEY ; 2 3 0 1 SUPPKEY ; 3 3 1 0 LINENUMBER ; 4 12 0 1 QUANTITY ; 5 13 0 1 EXTENDEDPRICE ; 6 12 0 1 DISCOUNT ; 7 13 0 1 TAX ; 8 9 0 1 RETURNFLAG ; 9 9 0 1 LINESTATUS ; 10 14 0 1 SHIPDATE ; 11 14 0 1 COMMITDATE ; 12 14 0 1 RECEIPTDATE ; 13 15 0 1 SHIPINSTRUCT ; 14 15 0 1 SHIPMODE ; 15 15 0 1 COMMENT");
+
+struct bench_query {
+    std::string name;
+    std::string preds;
+};
+
+// selectivities vary from very low to very high
+const std::vector<bench_query> BENCH_QUERIES = {
+    {"extendedprice_gt", "extendedprice,gt,71000.0;"},
+    {"orderkey_eq", "orderkey,eq,5;"},
+    {"quantity_discount_range",
+        "quantity,lt,24.0;discount,geq,0.05;discount,leq,0.07;"},
+    {"shipdate_geq", "shipdate,geq,1995-01-01;"},
+    {"comment_like", "comment,like,ave;"},
+    {"comment_like_prefix", "comment,like,^slyly;"},
+    {"comment_like_regex", "comment,like,reg.*ave;"},
+    {"returnflag_linestatus_eq", "returnflag,eq,A;linestatus,eq,F;"},
+    {"sum_extendedprice", "extendedprice,gt,71000.0;extendedprice,sum,0;"},
+};
+
+static void buildBlob(flatbuffers::FlatBufferBuilder& fbb, uint32_t nrows)
+{
+    const char* flags = "ANR";
+    const char* modes[] = {"AIR", "MAIL", "SHIP", "TRUCK", "RAIL"};
+    const char* words[] = {"slyly", "regular", "ave", "ironic", "pending",
+                           "furiously", "express", "deposits"};
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> small(0, 100);
+    std::uniform_real_distribution<double> price(900.0, 105000.0);
+
+    std::vector<flatbuffers::Offset<Tables::Record>> offs;
+    delete_vector dead_rows;
+    nullbits_vector nb(2, 0);
+    flexbuffers::Builder flexbldr;
+
+    for (uint32_t i = 0; i < nrows; i++) {
+        char date[16];
+        snprintf(date, sizeof(date), "%04d-%02d-%02d",
+                 1992 + (small(gen) % 7), 1 + (small(gen) % 12),
+                 1 + (small(gen) % 28));
+        std::string comment = std::string(words[small(gen) % 8]) + " " +
+                              words[small(gen) % 8] + " " +
+                              words[small(gen) % 8];
+
+        flexbldr.Clear();
+        flexbldr.Vector([&]() {
+            flexbldr.Add(static_cast<int32_t>(i / 4));          // orderkey
+            flexbldr.Add(static_cast<int32_t>(small(gen)));     // partkey
+            flexbldr.Add(static_cast<int32_t>(small(gen)));     // suppkey
+            flexbldr.Add(static_cast<int32_t>(i % 4));          // linenumber
+            flexbldr.Add(static_cast<float>(1 + small(gen) % 50));
+            flexbldr.Add(price(gen));
+            flexbldr.Add(static_cast<float>(small(gen) % 11) / 100);
+            flexbldr.Add(static_cast<double>(small(gen) % 9) / 100);
+            flexbldr.Add(static_cast<int8_t>(flags[small(gen) % 3]));
+            flexbldr.Add(static_cast<int8_t>(small(gen) % 2 ? 'O' : 'F'));
+            flexbldr.Add(std::string(date));
+            flexbldr.Add(std::string(date));
+            flexbldr.Add(std::string(date));
+            flexbldr.Add(std::string("DELIVER IN PERSON"));
+            flexbldr.Add(std::string(modes[small(gen) % 5]));
+            flexbldr.Add(comment);
+        });
+        flexbldr.Finish();
+
+        auto row_data = fbb.CreateVector(flexbldr.GetBuffer());
+        auto nullbits = fbb.CreateVector(nb);
+        offs.push_back(Tables::CreateRecord(fbb, i, nullbits, row_data));
+        dead_rows.push_back(0);
+    }
+
+    auto table = CreateTable(
+        fbb,
+        SFT_FLATBUF_FLEX_ROW,
+        2,
+        1,
+        1,
+        fbb.CreateString(BENCH_SCHEMA),
+        fbb.CreateString("*"),
+        fbb.CreateString("lineitem"),
+        fbb.CreateVector(dead_rows),
+        fbb.CreateVector(offs),
+        offs.size());
+    fbb.Finish(table);
+}
+
+// legacy path, one dynamic_cast and type switch per pred per row
+static uint64_t evalLegacy(predicate_vec& preds, sky_root& root)
+{
+    uint64_t npass = 0;
+    row_offs rows = static_cast<row_offs>(root.data_vec);
+    for (uint32_t i = 0; i < root.nrows; i++) {
+        sky_rec rec = getSkyRec(rows->Get(i));
+        if (applyPredicates(preds, rec))
+            npass++;
+    }
+    return npass;
+}
+
+// batched path, same batching as processSkyFb
+static uint64_t evalEngine(PredicateEngine& engine, sky_root& root)
+{
+    uint64_t npass = 0;
+    row_offs rows = static_cast<row_offs>(root.data_vec);
+    std::vector<flexbuffers::Vector> batch_rows;
+    std::vector<int64_t> batch_rids;
+    SelectionBitmap sel;
+    for (uint32_t bstart = 0; bstart < root.nrows; bstart += PRED_BATCH_ROWS) {
+        uint32_t bsize = std::min(PRED_BATCH_ROWS, root.nrows - bstart);
+        batch_rows.clear();
+        batch_rids.clear();
+        for (uint32_t j = 0; j < bsize; j++) {
+            const Tables::Record* r = rows->Get(bstart + j);
+            batch_rows.push_back(r->data_flexbuffer_root().AsVector());
+            batch_rids.push_back(r->RID());
+        }
+        sel.reset(bsize, true);
+        engine.evalFlexRows(batch_rows, batch_rids, sel);
+        engine.updateAggsFlexRows(batch_rows, batch_rids, sel);
+        npass += sel.count();
+    }
+    return npass;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t num_rows;
+    uint32_t iterations;
+
+    po::options_description gen_opts("General options");
+    gen_opts.add_options()
+      ("help,h", "show help message")
+      ("num_rows", po::value<uint32_t>(&num_rows)->default_value(1000000), "rows in the synthetic blob")
+      ("iterations", po::value<uint32_t>(&iterations)->default_value(5), "timed runs per query");
+
+    po::options_description all_opts("Allowed options");
+    all_opts.add(gen_opts);
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, all_opts), vm);
+    if (vm.count("help")) {
+      std::cout << all_opts << std::endl;
+      return 1;
+    }
+    po::notify(vm);
+
+    flatbuffers::FlatBufferBuilder fbb(1024);
+    buildBlob(fbb, num_rows);
+    const char* blob = reinterpret_cast<const char*>(fbb.GetBufferPointer());
+    sky_root root = getSkyRoot(blob, fbb.GetSize(), SFT_FLATBUF_FLEX_ROW);
+    schema_vec schema = schemaFromString(BENCH_SCHEMA);
+
+    int errcode = 0;
+    for (auto it = BENCH_QUERIES.begin(); it != BENCH_QUERIES.end(); ++it) {
+        predicate_vec preds = predsFromString(schema, it->preds);
+        PredicateEngine engine(preds);
+        uint64_t legacy_pass = 0, engine_pass = 0;
+        double legacy_s = 0, engine_s = 0;
+
+        for (uint32_t i = 0; i < iterations; i++) {
+            auto t0 = std::chrono::steady_clock::now();
+            legacy_pass = evalLegacy(preds, root);
+            auto t1 = std::chrono::steady_clock::now();
+            engine_pass = evalEngine(engine, root);
+            auto t2 = std::chrono::steady_clock::now();
+            legacy_s += std::chrono::duration<double>(t1 - t0).count();
+            engine_s += std::chrono::duration<double>(t2 - t1).count();
+        }
+
+        double nrows = static_cast<double>(num_rows) * iterations;
+        std::cout << it->name
+                  << " legacy_rows_per_sec=" << (nrows / legacy_s)
+                  << " engine_rows_per_sec=" << (nrows / engine_s)
+                  << " speedup=" << (legacy_s / engine_s)
+                  << " rows_passed=" << engine_pass << std::endl;
+
+        // aggs only count the first agg in the legacy path, compare filters
+        if (!engine.hasAggs() and legacy_pass != engine_pass) {
+            std::cerr << "ERROR: " << it->name << " legacy rows_passed="
+                      << legacy_pass << " != engine rows_passed="
+                      << engine_pass << std::endl;
+            errcode = 1;
+        }
+        for (auto itp = preds.begin(); itp != preds.end(); ++itp)
+            delete *itp;
+    }
+    return errcode;
+}
@@ -11,12 +11,23 @@
 /*
  * The program starts in the main function. The function takes in a data file,
  * schema file, number of objects (aka buckets), number of rows till object
- * flushes, and total number of rows to be read. The main function then enters
- * a while loop till the specified number of lines are read from the data file.
- * In the while loop, each data row is parsed, processed, and hashed into a
- * bucket. If the number of rows till the bucket flushes is reached or all the
- * data rows have been read, then the contents of the bucket are "finished",
- * writen to disk, and the bucket is deleted.
+ * flushes, and total number of rows to be read. The data file is mapped into
+ * memory and split into chunks of whole lines, which are loaded by a number
+ * of threads.  Each thread parses the rows of its chunks in place and hashes
+ * each row into one of its own buckets.  If the number of rows till the
+ * bucket flushes is reached or all the data rows have been read, then the
+ * contents of the bucket are "finished", appended to its object either on
+ * disk or directly in a pool, and the bucket is deleted.
+ *
+ * When writing to a pool, the fb index and zone map entries of each finished
+ * bucket are set in the object's omap by the same write, so the objects can
+ * be queried with --mem-constrain and zone map pruning without first
+ * building an fb index.
+ *
+ * The string and date cols given by --dict_cols are dictionary encoded, each
+ * bucket keeps the distinct values of these cols and its rows only hold the
+ * uint code of their value.  The dictionaries are written into the fb when
+ * the bucket is finished.
 */
 
 
@@ -35,17 +46,31 @@ bin/sky_tabular_flatflex_writer --input_file_name lineitem.txt --input_file_sche
 bin/rados mkpool tpchdata;
 yes | PATH=$PATH:bin ../src/progly/rados-store-glob.sh tpchdata fbmeta.Skyhook.v2.SFT_FLATBUF_FLEX_ROW.testdata.* ;
 
+# or write the objects obj.testdata.0 ... directly to the pool on 8 threads
+bin/sky_tabular_flatflex_writer --input_file_name lineitem.txt --input_file_schema lineitem_schema.txt --num_objs 2 --flush_rows 9 --read_rows 17 --csv_delim "|" --use_hashing true --rid_start_value 2 --table_name testdata --default_oid 0 --data_format SFT_FLATBUF_FLEX_ROW --num_threads 8 --pool tpchdata ;
+
+# dictionary encode the low cardinality string cols
+bin/sky_tabular_flatflex_writer --input_file_name lineitem.txt --input_file_schema lineitem_schema.txt --num_objs 2 --flush_rows 9 --read_rows 17 --csv_delim "|" --use_hashing true --rid_start_value 2 --table_name testdata --default_oid 0 --data_format SFT_FLATBUF_FLEX_ROW --dict_cols l_returnflag,l_linestatus,l_shipinstruct,l_shipmode ;
+
 */
 
 #include <fcntl.h>     // system call open
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <map>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
 #include <unistd.h>    // for getOpt
 #include <limits.h>
 #include <boost/program_options.hpp>
 
+#include "include/rados/librados.hpp"
 #include "cls_tabular_utils.h"
 
 using namespace std;
@@ -54,14 +79,23 @@ namespace po = boost::program_options ;
 
 const uint8_t SKYHOOK_VERSION = 1;
 const uint8_t SCHEMA_VERSION = 1;
+const int CHUNKS_PER_THREAD = 16;  // input chunks per loader thread
 string SCHEMA = "";
-uint64_t RID = 1;
+Tables::schema_vec SKY_SCHEMA;
+int COMPRESSION = none;  // CompressionType of the written blobs
 typedef flatbuffers::FlatBufferBuilder fbBuilder;
 typedef flatbuffers::FlatBufferBuilder* fbb;
 typedef flexbuffers::Builder flxBuilder;
 typedef vector<uint8_t> delete_vector;
 typedef vector<flatbuffers::Offset<Record>> rows_vector;
 
+// set when objects are written directly to a pool rather than to disk
+librados::IoCtx* IOCTX = NULL;
+string OID_PREFIX = "obj";
+unsigned MAX_INFLIGHT = 16;  // object writes in flight per loader thread
+bool APPEND_OP = false;  // append through exec_append_op, indexed by the osd
+vector<int> DICT_COLS;  // positions of the dictionary encoded cols
+
 typedef struct {
     uint64_t oid;
     uint64_t nrows;
@@ -69,8 +103,48 @@ typedef struct {
     fbb fb;
     delete_vector *deletev;
     rows_vector *rowsv;
+    DictEncoder *dicts;  // codes of the DICT_COLS of the bucket's rows
 } bucket_t;
 
+// a field of a row, pointing into the mapped input data
+typedef struct {
+    const char* data;
+    size_t len;
+} field_t;
+
+// a range of whole lines of the input, the first of which is line
+// first_line of the input
+typedef struct {
+    const char* begin;
+    const char* end;
+    uint64_t first_line;
+} chunk_t;
+
+// an object written by any of the loader threads, the offset and
+// fb_seq_num of each bucket appended to it are reserved under its lock.
+typedef struct {
+    std::mutex lock;
+    bool init;
+    uint64_t off;             // object len, including reserved appends
+    unsigned int fb_seq_num;  // seq num of the last fb appended
+    string name;              // object name, if written to a pool
+} object_t;
+
+std::mutex OBJECTS_LOCK;
+map<uint64_t, std::unique_ptr<object_t>> OBJECTS;
+
+// per-thread buckets, builders and parse buffers, the loader threads only
+// share the objects their buckets are appended to.
+typedef struct {
+    BuilderPool builders;
+    map<uint64_t, bucket_t *> FBmap;
+    vector<field_t> fields;
+    vector<char> field_buf;
+    deque<librados::AioCompletion*> inflight;
+    uint64_t nrows;
+    int err;
+} loader_t;
+
 //----------------- check inputs ------------------
 std::vector<std::string> line_split(const std::string &s, char delim);
 void promptDataFile(ifstream&, string&);
@@ -81,47 +155,59 @@ void helpMenu();
 //-------------------------------------------------
 Tables::schema_vec getSchema(vector<int>&, string&);
 
-uint64_t getNextRID();
+uint64_t getRID(uint64_t line_num, uint64_t rid_start_value);
 
-vector<string> parseRow(string row, char csv_delim);
+void splitFields(const char* begin, const char* end, char csv_delim,
+                 vector<field_t>& fields);
 
-void getFlxBuffer(flexbuffers::Builder *, vector<string>,
-                  Tables::schema_vec, vector<uint64_t> *);
+void getFlxBuffer(flexbuffers::Builder *, const vector<field_t>&,
+                  const Tables::schema_vec&, vector<char>&,
+                  vector<uint64_t> *, DictEncoder *);
 
-uint64_t hashCompositeKey(vector<int>, vector<string>);
+uint64_t hashCompositeKey(const vector<int>&, const vector<field_t>&,
+                          vector<char>&);
 
 uint64_t jumpConsistentHash(uint64_t, uint64_t);
 
-bucket_t *retrieveBucketFromOID(map<uint64_t, bucket_t *> &, uint64_t, string);
+bucket_t *retrieveBucketFromOID(loader_t&, uint64_t, string);
 
-void insertRowIntoBucket(fbb, uint64_t, vector<uint64_t> *, vector<uint8_t>,
-                         delete_vector *, rows_vector *);
+void insertRowIntoBucket(fbb, uint64_t, vector<uint64_t> *,
+                         const vector<uint8_t>&, delete_vector *, rows_vector *);
 
 //------------- Finishing flatbuffer --------------
-void flushFlatBuffer(string, uint8_t skyhook_v, uint8_t schema_v, bucket_t *bucketPtr,
-                     string schema, uint64_t numOfObjs);
+int flushFlatBuffer(loader_t&, string, uint8_t skyhook_v, uint8_t schema_v,
+                    bucket_t *bucketPtr, string schema);
 
 void finishFlatBuffer(fbb, uint8_t, uint8_t, string, string, delete_vector *,
                       rows_vector *, uint32_t);
 
-int writeToDisk(string, uint64_t, uint8_t, bucket_t*, uint64_t);
+object_t& getObject(uint64_t oid);
 
-void deleteBucket(bucket_t *bucketPtr, fbb fbPtr, delete_vector *deletePtr,
-                  rows_vector *rowsPtr);
+int writeToDisk(string, uint64_t, bucket_t*, bufferlist&);
 
-//-------------------------------------------------
-vector<uint8_t> initializeFlexBuffer(vector<string> parsedRow,
-                                     Tables::schema_vec schema,
-                                     vector<uint64_t> *nullbits);
+int writeToPool(loader_t&, uint64_t, bucket_t*, bufferlist&);
+
+int waitForWrites(loader_t&, unsigned max_inflight);
+
+int finishObjects();
 
+void deleteBucket(loader_t&, bucket_t *bucketPtr, fbb fbPtr,
+                  delete_vector *deletePtr, rows_vector *rowsPtr);
 
+//-------------------------------------------------
+const vector<uint8_t>& initializeFlexBuffer(loader_t& loader,
+                                            Tables::schema_vec& schema,
+                                            vector<uint64_t> *nullbits,
+                                            DictEncoder *dicts);
 
-bucket_t *GetAndInitializeBucket(map<uint64_t, bucket_t *> &FBmap,
+bucket_t *GetAndInitializeBucket(loader_t& loader,
                                  uint64_t oid,
+                                 uint64_t rid,
                                  vector<uint64_t> *nullbits,
-                                 vector<uint8_t> flxPtr,
                                  string tablename);
 
+vector<chunk_t> splitChunks(const char* data, size_t size, int nthreads);
+
 int main(int argc, char *argv[])
 {
     string input_file_name         = "";
@@ -135,6 +221,11 @@ int main(int argc, char *argv[])
     char csv_delim           = Tables::CSV_DELIM;
     bool use_hashing         = false;
     string data_format          = "";
+    string compression          = "none";
+    int num_threads          = 1;
+    string pool              = "";
+    string conf              = "";
+    string dict_cols         = "";
 
 // -------------- Get Variables ---------------
     po::options_description gen_opts("General options");
@@ -150,7 +241,15 @@ int main(int argc, char *argv[])
       ("use_hashing", po::value<bool>(&use_hashing)->required(), "use_hashing")
       ("table_name", po::value<string>(&table_name)->required(), "table_name")
       ("default_oid", po::value<uint64_t>(&default_oid)->required(), "default_oid")
-      ("data_format", po::value<string>(&data_format)->required(), "data_format");
+      ("data_format", po::value<string>(&data_format)->required(), "data_format")
+      ("compression", po::value<string>(&compression), "blob compression: none, lz4 or zstd (def=none)")
+      ("num_threads", po::value<int>(&num_threads), "loader threads parsing rows and writing buckets (def=1)")
+      ("pool", po::value<string>(&pool), "write objects directly to this pool with their fb index and zone maps, rather than to disk (def=none)")
+      ("conf", po::value<string>(&conf), "ceph.conf file of the pool's cluster (def=default search path)")
+      ("oid_prefix", po::value<string>(&OID_PREFIX), "prefix of the object names in the pool, as for run-query --oid-prefix (def=obj)")
+      ("max_inflight", po::value<unsigned>(&MAX_INFLIGHT), "max object writes in flight per loader thread (def=16)")
+      ("append_op", po::bool_switch(&APPEND_OP), "with --pool, append each fbmeta by the exec_append_op cls method, which indexes it and adds it to the object's col_stats (def=false)")
+      ("dict_cols", po::value<string>(&dict_cols), "comma separated string or date cols to dictionary encode within each fb (def=none)");
 
     po::options_description all_opts("Allowed options");
     all_opts.add(gen_opts);
@@ -164,98 +263,207 @@ int main(int argc, char *argv[])
     }
     po::notify(vm);
 
+    COMPRESSION = compression_type_from_string(compression);
+    if (COMPRESSION < 0) {
+        std::cout << "compression '" << compression << "' not supported. aborting." << std::endl;
+        exit(1);
+    }
+    if (data_format != "SFT_FLATBUF_FLEX_ROW") {
+        std::cout << "data_format '" << data_format << "' not supported. aborting." << std::endl;
+        exit(1);
+    }
+    if (num_threads < 1 or MAX_INFLIGHT < 1) {
+        std::cout << "num_threads and max_inflight must be >= 1. aborting." << std::endl;
+        exit(1);
+    }
+
     // returns schema vector and composite keys
-    Tables::schema_vec schema;
     vector<int> composite_key_indexes;
-    schema = getSchema(composite_key_indexes, input_file_schema);
-    SCHEMA = Tables::schemaToString(schema);
-
-// ----------- Read Rows and Load into Corresponding FlatBuffer -----------
-    map<uint64_t, bucket_t *> FBmap;
-    bucket_t *bucketPtr;
+    SKY_SCHEMA = getSchema(composite_key_indexes, input_file_schema);
+    SCHEMA = Tables::schemaToString(SKY_SCHEMA);
+
+    // the cols to dictionary encode, by their position in the rows
+    if (!dict_cols.empty()) {
+        vector<string> names;
+        boost::split(names, dict_cols, boost::is_any_of(","),
+                     boost::token_compress_on);
+        for (auto it = names.begin(); it != names.end(); ++it) {
+            boost::trim(*it);
+            if (it->empty())
+                continue;
+            auto col = std::find_if(SKY_SCHEMA.begin(), SKY_SCHEMA.end(),
+                [&](const Tables::col_info& c) {return c.name == *it;});
+            if (col == SKY_SCHEMA.end() or
+                (col->type != Tables::SDT_STRING and
+                 col->type != Tables::SDT_DATE)) {
+                std::cout << "dict_cols '" << *it << "' is not a string or date col. aborting." << std::endl;
+                exit(1);
+            }
+            DICT_COLS.push_back(col->idx);
+        }
+    }
 
-    std::ifstream inFile(input_file_name);
-    std::string line;
-    uint64_t line_counter = 1;
-    while(getline(inFile, line) && inFile.good()) {
-        if((line_counter >= rid_start_value) &&
-             (line_counter <= (rid_start_value+read_rows))) {
-            auto parsedRow = parseRow(line, csv_delim);
+    // connect to the pool, if writing to one
+    librados::Rados cluster;
+    librados::IoCtx ioctx;
+    if (!pool.empty()) {
+        cluster.init(NULL);
+        cluster.conf_read_file(conf.empty() ? NULL : conf.c_str());
+        int ret = cluster.connect();
+        if (ret < 0) {
+            std::cout << "cannot connect to cluster " << ret << ". aborting." << std::endl;
+            exit(1);
+        }
+        ret = cluster.ioctx_create(pool.c_str(), ioctx);
+        if (ret < 0) {
+            std::cout << "cannot open pool '" << pool << "' " << ret << ". aborting." << std::endl;
+            exit(1);
+        }
+        IOCTX = &ioctx;
+    }
 
-            vector<uint64_t> *nullbits = new vector<uint64_t>(2,0);
+// ----------- Map the input file and split it into chunks of lines -----------
+    int fd = open(input_file_name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        std::cout << "cannot open file '" << input_file_name << "'. aborting." << std::endl;
+        exit(1);
+    }
+    struct stat st;
+    fstat(fd, &st);
+    size_t input_size = st.st_size;
+    const char* input = NULL;
+    if (input_size > 0) {
+        void* p = mmap(NULL, input_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (p == MAP_FAILED) {
+            std::cout << "cannot mmap file '" << input_file_name << "'. aborting." << std::endl;
+            exit(1);
+        }
+        madvise(p, input_size, MADV_SEQUENTIAL);
+        input = static_cast<const char*>(p);
+    }
+    vector<chunk_t> chunks = splitChunks(input, input_size, num_threads);
 
-            // --------- Get Row and Load into FlexBuffer ---------
-            vector<uint8_t> flxPtr = initializeFlexBuffer(parsedRow,
-                                                          schema,
-                                                          nullbits);
+    // rows of lines [rid_start_value, rid_start_value+read_rows] are loaded
+    uint64_t first_line = std::max(rid_start_value, static_cast<uint64_t>(1));
+    uint64_t last_line = rid_start_value + read_rows;
 
-            uint64_t oid     = -1 ;
-            if(use_hashing) {
-              // --------- Hash Composite Key ----------
-              uint64_t hashKey = hashCompositeKey(composite_key_indexes, parsedRow);
+// ----------- Read Rows and Load into Corresponding FlatBuffer -----------
+    std::atomic<size_t> next_chunk(0);
+    vector<std::unique_ptr<loader_t>> loaders;
+    for (int t = 0; t < num_threads; t++) {
+        loaders.emplace_back(new loader_t());
+        loaders.back()->field_buf.resize(Tables::MAX_COLSIZE + 1);
+        loaders.back()->nrows = 0;
+        loaders.back()->err = 0;
+    }
 
-              // --------- Get Oid Using HashKey ----------
-              oid = jumpConsistentHash(hashKey, num_objs);
+    auto load = [&](loader_t* loader) {
+        vector<uint64_t> nullbits(2, 0);
+        for (size_t c = next_chunk++; c < chunks.size() and loader->err == 0;
+             c = next_chunk++) {
+            const chunk_t& chunk = chunks[c];
+            uint64_t line_counter = chunk.first_line;
+            const char* line = chunk.begin;
+            while (line < chunk.end and line_counter <= last_line and
+                   loader->err == 0) {
+                const char* eol = static_cast<const char*>(
+                    memchr(line, '\n', chunk.end - line));
+                if (eol == NULL)
+                    eol = chunk.end;
+                if (line_counter >= first_line) {
+                    splitFields(line, eol, csv_delim, loader->fields);
+
+                    uint64_t oid     = -1 ;
+                    if(use_hashing) {
+                      // --------- Hash Composite Key ----------
+                      uint64_t hashKey = hashCompositeKey(composite_key_indexes,
+                                                          loader->fields,
+                                                          loader->field_buf);
+
+                      // --------- Get Oid Using HashKey ----------
+                      oid = jumpConsistentHash(hashKey, num_objs);
+                    }
+                    else {
+                      // write all rows between rid_start_row and
+                      // (rid_start_row+read_rows) to a single object.
+                      oid  = default_oid ;
+                    }
+
+                    // ------ Get FB, load the row into a FlexBuffer and insert ------
+                    if ((line_counter % 100000) == 0)
+                        printf("Inserting Row %ld into Bucket %ld\n", line_counter, oid);
+                    nullbits[0] = 0;
+                    nullbits[1] = 0;
+                    bucket_t* bucketPtr = GetAndInitializeBucket(
+                        *loader, oid, getRID(line_counter, rid_start_value),
+                        &nullbits, table_name);
+                    loader->nrows++;
+
+                    // ----------- Flush if rows_flush was met -----------
+                    // each flush appends another fbmeta to the object.
+                    if( bucketPtr->rowsv->size() >= flush_rows) {
+                        printf("\tFlushing bucket %ld to Ceph with %ld rows\n",
+                               oid, bucketPtr->nrows);
+                        loader->FBmap.erase(oid);
+                        loader->err = flushFlatBuffer(*loader,
+                                                      data_format,
+                                                      SKYHOOK_VERSION,
+                                                      SCHEMA_VERSION,
+                                                      bucketPtr,
+                                                      SCHEMA);
+                    } // if need to flush
+                } // if in rid range
+                line = eol + 1;
+                line_counter++;
+            } // while get a row
+        } // for each chunk
+
+        // ------------- Flush the remaining buckets of this thread ----------
+        for (auto& x: loader->FBmap) {
+            bucket_t *b = x.second;
+            if (loader->err == 0) {
+                printf("\tFlushing bucket %ld to Ceph with %ld rows\n",
+                       b->oid, b->nrows);
+                loader->err = flushFlatBuffer(*loader, data_format,
+                                              SKYHOOK_VERSION, SCHEMA_VERSION,
+                                              b, SCHEMA);
             }
             else {
-              // write all rows between rid_start_row and (rid_start_row+read_rows)
-              // to a single bucket/file.
-              // define default oid
-              oid  = default_oid ;
+                deleteBucket(*loader, b, b->fb, b->deletev, b->rowsv);
             }
-
-            // --------- Get FB and insert ----------
-            if ((line_counter % 100000) == 0)
-                printf("Inserting Row %ld into Bucket %ld\n", line_counter, oid);
-            bucketPtr = GetAndInitializeBucket(FBmap, oid, nullbits, flxPtr, table_name);
-
-            // ----------- Flush if rows_flush was met -----------
-            // TODO: either disable flushing when not using hashing
-            //       or increment the oid.
-            //       otherwise, when flush_rows < read_rows,
-            //       this will flush everything to the same object,
-            //       which overwrites previously written data.
-            if( bucketPtr->rowsv->size() >= flush_rows) {
-                printf("\tFlushing bucket %ld to Ceph with %ld rows\n",
-                       oid, bucketPtr->nrows);
-
-                // Flush FlatBuffer to Ceph (currently writes to a file on disk)
-                flushFlatBuffer(data_format,
-                                SKYHOOK_VERSION,
-                                SCHEMA_VERSION,
-                                bucketPtr,
-                                SCHEMA,
-                                num_objs);
-                FBmap.erase(oid);
-            } // if need to flush
-            delete nullbits;
-        } // if in rid range
-        else if(line_counter >= (rid_start_value+read_rows))
-             break ;
-        else
-            std::cout << "skipping row " << line_counter << std::endl ;
-
-        line_counter++;
-    } // while get a row
-
-// ------------- Iterate over map and flush each bucket --------------
-   if(use_hashing) {
-        printf("\nFlush the remaining buckets in map\n");
-        for (auto& x: FBmap) {
-            bucket_t *b = x.second;
-            printf("\tFlushing bucket %ld to Ceph with %ld rows\n",
-                   b->oid, b->nrows);
-
-            flushFlatBuffer(data_format, SKYHOOK_VERSION, SCHEMA_VERSION, b, SCHEMA, num_objs);
         } // for every FBmap key
-    } // if using hashing
-
-    FBmap.clear();
-    printf("Done flushing all the objects\n");
+        loader->FBmap.clear();
+        int ret = waitForWrites(*loader, 0);
+        if (loader->err == 0)
+            loader->err = ret;
+    };
+
+    vector<std::thread> threads;
+    for (int t = 1; t < num_threads; t++)
+        threads.emplace_back(load, loaders[t].get());
+    load(loaders[0].get());
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+
+    int err = 0;
+    uint64_t nrows = 0;
+    for (auto it = loaders.begin(); it != loaders.end(); ++it) {
+        if ((*it)->err != 0)
+            err = (*it)->err;
+        nrows += (*it)->nrows;
+        printf("%s\n", (*it)->builders.stats().toString().c_str());
+    }
+    if (err == 0)
+        err = finishObjects();
+    if (err != 0) {
+        std::cout << "error writing objects " << err << ". aborting." << std::endl;
+        exit(EXIT_FAILURE);
+    }
+    printf("Done flushing all the objects, %ld rows\n", nrows);
 
-    // Close .csv file
-    if( inFile.is_open() )
-        inFile.close();
+    if (input)
+        munmap(const_cast<char*>(input), input_size);
+    close(fd);
 
     return 0;
 }
@@ -328,10 +536,6 @@ bool promptBoolVariable(string variable, string bool_string) {
     return i;
 }
 
-vector<string> parseRow(string row, char delim=Tables::CSV_DELIM) {
-    return line_split(row, delim);
-}
-
 Tables::schema_vec getSchema(vector<int>& compositeKey,
                              string& input_file_schema) {
     ifstream schemaFile;
@@ -378,50 +582,142 @@ Tables::schema_vec getSchema(vector<int>& compositeKey,
     return sky_schema;
 }
 
-vector<uint8_t>
-initializeFlexBuffer(vector<string> parsedRow,
-                     Tables::schema_vec schema,
-                     vector<uint64_t> *nullbits) {
+// the rows of lines [rid_start_value, ...] get RIDs 1, 2, ... and so on, in
+// line order regardless of the thread loading them.
+uint64_t getRID(uint64_t line_num, uint64_t rid_start_value) {
+    return line_num - std::max(rid_start_value, static_cast<uint64_t>(1)) + 1;
+}
+
+// split the data into nthreads * CHUNKS_PER_THREAD chunks of whole lines,
+// and count the lines of each chunk in parallel to number its first line.
+vector<chunk_t> splitChunks(const char* data, size_t size, int nthreads) {
+    vector<chunk_t> chunks;
+    size_t nchunks = nthreads * CHUNKS_PER_THREAD;
+    size_t chunk_size = std::max(size / nchunks, static_cast<size_t>(1));
+    const char* end = data + size;
+    const char* begin = data;
+    while (begin < end) {
+        const char* chunk_end = begin + std::min(chunk_size,
+                                                 static_cast<size_t>(end - begin));
+        if (chunk_end < end) {
+            const char* eol = static_cast<const char*>(
+                memchr(chunk_end, '\n', end - chunk_end));
+            chunk_end = (eol == NULL) ? end : eol + 1;
+        }
+        chunk_t chunk;
+        chunk.begin = begin;
+        chunk.end = chunk_end;
+        chunk.first_line = 0;
+        chunks.push_back(chunk);
+        begin = chunk_end;
+    }
 
-    flexbuffers::Builder *flx = new flexbuffers::Builder();
+    // lines per chunk, only the last chunk may not end with a newline
+    vector<uint64_t> nlines(chunks.size(), 0);
+    auto count = [&](size_t t) {
+        for (size_t c = t; c < chunks.size(); c += nthreads) {
+            const char* p = chunks[c].begin;
+            while (p < chunks[c].end) {
+                p = static_cast<const char*>(
+                    memchr(p, '\n', chunks[c].end - p));
+                nlines[c]++;
+                if (p == NULL)
+                    break;
+                p++;
+            }
+        }
+    };
+    vector<std::thread> threads;
+    for (int t = 1; t < nthreads; t++)
+        threads.emplace_back(count, t);
+    count(0);
+    for (auto it = threads.begin(); it != threads.end(); ++it)
+        it->join();
+
+    uint64_t line = 1;
+    for (size_t c = 0; c < chunks.size(); c++) {
+        chunks[c].first_line = line;
+        line += nlines[c];
+    }
+    return chunks;
+}
+
+// split a line into fields that point into the line, fields is reused for
+// each line so no memory is allocated once it has grown to the row width.
+void splitFields(const char* begin, const char* end, char csv_delim,
+                 vector<field_t>& fields) {
+    fields.clear();
+    const char* p = begin;
+    while (true) {
+        const char* delim = static_cast<const char*>(
+            memchr(p, csv_delim, end - p));
+        field_t f;
+        f.data = p;
+        f.len = (delim == NULL ? end : delim) - p;
+        fields.push_back(f);
+        if (delim == NULL)
+            break;
+        p = delim + 1;
+    }
+}
+
+// copy a field into buf as a null terminated string for the strto*()
+// functions, truncating fields longer than buf.
+static inline
+const char* fieldStr(const field_t& f, vector<char>& buf) {
+    size_t len = std::min(f.len, buf.size() - 1);
+    memcpy(buf.data(), f.data, len);
+    buf[len] = '\0';
+    return buf.data();
+}
+
+const vector<uint8_t>&
+initializeFlexBuffer(loader_t& loader,
+                     Tables::schema_vec& schema,
+                     vector<uint64_t> *nullbits,
+                     DictEncoder *dicts) {
+
+    flexbuffers::Builder *flx = &loader.builders.flexBuilder();
 
     // load parsed row into our flxBuilder and update nullbits
-    getFlxBuffer(flx, parsedRow, schema, nullbits);
+    getFlxBuffer(flx, loader.fields, schema, loader.field_buf, nullbits,
+                 dicts);
 
-    // get pointer to FlexBuffer
-    vector<uint8_t> flxPtr = flx->GetBuffer();
-    delete flx;
-    return flxPtr;
+    // FlexBuffer is only valid until the next row is initialized
+    return loader.builders.finishFlex();
 }
 
 void getFlxBuffer(flxBuilder *flx,
-                  vector<string> parsedRow,
-                  Tables::schema_vec schema,
-                  vector<uint64_t> *nullbits) {
+                  const vector<field_t>& parsedRow,
+                  const Tables::schema_vec& schema,
+                  vector<char>& buf,
+                  vector<uint64_t> *nullbits,
+                  DictEncoder *dicts) {
 
     bool nullFlag = false;
-    string nullcmp = "NULL";
+    field_t empty = {"", 0};
+
+    // add a string, or its code if the col is dictionary encoded
+    auto addString = [&](int pos, const char* s, size_t len) {
+        if (dicts->encodes(pos))
+            flx->UInt(dicts->code(pos, s, len));
+        else
+            flx->String(s, len);
+    };
 
     // Create Flexbuffer from Parsed Row and Schema
     flx->Vector([&]() {
         for(int i=0;i<(int)schema.size();i++) {
-            Tables::col_info col = schema[i];
-            nullFlag = false;
-            if(strcmp(parsedRow[i].c_str(), nullcmp.c_str() ) == 0)
-                nullFlag = true;
+            const Tables::col_info& col = schema[i];
+            const field_t& f = col.idx < (int)parsedRow.size() ?
+                               parsedRow[col.idx] : empty;
+            nullFlag = (i < (int)parsedRow.size() and
+                        parsedRow[i].len == 4 and
+                        memcmp(parsedRow[i].data, "NULL", 4) == 0);
             if(nullFlag) {
                 // Mark nullbit
-                uint64_t nullMask = 0x00;
-                if(i<64) {
-                    nullMask = 1lu << (63-i);
-                    nullbits[0][0] |=  nullMask;
-                }
-                else {
-                    nullMask = 1lu << (63- (i-64));
-                    nullbits[0][1] |= nullMask;
-                }
+                Tables::setNullBit(*nullbits, i);
 
-                printf("NULL CASE SWITCHES \n");
                 // Put a dummy variable to hold the index for future updates
                 switch(col.type) {
                 case Tables::SDT_INT8:
@@ -464,10 +760,10 @@ void getFlxBuffer(flxBuilder *flx,
                     flx->Add(static_cast<double>(0));
                     break;
                 case Tables::SDT_DATE:
-                    flx->Add("0000-00-00");
+                    addString(col.idx, "0000-00-00", 10);
                     break;
                 case Tables::SDT_STRING:
-                    flx->Add("This will be pooled with strings.");
+                    addString(col.idx, "This will be pooled with strings.", 33);
                     break;
                 default:
                     flx->Add("EMPTY");
@@ -477,49 +773,47 @@ void getFlxBuffer(flxBuilder *flx,
             else {
                 switch(col.type) {
                 case Tables::SDT_INT8:
-                    flx->Add(static_cast<int8_t>(stoi(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<int8_t>(strtol(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_INT16:
-                    flx->Add(static_cast<int16_t>(stoi(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<int16_t>(strtol(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_INT32:
-                    flx->Add(static_cast<int32_t>(stoi(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<int32_t>(strtol(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_INT64:
-                    flx->Add(static_cast<int64_t>(stoi(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<int64_t>(strtoll(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_UINT8:
-                    flx->Add(static_cast<uint8_t>(stoul(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<uint8_t>(strtoul(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_UINT16:
-                    flx->Add(static_cast<uint16_t>(stoul(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<uint16_t>(strtoul(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_UINT32:
-                    flx->Add(static_cast<uint32_t>(stoul(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<uint32_t>(strtoul(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_UINT64:
-                    flx->Add(static_cast<uint64_t>(stoul(parsedRow[col.idx].c_str())));
+                    flx->Add(static_cast<uint64_t>(strtoull(fieldStr(f, buf), NULL, 10)));
                     break;
                 case Tables::SDT_CHAR:
-                    flx->Add(static_cast<char>(parsedRow[col.idx][0]));
+                    flx->Add(static_cast<char>(f.len > 0 ? f.data[0] : 0));
                     break;
                 case Tables::SDT_UCHAR:
-                    flx->Add(static_cast<unsigned char>(parsedRow[col.idx][0]));
+                    flx->Add(static_cast<unsigned char>(f.len > 0 ? f.data[0] : 0));
                     break;
                 case Tables::SDT_BOOL:
-                    flx->Add(static_cast<bool>(parsedRow[col.idx].c_str()));
+                    flx->Add(f.len > 0);
                     break;
                 case Tables::SDT_FLOAT:
-                    flx->Add(static_cast<float>(stof(parsedRow[col.idx].c_str())));
+                    flx->Add(strtof(fieldStr(f, buf), NULL));
                     break;
                 case Tables::SDT_DOUBLE:
-                    flx->Add(static_cast<double>(stod(parsedRow[col.idx].c_str())));
+                    flx->Add(strtod(fieldStr(f, buf), NULL));
                     break;
                 case Tables::SDT_DATE:
-                    flx->Add(parsedRow[col.idx].c_str());
-                    break;
                 case Tables::SDT_STRING:
-                    flx->Add(parsedRow[col.idx].c_str());
+                    addString(col.idx, f.data, f.len);
                     break;
                 default:
                     flx->Add("EMPTY");
@@ -528,18 +822,24 @@ void getFlxBuffer(flxBuilder *flx,
             }
         }
     });
-    flx->Finish();
 }
 
-uint64_t hashCompositeKey(vector<int> compositeKeyIndexes,
-                          vector<string> parsedRow) {
+uint64_t hashCompositeKey(const vector<int>& compositeKeyIndexes,
+                          const vector<field_t>& parsedRow,
+                          vector<char>& buf) {
 
     // Hash the Composite Key
     uint64_t hashKey=0, upper=0, lower=0;
-    stringstream(parsedRow[compositeKeyIndexes[0]]) >> upper;
+    if (compositeKeyIndexes.empty())
+        return hashKey;
+    if (compositeKeyIndexes[0] < (int)parsedRow.size())
+        upper = strtoull(fieldStr(parsedRow[compositeKeyIndexes[0]], buf),
+                         NULL, 10);
     hashKey = upper << 32;
-    if(compositeKeyIndexes.size() > 1) {
-        stringstream(parsedRow[compositeKeyIndexes[1]]) >> lower;
+    if(compositeKeyIndexes.size() > 1 and
+       compositeKeyIndexes[1] < (int)parsedRow.size()) {
+        lower = strtoull(fieldStr(parsedRow[compositeKeyIndexes[1]], buf),
+                         NULL, 10);
         hashKey = hashKey | lower;
     }
     if (compositeKeyIndexes.size() > 2)
@@ -562,13 +862,18 @@ uint64_t jumpConsistentHash(uint64_t key, uint64_t num_buckets) {
 }
 
 bucket_t* GetAndInitializeBucket(
-    map<uint64_t, bucket_t *> &FBmap,
-    uint64_t oid,vector<uint64_t> *nullbits,
-    vector<uint8_t> flxPtr,
+    loader_t& loader,
+    uint64_t oid,
+    uint64_t rid,
+    vector<uint64_t> *nullbits,
     string tablename) {
 
     bucket_t *bucketPtr;
-    bucketPtr = retrieveBucketFromOID(FBmap, oid, tablename);
+    bucketPtr = retrieveBucketFromOID(loader, oid, tablename);
+
+    // the row's strings are encoded with the codes of its bucket
+    const vector<uint8_t>& flxPtr = \
+        initializeFlexBuffer(loader, SKY_SCHEMA, nullbits, bucketPtr->dicts);
 
     fbb fbPtr = bucketPtr->fb;
     delete_vector *deletePtr;
@@ -576,21 +881,19 @@ bucket_t* GetAndInitializeBucket(
     deletePtr = bucketPtr->deletev;
     rowsPtr = bucketPtr->rowsv;
 
-    uint64_t RID = getNextRID();
-
-    insertRowIntoBucket(fbPtr, RID, nullbits, flxPtr, deletePtr, rowsPtr);
+    insertRowIntoBucket(fbPtr, rid, nullbits, flxPtr, deletePtr, rowsPtr);
     bucketPtr->nrows++;
     return bucketPtr;
 }
 
 bucket_t*
-retrieveBucketFromOID(map<uint64_t, bucket_t *> &FBmap, uint64_t oid, string tablename) {
+retrieveBucketFromOID(loader_t& loader, uint64_t oid, string tablename) {
 
     bucket_t *bucketPtr;
     // Get FB from map or use new FB
     map<uint64_t, bucket_t *>::iterator it;
-    it = FBmap.find(oid);
-    if(it != FBmap.end()) {
+    it = loader.FBmap.find(oid);
+    if(it != loader.FBmap.end()) {
         bucketPtr = it->second;
     }
     else
@@ -599,10 +902,11 @@ retrieveBucketFromOID(map<uint64_t, bucket_t *> &FBmap, uint64_t oid, string tab
         bucketPtr->oid = oid;
         bucketPtr->nrows = 0;
         bucketPtr->table_name = tablename;
-        bucketPtr->fb = new fbBuilder();
+        bucketPtr->fb = loader.builders.acquire();
         bucketPtr->deletev = new delete_vector();
         bucketPtr->rowsv = new rows_vector();
-        FBmap[oid] = bucketPtr;
+        bucketPtr->dicts = new DictEncoder(DICT_COLS);
+        loader.FBmap[oid] = bucketPtr;
     }
     return bucketPtr;
 }
@@ -612,7 +916,7 @@ insertRowIntoBucket(
     fbb fbPtr,
     uint64_t RID,
     vector<uint64_t> *nullbits,
-    vector<uint8_t> flxPtr,
+    const vector<uint8_t>& flxPtr,
     delete_vector *deletePtr,
     rows_vector *rowsPtr) {
 
@@ -624,19 +928,14 @@ insertRowIntoBucket(
     rowsPtr->push_back(rowOffset);
 }
 
-// NOTE: this is a blind increment, should come from database
-uint64_t getNextRID() {
-    return RID++;
-}
-
-void
+int
 flushFlatBuffer(
+    loader_t& loader,
     string data_format,
     uint8_t skyhook_v,
     uint8_t schema_v,
     bucket_t *bucketPtr,
-    string schema,
-    uint64_t numOfObjs) {
+    string schema) {
 
     delete_vector *deletePtr;
     rows_vector *rowsPtr;
@@ -671,20 +970,50 @@ flushFlatBuffer(
                     table_n,
                     delete_vector,
                     rows,
-                    bucketPtr->nrows);
+                    bucketPtr->nrows,
+                    bucketPtr->dicts->finish(*fbPtr));
 
     fbPtr->Finish(tableOffset);
 
     // -----------------------------------
 
-    uint64_t oid = bucketPtr->oid;
+    // CREATE An FB_META, using the thread's meta builder
+    flatbuffers::FlatBufferBuilder *fbmeta_builder = \
+            &loader.builders.metaBuilder(fbPtr->GetSize());
+    int ret = createFbMeta(
+            fbmeta_builder,
+            SFT_FLATBUF_FLEX_ROW,
+            reinterpret_cast<unsigned char*>(fbPtr->GetBufferPointer()),
+            fbPtr->GetSize(),
+            false, 0, 0,
+            COMPRESSION);
+    if (ret != 0) {
+        deleteBucket(loader, bucketPtr, fbPtr, deletePtr, rowsPtr);
+        return -EINVAL;
+    }
 
-    // Flush to Ceph Here TO OID bucket with n Rows or Crash if Failed
-    if(writeToDisk(data_format, oid, schema_v, bucketPtr, numOfObjs) < 0)
-        exit(EXIT_FAILURE);
+    // add fbmeta_builder's data into a bufferlist as char*
+    bufferlist fbmeta_bl;
+    fbmeta_bl.append(
+            reinterpret_cast<const char*>(fbmeta_builder->GetBufferPointer()),
+            fbmeta_builder->GetSize());
+
+    // now encode the metabl into a wrapper bl so that it can be easily
+    // unpacked via decode from a bl iterator into a bl, used by
+    // query.cc and cls_tabular.cc
+    bufferlist fbmeta_wrapper_bl;
+    ceph::encode(fbmeta_bl, fbmeta_wrapper_bl);
+
+    // Flush to Ceph Here TO OID bucket with n Rows
+    uint64_t oid = bucketPtr->oid;
+    if (IOCTX)
+        ret = writeToPool(loader, oid, bucketPtr, fbmeta_wrapper_bl);
+    else
+        ret = writeToDisk(data_format, oid, bucketPtr, fbmeta_wrapper_bl);
 
     // Deallocate pointers
-    deleteBucket(bucketPtr, fbPtr, deletePtr, rowsPtr);
+    deleteBucket(loader, bucketPtr, fbPtr, deletePtr, rowsPtr);
+    return ret;
 }
 
 
@@ -728,74 +1057,203 @@ void finishFlatBuffer(
 }
 
 
-/* TODO: instead of writing objects to disk, write directly to ceph. */
+
+// the object of oid shared by all loader threads
+object_t& getObject(uint64_t oid) {
+    std::lock_guard<std::mutex> l(OBJECTS_LOCK);
+    std::unique_ptr<object_t>& obj = OBJECTS[oid];
+    if (!obj) {
+        obj.reset(new object_t());
+        obj->init = false;
+        obj->off = 0;
+        obj->fb_seq_num = Tables::DATASTRUCT_SEQ_NUM_MIN;
+    }
+    return *obj;
+}
+
+// append the wrapped fbmeta of a finished bucket to its object file, the
+// file is truncated by the first bucket of this run.
 int
 writeToDisk(
     string data_format,
     uint64_t oid,
-    uint8_t schema_v,
     bucket_t *bucket,
-    uint64_t nobjs) {
-
-    // NOTE: assumes bucketPtr->fb has been finished(), i.e., points to
-    // formatted, serialized data
-
-    // CREATE An FB_META, using an empty builder first.
-    flatbuffers::FlatBufferBuilder *fbmeta_builder = \
-            new flatbuffers::FlatBufferBuilder();
-    if(data_format== "SFT_FLATBUF_FLEX_ROW")
-        createFbMeta(
-                fbmeta_builder,
-                SFT_FLATBUF_FLEX_ROW,
-                reinterpret_cast<unsigned char*>(bucket->fb->GetBufferPointer()),
-                bucket->fb->GetSize());
-    else {
-        std::cout << "data_format '" << data_format << "' not supported. aborting." << std::endl;
-        exit(1);
-    }
-
-    // add fbmeta_builder's data into a bufferlist as char*
-    bufferlist fbmeta_bl;
-    fbmeta_bl.append(
-            reinterpret_cast<const char*>(fbmeta_builder->GetBufferPointer()),
-            fbmeta_builder->GetSize());
-
-    // now encode the metabl into a wrapper bl so that it can be easily
-    // unpacked via decode from a bl iterator into a bl, used by
-    // query.cc and cls_tabular.cc
-    bufferlist fbmeta_wrapper_bl;
-    ceph::encode(fbmeta_bl, fbmeta_wrapper_bl);
+    bufferlist& fbmeta_wrapper_bl) {
 
     string fname = "skyhook." + data_format
                                         + "." + bucket->table_name
                                         + "." + std::to_string(oid);
 
-    // write to disk as binary bl data.
+    // write to disk as binary bl data, in bucket flush order.
+    object_t& obj = getObject(oid);
+    std::lock_guard<std::mutex> l(obj.lock);
     int mode = 0600;
-    fbmeta_wrapper_bl.write_file(fname.c_str(), mode);
+    int flags = O_WRONLY | O_CREAT | (obj.init ? O_APPEND : O_TRUNC);
+    int fd = open(fname.c_str(), flags, mode);
+    if (fd < 0) {
+        std::cout << "cannot open file '" << fname << "'" << std::endl;
+        return -errno;
+    }
+    int ret = fbmeta_wrapper_bl.write_fd(fd);
+    close(fd);
+    if (ret < 0)
+        return ret;
+    obj.init = true;
+    obj.off += fbmeta_wrapper_bl.length();
     std::cout << "bucket->fb->GetSize()=" << bucket->fb->GetSize()
-              << "; fbmeta_builder len=" << fbmeta_builder->GetSize()
-              << "; fbmeta_bl len=" << fbmeta_bl.length()
               << "; fbmeta_wrapper_bl len=" << fbmeta_wrapper_bl.length()
+              << "; obj len=" << obj.off
               << std::endl;
+    return 0;
+}
+
+// write the wrapped fbmeta of a finished bucket at the end of its object in
+// the pool, along with its fb index and zone map omap entries.  The object
+// range and fb_seq_num are reserved first, so the writes of any threads
+// to the same object can be in flight at once.
+int
+writeToPool(
+    loader_t& loader,
+    uint64_t oid,
+    bucket_t *bucket,
+    bufferlist& fbmeta_wrapper_bl) {
+
+    string oid_name = OID_PREFIX + "." + bucket->table_name + "." +
+                      std::to_string(oid);
+
+    // or let the osd append and index it, at the end of the object then
+    if (APPEND_OP) {
+        append_op op;
+        op.data = fbmeta_wrapper_bl;
+        bufferlist inbl;
+        ceph::encode(op, inbl);
+        librados::AioCompletion *c = librados::Rados::aio_create_completion();
+        int ret = IOCTX->aio_exec(oid_name, c, "tabular", "exec_append_op",
+                                  inbl, NULL);
+        if (ret < 0) {
+            c->release();
+            return ret;
+        }
+        loader.inflight.push_back(c);
+        return waitForWrites(loader, MAX_INFLIGHT - 1);
+    }
+
+    // append after any data already in the object, and number its fbs
+    // after those already indexed
+    uint64_t off;
+    unsigned int fb_seq_num;
+    {
+        object_t& obj = getObject(oid);
+        std::lock_guard<std::mutex> l(obj.lock);
+        if (!obj.init) {
+            uint64_t size = 0;
+            time_t mtime;
+            int ret = IOCTX->stat(oid_name, &size, &mtime);
+            if (ret < 0 and ret != -ENOENT)
+                return ret;
+            obj.off = (ret == -ENOENT) ? 0 : size;
+            bufferlist seq_bl;
+            ret = IOCTX->getxattr(oid_name, "fb_seq_num", seq_bl);
+            if (ret > 0) {
+                bufferlist::const_iterator it = seq_bl.begin();
+                ceph::decode(obj.fb_seq_num, it);
+            }
+            obj.name = oid_name;
+            obj.init = true;
+        }
+        off = obj.off;
+        obj.off += fbmeta_wrapper_bl.length();
+        fb_seq_num = ++obj.fb_seq_num;
+    }
 
-    delete fbmeta_builder;
+    // the fb index and zone map entries, as built by exec_build_sky_index_op
+    std::string str_seq_num = Tables::u64tostr(fb_seq_num);
+    std::string key_data = str_seq_num.substr(str_seq_num.length() - 10);
+    std::map<std::string, bufferlist> omap;
+    struct idx_fb_entry fb_ent(off, fbmeta_wrapper_bl.length());
+    ceph::encode(fb_ent, omap[buildKeyPrefix(Tables::SIT_IDX_FB, "*",
+                                             bucket->table_name) + key_data]);
+
+    std::vector<Tables::col_summary> summaries;
+    uint64_t zone_rows = 0;
+    std::string errmsg;
+    int ret = Tables::summarize_cols(
+        reinterpret_cast<const char*>(bucket->fb->GetBufferPointer()),
+        bucket->fb->GetSize(), SFT_FLATBUF_FLEX_ROW, SKY_SCHEMA, 1,
+        &zone_rows, summaries, errmsg);
+    if (ret == 0) {
+        struct idx_zone_entry zone_ent = \
+            Tables::build_zone_entry(SKY_SCHEMA, summaries, zone_rows);
+        ceph::encode(zone_ent,
+                     omap[buildKeyPrefix(Tables::SIT_IDX_ZONE, "*",
+                                         bucket->table_name) + key_data]);
+    }
+    else {
+        std::cout << "no zone map for " << oid_name << ": " << errmsg
+                  << std::endl;
+    }
+
+    librados::ObjectWriteOperation op;
+    op.write(off, fbmeta_wrapper_bl);
+    op.omap_set(omap);
+    librados::AioCompletion *c = librados::Rados::aio_create_completion();
+    ret = IOCTX->aio_operate(oid_name, c, &op);
+    if (ret < 0) {
+        c->release();
+        return ret;
+    }
+    loader.inflight.push_back(c);
+
+    // pipeline the writes, only waiting once too many are in flight
+    return waitForWrites(loader, MAX_INFLIGHT - 1);
+}
+
+// wait for the oldest writes of the thread to complete, until no more than
+// max_inflight are still in flight.
+int waitForWrites(loader_t& loader, unsigned max_inflight) {
+    int err = 0;
+    while (loader.inflight.size() > max_inflight) {
+        librados::AioCompletion *c = loader.inflight.front();
+        loader.inflight.pop_front();
+        c->wait_for_complete();
+        int ret = c->get_return_value();
+        c->release();
+        if (ret < 0)
+            err = ret;
+    }
+    return err;
+}
+
+// set the fb_seq_num of each object written to the pool to its last fb, so
+// fbs appended or indexed later are numbered after these.
+int finishObjects() {
+    if (!IOCTX)
+        return 0;
+    for (auto it = OBJECTS.begin(); it != OBJECTS.end(); ++it) {
+        if (!it->second->init)
+            continue;
+        bufferlist seq_bl;
+        ceph::encode(it->second->fb_seq_num, seq_bl);
+        int ret = IOCTX->setxattr(it->second->name, "fb_seq_num", seq_bl);
+        if (ret < 0)
+            return ret;
+    }
     return 0;
 }
 
 void
 deleteBucket(
+    loader_t& loader,
     bucket_t *bucketPtr,
     fbb fbPtr,
     delete_vector *deletePtr,
     rows_vector *rowsPtr) {
 
-    printf("Clearing FB Ptr and RowsVector Ptr, Delete Bucket from Map\n\n");
-    fbPtr->Reset();
-    delete fbPtr;
+    loader.builders.release(fbPtr);
     deletePtr->clear();
     delete deletePtr;
     rowsPtr->clear();
     delete rowsPtr;
+    delete bucketPtr->dicts;
     delete bucketPtr;
 }
@@ -13,6 +13,8 @@ struct Table;
 
 struct Record;
 
+struct Dictionary;
+
 struct Table FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   enum FlatBuffersVTableOffset FLATBUFFERS_VTABLE_UNDERLYING_TYPE {
     VT_DATA_FORMAT_TYPE = 4,
@@ -24,7 +26,8 @@ struct Table FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
     VT_TABLE_NAME = 16,
     VT_DELETE_VECTOR = 18,
     VT_ROWS = 20,
-    VT_NROWS = 22
+    VT_NROWS = 22,
+    VT_DICTIONARIES = 24
   };
   int32_t data_format_type() const {
     return GetField<int32_t>(VT_DATA_FORMAT_TYPE, 0);
@@ -56,6 +59,9 @@ struct Table FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
   uint32_t nrows() const {
     return GetField<uint32_t>(VT_NROWS, 0);
   }
+  const flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>> *dictionaries() const {
+    return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>> *>(VT_DICTIONARIES);
+  }
   bool Verify(flatbuffers::Verifier &verifier) const {
     return VerifyTableStart(verifier) &&
            VerifyField<int32_t>(verifier, VT_DATA_FORMAT_TYPE) &&
@@ -74,6 +80,9 @@ struct Table FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
            verifier.VerifyVector(rows()) &&
            verifier.VerifyVectorOfTables(rows()) &&
            VerifyField<uint32_t>(verifier, VT_NROWS) &&
+           VerifyOffset(verifier, VT_DICTIONARIES) &&
+           verifier.VerifyVector(dictionaries()) &&
+           verifier.VerifyVectorOfTables(dictionaries()) &&
            verifier.EndTable();
   }
 };
@@ -111,6 +120,9 @@ struct TableBuilder {
   void add_nrows(uint32_t nrows) {
     fbb_.AddElement<uint32_t>(Table::VT_NROWS, nrows, 0);
   }
+  void add_dictionaries(flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>>> dictionaries) {
+    fbb_.AddOffset(Table::VT_DICTIONARIES, dictionaries);
+  }
   explicit TableBuilder(flatbuffers::FlatBufferBuilder &_fbb)
         : fbb_(_fbb) {
     start_ = fbb_.StartTable();
@@ -134,8 +146,10 @@ inline flatbuffers::Offset<Table> CreateTable(
     flatbuffers::Offset<flatbuffers::String> table_name = 0,
     flatbuffers::Offset<flatbuffers::Vector<uint8_t>> delete_vector = 0,
     flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Record>>> rows = 0,
-    uint32_t nrows = 0) {
+    uint32_t nrows = 0,
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<Tables::Dictionary>>> dictionaries = 0) {
   TableBuilder builder_(_fbb);
+  builder_.add_dictionaries(dictionaries);
   builder_.add_nrows(nrows);
   builder_.add_rows(rows);
   builder_.add_delete_vector(delete_vector);
@@ -160,12 +174,14 @@ inline flatbuffers::Offset<Table> CreateTableDirect(
     const char *table_name = nullptr,
     const std::vector<uint8_t> *delete_vector = nullptr,
     const std::vector<flatbuffers::Offset<Tables::Record>> *rows = nullptr,
-    uint32_t nrows = 0) {
+    uint32_t nrows = 0,
+    const std::vector<flatbuffers::Offset<Tables::Dictionary>> *dictionaries = nullptr) {
   auto data_schema__ = data_schema ? _fbb.CreateString(data_schema) : 0;
   auto db_schema__ = db_schema ? _fbb.CreateString(db_schema) : 0;
   auto table_name__ = table_name ? _fbb.CreateString(table_name) : 0;
   auto delete_vector__ = delete_vector ? _fbb.CreateVector<uint8_t>(*delete_vector) : 0;
   auto rows__ = rows ? _fbb.CreateVector<flatbuffers::Offset<Tables::Record>>(*rows) : 0;
+  auto dictionaries__ = dictionaries ? _fbb.CreateVector<flatbuffers::Offset<Tables::Dictionary>>(*dictionaries) : 0;
   return Tables::CreateTable(
       _fbb,
       data_format_type,
@@ -177,7 +193,8 @@ inline flatbuffers::Offset<Table> CreateTableDirect(
       table_name__,
       delete_vector__,
       rows__,
-      nrows);
+      nrows,
+      dictionaries__);
 }
 
 struct Record FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
@@ -259,6 +276,69 @@ inline flatbuffers::Offset<Record> CreateRecordDirect(
       data__);
 }
 
+struct Dictionary FLATBUFFERS_FINAL_CLASS : private flatbuffers::Table {
+  enum FlatBuffersVTableOffset FLATBUFFERS_VTABLE_UNDERLYING_TYPE {
+    VT_COL_IDX = 4,
+    VT_VALUES = 6
+  };
+  int32_t col_idx() const {
+    return GetField<int32_t>(VT_COL_IDX, 0);
+  }
+  const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *values() const {
+    return GetPointer<const flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>> *>(VT_VALUES);
+  }
+  bool Verify(flatbuffers::Verifier &verifier) const {
+    return VerifyTableStart(verifier) &&
+           VerifyField<int32_t>(verifier, VT_COL_IDX) &&
+           VerifyOffset(verifier, VT_VALUES) &&
+           verifier.VerifyVector(values()) &&
+           verifier.VerifyVectorOfStrings(values()) &&
+           verifier.EndTable();
+  }
+};
+
+struct DictionaryBuilder {
+  flatbuffers::FlatBufferBuilder &fbb_;
+  flatbuffers::uoffset_t start_;
+  void add_col_idx(int32_t col_idx) {
+    fbb_.AddElement<int32_t>(Dictionary::VT_COL_IDX, col_idx, 0);
+  }
+  void add_values(flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>> values) {
+    fbb_.AddOffset(Dictionary::VT_VALUES, values);
+  }
+  explicit DictionaryBuilder(flatbuffers::FlatBufferBuilder &_fbb)
+        : fbb_(_fbb) {
+    start_ = fbb_.StartTable();
+  }
+  DictionaryBuilder &operator=(const DictionaryBuilder &);
+  flatbuffers::Offset<Dictionary> Finish() {
+    const auto end = fbb_.EndTable(start_);
+    auto o = flatbuffers::Offset<Dictionary>(end);
+    return o;
+  }
+};
+
+inline flatbuffers::Offset<Dictionary> CreateDictionary(
+    flatbuffers::FlatBufferBuilder &_fbb,
+    int32_t col_idx = 0,
+    flatbuffers::Offset<flatbuffers::Vector<flatbuffers::Offset<flatbuffers::String>>> values = 0) {
+  DictionaryBuilder builder_(_fbb);
+  builder_.add_values(values);
+  builder_.add_col_idx(col_idx);
+  return builder_.Finish();
+}
+
+inline flatbuffers::Offset<Dictionary> CreateDictionaryDirect(
+    flatbuffers::FlatBufferBuilder &_fbb,
+    int32_t col_idx = 0,
+    const std::vector<flatbuffers::Offset<flatbuffers::String>> *values = nullptr) {
+  auto values__ = values ? _fbb.CreateVector<flatbuffers::Offset<flatbuffers::String>>(*values) : 0;
+  return Tables::CreateDictionary(
+      _fbb,
+      col_idx,
+      values__);
+}
+
 inline const Tables::Table *GetTable(const void *buf) {
   return flatbuffers::GetRoot<Tables::Table>(buf);
 }
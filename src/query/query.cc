@@ -10,6 +10,13 @@
 
 
 #include <fstream>
+#include <cmath>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <unistd.h>
 #include "query/query.h"
 #include "cls/cls_tabular_utils.h"
 
@@ -31,6 +38,11 @@ uint64_t extra_row_cost;
 
 std::vector<timing> timings;
 
+// samples of the completed query ios, if collect_stats
+bool collect_stats;
+std::vector<query_sample> query_samples;
+static std::mutex samples_lock;
+
 // query parameters to be encoded into query_op struct
 
 // query_op params old
@@ -63,6 +75,14 @@ std::string qop_index2_schema;
 std::string qop_query_preds;
 std::string qop_index_preds;
 std::string qop_index2_preds;
+uint64_t qop_result_max_bytes;
+std::string qop_groupby_schema;
+uint64_t qop_groupby_max_bytes;
+uint64_t qop_row_limit;
+int qop_result_compression;  // CompressionType
+std::string qop_orderby_schema;
+bool qop_orderby_desc;
+int qop_max_threads;
 
 // build index op params for flatbufs
 bool idx_op_idx_unique;
@@ -71,9 +91,13 @@ int idx_op_batch_size;
 int idx_op_idx_type;
 std::string idx_op_idx_schema;
 std::string idx_op_text_delims;
+bool idx_op_incremental;
 
 // transform op params
 int trans_op_format_type;
+int trans_op_compression_type;  // CompressionType
+int trans_op_arrow_batch_rows;
+uint64_t trans_op_chunk_bytes;
 
 // Example op params
 int expl_func_counter;
@@ -97,6 +121,8 @@ int skyhook_output_format;  // SkyFormatType enum
 // to convert strings <=> skyhook data structs
 Tables::schema_vec sky_tbl_schema;
 Tables::schema_vec sky_qry_schema;
+Tables::schema_vec sky_groupby_schema;
+Tables::schema_vec sky_orderby_schema;
 Tables::schema_vec sky_idx_schema;
 Tables::schema_vec sky_idx2_schema;
 Tables::predicate_vec sky_qry_preds;
@@ -111,27 +137,133 @@ std::atomic<unsigned> rows_returned;
 std::atomic<bool> print_header;
 std::atomic<long long int> row_counter;
 long long int row_limit;
+bool orderby_desc;
 
-// rename work_lock
-int outstanding_ios;
+std::atomic<int> outstanding_ios;
 std::vector<std::string> target_objects;
-std::list<AioState*> ready_ios;
-
-std::mutex dispatch_lock;
-std::condition_variable dispatch_cond;
+MPMCQueue<AioState*> ready_ios;
+librados::IoCtx *query_ioctx = NULL;
 
 std::mutex work_lock;
-std::condition_variable work_cond;
 
-bool stop;
-
-static void print_row(const char *row)
+bool ordered_output;
+
+int dispatch_mode = DISPATCH_FIFO;
+double hedge_factor;
+double slow_factor;
+std::map<std::string, int> target_osds;
+
+std::atomic<bool> stop;
+
+// next unclaimed entry of target_objects, counted from the back
+static std::atomic<size_t> next_target(0);
+
+// dispatch order of query ios
+static std::atomic<uint64_t> dispatch_seq(0);
+
+// signaled when the last outstanding io is retired
+static std::mutex done_lock;
+static std::condition_variable done_cond;
+
+// the query io of an object, or of the rest of a capped object, under
+// adaptive dispatch.  it may be sent more than once, as a hedge or a retry,
+// and the first successful result is used.  protected by dispatch_lock.
+struct query_req {
+  std::string oid;
+  int resume_seq_num;
+  uint64_t seq;          // dispatch order, shared by all of its ios
+  size_t group;          // index into dispatch_groups
+  uint64_t dispatch_ns;  // of the first io
+  uint64_t last_ns;      // of the last io
+  double window;         // of the group when dispatched
+  int attempts = 0;      // ios sent
+  int outstanding = 0;   // ios in flight
+  bool hedged = false;
+  bool done = false;     // its result was queued on ready_ios
+};
+
+// the objects of the same primary osd (or all objects, for adaptive
+// dispatch) and the window of their ios in flight. protected by dispatch_lock.
+struct dispatch_group {
+  int osd = -1;
+  std::deque<std::pair<std::string, int>> pending;  // oid, resume seq num
+  double window = 1;
+  int inflight = 0;            // reqs dispatched and not yet retired
+  double srtt_ns = 0;          // smoothed latency of its reqs
+  double base_ns = 0;          // lowest srtt_ns so far
+  uint64_t last_decrease_ns = 0;
+  uint64_t objects = 0;
+  uint64_t reqs = 0;
+  uint64_t hedges = 0;
+  uint64_t hedge_wins = 0;
+  uint64_t retries = 0;
+  uint64_t decreases = 0;
+  double max_window = 1;
+  double min_window = 1;
+};
+
+static std::mutex dispatch_lock;
+static std::condition_variable dispatch_cond;  // wakes wait_adaptive_ios
+static std::vector<dispatch_group> dispatch_groups;
+static std::map<uint64_t, std::shared_ptr<query_req>> inflight_reqs;  // by seq
+static std::deque<std::shared_ptr<query_req>> retry_reqs;
+static int dispatch_qdepth = 1;
+static int reqs_inflight = 0;      // over all groups
+static int ios_inflight = 0;       // including hedges and retries
+static int balanced_inflight = 0;  // hedges and retries
+
+// a failed io is retried until its req has sent this many
+static const int QUERY_IO_ATTEMPTS_MAX = 3;
+
+// ios are never hedged before they are this old
+static const uint64_t HEDGE_MIN_NS = 1000000;
+
+// idle workers sleep here, producers only notify when someone is asleep
+static std::atomic<int> idle_workers(0);
+static std::mutex idle_lock;
+static std::condition_variable idle_cond;
+
+// spin this many times on an empty ready_ios before sleeping
+static const int WORKER_SPIN_COUNT = 64;
+
+// worker output is written to stdout once it reaches this size
+static const size_t OUTPUT_FLUSH_BYTES = 1 << 20;
+
+// an object is transformed (or compacted) into its temp object of this
+// suffix, which holds the transform progress in this xattr until it replaces
+// the object, started over up to TRANSFORM_RETRIES_MAX times if the object
+// changes.
+static const std::string TRANSFORM_TMP_SUFFIX = ".transform";
+static const std::string COMPACT_TMP_SUFFIX = ".compact";
+static const char *TRANSFORM_PROGRESS_XATTR = "transform_progress";
+static const int TRANSFORM_RETRIES_MAX = 5;
+
+// shared output state, all protected by print_lock.
+// the csv/binary header is formatted once on its own so that it precedes
+// the rows of every worker buffer regardless of flush order.
+static std::string out_header;
+static std::map<uint64_t, std::string> out_pending;  // ordered mode only
+static uint64_t out_next_seq = 0;
+
+std::vector<agg_output> agg_outputs;
+std::vector<Tables::group_agg> agg_partials;
+
+// all workers' partial aggs, each worker merges the partials it receives into
+// its own table without locks, and these are merged here under agg_lock as
+// each worker exits.  with no group keys all rows are of the one group.
+static std::unique_ptr<Tables::GroupTable> global_aggs;
+static std::mutex agg_lock;
+
+// all workers' top-k rows for order by with a limit, merged as the partial
+// aggs are.  topk_key_pos is the position of the order by col in the result.
+static std::unique_ptr<Tables::TopKRows> global_topk;
+static int topk_key_pos = -1;
+
+static void print_row(Tables::OutputBuffer& out, const char *row)
 {
   if (quiet)
     return;
 
-  print_lock.lock();
-
   const size_t order_key_field_offset = 0;
   size_t line_number_field_offset;
   if (old_projection && use_cls)
@@ -155,121 +287,135 @@ static void print_row(const char *row)
       comment_field_length);
 
   if (old_projection) {
-    std::cout << order_key <<
-      "|" << line_number <<
-      std::endl;
+    out.appendInt(order_key);
+    out.put('|');
+    out.appendInt(line_number);
+    out.put('\n');
   } else {
-    std::cout << extended_price <<
-      "|" << order_key <<
-      "|" << line_number <<
-      "|" << ship_date <<
-      "|" << discount <<
-      "|" << quantity <<
-      "|" << comment <<
-      std::endl;
+    out.appendDouble(extended_price);
+    out.put('|');
+    out.appendInt(order_key);
+    out.put('|');
+    out.appendInt(line_number);
+    out.put('|');
+    out.appendInt(ship_date);
+    out.put('|');
+    out.appendDouble(discount);
+    out.put('|');
+    out.appendDouble(quantity);
+    out.put('|');
+    out.append(comment);
+    out.put('\n');
   }
-
-  print_lock.unlock();
 }
 
 
-static void print_data(const char *dataptr,
-                       const size_t datasz,
-                       const int ds_format=SFT_FLATBUF_FLEX_ROW)
+// formats up to max_to_print rows of one result into out, returns the
+// number of rows consumed.
+static long long int print_formatted(Tables::OutputBuffer& out,
+                                     const char *dataptr,
+                                     const size_t datasz,
+                                     const int ds_format,
+                                     bool header,
+                                     bool verbose,
+                                     long long int max_to_print)
 {
-
-    // NOTE: quiet and print_verbose are exec flags in run-query
-    if (quiet)
-        return;
-
-    // NOTE: print_header is atomic, and declared in query.h
-    // used here to prevent duplicate printing of csv header at runtime
-    // row_counter used to limit num rows returned in result (csv output)
-    // print_lock prevents multiple worker threads from concurrent write output
-
-    print_lock.lock();
+    long long int counter = 0;
     switch (ds_format) {
 
         case SFT_FLATBUF_FLEX_ROW:
             if (skyhook_output_format == SkyFormatType::SFT_PG_BINARY) {
-                row_counter += Tables::printFlatbufFlexRowAsPGBinary(
+                counter = Tables::printFlatbufFlexRowAsPGBinary(
                     dataptr,
                     datasz,
-                    print_header,
-                    print_verbose,
-                    row_limit - row_counter);
+                    header,
+                    verbose,
+                    max_to_print,
+                    out);
             }
             else {
-                row_counter += Tables::printFlatbufFlexRowAsCsv(
+                counter = Tables::printFlatbufFlexRowAsCsv(
                     dataptr,
                     datasz,
-                    print_header,
-                    print_verbose,
-                    row_limit - row_counter);
+                    header,
+                    verbose,
+                    max_to_print,
+                    out);
             }
             break;
 
         case SFT_ARROW:
             if (skyhook_output_format == SkyFormatType::SFT_PG_BINARY) {
-                row_counter += Tables::printArrowbufRowAsPGBinary(
+                counter = Tables::printArrowbufRowAsPGBinary(
                     dataptr,
                     datasz,
-                    print_header,
-                    print_verbose,
-                    row_limit - row_counter);
+                    header,
+                    verbose,
+                    max_to_print,
+                    out);
             }
 
             else if (skyhook_output_format == SkyFormatType::SFT_PYARROW_BINARY) {
-                row_counter += Tables::printArrowbufRowAsPyArrowBinary(
+                counter = Tables::printArrowbufRowAsPyArrowBinary(
                     dataptr,
                     datasz,
-                    print_header,
-                    print_verbose,
-                    row_limit - row_counter
-                );
+                    header,
+                    verbose,
+                    max_to_print,
+                    out);
             }
 
             else {
-                row_counter += Tables::printArrowbufRowAsCsv(
+                counter = Tables::printArrowbufRowAsCsv(
                     dataptr,
                     datasz,
-                    print_header,
-                    print_verbose,
-                    row_limit - row_counter);
+                    header,
+                    verbose,
+                    max_to_print,
+                    out);
             }
             break;
 
         case SFT_PYARROW_BINARY:
-            row_counter += Tables::printArrowbufRowAsPyArrowBinary(
+            counter = Tables::printArrowbufRowAsPyArrowBinary(
                 dataptr,
                 datasz,
-                print_header,
-                print_verbose,
-                row_limit - row_counter);
+                header,
+                verbose,
+                max_to_print,
+                out);
             break;
 
-        case SFT_JSON:
+        case SFT_JSON: {
             if (skyhook_output_format == SkyFormatType::SFT_PG_BINARY) {
                 std::cerr << "Print SFT_JSON: "
                           << "SFT_PG_BINARY not implemented" << std::endl;
                 assert (Tables::SkyOutputBinaryNotImplemented==0);
             }
-            row_counter += Tables::printJSONAsCsv(
+            std::stringstream ss;
+            counter = Tables::printJSONAsCsv(
                 dataptr,
                 datasz,
-                print_header,
-                print_verbose,
-                row_limit - row_counter);
+                header,
+                verbose,
+                max_to_print,
+                ss);
+            out.append(ss.str());
             break;
+        }
 
-        case SFT_EXAMPLE_FORMAT:
-            row_counter += Tables::printExampleFormatAsCsv(
+        case SFT_EXAMPLE_FORMAT: {
+            std::stringstream ss;
+            counter = Tables::printExampleFormatAsCsv(
                 dataptr,
                 datasz,
-                print_header,
-                print_verbose,
-                row_limit - row_counter);
+                header,
+                verbose,
+                max_to_print,
+                ss);
+            out.append(ss.str());
             break;
+        }
 
         case SFT_FLATBUF_CSV_ROW:
         case SFT_PG_TUPLE:
@@ -277,8 +423,298 @@ static void print_data(const char *dataptr,
         default:
             assert (Tables::TablesErrCodes::SkyFormatTypeNotRecognized==0);
     }
-    print_header = false;
-    print_lock.unlock();
+    return counter;
+}
+
+
+// writes len bytes to stdout with as few write()s as the fd takes, after
+// anything already written to cout. caller holds print_lock.
+static void write_stdout(const char *data, size_t len)
+{
+    std::cout.flush();
+    while (len > 0) {
+        ssize_t n = ::write(STDOUT_FILENO, data, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            cerr << "ERROR: query.cc: writing output failed: "
+                 << strerror(errno) << std::endl;
+            exit(1);
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+// writes a finished chunk of worker output, preceded by the header the
+// first time any rows are written. caller holds print_lock.
+static void write_output(const std::string& chunk)
+{
+    if (chunk.empty())
+        return;
+    if (!out_header.empty()) {
+        write_stdout(out_header.data(), out_header.size());
+        out_header.clear();
+    }
+    write_stdout(chunk.data(), chunk.size());
+}
+
+static void flush_output(Tables::OutputBuffer& out)
+{
+    if (out.empty())
+        return;
+    std::lock_guard<std::mutex> l(print_lock);
+    write_output(out.str());
+    out.clear();
+}
+
+// called by a worker after each io.  unordered output is written once the
+// worker buffer is large enough, ordered output is handed off per io and
+// written as soon as all earlier dispatched ios have been written.
+static void emit_output(Tables::OutputBuffer& out, uint64_t seq)
+{
+    if (!ordered_output) {
+        if (out.size() >= OUTPUT_FLUSH_BYTES)
+            flush_output(out);
+        return;
+    }
+
+    std::string chunk = std::move(out.str());
+    out.clear();
+    std::lock_guard<std::mutex> l(print_lock);
+    if (seq != out_next_seq) {
+        out_pending[seq] = std::move(chunk);
+        return;
+    }
+    write_output(chunk);
+    out_next_seq++;
+    auto it = out_pending.begin();
+    while (it != out_pending.end() and it->first == out_next_seq) {
+        write_output(it->second);
+        it = out_pending.erase(it);
+        out_next_seq++;
+    }
+}
+
+// formats one result into the worker's own buffer. nrows is an upper bound
+// on the rows in the result, used to reserve them against --limit.
+static void print_data(Tables::OutputBuffer& out,
+                       const char *dataptr,
+                       const size_t datasz,
+                       const int ds_format,
+                       long long int nrows)
+{
+
+    // NOTE: quiet and print_verbose are exec flags in run-query
+    if (quiet)
+        return;
+
+    // pyarrow output is the raw ipc buffer, without header or row limit
+    bool raw_binary = (ds_format == SFT_PYARROW_BINARY or
+        (ds_format == SFT_ARROW and
+         skyhook_output_format == SkyFormatType::SFT_PYARROW_BINARY));
+    if (raw_binary) {
+
+        // unordered, the ipc buffer is written out as is rather than copied
+        // into the worker buffer. it has no row limit, so its rows are not
+        // counted here.
+        if (!ordered_output and !print_verbose) {
+            uint64_t buf_len = static_cast<uint64_t>(datasz);
+            std::lock_guard<std::mutex> l(print_lock);
+            write_output(out.str());
+            out.clear();
+            write_stdout(reinterpret_cast<const char*>(&buf_len),
+                         sizeof(buf_len));
+            write_stdout(dataptr, datasz);
+            return;
+        }
+        row_counter += print_formatted(out, dataptr, datasz, ds_format,
+                                       false, print_verbose, nrows);
+        return;
+    }
+
+    // NOTE: print_header is atomic, and declared in query.h
+    // whichever worker prints first formats the header alone, under
+    // print_lock so no rows can be written ahead of it.
+    if (print_header) {
+        std::lock_guard<std::mutex> l(print_lock);
+        if (print_header) {
+            Tables::OutputBuffer header;
+            print_formatted(header, dataptr, datasz, ds_format, true, false,
+                            0);
+            out_header = std::move(header.str());
+            print_header = false;
+        }
+    }
+
+    // row_counter limits num rows returned in result, workers reserve
+    // their rows up front and give back what they did not print.
+    long long int reserved = row_counter.load();
+    long long int take;
+    do {
+        take = std::min(nrows, row_limit - reserved);
+        if (take <= 0)
+            return;
+    } while (!row_counter.compare_exchange_weak(reserved, reserved + take));
+
+    long long int printed = print_formatted(out, dataptr, datasz, ds_format,
+                                            false, print_verbose, take);
+    if (printed < take)
+        row_counter -= take - printed;
+}
+
+// creates a pushed down agg pred on a col of the given type
+static Tables::PredicateBase* new_agg_pred(int col_idx, int col_type,
+                                           int op_type)
+{
+    using namespace Tables;
+    switch (col_type) {
+        case SDT_INT64:
+            return new TypedPredicate<int64_t>(col_idx, col_type, op_type, 0);
+        case SDT_UINT32:
+            return new TypedPredicate<uint32_t>(col_idx, col_type, op_type, 0);
+        case SDT_UINT64:
+            return new TypedPredicate<uint64_t>(col_idx, col_type, op_type, 0);
+        case SDT_FLOAT:
+            return new TypedPredicate<float>(col_idx, col_type, op_type, 0);
+        case SDT_DOUBLE:
+            return new TypedPredicate<double>(col_idx, col_type, op_type, 0);
+        default:
+            assert (UnsupportedAggDataType==0);
+    }
+    return NULL;
+}
+
+// rewrites each avg pred into a sum and a cnt pushed down in its place, and
+// records where each final agg finds its partials in the result agg rows,
+// which follow the sky_groupby_schema keys if any.
+void plan_global_aggs(Tables::predicate_vec& preds)
+{
+    using namespace Tables;
+    agg_outputs.clear();
+    agg_partials.clear();
+    global_aggs.reset();
+
+    predicate_vec pushed;
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+        PredicateBase* pb = *it;
+        if (!pb->isGlobalAgg()) {
+            pushed.push_back(pb);
+            continue;
+        }
+
+        agg_output out;
+        out.op_type = pb->opType();
+        out.col_type = pb->colType();
+        out.pos = agg_partials.size();
+        out.cnt_pos = -1;
+        if (pb->opType() == SOT_avg) {
+            out.cnt_pos = out.pos + 1;
+            pushed.push_back(new_agg_pred(pb->colIdx(), pb->colType(), SOT_sum));
+            pushed.push_back(new_agg_pred(pb->colIdx(), pb->colType(), SOT_cnt));
+            agg_partials.push_back({pb->colIdx(), pb->colType(), SOT_sum});
+            agg_partials.push_back({pb->colIdx(), pb->colType(), SOT_cnt});
+            delete pb;
+        }
+        else {
+            pushed.push_back(pb);
+            agg_partials.push_back({pb->colIdx(), pb->colType(), pb->opType()});
+        }
+        agg_outputs.push_back(out);
+    }
+    preds.swap(pushed);
+
+    if (!agg_outputs.empty())
+        global_aggs.reset(new GroupTable(sky_groupby_schema, agg_partials, true));
+}
+
+// builds a flatbuf result holding a row of final aggs per group, after the
+// group's keys.
+static void build_global_aggs(flatbuffers::FlatBufferBuilder& fbb,
+                              const Tables::GroupTable& groups)
+{
+    using namespace Tables;
+    std::string schema_str;
+    for (auto it = sky_groupby_schema.begin();
+         it != sky_groupby_schema.end(); ++it) {
+        col_info ci(it->idx, it->type, it->is_key, false, it->name);
+        schema_str.append(ci.toString() + "\n");
+    }
+    for (auto it = agg_outputs.begin(); it != agg_outputs.end(); ++it) {
+        std::string name = skyOpTypeToString(it->op_type);
+        int type = (it->op_type == SOT_avg) ? SDT_DOUBLE : it->col_type;
+        col_info ci(AGG_COL_IDX.at(name), type, false, false, name);
+        schema_str.append(ci.toString() + "\n");
+    }
+
+    groups.buildFb(fbb, schema_str,
+        [&](uint32_t g, flexbuffers::Builder& flexbldr) {
+            groups.addKeys(g, flexbldr);
+            for (auto it = agg_outputs.begin(); it != agg_outputs.end(); ++it) {
+                if (it->op_type != SOT_avg) {
+                    groups.addValue(g, it->pos, flexbldr);
+                    continue;
+                }
+                double cnt = groups.valueAsDouble(g, it->cnt_pos);
+                if (cnt > 0)
+                    flexbldr.Add(groups.valueAsDouble(g, it->pos) / cnt);
+                else
+                    flexbldr.Add(std::numeric_limits<double>::quiet_NaN());
+            }
+        });
+}
+
+// sets up the merge of each object's top-k rows when the query orders by a
+// col with a limit, with the col found among the projected cols.
+void plan_topk()
+{
+    using namespace Tables;
+    global_topk.reset();
+    topk_key_pos = -1;
+    if (sky_orderby_schema.empty() or row_limit == ROW_LIMIT_DEFAULT or
+        !agg_outputs.empty())
+        return;
+
+    for (unsigned i = 0; i < sky_qry_schema.size(); i++) {
+        if (sky_qry_schema[i].name == sky_orderby_schema[0].name)
+            topk_key_pos = i;
+    }
+    assert (topk_key_pos >= 0);
+    global_topk.reset(new TopKRows(sky_orderby_schema[0], orderby_desc,
+                                   row_limit));
+}
+
+// writes anything still held back, such as a header with no rows after it,
+// preceded by the final aggs or top-k rows merged from all workers.
+void flush_query_output()
+{
+    Tables::OutputBuffer out;
+    if (global_aggs and !global_aggs->empty()) {
+        flatbuffers::FlatBufferBuilder fbb(1024);
+        build_global_aggs(fbb, *global_aggs);
+        result_count += global_aggs->size();
+        print_data(out,
+                   reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                   fbb.GetSize(), SFT_FLATBUF_FLEX_ROW, global_aggs->size());
+    }
+    if (global_topk and !global_topk->empty()) {
+        flatbuffers::FlatBufferBuilder fbb(1024);
+        global_topk->buildFb(fbb, schemaToString(sky_qry_schema));
+        result_count += global_topk->size();
+        print_data(out,
+                   reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                   fbb.GetSize(), SFT_FLATBUF_FLEX_ROW, global_topk->size());
+    }
+
+    std::lock_guard<std::mutex> l(print_lock);
+    for (auto it = out_pending.begin(); it != out_pending.end(); ++it)
+        write_output(it->second);
+    out_pending.clear();
+    write_output(out.str());
+    if (!out_header.empty()) {
+        write_stdout(out_header.data(), out_header.size());
+        out_header.clear();
+    }
 }
 
 /* NOTE: This function will be used by python driver for locking  */
@@ -347,6 +783,196 @@ void worker_exec_build_sky_index_op(librados::IoCtx *ioctx, idx_op op)
   ioctx->close();
 }
 
+/*
+ * Rewrite the object in chunks of whole fbmetas of op.max_bytes each, each
+ * returned as a transform_chunk by the cls method, appending each chunk to
+ * the temp object of oid along with the progress so far in one write.  Once
+ * all of the chunks are done, finish is applied to the temp object if given,
+ * and the temp object replaces oid by copy_from, which is atomic and asserts
+ * the version of oid when its rewrite started, so data written to oid
+ * meanwhile is never lost.  The rewrite then starts over, up to
+ * TRANSFORM_RETRIES_MAX times.  A rewrite that fails partway is resumed
+ * from the progress in the temp object, unless the object has changed
+ * since.  An object with no fbmeta rewritten is left as it is, unless
+ * always_replace and it is not empty.
+ */
+template <typename Op>
+static void rewrite_object(librados::IoCtx *ioctx, std::string oid,
+                           std::string tmp_suffix, const char *cls_method,
+                           Op op, bool always_replace,
+                           std::function<void(const std::string&)> finish)
+{
+    std::string tmp_oid = oid + tmp_suffix;
+    int ret = 0;
+    for (int attempt = 0; ; attempt++) {
+        uint64_t size = 0;
+        time_t mtime;
+        ret = ioctx->stat(oid, &size, &mtime);
+        checkret(ret, 0);
+        uint64_t ver = ioctx->get_last_version();
+
+        struct transform_progress progress(size, ver);
+        ceph::bufferlist progress_bl;
+        ret = ioctx->getxattr(tmp_oid, TRANSFORM_PROGRESS_XATTR, progress_bl);
+        if (ret > 0) {
+            struct transform_progress prior;
+            try {
+                ceph::bufferlist::const_iterator it = progress_bl.begin();
+                using ceph::decode;
+                decode(prior, it);
+            } catch (const buffer::error &err) {
+                cerr << "ERROR: decoding transform_progress of " << tmp_oid
+                     << std::endl;
+                exit(1);
+            }
+            if (prior.src_len == size and prior.src_ver == ver)
+                progress = prior;
+            if (debug)
+                cout << "DEBUG: query.cc: rewrite_object: oid=" << oid
+                     << " prior " << prior.toString() << endl;
+        }
+
+        while (progress.src_off < progress.src_len) {
+            op.src_off = progress.src_off;
+            ceph::bufferlist inbl, outbl;
+            using ceph::encode;
+            encode(op, inbl);
+            ret = ioctx->exec(oid, "tabular", cls_method, inbl, outbl);
+            checkret(ret, 0);
+            ver = ioctx->get_last_version();
+
+            struct transform_chunk chunk;
+            try {
+                ceph::bufferlist::const_iterator it = outbl.begin();
+                using ceph::decode;
+                decode(chunk, it);
+            } catch (const buffer::error &err) {
+                cerr << "ERROR: decoding transform_chunk of " << oid
+                     << std::endl;
+                exit(1);
+            }
+
+            // the object has changed since its transform started, start over
+            if (chunk.obj_len != progress.src_len or ver != progress.src_ver) {
+                progress = transform_progress(chunk.obj_len, ver);
+                continue;
+            }
+
+            // the first chunk replaces any data of an abandoned transform
+            ceph::bufferlist next_bl;
+            struct transform_progress next = progress;
+            next.src_off = chunk.next_off;
+            next.dst_off += chunk.data.length();
+            next.ntransformed += chunk.ntransformed;
+            encode(next, next_bl);
+            librados::ObjectWriteOperation wop;
+            if (progress.dst_off == 0)
+                wop.write_full(chunk.data);
+            else
+                wop.write(progress.dst_off, chunk.data);
+            wop.setxattr(TRANSFORM_PROGRESS_XATTR, next_bl);
+            ret = ioctx->operate(tmp_oid, &wop);
+            checkret(ret, 0);
+            progress = next;
+
+            if (debug)
+                cout << "DEBUG: query.cc: rewrite_object: oid=" << oid << " "
+                     << progress.toString() << endl;
+        }
+
+        if (progress.ntransformed == 0 and
+            !(always_replace and progress.src_len > 0))
+            break;
+        if (finish)
+            finish(tmp_oid);
+
+        librados::ObjectWriteOperation done_op;
+        done_op.rmxattr(TRANSFORM_PROGRESS_XATTR);
+        ret = ioctx->operate(tmp_oid, &done_op);
+        checkret(ret, 0);
+        librados::ObjectWriteOperation copy_op;
+        copy_op.assert_version(progress.src_ver);
+        copy_op.copy_from(tmp_oid, *ioctx, ioctx->get_last_version(), 0);
+        ret = ioctx->operate(oid, &copy_op);
+        if (ret != -ERANGE and ret != -EOVERFLOW) {
+            checkret(ret, 0);
+            break;
+        }
+
+        // oid was written after its last chunk was read
+        if (attempt + 1 >= TRANSFORM_RETRIES_MAX) {
+            cerr << "ERROR: rewrite of " << oid << " abandoned, object "
+                 << "changed during " << TRANSFORM_RETRIES_MAX
+                 << " attempts" << std::endl;
+            exit(1);
+        }
+        if (debug)
+            cout << "DEBUG: query.cc: rewrite_object: oid=" << oid
+                 << " changed during rewrite, starting over" << endl;
+    }
+    ret = ioctx->remove(tmp_oid);
+    if (ret != -ENOENT)
+        checkret(ret, 0);
+}
+
+/*
+ * Transform the object into the required format, see rewrite_object.  An
+ * object already in the required format is left as it is.  Its indexes are
+ * not copied, they must be rebuilt.
+ */
+static void transform_object(librados::IoCtx *ioctx, std::string oid,
+                             transform_op op)
+{
+    rewrite_object(ioctx, oid, TRANSFORM_TMP_SUFFIX, "transform_db_op", op,
+                   false, nullptr);
+}
+
+// the StatsLevel of the col_stats of oid, 0 if runstats has not been done
+static int lookup_stats_level(librados::IoCtx *ioctx, const std::string& oid)
+{
+    std::map<std::string, ceph::bufferlist> vals;
+    bool more = false;
+    std::string prefix = Tables::COL_STATS_KEY_PREFIX +
+                         Tables::IDX_KEY_DELIM_OUTER;
+    int ret = ioctx->omap_get_vals2(oid, "", prefix, 1, &vals, &more);
+    checkret(ret, 0);
+    if (vals.empty())
+        return 0;
+
+    struct col_stats stats;
+    try {
+        ceph::bufferlist::const_iterator it = vals.begin()->second.begin();
+        using ceph::decode;
+        decode(stats, it);
+    } catch (const buffer::error &err) {
+        cerr << "ERROR: decoding col_stats of " << oid << std::endl;
+        exit(1);
+    }
+    return stats.stats_level;
+}
+
+/*
+ * Compact the object in chunks, see rewrite_object and exec_compact_op.
+ * The temp object is indexed before it replaces the object, so its data,
+ * indexes and col_stats are all replaced at once.
+ */
+static void compact_object(librados::IoCtx *ioctx, std::string oid,
+                           compact_op op)
+{
+    auto index_tmp = [&](const std::string& tmp_oid) {
+        compact_op idx_op = op;
+        idx_op.stats_level = lookup_stats_level(ioctx, oid);
+        ceph::bufferlist inbl, outbl;
+        using ceph::encode;
+        encode(idx_op, inbl);
+        int ret = ioctx->exec(tmp_oid, "tabular", "exec_compact_index_op",
+                              inbl, outbl);
+        checkret(ret, 0);
+    };
+    rewrite_object(ioctx, oid, COMPACT_TMP_SUFFIX, "exec_compact_op", op,
+                   true, index_tmp);
+}
+
 void worker_transform_db_op(librados::IoCtx *ioctx, transform_op op)
 {
   while (true) {
@@ -359,16 +985,30 @@ void worker_transform_db_op(librados::IoCtx *ioctx, transform_op op)
     target_objects.pop_back();
     work_lock.unlock();
 
-    ceph::bufferlist inbl, outbl;
-    using ceph::encode;
-    encode(op, inbl);
-
     if (debug)
         cout << "DEBUG: query.cc: worker_transform_db_op: launching exec for oid=" << oid << endl;
 
-    int ret = ioctx->exec(oid, "tabular", "transform_db_op",
-                          inbl, outbl);
-    checkret(ret, 0);
+    transform_object(ioctx, oid, op);
+  }
+  ioctx->close();
+}
+
+void worker_compact_op(librados::IoCtx *ioctx, compact_op op)
+{
+  while (true) {
+    work_lock.lock();
+    if (target_objects.empty()) {
+      work_lock.unlock();
+      break;
+    }
+    std::string oid = target_objects.back();
+    target_objects.pop_back();
+    work_lock.unlock();
+
+    if (debug)
+        cout << "DEBUG: query.cc: worker_compact_op: launching exec for oid=" << oid << endl;
+
+    compact_object(ioctx, oid, op);
   }
   ioctx->close();
 }
@@ -486,43 +1126,19 @@ static void add_extra_row_cost(uint64_t cost)
   }
 }
 
-// primary method for read() queries.
-void worker_exec_query_op()
+// decodes and prints one query result into the worker's output buffer,
+// or merges it into the worker's aggs or top-k rows.
+static void process_query_result(ceph::bufferlist& raw_result,
+                                 Tables::OutputBuffer& out,
+                                 Tables::GroupTable& aggs,
+                                 Tables::TopKRows* topk)
 {
-  std::unique_lock<std::mutex> lock(work_lock);
-
-  while (true) {
-    // wait for work, or done
-    if (ready_ios.empty()) {
-      if (stop)
-        break;
-      work_cond.wait(lock);
-      continue;
-    }
-
-    // prepare result
-    AioState *s = ready_ios.front();
-    ready_ios.pop_front();
-
-    if (debug)
-        cout << "DEBUG: query.cc: worker: popped front of ready_ios" << endl;
-
-    // get returned data out of our Aio State struct, used by each query type.
-    ceph::bufferlist raw_result = s->bl;
-
     // hold unpacked results
     ceph::bufferlist result;
 
     // contains cls stats such as read time, process time, pushdowns, etc.
     cls_info info;
 
-    // process result without lock. we own it now.
-    lock.unlock();
-    dispatch_lock.lock();
-    outstanding_ios--;
-    dispatch_lock.unlock();
-    dispatch_cond.notify_one();
-
     if (query == "flatbuf") {
 
         using namespace Tables;
@@ -534,8 +1150,6 @@ void worker_exec_query_op()
             cout << "DEBUG: query.cc: worker: use_cls=" << use_cls << endl;
         }
 
-        delete s;  // release aio struct.
-
         // decode our raw results if not empty. cases when it could be empty include:
         // (1) cls processing returned zero matching data
         // (2) result was from a non-existing object/oid
@@ -559,6 +1173,8 @@ void worker_exec_query_op()
             }
             if (debug) {
                 cout << "DEBUG: query.cc: worker: decoded result.length()=" << result.length() << endl;
+                if (use_cls)
+                    cout << "DEBUG: query.cc: worker:" << info.toString() << endl;
             }
         }
         else {
@@ -567,8 +1183,7 @@ void worker_exec_query_op()
             if (debug) {
                 cout << "DEBUG: query.cc: worker: raw_result is empty." << endl;
             }
-            lock.lock();
-            break;
+            return;
         }
 
         if (debug) {
@@ -579,10 +1194,16 @@ void worker_exec_query_op()
         // the result data should be a single bl with an fbmeta within.
         sky_meta fbmeta = getSkyMeta(&result);
 
+        // compressed results are processed decompressed, held here.
+        std::vector<char> blob_buf;
+        if (decompressSkyMeta(fbmeta, blob_buf) != 0) {
+            std::cerr << "DEBUG: query.cc: worker: failed to decompress result data" << std::endl;
+            assert(Tables::TablesErrCodes::BlobDecompressionFailure==0);
+        }
+
         if (debug)
             cout << "DEBUG: query.cc: worker: done with getSkyMeta(&result)." << endl;
 
-        // TODO: add any global aggs here.
         // TODO: check if any predicates or projects remain to be applied.
         bool more_processing = false;
 
@@ -592,6 +1213,10 @@ void worker_exec_query_op()
             if ((project_cols != PROJECT_DEFAULT) || (sky_qry_preds.size() > 0)) {
                 more_processing = true;
             }
+
+            // the top-k rows are selected from the rows of the object
+            if (topk)
+                more_processing = true;
         }
 
         // nothing left to do here, so we just print results
@@ -610,11 +1235,27 @@ void worker_exec_query_op()
                                            fbmeta.blob_size,
                                            fbmeta.blob_format);
 
+                    // partial aggs are merged, the final aggs are printed
+                    // once all objects are done.
+                    if (!agg_outputs.empty() and
+                        fbmeta.blob_format == SFT_FLATBUF_FLEX_ROW) {
+                        aggs.updateSkyRoot(root);
+                        break;
+                    }
+
+                    // likewise each object's top-k rows
+                    if (topk and fbmeta.blob_format == SFT_FLATBUF_FLEX_ROW) {
+                        topk->updateSkyRoot(root, topk_key_pos);
+                        break;
+                    }
+
                     result_count += root.nrows;
 
-                    print_data(fbmeta.blob_data,
+                    print_data(out,
+                               fbmeta.blob_data,
                                fbmeta.blob_size,
-                               fbmeta.blob_format);
+                               fbmeta.blob_format,
+                               root.nrows);
                     break;
                 }
                 case SFT_FLATBUF_CSV_ROW:
@@ -639,14 +1280,61 @@ void worker_exec_query_op()
                 if (debug)
                     cout << "DEBUG: query.cc: worker:  case SFT_FLATBUF_FLEX_ROW." << endl;
 
+                // agg preds accumulate in place, so each result gets its
+                // own rather than the workers sharing sky_qry_preds.
+                predicate_vec agg_preds;
+                if (!agg_outputs.empty())
+                    agg_preds = predsFromString(sky_tbl_schema, qop_query_preds);
+                predicate_vec& preds = \
+                    agg_outputs.empty() ? sky_qry_preds : agg_preds;
+
+                if (!sky_groupby_schema.empty() and !agg_outputs.empty()) {
+                    PredicateEngine engine(agg_preds);
+                    GroupTable groups(sky_groupby_schema,
+                                      groupAggsFromPreds(agg_preds), false);
+                    int ret = processSkyFbGroups(groups, engine,
+                                                 fbmeta.blob_data,
+                                                 fbmeta.blob_size,
+                                                 errmsg);
+                    for (auto it = agg_preds.begin(); it != agg_preds.end(); ++it)
+                        delete *it;
+                    if (ret != 0) {
+                        std::cerr << "ERROR: query.cc: processSkyFbGroups: "
+                                  << errmsg << "\n ERR=" << ret
+                                  << endl;
+                        assert(Tables::TablesErrCodes::ECLIENTSIDE_PROCESSING_FAILURE==0);
+                    }
+                    aggs.merge(groups);
+                    break;
+                }
+
+                if (topk) {
+                    PredicateEngine engine(sky_qry_preds);
+                    BuilderPool pool;
+                    int ret = processSkyFbTopK(*topk, sky_tbl_schema,
+                                               sky_qry_schema, engine, pool,
+                                               fbmeta.blob_data,
+                                               fbmeta.blob_size,
+                                               errmsg);
+                    if (ret != 0) {
+                        std::cerr << "ERROR: query.cc: processSkyFbTopK: "
+                                  << errmsg << "\n ERR=" << ret
+                                  << endl;
+                        assert(Tables::TablesErrCodes::ECLIENTSIDE_PROCESSING_FAILURE==0);
+                    }
+                    break;
+                }
+
                 flatbuffers::FlatBufferBuilder flatbldr(1024); // pre-alloc
                 int ret = processSkyFb(flatbldr,
                                        sky_tbl_schema,
                                        sky_qry_schema,
-                                       sky_qry_preds,
+                                       preds,
                                        fbmeta.blob_data,
                                        fbmeta.blob_size,
                                        errmsg);
+                for (auto it = agg_preds.begin(); it != agg_preds.end(); ++it)
+                    delete *it;
                 if (ret != 0) {
                     std::cerr << "ERROR: query.cc: processSkyFb: "
                               << errmsg << "\n ERR=" << ret
@@ -658,8 +1346,13 @@ void worker_exec_query_op()
                 const char* processed_data = \
                     reinterpret_cast<const char*>(flatbldr.GetBufferPointer());
                 sky_root root = getSkyRoot(processed_data, 0);
+                if (!agg_outputs.empty()) {
+                    aggs.updateSkyRoot(root);
+                    break;
+                }
                 result_count += root.nrows;
-                print_data(processed_data, 0, SFT_FLATBUF_FLEX_ROW);
+                print_data(out, processed_data, 0, SFT_FLATBUF_FLEX_ROW,
+                           root.nrows);
                 break;
             }
 
@@ -668,6 +1361,44 @@ void worker_exec_query_op()
                 if (debug)
                     cout << "DEBUG: query.cc: worker:  case SFT_ARROW." << endl;
 
+                if (!sky_groupby_schema.empty() and !agg_outputs.empty()) {
+                    predicate_vec agg_preds = \
+                        predsFromString(sky_tbl_schema, qop_query_preds);
+                    PredicateEngine engine(agg_preds);
+                    GroupTable groups(sky_groupby_schema,
+                                      groupAggsFromPreds(agg_preds), false);
+                    int ret = processArrowGroups(groups, sky_tbl_schema, engine,
+                                                 fbmeta.blob_data,
+                                                 fbmeta.blob_size,
+                                                 errmsg);
+                    for (auto it = agg_preds.begin(); it != agg_preds.end(); ++it)
+                        delete *it;
+                    if (ret != 0) {
+                        std::cerr << "ERROR: query.cc: processArrowGroups: "
+                                  << errmsg << "\n ERR=" << ret
+                                  << endl;
+                        assert(Tables::TablesErrCodes::ECLIENTSIDE_PROCESSING_FAILURE==0);
+                    }
+                    aggs.merge(groups);
+                    break;
+                }
+
+                if (topk) {
+                    PredicateEngine engine(sky_qry_preds);
+                    int ret = processArrowTopK(*topk, sky_tbl_schema,
+                                               sky_qry_schema, engine,
+                                               fbmeta.blob_data,
+                                               fbmeta.blob_size,
+                                               errmsg);
+                    if (ret != 0) {
+                        std::cerr << "ERROR: query.cc: processArrowTopK: "
+                                  << errmsg << "\n ERR=" << ret
+                                  << endl;
+                        assert(Tables::TablesErrCodes::ECLIENTSIDE_PROCESSING_FAILURE==0);
+                    }
+                    break;
+                }
+
                 std::shared_ptr<arrow::Table> table;
                 int ret = processArrowCol(
                               &table,
@@ -687,9 +1418,11 @@ void worker_exec_query_op()
                     std::shared_ptr<arrow::Buffer> buffer;
                     auto schema = table->schema();
                     auto metadata = schema->metadata();
-                    result_count += std::stoi(metadata->value(METADATA_NUM_ROWS));
+                    int nrows = std::stoi(metadata->value(METADATA_NUM_ROWS));
+                    result_count += nrows;
                     convert_arrow_to_buffer(table, &buffer);
-                    print_data(buffer->ToString().c_str(), buffer->size(), SFT_ARROW);
+                    print_data(out, buffer->ToString().c_str(), buffer->size(),
+                               SFT_ARROW, nrows);
                 }
                 break;
             }
@@ -739,11 +1472,11 @@ void worker_exec_query_op()
             if (debug) {
                 cout << "DEBUG: query.cc: worker: raw_result is empty." << endl;
             }
-            lock.lock();
-            break;
+            return;
         }
 
-        print_data(result.c_str(), result.length(), SFT_EXAMPLE_FORMAT);
+        print_data(out, result.c_str(), result.length(),
+                   SFT_EXAMPLE_FORMAT, Tables::ROW_LIMIT_DEFAULT);
     }
     else if (query == "wasm") {
 
@@ -779,11 +1512,11 @@ void worker_exec_query_op()
             if (debug) {
                 cout << "DEBUG: query.cc: worker: raw_result is empty." << endl;
             }
-            lock.lock();
-            break;
+            return;
         }
 
-        print_data(result.c_str(), result.length(), SFT_EXAMPLE_FORMAT);
+        print_data(out, result.c_str(), result.length(),
+                   SFT_EXAMPLE_FORMAT, Tables::ROW_LIMIT_DEFAULT);
 
     }
     else {   // older processing code below
@@ -805,7 +1538,7 @@ void worker_exec_query_op()
         if (use_cls) {
             try {
                 using ceph::decode;
-                ceph::bufferlist::const_iterator it = s->bl.begin();
+                ceph::bufferlist::const_iterator it = raw_result.begin();
                 decode(info, it);
                 decode(result, it);
             } catch (ceph::buffer::error&) {
@@ -814,12 +1547,9 @@ void worker_exec_query_op()
                 assert(decode_runquery_cls);
             }
         } else {
-            result = s->bl;
+            result = raw_result;
         }
 
-        // data is now all in bl
-        delete s;
-
         // our older query processing code below...
         // apply the query
         size_t row_size;
@@ -862,7 +1592,7 @@ void worker_exec_query_op()
           if (old_projection && use_cls) {
             for (size_t rid = 0; rid < num_rows; rid++) {
               const char *row = rows + rid * row_size;
-              print_row(row);
+              print_row(out, row);
               result_count++;
             }
           } else {
@@ -871,7 +1601,7 @@ void worker_exec_query_op()
               const char *vptr = row + extended_price_field_offset;
               const double val = *(const double*)vptr;
               if (val > extended_price) {
-                print_row(row);
+                print_row(out, row);
                 result_count++;
                 add_extra_row_cost(extra_row_cost);
               }
@@ -882,7 +1612,7 @@ void worker_exec_query_op()
           if (old_projection && use_cls) {
             for (size_t rid = 0; rid < num_rows; rid++) {
               const char *row = rows + rid * row_size;
-              print_row(row);
+              print_row(out, row);
               result_count++;
             }
           } else {
@@ -891,7 +1621,7 @@ void worker_exec_query_op()
               const char *vptr = row + extended_price_field_offset;
               const double val = *(const double*)vptr;
               if (val == extended_price) {
-                print_row(row);
+                print_row(out, row);
                 result_count++;
                 add_extra_row_cost(extra_row_cost);
               }
@@ -902,7 +1632,7 @@ void worker_exec_query_op()
           if (old_projection && use_cls) {
             for (size_t rid = 0; rid < num_rows; rid++) {
               const char *row = rows + rid * row_size;
-              print_row(row);
+              print_row(out, row);
               result_count++;
             }
           } else {
@@ -914,7 +1644,7 @@ void worker_exec_query_op()
                 const char *vptr = row + line_number_field_offset;
                 const int line_number_val = *(const int*)vptr;
                 if (line_number_val == line_number) {
-                  print_row(row);
+                  print_row(out, row);
                   result_count++;
                   add_extra_row_cost(extra_row_cost);
                 }
@@ -926,7 +1656,7 @@ void worker_exec_query_op()
           if (old_projection && use_cls) {
             for (size_t rid = 0; rid < num_rows; rid++) {
               const char *row = rows + rid * row_size;
-              print_row(row);
+              print_row(out, row);
               result_count++;
             }
           } else {
@@ -939,7 +1669,7 @@ void worker_exec_query_op()
                 if (discount_val > discount_low && discount_val < discount_high) {
                   const double quantity_val = *((const double *)(row + quantity_field_offset));
                   if (quantity_val < quantity) {
-                    print_row(row);
+                    print_row(out, row);
                     result_count++;
                     add_extra_row_cost(extra_row_cost);
                   }
@@ -952,7 +1682,7 @@ void worker_exec_query_op()
           if (old_projection && use_cls) {
             for (size_t rid = 0; rid < num_rows; rid++) {
               const char *row = rows + rid * row_size;
-              print_row(row);
+              print_row(out, row);
               result_count++;
             }
           } else {
@@ -963,7 +1693,7 @@ void worker_exec_query_op()
               const std::string comment_val = string_ncopy(cptr,
                   comment_field_length);
               if (RE2::PartialMatch(comment_val, re)) {
-                print_row(row);
+                print_row(out, row);
                 result_count++;
                 add_extra_row_cost(extra_row_cost);
               }
@@ -973,7 +1703,7 @@ void worker_exec_query_op()
         else if (query == "fastpath") {
             for (size_t rid = 0; rid < num_rows; rid++) {
               const char *row = rows + rid * row_size;
-              print_row(row);
+              print_row(out, row);
               result_count++;
             }
         }
@@ -982,8 +1712,651 @@ void worker_exec_query_op()
         }
     }
 
-    lock.lock();
+}
+
+// takes the next completed io, spinning briefly before going to sleep.
+// returns NULL once stopped and no completed ios remain.
+static AioState* next_ready_io()
+{
+    AioState *s = NULL;
+    while (true) {
+        for (int i = 0; i < WORKER_SPIN_COUNT; i++) {
+            if (ready_ios.try_pop(s))
+                return s;
+            if (stop and ready_ios.empty())
+                return NULL;
+        }
+
+        // producers read idle_workers after pushing, so either they see
+        // this worker asleep or the recheck below sees their io.
+        std::unique_lock<std::mutex> lock(idle_lock);
+        idle_workers++;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        idle_cond.wait(lock, []{ return stop or !ready_ios.empty(); });
+        idle_workers--;
+    }
+}
+
+static void wake_idle_worker(bool all=false)
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (idle_workers.load() == 0 and !all)
+        return;
+    {
+        std::lock_guard<std::mutex> l(idle_lock);
+    }
+    if (all)
+        idle_cond.notify_all();
+    else
+        idle_cond.notify_one();
+}
+
+// send the io of s to the primary osd of its object, or balanced to any of
+// its replicas for a hedge or retry.  method is NULL to read the object.
+static int submit_query_io(librados::IoCtx& ioctx, AioState *s,
+                           const char *method, ceph::bufferlist& inbl)
+{
+    if (!s->balanced) {
+        if (method == NULL)
+            return ioctx.aio_read(s->oid, s->c, &s->bl, 0, 0);
+        return ioctx.aio_exec(s->oid, s->c, "tabular", method, inbl, &s->bl);
+    }
+    librados::ObjectReadOperation op;
+    if (method == NULL)
+        op.read(0, 0, &s->bl, NULL);
+    else
+        op.exec("tabular", method, inbl, &s->bl, NULL);
+    return ioctx.aio_operate(s->oid, s->c, &op,
+                             librados::OPERATION_BALANCE_READS, NULL);
+}
+
+// set the now validated query op params into the op struct, encode the op
+// and launch the aio for the specified oid.  the ios of an adaptive
+// dispatch req share its seq.
+static void launch_query_io(const std::string& oid, int resume_seq_num,
+                            const std::shared_ptr<query_req>& req=nullptr,
+                            bool balanced=false)
+{
+    // dispatch an io request
+    AioState *s = new AioState;
+    s->oid = oid;
+    s->seq = req ? req->seq : dispatch_seq++;
+    s->req = req;
+    s->balanced = balanced;
+    s->c = librados::Rados::aio_create_completion(
+        s, NULL, handle_cb);
+
+    // keeps track of the worker latency
+    memset(&s->times, 0, sizeof(s->times));
+    s->times.dispatch = getns();
+
+    librados::IoCtx& ioctx = *query_ioctx;
+
+    if (query == "flatbuf" ) {
+      if (use_cls) {
+      query_op op;
+      op.debug = debug;
+      op.query = query;
+      op.fastpath = qop_fastpath;
+      op.index_read = qop_index_read;
+      op.mem_constrain = qop_mem_constrain;
+      op.index_type = qop_index_type;
+      op.index2_type = qop_index2_type;
+      op.index_plan_type = qop_index_plan_type;
+      op.index_batch_size = qop_index_batch_size;
+      op.result_format = qop_result_format;
+      op.db_schema_name = qop_db_schema_name;
+      op.table_name = qop_table_name;
+      op.data_schema = qop_data_schema;
+      op.query_schema = qop_query_schema;
+      op.index_schema = qop_index_schema;
+      op.index2_schema = qop_index2_schema;
+      op.query_preds = qop_query_preds;
+      op.index_preds = qop_index_preds;
+      op.index2_preds = qop_index2_preds;
+      op.resume_seq_num = resume_seq_num;
+      op.result_max_bytes = qop_result_max_bytes;
+      op.groupby_schema = qop_groupby_schema;
+      op.groupby_max_bytes = qop_groupby_max_bytes;
+      op.row_limit = qop_row_limit;
+      op.orderby_schema = qop_orderby_schema;
+      op.orderby_desc = qop_orderby_desc;
+      op.result_compression = qop_result_compression;
+      op.max_threads = qop_max_threads;
+      ceph::bufferlist inbl;
+      using ceph::encode;
+      encode(op, inbl);
+
+      if (debug)
+          cout << "DEBUG: run-query: launching aio_exec for oid=" << oid << endl;
+
+      // Launch CEPH CLS Read
+      int ret = submit_query_io(ioctx, s, "exec_query_op", inbl);
+      checkret(ret, 0);
+
+    } else {
+
+      if (debug)
+          cout << "DEBUG: run-query: launching aio_read for oid=" << oid << endl;
+
+      // Launch CEPH STANDARD Read
+      ceph::bufferlist inbl;
+      int ret = submit_query_io(ioctx, s, NULL, inbl);
+      checkret(ret, 0);
+    }
   }
+
+    // OLDER TEST QUERIES
+    // handle older fixed queries
+    if (query == "a" or
+        query == "b" or
+        query == "c" or
+        query == "d" or
+        query == "e" or
+        query == "f" or
+        query == "g") {
+
+        if (use_cls) {
+            test_op op;
+            op.query = query;
+            op.fastpath = qop_fastpath;
+            op.extended_price = extended_price;
+            op.order_key = order_key;
+            op.line_number = line_number;
+            op.ship_date_low = ship_date_low;
+            op.ship_date_high = ship_date_high;
+            op.discount_low = discount_low;
+            op.discount_high = discount_high;
+            op.quantity = quantity;
+            op.comment_regex = comment_regex;
+            op.use_index = use_index;
+            op.old_projection = old_projection;
+            op.extra_row_cost = extra_row_cost;
+
+            ceph::bufferlist inbl;
+            using ceph::encode;
+            encode(op, inbl);
+            int ret = submit_query_io(ioctx, s, "test_query_op", inbl);
+            checkret(ret, 0);
+        }
+        else {
+            ceph::bufferlist inbl;
+            int ret = submit_query_io(ioctx, s, NULL, inbl);
+            checkret(ret, 0);
+        }
+    }
+
+    // simple example query op for developers to extend with their own
+    // customized method
+    if (query == "example") {
+
+        if (use_cls) {  // execute a cls read method
+
+            // setup and encode our op params here.
+            inbl_sample_op op;
+            op.message = "This is an example op";
+            op.instructions = "Example instructions";
+            op.counter = expl_func_counter;
+            op.func_id = expl_func_id;
+            ceph::bufferlist inbl;
+            using ceph::encode;
+            encode(op, inbl);
+
+            // execute our example method on the object, passing in our op.
+            int ret = submit_query_io(ioctx, s, "example_query_op", inbl);
+            checkret(ret, 0);
+        }
+        else {  // execute standard read
+            // read entire object by specifying off=0 len=0.
+            ceph::bufferlist inbl;
+            int ret = submit_query_io(ioctx, s, NULL, inbl);
+            checkret(ret, 0);
+        }
+    }
+
+    // method for executing query processing using pre-compiled binary wasm
+    // code on the OSDs
+    if (query == "wasm") {
+
+        if (use_cls) {  // execute a cls read method
+
+            // setup and encode our op params here.
+            wasm_inbl_sample_op op;
+            op.message = "This is an wasm op";
+            op.instructions = "Wasm instructions";
+            op.counter = expl_func_counter;
+            op.func_id = expl_func_id;
+            ceph::bufferlist inbl;
+            using ceph::encode;
+            encode(op, inbl);
+
+            // execute our example method on the object, passing in our op.
+            int ret = submit_query_io(ioctx, s, "wasm_query_op", inbl);
+            checkret(ret, 0);
+        }
+        else {  // execute standard read
+            // read entire object by specifying off=0 len=0.
+            ceph::bufferlist inbl;
+            int ret = submit_query_io(ioctx, s, NULL, inbl);
+            checkret(ret, 0);
+        }
+    }
+}
+
+// true once a limit without order by has been met by the rows returned so
+// far, any further objects would only add rows past the limit.
+static bool row_limit_reached()
+{
+    return row_limit != Tables::ROW_LIMIT_DEFAULT and !global_topk and
+           agg_outputs.empty() and
+           static_cast<long long int>(result_count.load()) >= row_limit;
+}
+
+// launches a replacement for a retired io: the capped object again from its
+// cursor, else the next target object.  when neither is left, or the row
+// limit was reached, the io slot is retired, and the last one wakes up the
+// dispatcher.
+static void dispatch_next_io(const std::string& oid, int next_seq_num)
+{
+    if (row_limit_reached()) {
+        next_seq_num = -1;
+        next_target = target_objects.size();
+    }
+
+    if (next_seq_num >= 0) {
+        launch_query_io(oid, next_seq_num);
+        return;
+    }
+
+    size_t n = next_target++;
+    if (n < target_objects.size()) {
+        launch_query_io(target_objects[target_objects.size() - 1 - n],
+                        Tables::DATASTRUCT_SEQ_NUM_MIN);
+        return;
+    }
+
+    if (--outstanding_ios == 0) {
+        std::lock_guard<std::mutex> l(done_lock);
+        done_cond.notify_all();
+    }
+}
+
+// a req is ready to dispatch with adaptive dispatch, its counts are
+// updated under dispatch_lock and its io is launched after unlocking.
+struct io_launch {
+    std::shared_ptr<query_req> req;
+    bool balanced;
+};
+
+static void schedule_io(const std::shared_ptr<query_req>& req, bool balanced,
+                        uint64_t now, std::vector<io_launch>& launches)
+{
+    req->attempts++;
+    req->outstanding++;
+    req->last_ns = now;
+    ios_inflight++;
+    if (balanced)
+        balanced_inflight++;
+    launches.push_back(io_launch{req, balanced});
+}
+
+// the next reqs to dispatch, retries first, then the pending objects of the
+// groups with room in their window, least loaded first.  at most qdepth
+// reqs are in flight over all groups.
+static void schedule_adaptive_ios(uint64_t now, std::vector<io_launch>& launches)
+{
+    while (!retry_reqs.empty()) {
+        std::shared_ptr<query_req> req = retry_reqs.front();
+        retry_reqs.pop_front();
+        dispatch_groups[req->group].retries++;
+        schedule_io(req, true, now, launches);
+    }
+
+    while (reqs_inflight < dispatch_qdepth) {
+        dispatch_group* next = NULL;
+        size_t next_idx = 0;
+        for (size_t i = 0; i < dispatch_groups.size(); i++) {
+            dispatch_group& g = dispatch_groups[i];
+            if (g.pending.empty() or g.inflight >= std::max(1, (int)g.window))
+                continue;
+            if (!next or g.inflight / g.window < next->inflight / next->window) {
+                next = &g;
+                next_idx = i;
+            }
+        }
+        if (!next)
+            break;
+
+        std::shared_ptr<query_req> req(new query_req);
+        req->oid = next->pending.front().first;
+        req->resume_seq_num = next->pending.front().second;
+        req->seq = dispatch_seq++;
+        req->group = next_idx;
+        req->dispatch_ns = now;
+        req->window = next->window;
+        next->pending.pop_front();
+        next->inflight++;
+        next->reqs++;
+        reqs_inflight++;
+        inflight_reqs[req->seq] = req;
+        schedule_io(req, false, now, launches);
+    }
+}
+
+// hedges the reqs in flight for hedge_factor times the smoothed latency of
+// their group, or of all groups if theirs has none yet.  at most a quarter
+// of the qdepth are hedged at once.  returns when the next req is due.
+static uint64_t hedge_slow_ios(uint64_t now, std::vector<io_launch>& launches)
+{
+    uint64_t next_due = UINT64_MAX;
+    if (hedge_factor <= 0)
+        return next_due;
+
+    double all_srtt_ns = 0;
+    int nsrtt = 0;
+    for (auto it = dispatch_groups.begin(); it != dispatch_groups.end(); ++it) {
+        if (it->srtt_ns > 0) {
+            all_srtt_ns += it->srtt_ns;
+            nsrtt++;
+        }
+    }
+    if (nsrtt == 0)
+        return next_due;
+    all_srtt_ns /= nsrtt;
+
+    int max_hedges = std::max(1, dispatch_qdepth / 4);
+    for (auto it = inflight_reqs.begin(); it != inflight_reqs.end(); ++it) {
+        query_req& req = *it->second;
+        if (req.done or req.hedged or req.outstanding != 1)
+            continue;
+        dispatch_group& g = dispatch_groups[req.group];
+        double srtt_ns = g.srtt_ns > 0 ? g.srtt_ns : all_srtt_ns;
+        uint64_t due = req.last_ns +
+            std::max(HEDGE_MIN_NS, static_cast<uint64_t>(hedge_factor * srtt_ns));
+        if (due > now) {
+            next_due = std::min(next_due, due);
+            continue;
+        }
+        if (balanced_inflight >= max_hedges)
+            break;
+        req.hedged = true;
+        g.hedges++;
+        schedule_io(it->second, true, now, launches);
+    }
+    return next_due;
+}
+
+// the io of s has completed with ret, called from handle_cb.  true if its
+// result is to be queued on ready_ios, its req was not already completed
+// by its other io and it did not fail with another attempt left.
+static bool adaptive_io_done(AioState *s, int ret)
+{
+    bool failed = ret < 0 and ret != -ENOENT;
+    std::lock_guard<std::mutex> l(dispatch_lock);
+    query_req& req = *s->req;
+    ios_inflight--;
+    if (s->balanced)
+        balanced_inflight--;
+    req.outstanding--;
+
+    bool use = false;
+    if (req.done) {
+        use = false;  // a duplicate
+    } else if (failed and req.outstanding > 0) {
+        use = false;  // its other io may succeed
+    } else if (failed and req.attempts < QUERY_IO_ATTEMPTS_MAX) {
+        retry_reqs.push_back(s->req);
+    } else {
+        req.done = true;
+        if (s->balanced and req.hedged and !failed)
+            dispatch_groups[req.group].hedge_wins++;
+        use = true;
+    }
+    dispatch_cond.notify_one();
+    return use;
+}
+
+// the result of req has been taken off ready_ios, and it is retired.  the
+// latency of req from its first io adjusts its group's window, and the
+// rest of a capped object is dispatched next in the group.
+static void retire_adaptive_req(const std::shared_ptr<query_req>& req,
+                                uint64_t response_ns, int next_seq_num,
+                                query_sample& sample)
+{
+    std::lock_guard<std::mutex> l(dispatch_lock);
+    dispatch_group& g = dispatch_groups[req->group];
+    double latency_ns = response_ns - req->dispatch_ns;
+    g.srtt_ns = g.srtt_ns == 0 ? latency_ns :
+                                 g.srtt_ns + (latency_ns - g.srtt_ns) / 8;
+    if (g.base_ns == 0 or g.srtt_ns < g.base_ns)
+        g.base_ns = g.srtt_ns;
+
+    // AIMD, decrease at most once per round trip
+    if (g.srtt_ns > slow_factor * g.base_ns) {
+        if (response_ns - g.last_decrease_ns > g.srtt_ns) {
+            g.window = std::max(1.0, g.window / 2);
+            g.last_decrease_ns = response_ns;
+            g.decreases++;
+        }
+    } else {
+        g.window = std::min(static_cast<double>(dispatch_qdepth),
+                            g.window + 1 / g.window);
+    }
+    g.max_window = std::max(g.max_window, g.window);
+    g.min_window = std::min(g.min_window, g.window);
+
+    g.inflight--;
+    reqs_inflight--;
+    inflight_reqs.erase(req->seq);
+
+    if (row_limit_reached()) {
+        for (auto it = dispatch_groups.begin(); it != dispatch_groups.end(); ++it)
+            it->pending.clear();
+    } else if (next_seq_num >= 0) {
+        g.pending.push_front(std::make_pair(req->oid, next_seq_num));
+    }
+
+    sample.latency_ns = latency_ns;
+    sample.attempts = req->attempts;
+    sample.hedged = req->hedged;
+    sample.window = req->window;
+    dispatch_cond.notify_one();
+}
+
+// groups target_objects, taken from the back as with fifo dispatch, and
+// splits the qdepth evenly into the initial windows of the groups.
+static void start_adaptive_ios(int qdepth)
+{
+    std::lock_guard<std::mutex> l(dispatch_lock);
+    dispatch_qdepth = qdepth;
+    dispatch_groups.clear();
+    inflight_reqs.clear();
+    retry_reqs.clear();
+    reqs_inflight = 0;
+    ios_inflight = 0;
+    balanced_inflight = 0;
+
+    std::map<int, size_t> group_of_osd;
+    for (auto it = target_objects.rbegin(); it != target_objects.rend(); ++it) {
+        int osd = -1;
+        if (dispatch_mode == DISPATCH_OSD) {
+            auto ito = target_osds.find(*it);
+            if (ito != target_osds.end())
+                osd = ito->second;
+        }
+        auto itg = group_of_osd.find(osd);
+        if (itg == group_of_osd.end()) {
+            itg = group_of_osd.insert(
+                std::make_pair(osd, dispatch_groups.size())).first;
+            dispatch_groups.push_back(dispatch_group());
+            dispatch_groups.back().osd = osd;
+        }
+        dispatch_group& g = dispatch_groups[itg->second];
+        g.pending.push_back(std::make_pair(*it, Tables::DATASTRUCT_SEQ_NUM_MIN));
+        g.objects++;
+    }
+
+    double window = dispatch_groups.empty() ? 1 :
+        std::max(1.0, static_cast<double>(qdepth) / dispatch_groups.size());
+    for (auto it = dispatch_groups.begin(); it != dispatch_groups.end(); ++it) {
+        it->window = window;
+        it->max_window = window;
+        it->min_window = window;
+    }
+}
+
+// dispatches the reqs and hedges of adaptive dispatch until all objects
+// are done and all of their ios have completed, including the duplicates.
+static void wait_adaptive_ios()
+{
+    uint64_t last_status_ns = getns();
+    std::unique_lock<std::mutex> lock(dispatch_lock);
+    while (true) {
+        uint64_t now = getns();
+        std::vector<io_launch> launches;
+        schedule_adaptive_ios(now, launches);
+        uint64_t next_due = hedge_slow_ios(now, launches);
+        if (!launches.empty()) {
+            lock.unlock();
+            for (auto it = launches.begin(); it != launches.end(); ++it)
+                launch_query_io(it->req->oid, it->req->resume_seq_num,
+                                it->req, it->balanced);
+            lock.lock();
+            continue;
+        }
+
+        bool pending = false;
+        for (auto it = dispatch_groups.begin(); it != dispatch_groups.end(); ++it)
+            pending |= !it->pending.empty();
+        if (!pending and reqs_inflight == 0 and ios_inflight == 0 and
+            retry_reqs.empty())
+            break;
+
+        // only report status messages during quiet operation
+        // since otherwise we are printing as csv data to std out
+        if (quiet and now - last_status_ns >= 1000000000ULL) {
+            std::cout << "draining ios: " << reqs_inflight << " remaining\n";
+            last_status_ns = now;
+        }
+        uint64_t wait_ns = std::min<uint64_t>(next_due - now, 1000000000ULL);
+        dispatch_cond.wait_for(lock, std::chrono::nanoseconds(wait_ns));
+    }
+}
+
+// fills the queue depth, from then on ios are dispatched by the workers
+// as each completed io is taken off ready_ios, or by wait_query_ios with
+// adaptive dispatch.
+void start_query_ios(int qdepth)
+{
+    next_target = 0;
+    dispatch_seq = 0;
+    out_next_seq = 0;
+    ready_ios.reserve(qdepth * 2);
+    if (dispatch_mode != DISPATCH_FIFO) {
+        start_adaptive_ios(qdepth);
+        return;
+    }
+    outstanding_ios = qdepth;
+    for (int i = 0; i < qdepth; i++)
+        dispatch_next_io("", -1);
+}
+
+// blocks until all ios are retired
+void wait_query_ios()
+{
+    if (dispatch_mode != DISPATCH_FIFO) {
+        wait_adaptive_ios();
+        return;
+    }
+    std::unique_lock<std::mutex> lock(done_lock);
+    while (!done_cond.wait_for(lock, std::chrono::seconds(1),
+                               []{ return outstanding_ios == 0; })) {
+
+        // only report status messages during quiet operation
+        // since otherwise we are printing as csv data to std out
+        if (quiet)
+            std::cout << "draining ios: " << outstanding_ios << " remaining\n";
+    }
+}
+
+void stop_query_workers()
+{
+    stop = true;
+    wake_idle_worker(true);
+}
+
+// primary method for read() queries.
+void worker_exec_query_op()
+{
+    // each worker formats into its own buffer, see emit_output()
+    Tables::OutputBuffer out;
+    out.reserve(OUTPUT_FLUSH_BYTES);
+
+    // partial aggs merged by this worker
+    Tables::GroupTable aggs(sky_groupby_schema, agg_partials, true);
+
+    // top-k rows merged by this worker, if any
+    std::unique_ptr<Tables::TopKRows> topk;
+    if (global_topk)
+        topk.reset(new Tables::TopKRows(sky_orderby_schema[0], orderby_desc,
+                                        row_limit));
+
+    while (true) {
+
+        // wait for work, or done
+        AioState *s = next_ready_io();
+        if (!s)
+            break;
+
+        if (debug)
+            cout << "DEBUG: query.cc: worker: popped front of ready_ios" << endl;
+
+        // get returned data out of our Aio State struct, used by each query
+        // type, we own it now.
+        ceph::bufferlist raw_result = s->bl;
+        std::string oid = s->oid;
+        uint64_t seq = s->seq;
+        uint64_t response_ns = s->times.response;
+        std::shared_ptr<query_req> req = s->req;
+        query_sample sample;
+        sample.latency_ns = response_ns - s->times.dispatch;
+        delete s;  // release aio struct.
+
+        // a capped result returns a cursor to resume the object from. the
+        // replacement io is launched before this result is processed so
+        // the osds are kept busy meanwhile.
+        cls_info info;
+        if (query == "flatbuf" and use_cls and raw_result.length() > 0) {
+            try {
+                ceph::bufferlist::const_iterator it = raw_result.begin();
+                using ceph::decode;
+                decode(info, it);
+            }
+            catch (ceph::buffer::error&) {}  // reported when decoded below
+        }
+        if (req)
+            retire_adaptive_req(req, response_ns, info.next_seq_num, sample);
+        else if (query_ioctx)
+            dispatch_next_io(oid, info.next_seq_num);
+
+        if (collect_stats) {
+            sample.oid = oid;
+            sample.raw_bytes = raw_result.length();
+            sample.info = info;
+            std::lock_guard<std::mutex> l(samples_lock);
+            query_samples.push_back(std::move(sample));
+        }
+
+        process_query_result(raw_result, out, aggs, topk.get());
+        emit_output(out, seq);
+    }
+    flush_output(out);
+
+    std::lock_guard<std::mutex> l(agg_lock);
+    if (global_aggs)
+        global_aggs->merge(aggs);
+    if (global_topk)
+        global_topk->merge(*topk);
 }
 
 /*
@@ -995,23 +2368,298 @@ void handle_cb(librados::completion_t cb, void *arg)
 {
   AioState *s = (AioState*)arg;
   s->times.response = getns();
+  int ret = s->c->get_return_value();
+  s->c->release();
+  s->c = NULL;
+
+  // with adaptive dispatch, drop the duplicate result of a hedged req, or
+  // a failure that is retried
+  if (s->req and !adaptive_io_done(s, ret)) {
+    delete s;
+    return;
+  }
 
   // there might have been an error, although we can ignore obj not exists err.
-  if (s->c->get_return_value()  < 0) {
-    if (s->c->get_return_value() != -ENOENT) {
+  if (ret < 0) {
+    if (ret != -ENOENT) {
       // we can ignore ENOENT since skyhook generates reads for potentially
       // empty partitions due to partition name generator function.
         cerr << "handle_cb: s->c->get_return_value()="
-             << std::to_string(s->c->get_return_value()) << endl;
-        assert(s->c->get_return_value() >= 0);
+             << std::to_string(ret) << endl;
+        assert(ret >= 0);
     }
   }
-  s->c->release();
-  s->c = NULL;
 
-  work_lock.lock();
-  ready_ios.push_back(s);
-  work_lock.unlock();
+  ready_ios.push(s);
+  wake_idle_worker();
+}
+
+// the acting primary osd of each pg of pool_id, keyed by the position of
+// the pg in the pool, from a single pg dump of the cluster.
+static int lookup_pg_primaries(librados::Rados& cluster, int64_t pool_id,
+                               std::map<uint32_t, int>& primaries)
+{
+    std::string cmd = "{\"prefix\": \"pg dump\", "
+                      "\"dumpcontents\": [\"pgs_brief\"], "
+                      "\"format\": \"json\"}";
+    ceph::bufferlist inbl, outbl;
+    std::string outs;
+    int ret = cluster.mgr_command(cmd, inbl, &outbl, &outs);
+    if (ret < 0) {
+        outbl.clear();
+        ret = cluster.mon_command(cmd, inbl, &outbl, &outs);
+    }
+    if (ret < 0)
+        return ret;
+    rapidjson::Document doc;
+    doc.Parse(outbl.to_str().c_str());
+    if (doc.HasParseError())
+        return -EINVAL;
+
+    // a list of pgs, or within pg_stats in later releases
+    const rapidjson::Value* pgs = &doc;
+    if (doc.IsObject() and doc.HasMember("pg_stats"))
+        pgs = &doc["pg_stats"];
+    if (!pgs->IsArray())
+        return -EINVAL;
+    for (auto it = pgs->Begin(); it != pgs->End(); ++it) {
+        if (!it->IsObject() or !it->HasMember("pgid") or
+            !(*it)["pgid"].IsString() or !it->HasMember("acting_primary") or
+            !(*it)["acting_primary"].IsInt())
+            continue;
+        std::string pgid = (*it)["pgid"].GetString();
+        size_t dot = pgid.find('.');
+        if (dot == std::string::npos or
+            std::strtoll(pgid.c_str(), NULL, 10) != pool_id)
+            continue;
+        uint32_t ps = std::strtoul(pgid.c_str() + dot + 1, NULL, 16);
+        primaries[ps] = (*it)["acting_primary"].GetInt();
+    }
+    return 0;
+}
+
+// the primary osd of each of oids in pool, or -1 if it cannot be looked
+// up.  The pg of each object is computed locally from its hash, so the
+// cluster is asked only once for the primary of each pg.
+static void lookup_object_osds(librados::Rados& cluster,
+                               const std::string& pool,
+                               const std::vector<std::string>& oids,
+                               std::map<std::string, int>& osds)
+{
+    librados::IoCtx ioctx;
+    std::map<uint32_t, int> primaries;
+    int ret = cluster.ioctx_create(pool.c_str(), ioctx);
+    if (ret == 0)
+        ret = lookup_pg_primaries(cluster, ioctx.get_id(), primaries);
+    if (ret < 0)
+        cerr << "cannot look up the pgs of pool " << pool << " ("
+             << ret << "), osds unknown" << std::endl;
+    for (auto it = oids.begin(); it != oids.end(); ++it) {
+        int osd = -1;
+        uint32_t ps = 0;
+        if (ret == 0 and ioctx.get_object_pg_hash_position2(*it, &ps) == 0) {
+            auto itp = primaries.find(ps);
+            if (itp != primaries.end())
+                osd = itp->second;
+        }
+        osds[*it] = osd;
+    }
+}
+
+void lookup_sample_osds(librados::Rados& cluster, const std::string& pool,
+                        std::map<std::string, int>& osds)
+{
+    std::vector<std::string> oids;
+    for (auto it = query_samples.begin(); it != query_samples.end(); ++it) {
+        if (!osds.count(it->oid))
+            oids.push_back(it->oid);
+    }
+    if (!oids.empty())
+        lookup_object_osds(cluster, pool, oids, osds);
+}
+
+void lookup_target_osds(librados::Rados& cluster, const std::string& pool)
+{
+    lookup_object_osds(cluster, pool, target_objects, target_osds);
+}
+
+static int sample_osd(const std::map<std::string, int>& osds,
+                      const std::string& oid)
+{
+    auto it = osds.find(oid);
+    return it == osds.end() ? -1 : it->second;
+}
+
+void write_query_log(std::ostream& out,
+                     const std::map<std::string, int>& osds)
+{
+    out << "oid,osd,latency_ns,raw_bytes,read_ns,eval_ns,index_ns,"
+        << "encode_ns,omap_keys,bytes_read,fbs_scanned,fbs_skipped,"
+        << "rows_examined,rows_passed,result_bytes,attempts,hedged,window"
+        << std::endl;
+    for (auto it = query_samples.begin(); it != query_samples.end(); ++it) {
+        const cls_info& info = it->info;
+        out << it->oid << "," << sample_osd(osds, it->oid) << ","
+            << it->latency_ns << "," << it->raw_bytes << ","
+            << info.read_ns << "," << info.eval_ns << ","
+            << info.index_ns << "," << info.encode_ns << ","
+            << info.omap_keys << "," << info.bytes_read << ","
+            << info.fbs_scanned << "," << info.fbs_skipped << ","
+            << info.rows_examined << "," << info.rows_passed << ","
+            << info.result_bytes << "," << it->attempts << ","
+            << it->hedged << "," << it->window << std::endl;
+    }
+}
 
-  work_cond.notify_one();
+// the value at percentile p of sorted vals, by nearest rank
+static uint64_t percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty())
+        return 0;
+    size_t rank = static_cast<size_t>(std::ceil(p * sorted.size()));
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+static void write_distribution(std::ostream& out, const std::string& name,
+                               std::vector<uint64_t>& vals)
+{
+    std::sort(vals.begin(), vals.end());
+    uint64_t sum = 0;
+    for (auto it = vals.begin(); it != vals.end(); ++it)
+        sum += *it;
+    out << "\"" << name << "\": {"
+        << "\"min\": " << (vals.empty() ? 0 : vals.front())
+        << ", \"mean\": " << (vals.empty() ? 0 : sum / vals.size())
+        << ", \"p50\": " << percentile(vals, 0.50)
+        << ", \"p99\": " << percentile(vals, 0.99)
+        << ", \"p999\": " << percentile(vals, 0.999)
+        << ", \"max\": " << (vals.empty() ? 0 : vals.back())
+        << "}";
+}
+
+// the latency and cls info of samples, a set of query ios
+static void write_sample_stats(std::ostream& out,
+                               const std::vector<const query_sample*>& samples,
+                               double wall_s)
+{
+    std::vector<uint64_t> latency, read, eval, index, encode;
+    std::map<int, uint64_t> hist;  // log2 latency us bucket => ios
+    cls_info total;
+    uint64_t raw_bytes = 0;
+    for (auto it = samples.begin(); it != samples.end(); ++it) {
+        const query_sample& s = **it;
+        latency.push_back(s.latency_ns);
+        read.push_back(s.info.read_ns);
+        eval.push_back(s.info.eval_ns);
+        index.push_back(s.info.index_ns);
+        encode.push_back(s.info.encode_ns);
+        int bucket = 0;
+        while ((1ULL << bucket) * 1000 < s.latency_ns)
+            bucket++;
+        hist[bucket]++;
+        raw_bytes += s.raw_bytes;
+        total.omap_keys += s.info.omap_keys;
+        total.bytes_read += s.info.bytes_read;
+        total.fbs_scanned += s.info.fbs_scanned;
+        total.fbs_skipped += s.info.fbs_skipped;
+        total.rows_examined += s.info.rows_examined;
+        total.rows_passed += s.info.rows_passed;
+        total.result_bytes += s.info.result_bytes;
+    }
+    if (wall_s <= 0)
+        wall_s = 1e-9;
+
+    out << "{\"ios\": " << samples.size() << ", ";
+    write_distribution(out, "latency_ns", latency);
+    out << ", ";
+    write_distribution(out, "read_ns", read);
+    out << ", ";
+    write_distribution(out, "eval_ns", eval);
+    out << ", ";
+    write_distribution(out, "index_ns", index);
+    out << ", ";
+    write_distribution(out, "encode_ns", encode);
+    out << ", \"latency_hist_us\": [";
+    for (auto it = hist.begin(); it != hist.end(); ++it) {
+        out << (it == hist.begin() ? "" : ", ")
+            << "{\"le\": " << (1ULL << it->first)
+            << ", \"ios\": " << it->second << "}";
+    }
+    out << "]"
+        << ", \"omap_keys\": " << total.omap_keys
+        << ", \"bytes_read\": " << total.bytes_read
+        << ", \"fbs_scanned\": " << total.fbs_scanned
+        << ", \"fbs_skipped\": " << total.fbs_skipped
+        << ", \"rows_examined\": " << total.rows_examined
+        << ", \"rows_passed\": " << total.rows_passed
+        << ", \"result_bytes\": " << total.result_bytes
+        << ", \"raw_bytes\": " << raw_bytes
+        << ", \"ios_per_sec\": " << samples.size() / wall_s
+        << ", \"rows_per_sec\": " << total.rows_passed / wall_s
+        << ", \"bytes_per_sec\": " << raw_bytes / wall_s
+        << "}";
+}
+
+// the windows and hedges of each dispatch group, by osd
+static void write_dispatch_stats(std::ostream& out)
+{
+    std::lock_guard<std::mutex> l(dispatch_lock);
+    out << ", \"dispatch\": {\"mode\": \""
+        << (dispatch_mode == DISPATCH_OSD ? "osd" : "adaptive")
+        << "\", \"hedge_factor\": " << hedge_factor
+        << ", \"slow_factor\": " << slow_factor
+        << ", \"groups\": {";
+    for (auto it = dispatch_groups.begin(); it != dispatch_groups.end(); ++it) {
+        out << (it == dispatch_groups.begin() ? "" : ", ")
+            << "\"" << it->osd << "\": {"
+            << "\"objects\": " << it->objects
+            << ", \"reqs\": " << it->reqs
+            << ", \"window\": " << it->window
+            << ", \"max_window\": " << it->max_window
+            << ", \"min_window\": " << it->min_window
+            << ", \"decreases\": " << it->decreases
+            << ", \"hedges\": " << it->hedges
+            << ", \"hedge_wins\": " << it->hedge_wins
+            << ", \"retries\": " << it->retries
+            << ", \"srtt_ns\": " << static_cast<uint64_t>(it->srtt_ns)
+            << ", \"base_ns\": " << static_cast<uint64_t>(it->base_ns)
+            << "}";
+    }
+    out << "}}";
+}
+
+void write_query_stats(std::ostream& out, double wall_s,
+                       const std::map<std::string, int>& osds)
+{
+    std::vector<const query_sample*> all;
+    std::map<int, std::vector<const query_sample*>> per_osd;
+    for (auto it = query_samples.begin(); it != query_samples.end(); ++it) {
+        all.push_back(&(*it));
+        per_osd[sample_osd(osds, it->oid)].push_back(&(*it));
+    }
+
+    // per osd throughput is over the same wall time as the whole query
+    out << "{\"wall_s\": " << wall_s << ", \"overall\": ";
+    write_sample_stats(out, all, wall_s);
+    out << ", \"osds\": {";
+    for (auto it = per_osd.begin(); it != per_osd.end(); ++it) {
+        out << (it == per_osd.begin() ? "" : ", ")
+            << "\"" << it->first << "\": ";
+        write_sample_stats(out, it->second, wall_s);
+    }
+    out << "}";
+    if (dispatch_mode != DISPATCH_FIFO)
+        write_dispatch_stats(out);
+    out << "}" << std::endl;
+}
+
+int dispatch_mode_from_string(const std::string& s)
+{
+    if (s == "fifo")
+        return DISPATCH_FIFO;
+    if (s == "adaptive")
+        return DISPATCH_ADAPTIVE;
+    if (s == "osd")
+        return DISPATCH_OSD;
+    return -1;
 }
@@ -11,6 +11,7 @@
 #include <iostream>
 #include <algorithm>
 #include <atomic>
+#include <memory>
 #include <thread>
 #include <condition_variable>
 #include "include/rados/librados.hpp"
@@ -48,10 +49,122 @@ struct timing {
   uint64_t eval2_ns;
 };
 
+struct query_req;
+
 struct AioState {
   ceph::bufferlist bl;
   librados::AioCompletion *c;
   timing times;
+  std::string oid;
+  uint64_t seq = 0;  // dispatch order, used for ordered output
+  std::shared_ptr<query_req> req;  // adaptive dispatch only
+  bool balanced = false;  // a hedge or retry of req, to any replica
+};
+
+/*
+ * Bounded lock-free multi-producer multi-consumer queue (after D. Vyukov).
+ * Each cell carries a sequence number that tells producers and consumers
+ * whether it is free for the current lap, so push and pop each cost one
+ * CAS on the shared position and never take a lock.  Capacity is rounded
+ * up to a power of 2; reserve() may only be called while the queue is
+ * empty and unused by other threads.
+ */
+const size_t MPMC_QUEUE_DEFAULT_CAPACITY = 1024;
+
+template <typename T>
+class MPMCQueue {
+
+  struct cell {
+    std::atomic<size_t> seq;
+    T data;
+  };
+
+  std::unique_ptr<cell[]> cells;
+  size_t mask;
+  alignas(64) std::atomic<size_t> enqueue_pos;
+  alignas(64) std::atomic<size_t> dequeue_pos;
+
+  MPMCQueue(const MPMCQueue&) = delete;
+  MPMCQueue& operator=(const MPMCQueue&) = delete;
+
+public:
+  explicit MPMCQueue(size_t capacity=MPMC_QUEUE_DEFAULT_CAPACITY) :
+      mask(0), enqueue_pos(0), dequeue_pos(0) {
+    reserve(capacity);
+  }
+
+  void reserve(size_t capacity) {
+    size_t n = 2;
+    while (n < capacity)
+      n <<= 1;
+    if (cells and n <= mask + 1)
+      return;
+    cells.reset(new cell[n]);
+    for (size_t i = 0; i < n; i++)
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    mask = n - 1;
+    enqueue_pos.store(0, std::memory_order_relaxed);
+    dequeue_pos.store(0, std::memory_order_relaxed);
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+  bool try_push(const T& v) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      cell* c = &cells[pos & mask];
+      size_t seq = c->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          c->data = v;
+          c->seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) {
+        return false;  // full
+      }
+      else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pop(T& v) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      cell* c = &cells[pos & mask];
+      size_t seq = c->seq.load(std::memory_order_acquire);
+      intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                              std::memory_order_relaxed)) {
+          v = c->data;
+          c->seq.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (diff < 0) {
+        return false;  // empty
+      }
+      else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // spins only if the queue is full, callers size it to avoid this.
+  void push(const T& v) {
+    while (!try_push(v))
+      std::this_thread::yield();
+  }
+
+  bool empty() const {
+    size_t pos = dequeue_pos.load(std::memory_order_acquire);
+    return cells[pos & mask].seq.load(std::memory_order_acquire) != pos + 1;
+  }
 };
 
 extern bool quiet;
@@ -64,6 +177,21 @@ extern uint64_t extra_row_cost;
 
 extern std::vector<timing> timings;
 
+// the latency and cls info of one completed query io, collected for the
+// stats and log files of run-query.
+struct query_sample {
+  std::string oid;
+  uint64_t latency_ns;  // aio dispatch to completion
+  uint64_t raw_bytes;   // returned by the osd
+  cls_info info;        // zeroed unless returned by exec_query_op
+  int attempts = 1;     // ios sent for the object, with hedges and retries
+  bool hedged = false;  // the result is of a hedge
+  double window = 0;    // osd window when dispatched, adaptive dispatch only
+};
+
+extern bool collect_stats;
+extern std::vector<query_sample> query_samples;
+
 // query parameters to be encoded into query_op struct
 
 // query params old
@@ -96,6 +224,14 @@ extern std::string qop_index2_schema;
 extern std::string qop_query_preds;
 extern std::string qop_index_preds;
 extern std::string qop_index2_preds;
+extern uint64_t qop_result_max_bytes;
+extern std::string qop_groupby_schema;
+extern uint64_t qop_groupby_max_bytes;
+extern uint64_t qop_row_limit;
+extern int qop_result_compression;  // CompressionType
+extern std::string qop_orderby_schema;
+extern bool qop_orderby_desc;
+extern int qop_max_threads;
 
 extern bool idx_op_idx_unique;
 extern bool idx_op_ignore_stopwords;
@@ -103,9 +239,13 @@ extern int idx_op_batch_size;
 extern int idx_op_idx_type;
 extern std::string idx_op_idx_schema;
 extern std::string idx_op_text_delims;
+extern bool idx_op_incremental;
 
 // Transform op params
 extern int trans_op_format_type;
+extern int trans_op_compression_type;  // CompressionType
+extern int trans_op_arrow_batch_rows;
+extern uint64_t trans_op_chunk_bytes;
 
 // Example op params
 extern int expl_func_counter;
@@ -129,6 +269,8 @@ extern int skyhook_output_format;  // SkyFormatType enum
 // to convert strings <=> skyhook data structs
 extern Tables::schema_vec sky_tbl_schema;
 extern Tables::schema_vec sky_qry_schema;
+extern Tables::schema_vec sky_groupby_schema;
+extern Tables::schema_vec sky_orderby_schema;
 extern Tables::schema_vec sky_idx_schema;
 extern Tables::schema_vec sky_idx2_schema;
 extern Tables::predicate_vec sky_qry_preds;
@@ -142,29 +284,91 @@ extern std::atomic<unsigned> rows_returned;
 extern std::atomic<bool> print_header;
 extern std::atomic<long long int> row_counter;
 extern long long int row_limit;
+extern bool orderby_desc;
 
-// rename work_lock
-extern int outstanding_ios;
+// in-flight query ios, each completion dispatches its own replacement
+extern std::atomic<int> outstanding_ios;
 extern std::vector<std::string> target_objects;
-extern std::list<AioState*> ready_ios;
-
-extern std::mutex dispatch_lock;
-extern std::condition_variable dispatch_cond;
+extern MPMCQueue<AioState*> ready_ios;
+extern librados::IoCtx *query_ioctx;  // NULL disables worker dispatch
 
+// for the non-query workers popping target_objects
 extern std::mutex work_lock;
-extern std::condition_variable work_cond;
 
-extern bool stop;
+// write each worker's output in object dispatch order
+extern bool ordered_output;
+
+// how start_query_ios dispatches the target objects.  fifo keeps the qdepth
+// ios in flight in target_objects order.  adaptive and osd split the qdepth
+// into a window of ios in flight per group of objects, one group for all of
+// them with adaptive or one per primary osd with osd.  each window grows by
+// one per round trip of its group (AIMD) while its smoothed latency stays
+// within slow_factor of the lowest it has had, and is halved at most once
+// per round trip when it does not.  ios in flight for hedge_factor times the
+// smoothed latency of their group are hedged once by a read balanced to a
+// replica, failed ios are retried the same way, the first result is used.
+enum dispatch_mode_t {
+  DISPATCH_FIFO,
+  DISPATCH_ADAPTIVE,
+  DISPATCH_OSD,
+};
+extern int dispatch_mode;
+extern double hedge_factor;  // 0 disables hedging
+extern double slow_factor;   // latency over the lowest of its group
+
+// primary osd of each target object, set by lookup_target_osds
+extern std::map<std::string, int> target_osds;
+
+extern std::atomic<bool> stop;
+
+// a final aggregate merged by the client from the per-object partial aggs,
+// pos is the position of its partial in each result agg row.
+struct agg_output {
+  int op_type;
+  int col_type;
+  int pos;
+  int cnt_pos;  // avg only, position of the partial cnt
+};
+
+// aggs of the query in output order, empty if there are none
+extern std::vector<agg_output> agg_outputs;
+
+// each partial agg, in result agg row order
+extern std::vector<Tables::group_agg> agg_partials;
 
 // worker tasks for threads, corresponding to our cls methods
 void worker_build_index(librados::IoCtx *ioctx);
 void worker_exec_build_sky_index_op(librados::IoCtx *ioctx, idx_op op);
 void worker_exec_runstats_op(librados::IoCtx *ioctx, stats_op op);
 void worker_transform_db_op(librados::IoCtx *ioctx, transform_op op);
+void worker_compact_op(librados::IoCtx *ioctx, compact_op op);
 void worker_exec_query_op();  // default worker task for exec_query_op
 void handle_cb(librados::completion_t cb, void *arg);
+void start_query_ios(int qdepth);
+void wait_query_ios();
+void stop_query_workers();
+void flush_query_output();
+void plan_global_aggs(Tables::predicate_vec& preds);
+void plan_topk();
 void worker_lock_obj_init_op(librados::IoCtx *ioctx, lockobj_info op);
 void worker_lock_obj_free_op(librados::IoCtx *ioctx, lockobj_info op);
 void worker_lock_obj_get_op(librados::IoCtx *ioctx, lockobj_info op);
 void worker_lock_obj_acquire_op(librados::IoCtx *ioctx, lockobj_info op);
 void worker_lock_obj_create_op(librados::IoCtx *ioctx, lockobj_info op);
+
+// primary osd of each sampled object, or -1 if it cannot be looked up
+void lookup_sample_osds(librados::Rados& cluster, const std::string& pool,
+                        std::map<std::string, int>& osds);
+
+// primary osd of each of target_objects into target_osds
+void lookup_target_osds(librados::Rados& cluster, const std::string& pool);
+
+// one line per query io, and the latency percentiles and throughput of the
+// query overall and per osd as json
+void write_query_log(std::ostream& out,
+                     const std::map<std::string, int>& osds);
+void write_query_stats(std::ostream& out, double wall_s,
+                       const std::map<std::string, int>& osds);
+
+// dispatch mode name <=> dispatch_mode_t, -1 if unknown
+int dispatch_mode_from_string(const std::string& s);
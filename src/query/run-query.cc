@@ -25,8 +25,12 @@ int main(int argc, char **argv)
   int wthreads;
   bool build_index;
   bool transform_db;
+  bool compact;
+  uint32_t compact_fb_rows;
   std::string logfile;
+  std::string stats_file;
   int qdepth;
+  std::string dispatch_str;
   std::string direction;
   std::string conf;
 
@@ -36,11 +40,24 @@ int main(int argc, char **argv)
   bool index_read;
   bool index_create;
   bool mem_constrain;
+  uint64_t result_max_bytes;
+  std::string groupby_cols;
+  uint64_t groupby_max_bytes;
+  std::string orderby_col;
+  int stats_level;
   bool text_index_ignore_stopwords;
+  bool index_incremental;
   bool lock_op;
   int index_plan_type;
   int trans_format_type;
+  int trans_compression_type;
+  int trans_batch_rows;
+  uint64_t trans_chunk_bytes;
+  int result_compression;
+  int query_threads;
   std::string trans_format_str;
+  std::string trans_compression_str;
+  std::string result_compression_str;
   std::string text_index_delims;
   std::string db_schema_name;
   std::string table_name;
@@ -120,15 +137,21 @@ int main(int argc, char **argv)
     ("query", po::value<std::string>(&query)->default_value("flatbuf"), "query name")
     ("wthreads", po::value<int>(&wthreads)->default_value(1), "num threads")
     ("qdepth", po::value<int>(&qdepth)->default_value(1), "queue depth")
+    ("dispatch", po::value<std::string>(&dispatch_str)->default_value("fifo"), "Query io dispatch: fifo keeps qdepth ios in flight in object order, adaptive adjusts the ios in flight to their latency, osd does so per primary osd of the objects (placed by their pg, from one pg dump before the query) (def=fifo)")
+    ("hedge-factor", po::value<double>(&hedge_factor)->default_value(3.0), "With adaptive or osd dispatch, resend an io to any replica after this many times its smoothed latency, 0 to never hedge (def=3.0)")
+    ("slow-factor", po::value<double>(&slow_factor)->default_value(2.0), "With adaptive or osd dispatch, halve the ios in flight when the smoothed latency is this many times its lowest (def=2.0)")
     ("build-index", po::bool_switch(&build_index)->default_value(false), "build index")
     ("use-index", po::bool_switch(&use_index)->default_value(false), "use index")
     ("old-projection", po::bool_switch(&old_projection)->default_value(false), "use older projection method")
     ("index-batch-size", po::value<uint32_t>(&index_batch_size)->default_value(1000), "index (read/write) batch size")
     ("extra-row-cost", po::value<uint64_t>(&extra_row_cost)->default_value(0), "extra row cost")
-    ("log-file", po::value<std::string>(&logfile)->default_value(""), "log file")
+    ("log-file", po::value<std::string>(&logfile)->default_value(""), "log file, one csv line of latency and cls info per query io")
+    ("stats-file", po::value<std::string>(&stats_file)->default_value(""), "json file of the latency percentiles, cls stage times and counters, and throughput of the query overall and per osd (osds of the objects are placed by their pg, from one pg dump after the query)")
     ("direction", po::value<std::string>(&direction)->default_value("fwd"), "direction for cache warmup testing. choose one of: fwd, bwd, rnd")
     ("conf", po::value<std::string>(&conf)->default_value(""), "path to ceph.conf")
     ("transform-db", po::bool_switch(&transform_db)->default_value(false), "transform DB")
+    ("compact", po::bool_switch(&compact)->default_value(false), "Compact each object into fewer fbmetas without its deleted rows, in the transform-format-type, and rebuild its indexes and stats (with index-create, also rebuild that index)")
+    ("compact-fb-rows", po::value<uint32_t>(&compact_fb_rows)->default_value(100000), "Target num rows per fbmeta of compacted objects (def=100000)")
     // query parameters (old)
     ("extended-price", po::value<double>(&extended_price)->default_value(0.0), "extended price")
     ("order-key", po::value<int>(&order_key)->default_value(0.0), "order key")
@@ -147,20 +170,33 @@ int main(int argc, char **argv)
     ("index-create", po::bool_switch(&index_create)->default_value(false), create_index_help_msg.c_str())
     ("index-read", po::bool_switch(&index_read)->default_value(false), "Use the index for query")
     ("mem-constrain", po::bool_switch(&mem_constrain)->default_value(false), "Read/process data structs one at a time within object")
+    ("result-max-bytes", po::value<uint64_t>(&result_max_bytes)->default_value(0), "Max result size per object read, larger results are read in several calls (def=0, no max)")
     ("index-cols", po::value<std::string>(&index_cols)->default_value(""), project_help_msg.c_str())
     ("index2-cols", po::value<std::string>(&index2_cols)->default_value(""), project_help_msg.c_str())
     ("project", po::value<std::string>(&project_cols)->default_value(Tables::PROJECT_DEFAULT), project_help_msg.c_str())
+    ("groupby", po::value<std::string>(&groupby_cols)->default_value(""), "Group the agg preds by these cols, e.g., \"att0,att1\" (def=none)")
+    ("groupby-max-bytes", po::value<uint64_t>(&groupby_max_bytes)->default_value(0), "Memory budget for the groups per object read, larger group sets are read in several calls (def=0, cls default)")
     ("index-preds", po::value<std::string>(&index_preds)->default_value(""), select_help_msg.c_str())
     ("index2-preds", po::value<std::string>(&index2_preds)->default_value(""), select_help_msg.c_str())
     ("select", po::value<std::string>(&query_preds)->default_value(Tables::SELECT_DEFAULT), select_help_msg.c_str())
     ("index-delims", po::value<std::string>(&text_index_delims)->default_value(""), "Use delim for text indexes (def=whitespace")
     ("index-ignore-stopwords", po::bool_switch(&text_index_ignore_stopwords)->default_value(false), "Ignore stopwords when building text index. (def=false)")
+    ("index-incremental", po::bool_switch(&index_incremental)->default_value(false), "Only index the data appended to each object since its index was last built. (def=false)")
     ("index-plan-type", po::value<int>(&index_plan_type)->default_value(Tables::SIP_IDX_STANDARD), "If 2 indexes, for intersection plan use '2', for union plan use '3' (def='1')")
     ("runstats", po::bool_switch(&runstats)->default_value(false), "Run statistics on the specified table name")
+    ("stats-level", po::value<int>(&stats_level)->default_value(Tables::MED), "Sampling density of runstats, 1=LOW (1 in 100 rows), 2=MED (1 in 10), 3=HIGH (all rows) (def=2)")
     ("transform-format-type", po::value<std::string>(&trans_format_str)->default_value("SFT_FLATBUF_FLEX_ROW"), "Destination format type ")
+    ("transform-compression", po::value<std::string>(&trans_compression_str)->default_value("none"), "Compress the transformed blobs: none, lz4 or zstd (def=none)")
+    ("transform-batch-rows", po::value<int>(&trans_batch_rows)->default_value(0), "Max rows per record batch of transformed arrow blobs, 0 for one batch per blob, -1 to size batches to fit in L2 cache (def=0)")
+    ("transform-chunk-bytes", po::value<uint64_t>(&trans_chunk_bytes)->default_value(0), "Max bytes of an object transformed per call, the transform of each object can be resumed after the last chunk (def=0, cls default)")
+    ("query-threads", po::value<int>(&query_threads)->default_value(1), "Max threads per object to process its fbmetas concurrently in cls, 1 for serial (def=1)")
+    ("result-compression", po::value<std::string>(&result_compression_str)->default_value("none"), "Compress the query result blobs returned by cls: none, lz4 or zstd (def=none)")
     ("verbose", po::bool_switch(&print_verbose)->default_value(false), "Print detailed record metadata.")
     ("header", po::bool_switch(&header)->default_value(false), "Print row header (i.e., row schema")
+    ("ordered-output", po::bool_switch(&ordered_output)->default_value(false), "Print results in object dispatch order rather than as workers finish them")
     ("limit", po::value<long long int>(&row_limit)->default_value(Tables::ROW_LIMIT_DEFAULT), "SQL limit option, limit num_rows of result set")
+    ("order-by", po::value<std::string>(&orderby_col)->default_value(""), "Return the top --limit rows ordered by this projected col, e.g., \"att0\" (def=none)")
+    ("order-desc", po::bool_switch(&orderby_desc)->default_value(false), "Order by the --order-by col descending (def=ascending)")
     ("example-counter", po::value<int>(&example_counter)->default_value(100), "Loop counter for example function")
     ("example-function-id", po::value<int>(&example_function_id)->default_value(1), "CLS function identifier for example function")
     ("oid-prefix", po::value<std::string>(&oid_prefix)->default_value("obj"), "Prefix to enumerated object ids (names) (def=obj)")
@@ -190,6 +226,16 @@ int main(int argc, char **argv)
   assert(wthreads > 0);
   assert(qdepth > 0);
 
+  dispatch_mode = dispatch_mode_from_string(dispatch_str);
+  if (dispatch_mode < 0) {
+    cerr << "dispatch must be one of fifo, adaptive or osd" << std::endl;
+    exit(1);
+  }
+  if (hedge_factor < 0 or slow_factor <= 1) {
+    cerr << "hedge-factor must be >= 0 and slow-factor > 1" << std::endl;
+    exit(1);
+  }
+
   // connect to rados
   librados::Rados cluster;
   cluster.init(NULL);
@@ -326,11 +372,15 @@ int main(int argc, char **argv)
     boost::trim(index_cols);
     boost::trim(index2_cols);
     boost::trim(project_cols);
+    boost::trim(groupby_cols);
+    boost::trim(orderby_col);
     boost::trim(query_preds);
     boost::trim(index_preds);
     boost::trim(index2_preds);
     boost::trim(text_index_delims);
     boost::trim(trans_format_str);
+    boost::trim(trans_compression_str);
+    boost::trim(result_compression_str);
     boost::trim(client_format_str);
 
     // standardize naming as uppercase
@@ -339,6 +389,8 @@ int main(int argc, char **argv)
     boost::to_upper(index_cols);
     boost::to_upper(index2_cols);
     boost::to_upper(project_cols);
+    boost::to_upper(groupby_cols);
+    boost::to_upper(orderby_col);
     boost::to_upper(trans_format_str);
     boost::to_upper(client_format_str);
 
@@ -352,8 +404,13 @@ int main(int argc, char **argv)
         assert (!index_cols.empty());
         assert (use_cls);
     }
+    if (compact) {
+        assert (use_cls);
+        assert (compact_fb_rows > 0);
+    }
     if (runstats) {
         assert (use_cls);
+        assert (stats_level >= Tables::LOW and stats_level <= Tables::HIGH);
     }
 
     // set and validate the desired format types
@@ -368,6 +425,22 @@ int main(int argc, char **argv)
             assert(Tables::TablesErrCodes::EINVALID_TRANSFORM_FORMAT);
     }
 
+    // set and validate the blob compression of transformed data and results
+    trans_compression_type = compression_type_from_string(trans_compression_str);
+    result_compression = compression_type_from_string(result_compression_str);
+    if (trans_compression_type < 0 or result_compression < 0) {
+        cerr << "Compression must be one of none, lz4 or zstd" << std::endl;
+        assert (Tables::TablesErrCodes::BlobCompressionTypeNotRecognized == 0);
+    }
+    if (trans_batch_rows < -1) {
+        cerr << "transform-batch-rows must be >= -1" << std::endl;
+        exit(1);
+    }
+    if (query_threads < 1) {
+        cerr << "query-threads must be >= 1" << std::endl;
+        exit(1);
+    }
+
     // verify client specified output format is valid
     skyhook_output_format = sky_format_type_from_string(client_format_str);
     switch (skyhook_output_format) {
@@ -395,6 +468,19 @@ int main(int argc, char **argv)
     // verify and set the query predicates
     sky_qry_preds = predsFromString(sky_tbl_schema, query_preds);
 
+    // verify and set the group by cols, these group the agg preds
+    if (!groupby_cols.empty()) {
+        sky_groupby_schema = schemaFromColNames(sky_tbl_schema, groupby_cols);
+        if (!hasAggPreds(sky_qry_preds)) {
+            cerr << "Group by cols require at least one agg predicate, "
+                 << "e.g., --select \"att1,sum,0;\"" << std::endl;
+            assert (GroupByRequiresAggPreds == 0);
+        }
+    }
+
+    // push down partial aggs, the client merges them into the final aggs
+    plan_global_aggs(sky_qry_preds);
+
     if (debug) {
         std::cout << "DEBUG: run-query: query predicates:\n";
         for (auto p:sky_qry_preds)
@@ -420,6 +506,13 @@ int main(int argc, char **argv)
         }
     } else {
         if (hasAggPreds(sky_qry_preds)) {
+            // group rows hold the group keys, then the aggs
+            for (auto it = sky_groupby_schema.begin();
+                 it != sky_groupby_schema.end(); ++it) {
+                const struct col_info ci(it->idx, it->type, it->is_key,
+                                         false, it->name);
+                sky_qry_schema.push_back(ci);
+            }
             for (auto it = sky_qry_preds.begin();
                  it != sky_qry_preds.end(); ++it) {
                 PredicateBase* p = *it;
@@ -441,6 +534,37 @@ int main(int argc, char **argv)
         }
     }
 
+    // verify and set the order by col, the top --limit rows of each object
+    // are selected in cls and merged by the client.
+    if (!orderby_col.empty()) {
+        sky_orderby_schema = schemaFromColNames(sky_tbl_schema, orderby_col);
+        if (sky_orderby_schema.size() != 1 or
+            row_limit == ROW_LIMIT_DEFAULT or
+            hasAggPreds(sky_qry_preds)) {
+            cerr << "Order by requires a single col with a --limit, "
+                 << "and no agg predicates" << std::endl;
+            assert (OrderByRequiresLimit == 0);
+        }
+        bool projected = false;
+        for (auto it = sky_qry_schema.begin(); it != sky_qry_schema.end(); ++it) {
+            if (it->name == sky_orderby_schema[0].name)
+                projected = true;
+        }
+        if (!projected) {
+            cerr << "Order by col must be among the projected cols" << std::endl;
+            assert (OrderByColNotProjected == 0);
+        }
+    }
+    plan_topk();
+
+    // a limit is pushed down unless the rows are aggs, which cannot stop
+    // early, and the limited rows must be processed rather than passed thru.
+    uint64_t pushed_row_limit = 0;
+    if (row_limit != ROW_LIMIT_DEFAULT and !hasAggPreds(sky_qry_preds)) {
+        pushed_row_limit = row_limit;
+        fastpath = false;
+    }
+
     // set the index type
     if (!index_cols.empty()) {
         if (index_cols == RID_INDEX) { // const value for colname=RID
@@ -489,9 +613,14 @@ int main(int argc, char **argv)
                 case SOT_leq:
                 case SOT_geq:
                     break;  // all ok, supported index ops
+                case SOT_like:
+                    if (index_type == SIT_IDX_TXT)
+                        break;  // words of a text index, see textPredTerms
+                    // fall through
                 default:
                     cerr << "Only >, <, =, <=, >= predicates currently "
-                         << "supported for Skyhook indexes" << std::endl;
+                         << "supported for Skyhook indexes, "
+                         << "and like for text indexes" << std::endl;
                     assert (SkyIndexUnsupportedOpType == 0);
             }
             // verify index pred cols are all in the index schema
@@ -515,9 +644,14 @@ int main(int argc, char **argv)
                 case SOT_leq:
                 case SOT_geq:
                     break;  // all ok, supported index ops
+                case SOT_like:
+                    if (index2_type == SIT_IDX_TXT)
+                        break;  // words of a text index, see textPredTerms
+                    // fall through
                 default:
                     cerr << "Only >, <, =, <=, >= predicates currently "
-                         << "supported for Skyhook indexes" << std::endl;
+                         << "supported for Skyhook indexes, "
+                         << "and like for text indexes" << std::endl;
                     assert (SkyIndexUnsupportedOpType == 0);
             }
             // verify index pred cols are all in the index schema
@@ -583,6 +717,14 @@ int main(int argc, char **argv)
     qop_fastpath = fastpath;
     qop_index_read = index_read;
     qop_mem_constrain = mem_constrain;
+    qop_result_max_bytes = result_max_bytes;
+    qop_groupby_schema = schemaToString(sky_groupby_schema);
+    qop_groupby_max_bytes = groupby_max_bytes;
+    qop_row_limit = pushed_row_limit;
+    qop_orderby_schema = schemaToString(sky_orderby_schema);
+    qop_orderby_desc = orderby_desc;
+    qop_result_compression = result_compression;
+    qop_max_threads = query_threads;
     qop_index_type = index_type;
     qop_index2_type = index2_type;
     qop_index_plan_type = index_plan_type;
@@ -603,7 +745,11 @@ int main(int argc, char **argv)
     idx_op_idx_schema = schemaToString(sky_idx_schema);
     idx_op_ignore_stopwords = text_index_ignore_stopwords;
     idx_op_text_delims = text_index_delims;
+    idx_op_incremental = index_incremental;
     trans_op_format_type = trans_format_type;
+    trans_op_compression_type = trans_compression_type;
+    trans_op_arrow_batch_rows = trans_batch_rows;
+    trans_op_chunk_bytes = trans_chunk_bytes;
 
     if (debug) {
         if (query == "flatbuf" || query == "fastpath") {
@@ -620,6 +766,12 @@ int main(int argc, char **argv)
             cout << "DEBUG: run-query: qop_index_schema=\n" << qop_index_schema << endl;
             cout << "DEBUG: run-query: qop_index2_schema=\n" << qop_index2_schema << endl;
             cout << "DEBUG: run-query: qop_query_preds=" << qop_query_preds << endl;
+            cout << "DEBUG: run-query: qop_groupby_schema=\n" << qop_groupby_schema << endl;
+            cout << "DEBUG: run-query: qop_row_limit=" << qop_row_limit << endl;
+            cout << "DEBUG: run-query: qop_orderby_schema=\n" << qop_orderby_schema << endl;
+            cout << "DEBUG: run-query: qop_orderby_desc=" << qop_orderby_desc << endl;
+            cout << "DEBUG: run-query: qop_result_compression=" << qop_result_compression << endl;
+            cout << "DEBUG: run-query: qop_max_threads=" << qop_max_threads << endl;
             cout << "DEBUG: run-query: qop_index_preds=" << qop_index_preds << endl;
             cout << "DEBUG: run-query: qop_index2_preds=" << qop_index2_preds << endl;
             cout << "DEBUG: run-query: qop_result_format=" << qop_result_format << endl;
@@ -631,6 +783,7 @@ int main(int argc, char **argv)
             cout << "DEBUG: run-query: idx_op_idx_schema=" << idx_op_idx_schema << endl;
             cout << "DEBUG: run-query: idx_op_ignore_stopwords=" << idx_op_ignore_stopwords << endl;
             cout << "DEBUG: run-query: idx_op_text_delims=" << idx_op_text_delims << endl;
+            cout << "DEBUG: run-query: idx_op_incremental=" << idx_op_incremental << endl;
         }
     }
 
@@ -695,6 +848,46 @@ int main(int argc, char **argv)
     exit(1);
   }  // end verify query params*/
 
+  // for COMPACT job
+  // launch compaction of each object here, also rebuilding the index of
+  // index-create if given.
+  if (query == "flatbuf" && compact) {
+
+    // create compact_op for workers
+    compact_op op;
+    op.required_type = trans_op_format_type;
+    op.fb_rows = compact_fb_rows;
+    op.compression_type = trans_op_compression_type;
+    op.arrow_batch_rows = trans_op_arrow_batch_rows;
+    op.idx_batch_size = index_batch_size;
+    if (index_create) {
+        op.idx_ops.push_back(idx_op(idx_op_idx_unique,
+                                    idx_op_ignore_stopwords,
+                                    idx_op_batch_size,
+                                    idx_op_idx_type,
+                                    idx_op_idx_schema,
+                                    idx_op_text_delims));
+    }
+
+    if (debug)
+        cout << "DEBUG: compact op=" << op.toString() << endl;
+
+    // kick off the workers
+    std::vector<std::thread> threads;
+    for (int i = 0; i < wthreads; i++) {
+      auto ioctx = new librados::IoCtx;
+      int ret = cluster.ioctx_create(pool.c_str(), *ioctx);
+      checkret(ret, 0);
+      threads.push_back(std::thread(worker_compact_op, ioctx, op));
+    }
+
+    for (auto& thread : threads) {
+      thread.join();
+    }
+
+    return 0;
+  }
+
   // for INDEX CREATE job
   // launch index creation on given table and cols here.
   if (query == "flatbuf" && index_create) {
@@ -705,7 +898,8 @@ int main(int argc, char **argv)
               idx_op_batch_size,
               idx_op_idx_type,
               idx_op_idx_schema,
-              idx_op_text_delims);
+              idx_op_text_delims,
+              idx_op_incremental);
 
     // kick off the workers
     std::vector<std::thread> threads;
@@ -728,7 +922,8 @@ int main(int argc, char **argv)
   if (query == "flatbuf" && runstats) {
 
     // create idx_op for workers
-    stats_op op(qop_db_schema_name, qop_table_name, qop_data_schema);
+    stats_op op(qop_db_schema_name, qop_table_name, qop_data_schema,
+                stats_level);
 
     if (debug)
         cout << "DEBUG: stats op=" << op.toString() << endl;
@@ -754,7 +949,9 @@ int main(int argc, char **argv)
   if (query == "flatbuf" && transform_db) {
 
     // create idx_op for workers
-    transform_op op(qop_table_name, qop_query_schema, trans_op_format_type);
+    transform_op op(qop_table_name, qop_query_schema, trans_op_format_type,
+                    trans_op_compression_type, trans_op_arrow_batch_rows,
+                    0, trans_op_chunk_bytes);
 
     if (debug)
         cout << "DEBUG: transform op=" << op.toString() << endl;
@@ -835,6 +1032,11 @@ int main(int argc, char **argv)
   rows_returned = 0;
   outstanding_ios = 0;
   stop = false;
+  query_ioctx = &ioctx;
+  collect_stats = !logfile.empty() or !stats_file.empty();
+  if (dispatch_mode == DISPATCH_OSD)
+    lookup_target_osds(cluster, pool);
+  uint64_t query_start = getns();
 
   // start worker threads
   std::vector<std::thread> threads;
@@ -842,206 +1044,44 @@ int main(int argc, char **argv)
     threads.push_back(std::thread(worker_exec_query_op));
   }
 
-  // create the oid list, for dispatching workers
-  std::unique_lock<std::mutex> lock(dispatch_lock);
-  while (true) {
-    while (outstanding_ios < qdepth) {
-      // get an object to process
-      if (target_objects.empty())
-        break;
-      std::string oid = target_objects.back();
-      target_objects.pop_back();
-      lock.unlock();
-
-      // dispatch an io request
-      AioState *s = new AioState;
-      s->c = librados::Rados::aio_create_completion(
-          s, NULL, handle_cb);
-
-      // keeps track of the worker latency
-      memset(&s->times, 0, sizeof(s->times));
-      s->times.dispatch = getns();
-
-      // set the now validated query op params into the op struct, and
-      // encode the op into the inbound bl for the specified oid.
-      if (query == "flatbuf" ) {
-        if (use_cls) {
-        query_op op;
-        op.debug = debug;
-        op.query = query;
-        op.fastpath = qop_fastpath;
-        op.index_read = qop_index_read;
-        op.mem_constrain = qop_mem_constrain;
-        op.index_type = qop_index_type;
-        op.index2_type = qop_index2_type;
-        op.index_plan_type = qop_index_plan_type;
-        op.index_batch_size = qop_index_batch_size;
-        op.result_format = qop_result_format;
-        op.db_schema_name = qop_db_schema_name;
-        op.table_name = qop_table_name;
-        op.data_schema = qop_data_schema;
-        op.query_schema = qop_query_schema;
-        op.index_schema = qop_index_schema;
-        op.index2_schema = qop_index2_schema;
-        op.query_preds = qop_query_preds;
-        op.index_preds = qop_index_preds;
-        op.index2_preds = qop_index2_preds;
-        ceph::bufferlist inbl;
-        using ceph::encode;
-        encode(op, inbl);
-
-        if (debug)
-            cout << "DEBUG: run-query: launching aio_exec for oid=" << oid << endl;
-
-        // Launch CEPH CLS Read
-        int ret = ioctx.aio_exec(oid, s->c, "tabular", "exec_query_op", inbl, &s->bl);
-        checkret(ret, 0);
-
-      } else {
-
-        if (debug)
-            cout << "DEBUG: run-query: launching aio_read for oid=" << oid << endl;
-
-        // Launch CEPH STANDARD Read
-        int ret = ioctx.aio_read(oid, s->c, &s->bl, 0, 0);
-        checkret(ret, 0);
-      }
-    }
-
-    // OLDER TEST QUERIES
-    // handle older fixed queries
-    if (query == "a" or
-        query == "b" or
-        query == "c" or
-        query == "d" or
-        query == "e" or
-        query == "f" or
-        query == "g") {
-
-        if (use_cls) {
-            test_op op;
-            op.query = query;
-            op.fastpath = qop_fastpath;
-            op.extended_price = extended_price;
-            op.order_key = order_key;
-            op.line_number = line_number;
-            op.ship_date_low = ship_date_low;
-            op.ship_date_high = ship_date_high;
-            op.discount_low = discount_low;
-            op.discount_high = discount_high;
-            op.quantity = quantity;
-            op.comment_regex = comment_regex;
-            op.use_index = use_index;
-            op.old_projection = old_projection;
-            op.extra_row_cost = extra_row_cost;
-            op.fastpath = fastpath;
-
-            ceph::bufferlist inbl;
-            using ceph::encode;
-            encode(op, inbl);
-            int ret = ioctx.aio_exec(oid, s->c,
-                "tabular", "test_query_op", inbl, &s->bl);
-            checkret(ret, 0);
-        }
-        else {
-            int ret = ioctx.aio_read(oid, s->c, &s->bl, 0, 0);
-            checkret(ret, 0);
-        }
-    }
-
-    // simple example query op for developers to extend with their own
-    // customized method
-    if (query == "example") {
-
-        if (use_cls) {  // execute a cls read method
-
-            // setup and encode our op params here.
-            inbl_sample_op op;
-            op.message = "This is an example op";
-            op.instructions = "Example instructions";
-            op.counter = example_counter;
-            op.func_id = example_function_id;
-            ceph::bufferlist inbl;
-            using ceph::encode;
-            encode(op, inbl);
-
-            // execute our example method on the object, passing in our op.
-            int ret = ioctx.aio_exec(oid, s->c, "tabular",
-                                    "example_query_op", inbl, &s->bl);
-            checkret(ret, 0);
-        }
-        else {  // execute standard read
-            // read entire object by specifying off=0 len=0.
-            int ret = ioctx.aio_read(oid, s->c, &s->bl, 0, 0);
-            checkret(ret, 0);
-        }
-      }
-
-    // method for executing query processing using pre-compiled binary wasm
-    // code on the OSDs
-    if (query == "wasm") {
-
-        if (use_cls) {  // execute a cls read method
-
-            // setup and encode our op params here.
-            wasm_inbl_sample_op op;
-            op.message = "This is an wasm op";
-            op.instructions = "Wasm instructions";
-            op.counter = example_counter;
-            op.func_id = example_function_id;
-            ceph::bufferlist inbl;
-            using ceph::encode;
-            encode(op, inbl);
-
-            // execute our example method on the object, passing in our op.
-            int ret = ioctx.aio_exec(oid, s->c, "tabular",
-                                     "wasm_query_op", inbl, &s->bl);
-            checkret(ret, 0);
-        }
-        else {  // execute standard read
-            // read entire object by specifying off=0 len=0.
-            int ret = ioctx.aio_read(oid, s->c, &s->bl, 0, 0);
-            checkret(ret, 0);
-        }
-    }
-
-      lock.lock();
-      outstanding_ios++;
-    }
-    if (target_objects.empty())
-      break;
-    dispatch_cond.wait(lock);
-  }
-  lock.unlock();
-
-  // drain any still-in-flight operations
-  while (true) {
-    lock.lock();
-    if (outstanding_ios == 0) {
-      lock.unlock();
-      break;
-    }
-    lock.unlock();
-
-    // only report status messages during quiet operation
-    // since otherwise we are printing as csv data to std out
-    if (quiet)
-        std::cout << "draining ios: " << outstanding_ios << " remaining\n";
-    sleep(1);
-  }
+  // dispatch the first qdepth ios, after which each completion taken by a
+  // worker dispatches the next one.
+  start_query_ios(qdepth);
+  wait_query_ios();
 
   // wait for all the workers to stop
-  work_lock.lock();
-  stop = true;
-  work_lock.unlock();
-  work_cond.notify_all();
+  stop_query_workers();
 
   // the threads will exit when all the objects are processed
   for (auto& thread : threads) {
     thread.join();
   }
+  flush_query_output();
+  double query_s = (getns() - query_start) / 1e9;
   ioctx.close();
 
+  if (collect_stats) {
+    std::map<std::string, int> osds = target_osds;
+    if (!stats_file.empty())
+      lookup_sample_osds(cluster, pool, osds);
+    if (!logfile.empty()) {
+      std::ofstream out(logfile);
+      if (!out) {
+        cerr << "cannot open log-file " << logfile << std::endl;
+        exit(1);
+      }
+      write_query_log(out, osds);
+    }
+    if (!stats_file.empty()) {
+      std::ofstream out(stats_file);
+      if (!out) {
+        cerr << "cannot open stats-file " << stats_file << std::endl;
+        exit(1);
+      }
+      write_query_stats(out, query_s, osds);
+    }
+  }
+
   // all workers are done, now we check if we need to add any trailers to
   // binary output such as postgres or pyarrow raw binary data being returned
   // to those corresponding clients.
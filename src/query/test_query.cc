@@ -1,4 +1,7 @@
 #include <iostream>
+#include <functional>
+#include <map>
+#include <set>
 #include <errno.h>
 
 #include "query.h"
@@ -149,7 +152,7 @@ class SkyhookQuery : public ::testing::Test {
           ASSERT_GE(s->c->get_return_value(), 0);
           s->c->release();
         }
-        ready_ios.push_back(s);
+        ready_ios.push(s);
       }
 
       // process data
@@ -165,6 +168,243 @@ Rados SkyhookQuery::rados;
 IoCtx SkyhookQuery::ioctx;
 std::string SkyhookQuery::pool_name;
 
+// a small flatbuf table of int cols ID and the nullable VAL, for the tests
+// of the cls methods that write fbmetas.
+const std::string TEST_DB = "testdb";
+const std::string TEST_TABLE = "testtbl";
+const std::string TEST_SCHEMA = " \
+    0 " + std::to_string(Tables::SDT_INT32) + " 1 0 ID \n\
+    1 " + std::to_string(Tables::SDT_INT32) + " 0 1 VAL \n\
+    ";
+
+// append the wrapped fbmeta of a flatbuf of rows with IDs first_id,
+// first_id+1, .. to wrapped_bl, or of the same rows as arrow.  VAL is ID*10,
+// or null for the IDs null_ids, stored as 0 as by the writer.  The rows of
+// the IDs dead_ids are marked deleted.
+static void build_test_fbmeta(int first_id, int nrows, bufferlist& wrapped_bl,
+                              int format=Tables::SFT_FLATBUF_FLEX_ROW,
+                              const std::set<int>& null_ids={},
+                              const std::set<int>& dead_ids={})
+{
+  flatbuffers::FlatBufferBuilder fbb(1024);
+  std::vector<flatbuffers::Offset<Tables::Record>> offs;
+  Tables::delete_vector dead_rows;
+  flexbuffers::Builder flx;
+  for (int i = 0; i < nrows; i++) {
+    Tables::nullbits_vector nb(2, 0);
+    int32_t val = (first_id + i) * 10;
+    if (null_ids.count(first_id + i)) {
+      Tables::setNullBit(nb, 1);
+      val = 0;
+    }
+    flx.Clear();
+    flx.Vector([&]() {
+      flx.Add(static_cast<int32_t>(first_id + i));
+      flx.Add(val);
+    });
+    flx.Finish();
+    auto row_data = fbb.CreateVector(flx.GetBuffer());
+    auto nullbits = fbb.CreateVector(nb);
+    offs.push_back(Tables::CreateRecord(fbb, first_id + i, nullbits, row_data));
+    dead_rows.push_back(dead_ids.count(first_id + i) ? 1 : 0);
+  }
+  auto table = Tables::CreateTable(
+      fbb,
+      Tables::SFT_FLATBUF_FLEX_ROW,
+      2,
+      1,
+      1,
+      fbb.CreateString(TEST_SCHEMA),
+      fbb.CreateString(TEST_DB),
+      fbb.CreateString(TEST_TABLE),
+      fbb.CreateVector(dead_rows),
+      fbb.CreateVector(offs),
+      offs.size());
+  fbb.Finish(table);
+
+  bufferlist meta_bl;
+  if (format == Tables::SFT_ARROW) {
+    Tables::schema_vec schema = Tables::schemaFromString(TEST_SCHEMA);
+    std::shared_ptr<arrow::Table> arrow_table;
+    std::string errmsg;
+    ASSERT_EQ(0, Tables::transform_fb_to_arrow(
+                     reinterpret_cast<const char*>(fbb.GetBufferPointer()),
+                     fbb.GetSize(), schema, errmsg, &arrow_table));
+    ASSERT_EQ(0, Tables::convert_arrow_to_fbmeta(arrow_table, meta_bl));
+  }
+  else {
+    flatbuffers::FlatBufferBuilder meta_builder(1024);
+    Tables::createFbMeta(&meta_builder, Tables::SFT_FLATBUF_FLEX_ROW,
+                         fbb.GetBufferPointer(), fbb.GetSize());
+    meta_bl.append(
+        reinterpret_cast<const char*>(meta_builder.GetBufferPointer()),
+        meta_builder.GetSize());
+  }
+  using ceph::encode;
+  encode(meta_bl, wrapped_bl);
+}
+
+// the test table with a string col NAME in place of VAL, which may be
+// dictionary encoded
+const std::string TEST_DICT_SCHEMA = " \
+    0 " + std::to_string(Tables::SDT_INT32) + " 1 0 ID \n\
+    1 " + std::to_string(Tables::SDT_STRING) + " 0 0 NAME \n\
+    ";
+
+// append the wrapped fbmeta of a flatbuf of rows with IDs first_id,
+// first_id+1, .. and the NAMEs names to wrapped_bl.  If encoded, NAME holds
+// the codes of its dictionary, assigned in first seen order as by the writer.
+static void build_test_dict_fbmeta(int first_id,
+                                   const std::vector<std::string>& names,
+                                   bool encoded, bufferlist& wrapped_bl)
+{
+  flatbuffers::FlatBufferBuilder fbb(1024);
+  std::vector<flatbuffers::Offset<Tables::Record>> offs;
+  Tables::delete_vector dead_rows;
+  Tables::DictEncoder dicts(encoded ? std::vector<int>{1} : std::vector<int>{});
+  flexbuffers::Builder flx;
+  for (int i = 0; i < (int) names.size(); i++) {
+    Tables::nullbits_vector nb(2, 0);
+    flx.Clear();
+    flx.Vector([&]() {
+      flx.Add(static_cast<int32_t>(first_id + i));
+      if (dicts.encodes(1))
+        flx.UInt(dicts.code(1, names[i].c_str(), names[i].size()));
+      else
+        flx.String(names[i]);
+    });
+    flx.Finish();
+    auto row_data = fbb.CreateVector(flx.GetBuffer());
+    auto nullbits = fbb.CreateVector(nb);
+    offs.push_back(Tables::CreateRecord(fbb, first_id + i, nullbits, row_data));
+    dead_rows.push_back(0);
+  }
+  auto table = Tables::CreateTable(
+      fbb,
+      Tables::SFT_FLATBUF_FLEX_ROW,
+      2,
+      1,
+      1,
+      fbb.CreateString(TEST_DICT_SCHEMA),
+      fbb.CreateString(TEST_DB),
+      fbb.CreateString(TEST_TABLE),
+      fbb.CreateVector(dead_rows),
+      fbb.CreateVector(offs),
+      offs.size(),
+      dicts.finish(fbb));
+  fbb.Finish(table);
+
+  flatbuffers::FlatBufferBuilder meta_builder(1024);
+  Tables::createFbMeta(&meta_builder, Tables::SFT_FLATBUF_FLEX_ROW,
+                       fbb.GetBufferPointer(), fbb.GetSize());
+  bufferlist meta_bl;
+  meta_bl.append(reinterpret_cast<const char*>(meta_builder.GetBufferPointer()),
+                 meta_builder.GetSize());
+  using ceph::encode;
+  encode(meta_bl, wrapped_bl);
+}
+
+// a query_op of all cols of the test table, with no index, cap or limit
+static query_op build_test_query_op(const std::string& query_preds)
+{
+  Tables::schema_vec schema = Tables::schemaFromString(TEST_SCHEMA);
+  query_op op;
+  op.debug = false;
+  op.query = "flatbuf";
+  op.fastpath = false;
+  op.index_read = false;
+  op.mem_constrain = false;
+  op.index_type = Tables::SIT_IDX_FB;
+  op.index2_type = Tables::SIT_IDX_FB;
+  op.index_plan_type = Tables::SIP_IDX_STANDARD;
+  op.index_batch_size = 1000;
+  op.result_format = Tables::SFT_FLATBUF_FLEX_ROW;
+  op.db_schema_name = TEST_DB;
+  op.table_name = TEST_TABLE;
+  op.data_schema = Tables::schemaToString(schema);
+  op.query_schema = op.data_schema;
+  op.index_schema = "";
+  op.index2_schema = "";
+  op.query_preds = query_preds;
+  op.index_preds = "";
+  op.index2_preds = "";
+  op.resume_seq_num = Tables::DATASTRUCT_SEQ_NUM_MIN;
+  op.result_max_bytes = 0;
+  op.groupby_schema = "";
+  op.groupby_max_bytes = 0;
+  op.row_limit = 0;
+  op.orderby_schema = "";
+  op.orderby_desc = false;
+  op.result_compression = none;
+  op.max_threads = 1;
+  return op;
+}
+
+// run exec_query_op on oid, returning its cls_info and result
+static int exec_test_query_op(IoCtx& ioctx, const std::string& oid,
+                              const query_op& op, cls_info& info,
+                              bufferlist& result_bl)
+{
+  bufferlist inbl, outbl;
+  using ceph::encode;
+  encode(op, inbl);
+  int ret = ioctx.exec(oid, "tabular", "exec_query_op", inbl, outbl);
+  if (ret < 0)
+    return ret;
+  bufferlist::const_iterator it = outbl.begin();
+  using ceph::decode;
+  decode(info, it);
+  decode(result_bl, it);
+  return 0;
+}
+
+typedef std::function<void(const Tables::sky_root& root,
+                           const Tables::sky_rec& rec)> test_row_fn;
+
+// run exec_query_op on oid capped at one fbmeta per call, each call resuming
+// where the prior one stopped, and call row_fn on every row of the results
+static void exec_test_query_rows(IoCtx& ioctx, const std::string& oid,
+                                 query_op op, const test_row_fn& row_fn)
+{
+  op.result_max_bytes = 1;
+  int next_seq_num = -1;
+  do {
+    cls_info info;
+    bufferlist result_bl;
+    ASSERT_EQ(0, exec_test_query_op(ioctx, oid, op, info, result_bl));
+    if (result_bl.length() > 0) {
+      Tables::sky_meta meta = Tables::getSkyMeta(&result_bl);
+      Tables::sky_root root = Tables::getSkyRoot(meta.blob_data,
+                                                 meta.blob_size,
+                                                 meta.blob_format);
+      for (uint32_t i = 0; i < root.nrows; i++) {
+        Tables::sky_rec rec = Tables::getSkyRec(
+            static_cast<Tables::row_offs>(root.data_vec)->Get(i));
+        row_fn(root, rec);
+      }
+    }
+    next_seq_num = info.next_seq_num;
+    op.resume_seq_num = next_seq_num;
+  } while (next_seq_num >= 0);
+}
+
+// the rows of the test table returned by a query on oid, as "ID,VAL" with a
+// null VAL as "null", sorted
+static void query_test_rows(IoCtx& ioctx, const std::string& oid,
+                            const query_op& op, std::vector<std::string>& rows)
+{
+  rows.clear();
+  exec_test_query_rows(ioctx, oid, op,
+      [&](const Tables::sky_root& root, const Tables::sky_rec& rec) {
+        auto row = rec.data.AsVector();
+        std::string val = "null";
+        if (!Tables::isNullBitSet(rec.nullbits, 1))
+          val = std::to_string(row[1].AsInt32());
+        rows.push_back(std::to_string(row[0].AsInt32()) + "," + val);
+      });
+  std::sort(rows.begin(), rows.end());
+}
+
 /*
  *TEST QUERY B - NO CLS (returns all rows to client)
  *selectivity=1%
@@ -320,3 +560,354 @@ TEST_F(SkyhookQuery, QueryFastpathCLS)
   ASSERT_EQ((unsigned) 1000000, result_count);
   ASSERT_EQ((unsigned) 1000000, rows_returned);
 }
+
+/*
+ * TEST APPEND THEN QUERY THROUGH THE INDEX
+ * each append indexes its fbmetas as written, so a query right after it
+ * finds the appended rows through the rec index.
+ */
+TEST_F(SkyhookQuery, AppendIndexedQuery)
+{
+  std::string oid = "append.obj";
+  Tables::schema_vec schema = Tables::schemaFromString(TEST_SCHEMA);
+  std::string idx_schema = Tables::schemaToString(
+      Tables::schemaFromColNames(schema, "ID"));
+
+  for (int i = 0; i < 2; i++) {
+    append_op aop;
+    build_test_fbmeta(i * 4, 4, aop.data);
+    aop.idx_ops.push_back(idx_op(true, false, 1000, Tables::SIT_IDX_REC,
+                                 idx_schema, ""));
+    bufferlist inbl, outbl;
+    using ceph::encode;
+    encode(aop, inbl);
+    ASSERT_EQ(0, ioctx.exec(oid, "tabular", "exec_append_op", inbl, outbl));
+
+    // a row of the fbmeta just appended
+    query_op op = build_test_query_op("");
+    op.index_read = true;
+    op.index_type = Tables::SIT_IDX_REC;
+    op.index_schema = idx_schema;
+    op.index_preds = ";ID,eq," + std::to_string(i * 4 + 2) + ";";
+    cls_info info;
+    bufferlist result_bl;
+    ASSERT_EQ(0, exec_test_query_op(ioctx, oid, op, info, result_bl));
+    ASSERT_NE(std::string::npos, info.plan_info.find("plan=index"));
+    ASSERT_EQ((unsigned) 1, info.rows_passed);
+  }
+}
+
+/*
+ * TEST GLOBAL AGGS OVER MIXED FORMAT FBMETAS
+ * the agg row built for a flatbuf fbmeta is kept when a later arrow
+ * fbmeta of the object is processed, and returned after its rows.
+ */
+TEST_F(SkyhookQuery, AggsMixedFormats)
+{
+  std::string mixed_oid = "aggs.mixed.obj";
+  std::string arrow_oid = "aggs.arrow.obj";
+  bufferlist mixed_bl, arrow_bl;
+  build_test_fbmeta(0, 4, mixed_bl);
+  build_test_fbmeta(4, 4, mixed_bl, Tables::SFT_ARROW);
+  build_test_fbmeta(4, 4, arrow_bl, Tables::SFT_ARROW);
+  ASSERT_EQ(0, ioctx.write_full(mixed_oid, mixed_bl));
+  ASSERT_EQ(0, ioctx.write_full(arrow_oid, arrow_bl));
+
+  // the rows of the arrow fbmeta alone, which precede the agg row
+  query_op op = build_test_query_op(";VAL,sum,0;");
+  cls_info info;
+  bufferlist arrow_result;
+  ASSERT_EQ(0, exec_test_query_op(ioctx, arrow_oid, op, info, arrow_result));
+
+  bufferlist mixed_result;
+  ASSERT_EQ(0, exec_test_query_op(ioctx, mixed_oid, op, info, mixed_result));
+  ASSERT_GT(mixed_result.length(), arrow_result.length());
+
+  // the sum of VAL over the rows of the flatbuf fbmeta
+  bufferlist agg_bl;
+  agg_bl.substr_of(mixed_result, arrow_result.length(),
+                   mixed_result.length() - arrow_result.length());
+  Tables::sky_meta meta = Tables::getSkyMeta(&agg_bl);
+  Tables::sky_root root = Tables::getSkyRoot(meta.blob_data, meta.blob_size,
+                                             meta.blob_format);
+  ASSERT_EQ((unsigned) 1, root.nrows);
+  Tables::sky_rec rec = Tables::getSkyRec(
+      static_cast<Tables::row_offs>(root.data_vec)->Get(0));
+  ASSERT_EQ(0 + 10 + 20 + 30, rec.data.AsVector()[0].AsInt64());
+}
+
+/*
+ * TEST ZONE MAPS SKIP ONLY FBS WITH NO MATCHING ROWS
+ * a query returns the same rows with and without zone maps, including the
+ * rows whose VAL is null, and a range pred skips the fbs outside of it.
+ */
+TEST_F(SkyhookQuery, ZoneMapsPruneFbs)
+{
+  std::string plain_oid = "zonemap.plain.obj";
+  std::string zone_oid = "zonemap.zone.obj";
+
+  // fbs of IDs 0-3, 4-7 and 8-11, the VALs of 5 and 6 are null
+  bufferlist data;
+  build_test_fbmeta(0, 4, data);
+  build_test_fbmeta(4, 4, data, Tables::SFT_FLATBUF_FLEX_ROW, {5, 6});
+  build_test_fbmeta(8, 4, data);
+  ASSERT_EQ(0, ioctx.write_full(plain_oid, data));
+
+  // an append indexes its fbmetas, adding their zone maps
+  append_op aop;
+  aop.data = data;
+  bufferlist inbl, outbl;
+  using ceph::encode;
+  encode(aop, inbl);
+  ASSERT_EQ(0, ioctx.exec(zone_oid, "tabular", "exec_append_op", inbl, outbl));
+
+  std::vector<std::string> preds = {
+    ";VAL,gt,75;",
+    ";VAL,lt,10;",
+    ";VAL,eq,0;",
+    ";ID,geq,5;VAL,leq,40;"
+  };
+  for (auto it = preds.begin(); it != preds.end(); ++it) {
+    query_op op = build_test_query_op(*it);
+    std::vector<std::string> plain_rows, zone_rows;
+    query_test_rows(ioctx, plain_oid, op, plain_rows);
+    query_test_rows(ioctx, zone_oid, op, zone_rows);
+    ASSERT_FALSE(plain_rows.empty()) << *it;
+    ASSERT_EQ(plain_rows, zone_rows) << *it;
+  }
+
+  // the fbs of IDs 0-3 and 4-7 hold no VAL above 75
+  query_op op = build_test_query_op(";VAL,gt,75;");
+  cls_info info;
+  bufferlist result_bl;
+  ASSERT_EQ(0, exec_test_query_op(ioctx, zone_oid, op, info, result_bl));
+  ASSERT_NE(std::string::npos, info.plan_info.find("zonemap_skipped=2/3"));
+  ASSERT_EQ((unsigned) 2, info.fbs_skipped);
+  ASSERT_EQ((unsigned) 4, info.rows_passed);
+}
+
+/*
+ * TEST COMPACTION KEEPS THE LIVE ROWS
+ * small appended fbmetas with deleted rows are merged into fewer fbmetas
+ * through the temp object, the live rows are unchanged, and the rec index
+ * rebuilt for the compacted object finds them.
+ */
+TEST_F(SkyhookQuery, CompactLiveRows)
+{
+  std::string oid = "compact.obj";
+  Tables::schema_vec schema = Tables::schemaFromString(TEST_SCHEMA);
+  std::string idx_schema = Tables::schemaToString(
+      Tables::schemaFromColNames(schema, "ID"));
+
+  // fbmetas of IDs 0-2, 3-5, 6-8 and 9-11, of which 1, 4, 5 and 10 are dead
+  std::vector<std::set<int>> dead_ids = {{1}, {4, 5}, {}, {10}};
+  bufferlist first_bls;
+  for (int i = 0; i < (int) dead_ids.size(); i++) {
+    append_op aop;
+    build_test_fbmeta(i * 3, 3, aop.data, Tables::SFT_FLATBUF_FLEX_ROW, {},
+                      dead_ids[i]);
+    if (i < 2)
+      first_bls.append(aop.data);
+    aop.idx_ops.push_back(idx_op(true, false, 1000, Tables::SIT_IDX_REC,
+                                 idx_schema, ""));
+    bufferlist inbl, outbl;
+    using ceph::encode;
+    encode(aop, inbl);
+    ASSERT_EQ(0, ioctx.exec(oid, "tabular", "exec_append_op", inbl, outbl));
+  }
+
+  query_op op = build_test_query_op("");
+  std::vector<std::string> rows_before;
+  query_test_rows(ioctx, oid, op, rows_before);
+  ASSERT_EQ((unsigned) 8, rows_before.size());
+  cls_info info_before;
+  bufferlist result_bl;
+  ASSERT_EQ(0, exec_test_query_op(ioctx, oid, op, info_before, result_bl));
+  ASSERT_EQ((unsigned) 4, info_before.fbs_scanned);
+
+  // compact at most two of the fbmetas per call, so that the compacted
+  // object is written to the temp object in several chunks
+  compact_op cop;
+  cop.max_bytes = first_bls.length();
+  cop.idx_ops.push_back(idx_op(true, false, 1000, Tables::SIT_IDX_REC,
+                               idx_schema, ""));
+  std::vector<std::string> targets;
+  targets.swap(target_objects);
+  target_objects.push_back(oid);
+  IoCtx compact_ioctx;
+  ASSERT_EQ(0, rados.ioctx_create(pool_name.c_str(), compact_ioctx));
+  worker_compact_op(&compact_ioctx, cop);
+  target_objects.swap(targets);
+
+  std::vector<std::string> rows_after;
+  query_test_rows(ioctx, oid, op, rows_after);
+  ASSERT_EQ(rows_before, rows_after);
+  cls_info info_after;
+  ASSERT_EQ(0, exec_test_query_op(ioctx, oid, op, info_after, result_bl));
+  ASSERT_LT(info_after.fbs_scanned, info_before.fbs_scanned);
+  ASSERT_EQ((unsigned) 8, info_after.rows_examined);
+
+  // a live row of the last fbmeta is found through the index, a dead one
+  // is not
+  op.index_read = true;
+  op.index_type = Tables::SIT_IDX_REC;
+  op.index_schema = idx_schema;
+  op.index_preds = ";ID,eq,11;";
+  cls_info info;
+  ASSERT_EQ(0, exec_test_query_op(ioctx, oid, op, info, result_bl));
+  ASSERT_NE(std::string::npos, info.plan_info.find("plan=index"));
+  ASSERT_EQ((unsigned) 1, info.rows_passed);
+  op.index_preds = ";ID,eq,10;";
+  ASSERT_EQ(0, exec_test_query_op(ioctx, oid, op, info, result_bl));
+  ASSERT_EQ((unsigned) 0, info.rows_passed);
+}
+
+/*
+ * TEST GROUP BY PUSHDOWN
+ * the sum and cnt of VAL per ID over fbmetas whose IDs overlap, returned at
+ * once, or as partials per call once the group table reaches its budget
+ * with the partials of each group merged by the client.
+ */
+TEST_F(SkyhookQuery, GroupByPushdown)
+{
+  std::string oid = "groupby.obj";
+  bufferlist data;
+  build_test_fbmeta(0, 4, data);
+  build_test_fbmeta(2, 4, data);
+  build_test_fbmeta(0, 2, data);
+  ASSERT_EQ(0, ioctx.write_full(oid, data));
+
+  // sum and cnt of VAL by ID
+  std::map<int, std::pair<int64_t, int64_t>> expected = {
+    {0, {0, 2}}, {1, {20, 2}}, {2, {40, 2}},
+    {3, {60, 2}}, {4, {40, 1}}, {5, {50, 1}}
+  };
+
+  Tables::schema_vec schema = Tables::schemaFromString(TEST_SCHEMA);
+  query_op op = build_test_query_op(";VAL,sum,0;VAL,cnt,0;");
+  op.groupby_schema = Tables::schemaToString(
+      Tables::schemaFromColNames(schema, "ID"));
+
+  // the default budget holds all groups, a budget of 1 byte is reached by
+  // the groups of each fbmeta
+  std::vector<uint64_t> budgets = {0, 1};
+  for (auto it = budgets.begin(); it != budgets.end(); ++it) {
+    op.groupby_max_bytes = *it;
+    op.resume_seq_num = Tables::DATASTRUCT_SEQ_NUM_MIN;
+    std::map<int, std::pair<int64_t, int64_t>> groups;
+    int ncalls = 0;
+    int next_seq_num = -1;
+    do {
+      cls_info info;
+      bufferlist result_bl;
+      ASSERT_EQ(0, exec_test_query_op(ioctx, oid, op, info, result_bl));
+      ncalls++;
+      Tables::sky_meta meta = Tables::getSkyMeta(&result_bl);
+      Tables::sky_root root = Tables::getSkyRoot(meta.blob_data,
+                                                 meta.blob_size,
+                                                 meta.blob_format);
+      for (uint32_t i = 0; i < root.nrows; i++) {
+        Tables::sky_rec rec = Tables::getSkyRec(
+            static_cast<Tables::row_offs>(root.data_vec)->Get(i));
+        auto row = rec.data.AsVector();
+        auto& g = groups[row[0].AsInt32()];
+        g.first += row[1].AsInt64();
+        g.second += row[2].AsInt64();
+      }
+      next_seq_num = info.next_seq_num;
+      op.resume_seq_num = next_seq_num;
+    } while (next_seq_num >= 0);
+    ASSERT_EQ(expected, groups) << "groupby_max_bytes=" << *it;
+    ASSERT_EQ(*it == 0 ? 1 : 3, ncalls) << "groupby_max_bytes=" << *it;
+  }
+}
+
+/*
+ * TEST PREDS ON DICTIONARY ENCODED COLS
+ * preds on an encoded col pass the same rows as on its plain strings,
+ * including range preds, whose order is not that of the first seen codes.
+ * projected encoded cols are returned encoded with their dictionaries and
+ * decoded by the client.
+ */
+TEST_F(SkyhookQuery, DictEncodedPreds)
+{
+  std::string plain_oid = "dict.plain.obj";
+  std::string dict_oid = "dict.encoded.obj";
+
+  // codes are pear=0 apple=1 fig=2, then kiwi=0 fig=1 pear=2 banana=3
+  std::vector<std::string> names0 = {"pear", "apple", "fig", "apple"};
+  std::vector<std::string> names1 = {"kiwi", "fig", "pear", "banana"};
+  bufferlist plain_bl, dict_bl;
+  build_test_dict_fbmeta(0, names0, false, plain_bl);
+  build_test_dict_fbmeta(4, names1, false, plain_bl);
+  build_test_dict_fbmeta(0, names0, true, dict_bl);
+  build_test_dict_fbmeta(4, names1, true, dict_bl);
+  ASSERT_EQ(0, ioctx.write_full(plain_oid, plain_bl));
+  ASSERT_EQ(0, ioctx.write_full(dict_oid, dict_bl));
+
+  // the rows of a query as their cols, strings decoded as by the client
+  auto query_rows = [&](const std::string& oid, const query_op& op,
+                        std::vector<std::string>& rows, bool& encoded) {
+    Tables::schema_vec query_schema = Tables::schemaFromString(op.query_schema);
+    rows.clear();
+    encoded = false;
+    exec_test_query_rows(ioctx, oid, op,
+        [&](const Tables::sky_root& root, const Tables::sky_rec& rec) {
+          auto row = rec.data.AsVector();
+          std::string s;
+          for (int j = 0; j < (int) query_schema.size(); j++) {
+            if (j > 0)
+              s.append(",");
+            if (query_schema[j].type == Tables::SDT_STRING) {
+              s.append(root.dicts.getString(row, j));
+              encoded |= root.dicts.get(j) != NULL;
+            }
+            else {
+              s.append(std::to_string(row[j].AsInt32()));
+            }
+          }
+          rows.push_back(s);
+        });
+    std::sort(rows.begin(), rows.end());
+  };
+
+  Tables::schema_vec schema = Tables::schemaFromString(TEST_DICT_SCHEMA);
+  std::vector<std::string> projections = {
+    Tables::schemaToString(schema),
+    Tables::schemaToString(Tables::schemaFromColNames(schema, "NAME"))
+  };
+  std::vector<std::string> preds = {
+    ";NAME,eq,apple;",
+    ";NAME,ne,pear;",
+    ";NAME,lt,fig;",
+    ";NAME,geq,kiwi;",
+    ";NAME,in,fig|kiwi;",
+    ";ID,gt,2;NAME,leq,fig;"
+  };
+  for (auto itp = projections.begin(); itp != projections.end(); ++itp) {
+    for (auto it = preds.begin(); it != preds.end(); ++it) {
+      query_op op = build_test_query_op(*it);
+      op.data_schema = Tables::schemaToString(schema);
+      op.query_schema = *itp;
+      std::vector<std::string> plain_rows, dict_rows;
+      bool plain_encoded = false;
+      bool dict_encoded = false;
+      query_rows(plain_oid, op, plain_rows, plain_encoded);
+      query_rows(dict_oid, op, dict_rows, dict_encoded);
+      ASSERT_FALSE(plain_rows.empty()) << *it;
+      ASSERT_EQ(plain_rows, dict_rows) << *it;
+      ASSERT_FALSE(plain_encoded) << *it;
+      ASSERT_TRUE(dict_encoded) << *it;
+    }
+  }
+
+  // apple and banana are below fig, though their codes are not
+  query_op op = build_test_query_op(";NAME,lt,fig;");
+  op.data_schema = Tables::schemaToString(schema);
+  op.query_schema = op.data_schema;
+  std::vector<std::string> rows;
+  bool encoded = false;
+  query_rows(dict_oid, op, rows, encoded);
+  std::vector<std::string> expected = {"1,apple", "3,apple", "7,banana"};
+  ASSERT_EQ(expected, rows);
+}